@@ -94,6 +94,16 @@ Java_com_google_android_filament_View_nSetShadowsEnabled(JNIEnv*, jclass,
     view->setShadowsEnabled(enabled);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_View_nSetShadowAtlasOptions(JNIEnv*, jclass,
+        jlong nativeView, jint maxSize, jint minShadowMapSize) {
+    View* view = (View*) nativeView;
+    View::ShadowAtlasOptions options;
+    options.maxSize = (uint32_t) maxSize;
+    options.minShadowMapSize = (uint32_t) minShadowMapSize;
+    view->setShadowAtlasOptions(options);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetSampleCount(JNIEnv*, jclass,
         jlong nativeView, jint count) {
@@ -31,6 +31,7 @@ public class View {
     private Viewport mViewport = new Viewport(0, 0, 0, 0);
     private DynamicResolutionOptions mDynamicResolution;
     private RenderQuality mRenderQuality;
+    private ShadowAtlasOptions mShadowAtlasOptions;
     private DepthPrepass mDepthPrepass = DepthPrepass.DEFAULT;
 
     public static class DynamicResolutionOptions {
@@ -44,6 +45,11 @@ public class View {
         public int history = 9;
     }
 
+    public static class ShadowAtlasOptions {
+        public int maxSize = 4096;
+        public int minShadowMapSize = 128;
+    }
+
     public enum QualityLevel {
         LOW,
         MEDIUM,
@@ -153,6 +159,19 @@ public class View {
         nSetShadowsEnabled(getNativeObject(), enabled);
     }
 
+    public void setShadowAtlasOptions(@NonNull ShadowAtlasOptions options) {
+        mShadowAtlasOptions = options;
+        nSetShadowAtlasOptions(getNativeObject(), options.maxSize, options.minShadowMapSize);
+    }
+
+    @NonNull
+    public ShadowAtlasOptions getShadowAtlasOptions() {
+        if (mShadowAtlasOptions == null) {
+            mShadowAtlasOptions = new ShadowAtlasOptions();
+        }
+        return mShadowAtlasOptions;
+    }
+
     public void setSampleCount(int count) {
         nSetSampleCount(getNativeObject(), count);
     }
@@ -281,6 +300,8 @@ public class View {
     private static native void nSetClearTargets(long nativeView, boolean color, boolean depth, boolean stencil);
     private static native void nSetVisibleLayers(long nativeView, int select, int value);
     private static native void nSetShadowsEnabled(long nativeView, boolean enabled);
+    private static native void nSetShadowAtlasOptions(long nativeView,
+            int maxSize, int minShadowMapSize);
     private static native void nSetSampleCount(long nativeView, int count);
     private static native int nGetSampleCount(long nativeView);
     private static native void nSetAntiAliasing(long nativeView, int type);
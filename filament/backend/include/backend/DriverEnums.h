@@ -160,6 +160,12 @@ enum class FenceStatus : int8_t {
 
 static constexpr uint64_t FENCE_WAIT_FOR_EVER = uint64_t(-1);
 
+/**
+ * Callback invoked on the application thread when the programs requested with
+ * compilePrograms() are ready.
+ */
+using ProgramCallback = void(*)(void* user);
+
 static constexpr size_t SHADER_MODEL_COUNT = 3;
 enum class ShaderModel : uint8_t {
     // For testing
@@ -740,6 +746,25 @@ struct RasterState {
     };
 };
 
+//! Counters of a cache of backend objects during the last frame
+struct CacheCounters {
+    uint32_t hits = 0;          //!< lookups that found an object
+    uint32_t misses = 0;        //!< lookups that created an object
+    uint32_t evictions = 0;     //!< objects destroyed to keep the cache within its budget
+    uint32_t size = 0;          //!< objects currently in the cache
+};
+
+//! Counters of the caches of backend objects, see Platform::CacheBudgets
+struct CacheStats {
+    CacheCounters pipelines;
+    CacheCounters descriptorSets;
+    CacheCounters framebuffers;
+    CacheCounters renderPasses;
+    CacheCounters samplers;
+    uint32_t pipelineCreationCount = 0; //!< pipelines created since the driver was created
+    float pipelineCreationTime = 0;     //!< time spent creating them, in milliseconds
+};
+
 } // namespace backend
 } // namespace filament
 
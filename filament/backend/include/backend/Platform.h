@@ -22,6 +22,12 @@
 #include <backend/DriverEnums.h>
 
 #include <utils/compiler.h>
+#include <utils/CString.h>
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
 
 namespace filament {
 namespace backend {
@@ -57,6 +63,130 @@ public:
      * @return nullptr on failure, or a pointer to the newly created driver.
      */
     virtual backend::Driver* createDriver(void* sharedContext) noexcept = 0;
+
+    /**
+     * Sets the directory where the backend caches compiled programs across launches, i.e. the
+     * OpenGL program binaries or the Vulkan pipeline cache. The cache is disabled by default,
+     * and is disabled again by passing nullptr. This must be called before the driver is
+     * created.
+     *
+     * The cache is only an optimization, and the backend falls back to compiling from source
+     * when an entry is missing or can't be used. OpenGL program binaries are keyed by the
+     * shader sources and the driver identity. The Vulkan pipeline cache is a single entry with
+     * a fixed key, and the Vulkan driver validates its content against the device. The
+     * directory must exist and be writable.
+     *
+     * The number of pipelines the Vulkan backend had to create, and the time this took, are
+     * exposed by the Engine's DebugRegistry as the "d.backend.pipeline_creation_*" properties.
+     *
+     * @param path the cache directory, or nullptr.
+     */
+    void setBlobCacheDirectory(const char* path) noexcept;
+
+    /**
+     * @return the directory set by setBlobCacheDirectory(), or an empty string.
+     */
+    utils::CString const& getBlobCacheDirectory() const noexcept { return mBlobCacheDirectory; }
+
+    /**
+     * Whether the backend should use insertBlob() and retrieveBlob(). By default, this is true
+     * when a cache directory is set.
+     */
+    virtual bool hasBlobCache() const noexcept;
+
+    /**
+     * Stores a blob in the cache, replacing the blob with the same key if any. This can be
+     * called from the driver thread or from the thread calling into the Engine, concurrently with
+     * retrieveBlob(). The default implementation writes a file in the cache directory.
+     *
+     * @param key       the key of the blob
+     * @param keySize   size of the key in bytes
+     * @param value     the content of the blob
+     * @param valueSize size of the blob in bytes
+     */
+    virtual void insertBlob(const void* key, size_t keySize,
+            const void* value, size_t valueSize) noexcept;
+
+    /**
+     * Retrieves a blob from the cache. This is called from the driver thread.
+     *
+     * The blob is copied into \p value only if \p valueSize is large enough, so the size of a
+     * blob can be queried by passing a null \p value.
+     *
+     * @param key       the key of the blob
+     * @param keySize   size of the key in bytes
+     * @param value     buffer receiving the blob, can be nullptr
+     * @param valueSize size of the \p value buffer in bytes
+     *
+     * @return the size of the blob in bytes, or 0 if the cache has no blob with this key.
+     */
+    virtual size_t retrieveBlob(const void* key, size_t keySize,
+            void* value, size_t valueSize) noexcept;
+
+    /**
+     * Number of cache entries the backend could use, e.g. programs created from their binary.
+     * Can be called from any thread.
+     */
+    uint32_t getBlobCacheHitCount() const noexcept {
+        return mBlobCacheHitCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of times the backend found no usable cache entry, and had to compile. Can be
+     * called from any thread.
+     */
+    uint32_t getBlobCacheMissCount() const noexcept {
+        return mBlobCacheMissCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Bounds of a cache of backend objects.
+     */
+    struct CacheBudget {
+        /**
+         * Number of frames an unused object stays in the cache, 0 for no limit. Objects are
+         * kept for at least 2 frames since they can be used by the GPU.
+         */
+        uint32_t maxAge;
+
+        /**
+         * Maximum number of objects in the cache. The least recently used objects are evicted
+         * first, and the cache may go over budget when all its objects were used recently.
+         */
+        uint32_t maxCount;
+    };
+
+    /**
+     * Budgets of the caches of backend objects. Their hits, misses and evictions during the last
+     * frame are exposed by the Engine's DebugRegistry as the "d.backend.*" properties. Only used
+     * by the Vulkan backend.
+     */
+    struct CacheBudgets {
+        CacheBudget pipelines       = { 2, 1024 };
+        CacheBudget descriptorSets  = { 2, 1000 };
+        CacheBudget framebuffers    = { 2, 256 };
+        CacheBudget renderPasses    = { 2, 64 };
+        CacheBudget samplers        = { 0, 256 };
+    };
+
+    /**
+     * Sets the budgets of the caches of backend objects. This must be called before the driver
+     * is created.
+     */
+    void setCacheBudgets(CacheBudgets const& budgets) noexcept { mCacheBudgets = budgets; }
+
+    CacheBudgets const& getCacheBudgets() const noexcept { return mCacheBudgets; }
+
+    // called by the backend once it knows whether a cache entry could be used
+    void recordBlobCacheLookup(bool hit) noexcept {
+        (hit ? mBlobCacheHitCount : mBlobCacheMissCount).fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    CacheBudgets mCacheBudgets;
+    utils::CString mBlobCacheDirectory;
+    std::atomic<uint32_t> mBlobCacheHitCount = { 0 };
+    std::atomic<uint32_t> mBlobCacheMissCount = { 0 };
 };
 
 
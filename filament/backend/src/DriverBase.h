@@ -30,6 +30,7 @@
 #include <array>
 #include <mutex>
 #include <utility>
+#include <vector>
 
 #include <assert.h>
 #include <stdint.h>
@@ -168,9 +169,13 @@ protected:
 
     void scheduleDestroySlow(BufferDescriptor&& buffer) noexcept;
 
+    // calls callback(user) from purge(), i.e. on the application thread
+    void scheduleCallback(ProgramCallback callback, void* user) noexcept;
+
 private:
     std::mutex mPurgeLock;
     std::vector<BufferDescriptor> mBufferToPurge;
+    std::vector<std::pair<ProgramCallback, void*>> mCallbacks;
 };
 
 
@@ -65,12 +65,100 @@
 
 #include "noop/PlatformNoop.h"
 
+#include <utils/Path.h>
+
+#include <fstream>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
 namespace filament {
 namespace backend {
 
 // this generates the vtable in this translation unit
 Platform::~Platform() noexcept = default;
 
+void Platform::setBlobCacheDirectory(const char* path) noexcept {
+    mBlobCacheDirectory = path ? utils::CString(path) : utils::CString();
+}
+
+bool Platform::hasBlobCache() const noexcept {
+    return !mBlobCacheDirectory.empty();
+}
+
+// Each blob is stored in its own file, named after the hash of its key. The file starts with
+// the key, which is checked when the blob is retrieved, so a hash collision is just a miss.
+static utils::Path getBlobPath(utils::CString const& directory,
+        const void* key, size_t keySize) noexcept {
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < keySize; i++) {
+        hash = (hash ^ static_cast<const uint8_t*>(key)[i]) * 0x100000001b3ull;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.blob", (unsigned long long)hash);
+    return utils::Path(directory.c_str()) + utils::Path(name);
+}
+
+void Platform::insertBlob(const void* key, size_t keySize,
+        const void* value, size_t valueSize) noexcept {
+    if (mBlobCacheDirectory.empty() || !keySize || !valueSize) {
+        return;
+    }
+
+    // write to a temporary file first, so a reader never sees a partially written blob
+    const utils::Path path = getBlobPath(mBlobCacheDirectory, key, keySize);
+    const std::string temp = path.getPath() + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return;
+    }
+    const uint32_t size = uint32_t(keySize);
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(static_cast<const char*>(key), keySize);
+    out.write(static_cast<const char*>(value), valueSize);
+    out.close();
+    if (!out || rename(temp.c_str(), path.getPath().c_str()) != 0) {
+        remove(temp.c_str());
+    }
+}
+
+size_t Platform::retrieveBlob(const void* key, size_t keySize,
+        void* value, size_t valueSize) noexcept {
+    if (mBlobCacheDirectory.empty() || !keySize) {
+        return 0;
+    }
+
+    const utils::Path path = getBlobPath(mBlobCacheDirectory, key, keySize);
+    std::ifstream in(path.getPath(), std::ios::binary | std::ios::ate);
+    if (!in) {
+        return 0;
+    }
+    const size_t fileSize = size_t(in.tellg());
+    in.seekg(0);
+
+    uint32_t size = 0;
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!in || size != keySize || fileSize <= sizeof(size) + keySize) {
+        return 0;
+    }
+    std::vector<char> storedKey(keySize);
+    in.read(storedKey.data(), keySize);
+    if (!in || memcmp(storedKey.data(), key, keySize) != 0) {
+        return 0;
+    }
+
+    const size_t blobSize = fileSize - sizeof(size) - keySize;
+    if (value && valueSize >= blobSize) {
+        in.read(static_cast<char*>(value), blobSize);
+        if (!in) {
+            return 0;
+        }
+    }
+    return blobSize;
+}
+
 // Creates the platform-specific Platform object. The caller takes ownership and is
 // responsible for destroying it. Initialization of the backend API is deferred until
 // createDriver(). The passed-in backend hint is replaced with the resolved backend.
@@ -113,6 +113,11 @@ void MetalDriver::flush(int dummy) {
 
 }
 
+void MetalDriver::compilePrograms(ProgramCallback callback, void* user) {
+    // the shader libraries are created by createProgram()
+    scheduleCallback(callback, user);
+}
+
 void MetalDriver::createVertexBufferR(Handle<HwVertexBuffer> vbh, uint8_t bufferCount,
         uint8_t attributeCount, uint32_t vertexCount, AttributeArray attributes,
         BufferUsage usage) {
@@ -448,6 +453,11 @@ bool MetalDriver::canGenerateMipmaps() {
     return true;
 }
 
+void MetalDriver::getCacheStats(CacheStats* stats) {
+    // only the Vulkan backend reports its caches
+    *stats = {};
+}
+
 void MetalDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh,
         BufferDescriptor&& data) {
    if (data.size <= 0) {
@@ -460,6 +470,15 @@ void MetalDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh,
     scheduleDestroy(std::move(data));
 }
 
+void MetalDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh,
+        BufferDescriptor&& data, uint32_t byteOffset) {
+    if (data.size > 0) {
+        auto buffer = handle_cast<MetalUniformBuffer>(mHandleMap, ubh);
+        buffer->copyIntoBufferRange(data.buffer, data.size, byteOffset);
+    }
+    scheduleDestroy(std::move(data));
+}
+
 void MetalDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
         SamplerGroup&& samplerGroup) {
     auto sb = handle_cast<MetalSamplerGroup>(mHandleMap, sbh);
@@ -687,6 +706,11 @@ void MetalDriver::blit(TargetBufferFlags buffers,
 }
 
 void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph) {
+    drawInstanced(ps, rph, 1);
+}
+
+void MetalDriver::drawInstanced(backend::PipelineState ps, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
     ASSERT_PRECONDITION(mContext->currentCommandEncoder != nullptr,
             "Attempted to draw without a valid command encoder.");
     auto primitive = handle_cast<MetalRenderPrimitive>(mHandleMap, rph);
@@ -830,7 +854,8 @@ void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph)
                                               indexCount:primitive->count
                                                indexType:getIndexType(indexBuffer->elementSize)
                                              indexBuffer:indexBuffer->buffer
-                                       indexBufferOffset:primitive->offset];
+                                       indexBufferOffset:primitive->offset
+                                           instanceCount:instanceCount];
 }
 
 void MetalDriver::enumerateSamplerGroups(
@@ -72,6 +72,12 @@ public:
      */
     void copyIntoBuffer(void* src, size_t size);
 
+    /**
+     * Same as copyIntoBuffer, but only updates the given range, the rest of the uniform is
+     * preserved.
+     */
+    void copyIntoBufferRange(void* src, size_t size, size_t byteOffset);
+
     /**
      * Denotes that this uniform is used for a draw call ensuring that its allocation remains valid
      * until the end of the current frame.
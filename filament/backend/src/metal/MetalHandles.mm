@@ -149,6 +149,31 @@ void MetalUniformBuffer::copyIntoBuffer(void* src, size_t size) {
     memcpy(static_cast<uint8_t*>(bufferPoolEntry->buffer.contents), src, size);
 }
 
+void MetalUniformBuffer::copyIntoBufferRange(void* src, size_t size, size_t byteOffset) {
+    if (size <= 0) {
+        return;
+    }
+    ASSERT_PRECONDITION(byteOffset + size <= this->size,
+            "Attempting to copy %d bytes at offset %d into a uniform of size %d",
+            size, byteOffset, this->size);
+
+    if (cpuBuffer) {
+        memcpy(static_cast<uint8_t*>(cpuBuffer) + byteOffset, src, size);
+        return;
+    }
+
+    // The current buffer might still be in use by the GPU, so we acquire a new one and carry
+    // over the contents we're not updating.
+    const MetalBufferPoolEntry* previous = bufferPoolEntry;
+    bufferPoolEntry = context.bufferPool->acquireBuffer(this->size);
+    uint8_t* contents = static_cast<uint8_t*>(bufferPoolEntry->buffer.contents);
+    if (previous) {
+        memcpy(contents, previous->buffer.contents, this->size);
+        context.bufferPool->releaseBuffer(previous);
+    }
+    memcpy(contents + byteOffset, src, size);
+}
+
 id<MTLBuffer> MetalUniformBuffer::getGpuBufferForDraw() {
     if (!bufferPoolEntry) {
         return nil;
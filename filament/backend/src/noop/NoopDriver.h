@@ -55,7 +55,15 @@ private:
         return RetType((RetType::HandleId)0xDEAD0000); } \
     UTILS_ALWAYS_INLINE void methodName##R(RetType, paramsDecl) { }
 
+    // compilePrograms() must call back even though there is nothing to compile, it's declared
+    // below rather than generated with an empty body
+#define compilePrograms compileProgramsUnused
 #include "private/backend/DriverAPI.inc"
+#undef compilePrograms
+
+    UTILS_ALWAYS_INLINE void compilePrograms(backend::ProgramCallback callback, void* user) {
+        scheduleCallback(callback, user);
+    }
 };
 
 } // namespace filament
@@ -71,6 +71,7 @@ inline void glRenderbufferStorage (GLenum, GLenum, GLsizei, GLsizei) { }
 
 inline void glClear(GLbitfield) { }
 inline void glDrawRangeElements(GLenum, GLuint, GLuint, GLsizei, GLenum, const void *)  { }
+inline void glDrawElementsInstanced(GLenum, GLsizei, GLenum, const void *, GLsizei)  { }
 inline void glBlitFramebuffer (GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) { }
 inline void glReadPixels (GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void *) { }
 
@@ -29,7 +29,9 @@
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
 #include <set>
+#include <string>
 
 // change to true to display all GL extensions in the console on start-up
 #define DEBUG_PRINT_EXTENSIONS false
@@ -220,6 +222,19 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     };
     mShaderModel = shaderModel;
 
+#if !defined(__EMSCRIPTEN__)
+    // program binaries are only useful if the platform can store them
+    if (mPlatform.hasBlobCache()) {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (formatCount > 0) {
+            const std::string identity = std::string(vendor) + '\n' + renderer + '\n' + version;
+            OpenGLProgram::hash(identity.data(), identity.size(), programBinaryCache.driverHash);
+            programBinaryCache.enabled = true;
+        }
+    }
+#endif
+
     /*
      * Set our default state
      */
@@ -280,6 +295,7 @@ void OpenGLDriver::initExtensionsGLES(GLint major, GLint minor, ExtentionSet con
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
     ext.texture_compression_s3tc = hasExtension(exts, "WEBGL_compressed_texture_s3tc");
     ext.EXT_multisampled_render_to_texture = hasExtension(exts, "GL_EXT_multisampled_render_to_texture");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
 }
 
 void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, ExtentionSet const& exts) {
@@ -289,9 +305,18 @@ void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, ExtentionSet const
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = true;  // Assumes core profile.
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile") ||
+            hasExtension(exts, "GL_ARB_parallel_shader_compile");
 }
 
 void OpenGLDriver::terminate() {
+    // nothing will be compiled anymore, don't leave the callbacks pending
+    mCompilingPrograms.clear();
+    for (ProgramCallbackEntry const& entry : mProgramCallbacks) {
+        scheduleCallback(entry.callback, entry.user);
+    }
+    mProgramCallbacks.clear();
+
     for (auto& item : mSamplerMap) {
         unbindSampler(item.second);
         glDeleteSamplers(1, &item.second);
@@ -301,6 +326,10 @@ void OpenGLDriver::terminate() {
         mOpenGLBlitter->terminate();
     }
     terminateClearProgram();
+
+    // purge() isn't called after terminate(), write the program binaries still queued
+    writeProgramBinaries(this);
+
     mPlatform.terminate();
 }
 
@@ -530,6 +559,11 @@ void OpenGLDriver::useProgram(GLuint program) noexcept {
 }
 
 void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
+    if (UTILS_UNLIKELY(!p->isInitialized())) {
+        // this waits for the compilation if it's not finished
+        p->initialize(this);
+        removeCompilingProgram(p);
+    }
     useProgram(p->gl.program);
     // set-up textures and samplers in the proper TMUs (as specified in setSamplers)
     p->use(this);
@@ -942,7 +976,8 @@ void OpenGLDriver::createRenderPrimitiveR(Handle<HwRenderPrimitive> rph, int) {
 void OpenGLDriver::createProgramR(Handle<HwProgram> ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    OpenGLProgram* p = construct<OpenGLProgram>(ph, this, program);
+    mCompilingPrograms.push_back(p);
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -1433,6 +1468,9 @@ void OpenGLDriver::destroyProgram(Handle<HwProgram> ph) {
 
     if (ph) {
         OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+        if (!p->isInitialized()) {
+            removeCompilingProgram(p);
+        }
         destruct(ph, p);
     }
 }
@@ -1768,6 +1806,25 @@ void OpenGLDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescript
     scheduleDestroy(std::move(p));
 }
 
+void OpenGLDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& p,
+        uint32_t byteOffset) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    assert(ub);
+    assert(ub->gl.ubo.usage != BufferUsage::STREAM);
+    assert(byteOffset + p.size <= ub->gl.ubo.capacity);
+
+    if (p.size > 0) {
+        bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo.id);
+        glBufferSubData(GL_UNIFORM_BUFFER, byteOffset, p.size, p.buffer);
+        ub->gl.ubo.size = std::max(ub->gl.ubo.size, uint32_t(byteOffset + p.size));
+    }
+    scheduleDestroy(std::move(p));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::updateBuffer(GLenum target,
         GLBuffer* buffer, BufferDescriptor const& p, uint32_t alignment) noexcept {
     assert(buffer->capacity >= p.size);
@@ -1892,6 +1949,11 @@ bool OpenGLDriver::canGenerateMipmaps() {
     return true;
 }
 
+void OpenGLDriver::getCacheStats(CacheStats* stats) {
+    // only the Vulkan backend reports its caches
+    *stats = {};
+}
+
 void OpenGLDriver::setTextureData(GLTexture* t,
                                   uint32_t level,
                                   uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -2755,6 +2817,9 @@ void OpenGLDriver::readPixels(Handle<HwRenderTarget> src,
 
 void OpenGLDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId) {
     insertEventMarker("beginFrame");
+    if (UTILS_UNLIKELY(!mProgramCallbacks.empty())) {
+        updateCompilingPrograms();
+    }
     if (UTILS_UNLIKELY(!mExternalStreams.empty())) {
         OpenGLPlatform& platform = mPlatform;
         const size_t index = getIndexForTextureTarget(GL_TEXTURE_EXTERNAL_OES);
@@ -2788,6 +2853,67 @@ void OpenGLDriver::flush(int) {
     }
 }
 
+void OpenGLDriver::compilePrograms(ProgramCallback callback, void* user) {
+    DEBUG_MARKER()
+    mProgramCallbacks.push_back({ callback, user, mCompilingPrograms });
+    updateCompilingPrograms();
+}
+
+void OpenGLDriver::updateCompilingPrograms() noexcept {
+    // iterate backward, removeCompilingProgram() removes the program from mCompilingPrograms
+    for (size_t i = mCompilingPrograms.size(); i-- > 0;) {
+        OpenGLProgram* const p = mCompilingPrograms[i];
+        if (p->isCompiled(this)) {
+            removeCompilingProgram(p);
+        }
+    }
+    auto last = std::remove_if(mProgramCallbacks.begin(), mProgramCallbacks.end(),
+            [this](ProgramCallbackEntry const& entry) {
+                if (entry.programs.empty()) {
+                    scheduleCallback(entry.callback, entry.user);
+                    return true;
+                }
+                return false;
+            });
+    mProgramCallbacks.erase(last, mProgramCallbacks.end());
+}
+
+void OpenGLDriver::removeCompilingProgram(OpenGLProgram* p) noexcept {
+    auto remove = [p](std::vector<OpenGLProgram*>& programs) {
+        programs.erase(std::remove(programs.begin(), programs.end(), p), programs.end());
+    };
+    remove(mCompilingPrograms);
+    for (ProgramCallbackEntry& entry : mProgramCallbacks) {
+        remove(entry.programs);
+    }
+}
+
+void OpenGLDriver::queueProgramBinary(void const* key, size_t keySize,
+        std::vector<uint8_t> blob) noexcept {
+    std::unique_lock<std::mutex> lock(mProgramBinariesLock);
+    const bool wasEmpty = mProgramBinaries.empty();
+    mProgramBinaries.push_back({
+            { static_cast<uint8_t const*>(key), static_cast<uint8_t const*>(key) + keySize },
+            std::move(blob) });
+    lock.unlock();
+    // a single callback writes all the binaries queued until it runs
+    if (wasEmpty) {
+        scheduleCallback(&OpenGLDriver::writeProgramBinaries, this);
+    }
+}
+
+void OpenGLDriver::writeProgramBinaries(void* user) noexcept {
+    OpenGLDriver* const driver = static_cast<OpenGLDriver*>(user);
+    std::vector<ProgramBinaryEntry> entries;
+    std::unique_lock<std::mutex> lock(driver->mProgramBinariesLock);
+    std::swap(entries, driver->mProgramBinaries);
+    lock.unlock(); // don't hold the lock during the file I/O
+    for (ProgramBinaryEntry const& entry : entries) {
+        driver->mPlatform.insertBlob(entry.key.data(), entry.key.size(),
+                entry.blob.data(), entry.blob.size());
+    }
+}
+
 UTILS_NOINLINE
 void OpenGLDriver::clearWithRasterPipe(
         bool clearColor, float4 const& linearColor,
@@ -2955,6 +3081,11 @@ void OpenGLDriver::updateTextureLodRange(GLTexture* texture, int8_t targetLevel)
 }
 
 void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
+    drawInstanced(state, rph, 1);
+}
+
+void OpenGLDriver::drawInstanced(PipelineState state, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
     DEBUG_MARKER()
 
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(state.program);
@@ -2969,8 +3100,14 @@ void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
 
     enable(GL_SCISSOR_TEST);
 
-    glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    if (UTILS_LIKELY(instanceCount == 1)) {
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    } else {
+        glDrawElementsInstanced(GLenum(rp->type), rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset),
+                GLsizei(instanceCount));
+    }
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -28,7 +28,9 @@
 
 #include <tsl/robin_map.h>
 
+#include <mutex>
 #include <set>
+#include <vector>
 
 #include <assert.h>
 
@@ -336,6 +338,11 @@ private:
 
     inline void useProgram(OpenGLProgram* p) noexcept;
 
+    // removes the programs that finished compiling and schedules the compilePrograms()
+    // callbacks that don't wait for any program anymore
+    void updateCompilingPrograms() noexcept;
+    void removeCompilingProgram(OpenGLProgram* p) noexcept;
+
     inline void bindBuffer(GLenum target, GLuint buffer) noexcept;
     inline void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
             GLintptr offset, GLsizeiptr size) noexcept;
@@ -518,6 +525,15 @@ private:
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
     mutable std::vector<GLTexture*> mExternalStreams;
 
+    // programs that may still be compiling, and the compilePrograms() callbacks waiting for them
+    struct ProgramCallbackEntry {
+        backend::ProgramCallback callback;
+        void* user;
+        std::vector<OpenGLProgram*> programs;
+    };
+    std::vector<OpenGLProgram*> mCompilingPrograms;
+    std::vector<ProgramCallbackEntry> mProgramCallbacks;
+
     // glGet*() values
     struct {
         GLint max_renderbuffer_size = 0;
@@ -530,6 +546,24 @@ private:
         bool multisample_texture = false;
     } features;
 
+    // program binaries cached with the Platform, see OpenGLProgram
+    struct {
+        bool enabled = false;
+        // program binaries are only valid with the driver that created them
+        uint32_t driverHash[2] = {};
+    } programBinaryCache;
+
+    // Program binaries waiting to be written to the Platform's cache. Writing a blob is file I/O,
+    // so it's done from purge() on the application thread rather than on the driver thread.
+    struct ProgramBinaryEntry {
+        std::vector<uint8_t> key;
+        std::vector<uint8_t> blob;
+    };
+    std::mutex mProgramBinariesLock;
+    std::vector<ProgramBinaryEntry> mProgramBinaries;
+    void queueProgramBinary(void const* key, size_t keySize, std::vector<uint8_t> blob) noexcept;
+    static void writeProgramBinaries(void* user) noexcept;
+
     // supported extensions detected at runtime
     struct {
         bool texture_compression_s3tc = false;
@@ -540,6 +574,7 @@ private:
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
         bool EXT_multisampled_render_to_texture = false;
+        bool KHR_parallel_shader_compile = false;
     } ext;
 
     struct {
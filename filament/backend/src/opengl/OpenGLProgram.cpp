@@ -18,10 +18,14 @@
 
 #include "OpenGLDriver.h"
 
+#include "private/backend/OpenGLPlatform.h"
+
 #include <utils/Log.h>
 #include <utils/compiler.h>
+#include <utils/Hash.h>
 #include <utils/Panic.h>
 
+#include <algorithm>
 #include <cctype>
 
 namespace filament {
@@ -37,9 +41,27 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
 
     const auto& shadersSource = programBuilder.getShadersSource();
 
+    // Try the program binary cache first, the binary is linked already.
+    ProgramBinaryKey key{};
+    bool storeProgramBinary = false;
+    if (gl->programBinaryCache.enabled) {
+        key.version = PROGRAM_BINARY_VERSION;
+        key.driverHash[0] = gl->programBinaryCache.driverHash[0];
+        key.driverHash[1] = gl->programBinaryCache.driverHash[1];
+        for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+            hash(shadersSource[i].data(), shadersSource[i].size(), key.shaders[i].hash);
+            key.shaders[i].size = uint32_t(shadersSource[i].size());
+        }
+        storeProgramBinary = !loadProgramBinary(gl, key);
+    }
+
+    // Compile and link without querying the status, which would wait for the compilation to
+    // finish. With KHR_parallel_shader_compile the GL driver does the work on its own threads;
+    // the results are checked by initialize(), when the program is first used.
+
     // build all shaders
     #pragma nounroll
-    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT && !this->gl.program; i++) {
         GLenum glShaderType;
         Shader type = (Shader)i;
         switch (type) {
@@ -52,19 +74,12 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
         }
 
         if (!shadersSource[i].empty()) {
-            GLint status;
             char const* const source = (const char*)shadersSource[i].data();
 
             GLuint shaderId = glCreateShader(glShaderType);
             glShaderSource(shaderId, 1, &source, nullptr);
             glCompileShader(shaderId);
 
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
             this->gl.shaders[i] = shaderId;
             mValidShaderSet |= 1U << i;
         }
@@ -73,29 +88,98 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
     // we need at least a vertex and fragment program
     const uint8_t validShaderSet = mValidShaderSet;
     const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
+    if (UTILS_LIKELY((validShaderSet & mask) == mask)) {
         GLuint program = glCreateProgram();
         for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
             if (validShaderSet & (1U << i)) {
                 glAttachShader(program, this->gl.shaders[i]);
             }
         }
+        if (storeProgramBinary) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
         glLinkProgram(program);
+        this->gl.program = program;
+    }
+
+    mLazyInitializationData.reset(new LazyInitializationData{
+            programBuilder.getUniformBlockInfo(),
+            programBuilder.getSamplerGroupInfo(),
+            programBuilder.hasSamplers(),
+            storeProgramBinary && this->gl.program,
+            key });
+}
+
+OpenGLProgram::~OpenGLProgram() noexcept {
+    const size_t validShaderSet = mValidShaderSet;
+    GLuint program = gl.program;
+    if (validShaderSet) {
+        #pragma nounroll
+        for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+            if (validShaderSet & (1U << i)) {
+                const GLuint shader = gl.shaders[i];
+                if (program) {
+                    glDetachShader(program, shader);
+                }
+                glDeleteShader(shader);
+            }
+        }
+    }
+    if (program) {
+        glDeleteProgram(program);
+    }
+}
 
+bool OpenGLProgram::isCompiled(OpenGLDriver const* gl) const noexcept {
+    if (isInitialized() || !gl->ext.KHR_parallel_shader_compile || !this->gl.program) {
+        return true;
+    }
+    GLint status = GL_FALSE;
+    glGetProgramiv(this->gl.program, GL_COMPLETION_STATUS_KHR, &status);
+    return status == GL_TRUE;
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl) noexcept {
+    assert(!isInitialized());
+    std::unique_ptr<LazyInitializationData> data = std::move(mLazyInitializationData);
+
+    // querying the status waits for the compilation if it's not finished
+    bool compiled = true;
+    const uint8_t validShaderSet = mValidShaderSet;
+    #pragma nounroll
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+        if (validShaderSet & (1U << i)) {
+            GLint status;
+            const GLuint shaderId = this->gl.shaders[i];
+            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                // the source is retrieved from GL, it isn't kept around otherwise
+                GLint length = 0;
+                glGetShaderiv(shaderId, GL_SHADER_SOURCE_LENGTH, &length);
+                std::vector<char> source(size_t(std::max(length, 1)), '\0');
+                glGetShaderSource(shaderId, GLsizei(source.size()), nullptr, source.data());
+                logCompilationError(slog.e, shaderId, source.data());
+                compiled = false;
+            }
+        }
+    }
+
+    GLuint program = this->gl.program;
+    if (UTILS_LIKELY(compiled && program)) {
+        GLint status;
         glGetProgramiv(program, GL_LINK_STATUS, &status);
         if (UTILS_UNLIKELY(status != GL_TRUE)) {
             char error[512];
             glGetProgramInfoLog(program, sizeof(error), nullptr, error);
 
             slog.e << "LINKING: " << error << io::endl;
-            glDeleteProgram(program);
-            return;
+            compiled = false;
         }
-        this->gl.program = program;
+    }
 
+    if (UTILS_LIKELY(compiled && program)) {
         // Associate each UniformBlock in the program to a known binding.
-        auto const& uniformBlockInfo = programBuilder.getUniformBlockInfo();
+        auto const& uniformBlockInfo = data->uniformBlockInfo;
         #pragma nounroll
         for (GLuint binding = 0, n = uniformBlockInfo.size(); binding < n; binding++) {
             auto const& name = uniformBlockInfo[binding];
@@ -108,12 +192,12 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
             }
         }
 
-        if (programBuilder.hasSamplers()) {
+        if (data->hasSamplers) {
             // if we have samplers, we need to do a bit of extra work
             // activate this program so we can set all its samplers once and for all (glUniform1i)
             gl->useProgram(program);
 
-            auto const& samplerGroupInfo = programBuilder.getSamplerGroupInfo();
+            auto const& samplerGroupInfo = data->samplerGroupInfo;
             auto& indicesRun = mIndicesRuns;
             uint8_t numUsedBindings = 0;
             uint8_t tmu = 0;
@@ -148,6 +232,10 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
             mUsedBindingsCount = numUsedBindings;
         }
         mIsValid = true;
+
+        if (data->storeProgramBinary) {
+            storeProgramBinary(gl, data->programBinaryKey);
+        }
     }
 
     // failing to compile a program can't be fatal, because this will happen a lot in
@@ -158,27 +246,64 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
     }
 }
 
-OpenGLProgram::~OpenGLProgram() noexcept {
-    const size_t validShaderSet = mValidShaderSet;
-    const bool isValid = mIsValid;
-    GLuint program = gl.program;
-    if (validShaderSet) {
-        #pragma nounroll
-        for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
-            if (validShaderSet & (1U << i)) {
-                const GLuint shader = gl.shaders[i];
-                if (isValid) {
-                    glDetachShader(program, shader);
-                }
-                glDeleteShader(shader);
+bool OpenGLProgram::loadProgramBinary(OpenGLDriver* gl, ProgramBinaryKey const& key) noexcept {
+    // the blob is the binary format followed by the binary
+    OpenGLPlatform& platform = gl->mPlatform;
+    bool loaded = false;
+    const size_t size = platform.retrieveBlob(&key, sizeof(key), nullptr, 0);
+    if (size > sizeof(GLenum)) {
+        std::vector<uint8_t> blob(size);
+        if (platform.retrieveBlob(&key, sizeof(key), blob.data(), size) == size) {
+            GLenum format;
+            memcpy(&format, blob.data(), sizeof(format));
+            GLuint program = glCreateProgram();
+            glProgramBinary(program, format,
+                    blob.data() + sizeof(format), GLsizei(size - sizeof(format)));
+            GLint status = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if (status == GL_TRUE) {
+                this->gl.program = program;
+                loaded = true;
+            } else {
+                // the driver rejected the binary (e.g. after an update), we'll compile the
+                // program and replace it. glProgramBinary() may have raised an error, ignore it.
+                glDeleteProgram(program);
+                glGetError();
             }
         }
     }
-    if (isValid) {
-        glDeleteProgram(program);
+    platform.recordBlobCacheLookup(loaded);
+    return loaded;
+}
+
+void OpenGLProgram::storeProgramBinary(OpenGLDriver* gl, ProgramBinaryKey const& key) noexcept {
+    const GLuint program = this->gl.program;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<uint8_t> blob(sizeof(GLenum) + size_t(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, blob.data() + sizeof(GLenum));
+    if (written > 0) {
+        memcpy(blob.data(), &format, sizeof(format));
+        blob.resize(sizeof(GLenum) + size_t(written));
+        // the blob is written to the cache later, off the driver thread
+        gl->queueProgramBinary(&key, sizeof(key), std::move(blob));
     }
 }
 
+void OpenGLProgram::hash(void const* data, size_t size, uint32_t result[2]) noexcept {
+    // murmur3 works on words, the last one is padded with zeros
+    std::vector<uint32_t> words(std::max(size_t(1), (size + 3) / 4), 0);
+    memcpy(words.data(), data, size);
+    const uint64_t h = utils::hash::murmur3x2(words.data(), words.size());
+    result[0] = uint32_t(h);
+    result[1] = uint32_t(h >> 32u);
+}
+
 void OpenGLProgram::updateSamplers(OpenGLDriver* gl) noexcept {
     using GLTexture = OpenGLDriver::GLTexture;
 
@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include <utils/compiler.h>
@@ -42,6 +43,15 @@ public:
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // The program is compiled and linked asynchronously, initialize() checks the results and
+    // sets up the uniform blocks and samplers. It must be called before the program is used.
+    bool isInitialized() const noexcept { return !mLazyInitializationData; }
+    void initialize(OpenGLDriver* gl) noexcept;
+
+    // Whether initialize() can be called without waiting for the compilation to finish. This is
+    // only known with KHR_parallel_shader_compile, otherwise the program is assumed compiled.
+    bool isCompiled(OpenGLDriver const* gl) const noexcept;
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
             // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
@@ -61,14 +71,19 @@ public:
     }
 
     struct {
-        GLuint shaders[backend::Program::SHADER_TYPE_COUNT];
-        GLuint program;
+        GLuint shaders[backend::Program::SHADER_TYPE_COUNT] = {};
+        GLuint program = 0;
     } gl; // 12 bytes
 
     static void logCompilationError(utils::io::ostream& out, GLuint shaderId, char const* source) noexcept;
 
+    // 64-bit hash of a string of bytes, used to key the program binary cache
+    static void hash(void const* data, size_t size, uint32_t result[2]) noexcept;
+
 private:
     static constexpr uint8_t TEXTURE_UNIT_COUNT = OpenGLDriver::MAX_TEXTURE_UNIT_COUNT;
+    // increment when the layout of ProgramBinaryKey or of the cached blobs changes
+    static constexpr uint32_t PROGRAM_BINARY_VERSION = 1;
     static constexpr uint8_t VERTEX_SHADER_BIT   = uint8_t(1) << size_t(backend::Program::Shader::VERTEX);
     static constexpr uint8_t FRAGMENT_SHADER_BIT = uint8_t(1) << size_t(backend::Program::Shader::FRAGMENT);
 
@@ -84,6 +99,33 @@ private:
         static_assert(backend::Program::SAMPLER_BINDING_COUNT <= 8, "SAMPLER_BINDING_COUNT must be <= 8");
     };
 
+    // Program binaries are cached with the Platform, keyed by the sources of the shaders and the
+    // driver that compiled them.
+    struct ProgramBinaryKey {
+        uint32_t version;
+        uint32_t driverHash[2];
+        struct {
+            uint32_t hash[2];
+            uint32_t size;
+        } shaders[backend::Program::SHADER_TYPE_COUNT];
+    };
+
+    // what initialize() needs from the Program, kept until the program is initialized
+    // NOTE: we have to use out-of-line allocation here because the size of a Handle<> is limited
+    struct LazyInitializationData {
+        backend::Program::UniformBlockInfo uniformBlockInfo;
+        backend::Program::SamplerGroupInfo samplerGroupInfo;
+        bool hasSamplers;
+        // whether the program binary must be stored in the cache once linked
+        bool storeProgramBinary;
+        ProgramBinaryKey programBinaryKey;
+    };
+
+    // creates the program from the cache, returns false if that's not possible
+    bool loadProgramBinary(OpenGLDriver* gl, ProgramBinaryKey const& key) noexcept;
+    void storeProgramBinary(OpenGLDriver* gl, ProgramBinaryKey const& key) noexcept;
+    std::unique_ptr<LazyInitializationData> mLazyInitializationData;
+
     uint8_t mUsedBindingsCount = 0;
     uint8_t mValidShaderSet = 0;
     bool mIsValid = false;
@@ -80,6 +80,11 @@
 #define GL_TEXTURE_EXTERNAL_OES           0x8D65
 #endif
 
+// KHR_parallel_shader_compile, same token as ARB_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+#endif
+
 #include "NullGLES.h"
 
 #if (!defined(GL_ES_VERSION_3_1) && !defined(GL_VERSION_4_1))
@@ -15,10 +15,13 @@
  */
 
 #include "vulkan/VulkanBinder.h"
+#include "vulkan/VulkanUtility.h"
 
 #include <utils/Panic.h>
 #include <utils/trap.h>
 
+#include <algorithm>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
@@ -33,12 +36,8 @@ namespace backend {
 // allocator by passing in a null pointer, and we pinpoint the argument by using the VKALLOC macro.
 static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 
-// Maximum number of descriptor sets that can be allocated by the pool.
-// TODO: Make VulkanBinder robust against a large number of descriptors.
-// There are several approaches we could take to deal with too many descriptors:
-// - Create another pool after hitting the limit of the first pool.
-// - Allow up to 3 uniform descriptors to bind simultaneously instead of just 1.
-static constexpr uint32_t MAX_NUM_DESCRIPTORS = 1000;
+// Number of descriptor sets that can be allocated by each descriptor pool.
+static constexpr uint32_t DESCRIPTORS_PER_POOL = 1000;
 
 static const VulkanBinder::RasterState createDefaultRasterState();
 
@@ -92,6 +91,7 @@ bool VulkanBinder::getOrCreateDescriptors(VkDescriptorSet descriptors[2],
     // value method for obtaining a stable reference.
     auto iter = mDescriptorSets.find(mDescriptorKey);
     if (UTILS_LIKELY(iter != mDescriptorSets.end())) {
+        mDescriptorCounters.hits++;
         mCurrentDescriptor = &iter.value();
         descriptors[0] = mCurrentDescriptor->handles[0];
         descriptors[1] = mCurrentDescriptor->handles[1];
@@ -103,16 +103,8 @@ bool VulkanBinder::getOrCreateDescriptors(VkDescriptorSet descriptors[2],
     }
 
     // If we reach this point, we need to create and stash a brand new descriptor set.
-    ASSERT_POSTCONDITION(mDescriptorSets.size() < MAX_NUM_DESCRIPTORS, "Too many descriptors.");
-
-    // Allocate descriptor (does not need explicit destruction)
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = 2;
-    allocInfo.pSetLayouts = mDescriptorSetLayouts;
-    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptors);
-    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    mDescriptorCounters.misses++;
+    allocateDescriptors(descriptors);
     *pipelineLayout = mPipelineLayout;
 
     // Here we construct a DescriptorVal in place, then stash its pointer to allow fast subsequent
@@ -193,6 +185,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     // method for obtaining a stable reference.
     auto iter = mPipelines.find(mPipelineKey);
     if (UTILS_LIKELY(iter != mPipelines.end())) {
+        mPipelineCounters.hits++;
         mCurrentPipeline = &iter.value();
         *pipeline = mCurrentPipeline->handle;
         mCurrentPipeline->timestamp = mCurrentTime;
@@ -202,6 +195,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     }
 
     // If we reach this point, we need to create and stash a brand new pipeline object.
+    mPipelineCounters.misses++;
     mShaderStages[0].module = mPipelineKey.shaders[0];
     mShaderStages[1].module = mPipelineKey.shaders[1];
 
@@ -268,8 +262,11 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
             << mShaderStages[0].module << ", " << mShaderStages[1].module << ")" << utils::io::endl;
     #endif
 
-    VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    const auto start = std::chrono::steady_clock::now();
+    VkResult err = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineCreateInfo,
             VKALLOC, pipeline);
+    mPipelineCreationTime += std::chrono::steady_clock::now() - start;
+    mPipelineCreationCount++;
     if (err) {
         utils::slog.e << "vkCreateGraphicsPipelines error " << err << utils::io::endl;
         utils::debug_trap();
@@ -402,9 +399,47 @@ void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
     });
 }
 
+void VulkanBinder::unbindRenderPass(VkRenderPass renderPass) noexcept {
+    if (mPipelineKey.renderPass == renderPass) {
+        mPipelineKey.renderPass = VK_NULL_HANDLE;
+    }
+    releaseBindings();
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
+            iter != mPipelines.end();) {
+        if (iter->first.renderPass == renderPass) {
+            vkDestroyPipeline(mDevice, iter->second.handle, VKALLOC);
+            mPipelineCounters.evictions++;
+            iter = mPipelines.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void VulkanBinder::unbindSampler(VkSampler sampler) noexcept {
+    for (auto& binding : mDescriptorKey.samplers) {
+        if (binding.sampler == sampler) {
+            binding = {
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            };
+            mDirtyDescriptor = true;
+        }
+    }
+    evictDescriptors([sampler] (const DescriptorKey& key) {
+        for (const auto& binding : key.samplers) {
+            if (binding.sampler == sampler) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
 // Discards all descriptor sets that pass the given filter. Immediately removes the cache entries,
 // but defers calling vkFreeDescriptorSets until the next eviction cycle.
 void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept {
+    releaseBindings();
     // Due to robin_map restrictions, we cannot use auto or a range-based loop.
     decltype(mDescriptorSets)::const_iterator iter;
     for (iter = mDescriptorSets.begin(); iter != mDescriptorSets.end();) {
@@ -467,46 +502,85 @@ void VulkanBinder::resetBindings() noexcept {
     mDirtyDescriptor = true;
 }
 
-// Frees up old descriptor sets and pipelines, then nulls out their key.
+// Erasing entries from the maps moves the other entries, so the pointers to the current pipeline
+// and descriptor set are dropped first. They're looked up again the next time they're needed.
+void VulkanBinder::releaseBindings() noexcept {
+    if (mCurrentPipeline) {
+        mCurrentPipeline->timestamp = mCurrentTime;
+        mCurrentPipeline->bound = false;
+        mCurrentPipeline = nullptr;
+    }
+    if (mCurrentDescriptor) {
+        mCurrentDescriptor->timestamp = mCurrentTime;
+        mCurrentDescriptor->bound = false;
+        mCurrentDescriptor = nullptr;
+    }
+    mDirtyPipeline = true;
+    mDirtyDescriptor = true;
+}
+
+// Frees up old descriptor sets and pipelines, then the least recently used ones if there are more
+// than their budget allows.
 void VulkanBinder::gc() noexcept {
     // This method is designed to be called once per frame, and our notion of "time" is actually a
     // frame counter. Frames are a better metric than wall clock because we know with certainty that
     // objects last bound more than n frames ago are no longer in use (due to existing fences).
     mCurrentTime++;
-    // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
-    if (mCurrentTime <= TIME_BEFORE_EVICTION) {
-        return;
+    releaseBindings();
+
+    std::vector<uint32_t> timestamps;
+    timestamps.reserve(std::max(mDescriptorSets.size(), mPipelines.size()));
+    for (const auto& pair : mDescriptorSets) {
+        timestamps.push_back(pair.second.timestamp);
     }
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
+    uint32_t evictTime = getEvictionTime(mCurrentTime, TIME_BEFORE_EVICTION, mDescriptorBudget,
+            mDescriptorSets.size(), timestamps);
+
     // Due to robin_map restrictions, we cannot use auto or a range-based loop.
     for (decltype(mDescriptorSets)::const_iterator iter = mDescriptorSets.begin();
             iter != mDescriptorSets.end();) {
         auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
-            vkFreeDescriptorSets(mDevice, mDescriptorPool, 2, cacheEntry.handles);
+        if (cacheEntry.timestamp < evictTime) {
+            mDescriptorFreeList.push_back({ cacheEntry.handles[0], cacheEntry.handles[1] });
+            mDescriptorCounters.evictions++;
             iter = mDescriptorSets.erase(iter);
         } else {
             ++iter;
         }
     }
+
+    timestamps.clear();
+    for (const auto& pair : mPipelines) {
+        timestamps.push_back(pair.second.timestamp);
+    }
+    evictTime = getEvictionTime(mCurrentTime, TIME_BEFORE_EVICTION, mPipelineBudget,
+            mPipelines.size(), timestamps);
     for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
             iter != mPipelines.end();) {
         auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
+        if (cacheEntry.timestamp < evictTime) {
             vkDestroyPipeline(mDevice, cacheEntry.handle, VKALLOC);
+            mPipelineCounters.evictions++;
             iter = mPipelines.erase(iter);
         } else {
             ++iter;
         }
     }
+
+    // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
+    if (mCurrentTime <= TIME_BEFORE_EVICTION) {
+        return;
+    }
+
     // The graveyard is composed of descriptors that contain references to extinct objects. We
-    // take care only to free the ones that are old enough to be evicted, since they might be
-    // referenced in a command buffer that hasn't finished executing.
+    // take care only to recycle the ones that are old enough, since they might be referenced in a
+    // command buffer that hasn't finished executing.
+    const uint32_t safeTime = mCurrentTime - TIME_BEFORE_EVICTION;
     decltype(mDescriptorGraveyard) graveyard;
     graveyard.swap(mDescriptorGraveyard);
     for (auto& val : graveyard) {
-        if (val.timestamp < evictTime) {
-           vkFreeDescriptorSets(mDevice, mDescriptorPool, 2, val.handles);
+        if (val.timestamp < safeTime) {
+            mDescriptorFreeList.push_back({ val.handles[0], val.handles[1] });
         } else {
             mDescriptorGraveyard.emplace_back(DescriptorVal {
                 .handles = { val.handles[0], val.handles[1] },
@@ -516,6 +590,60 @@ void VulkanBinder::gc() noexcept {
     }
 }
 
+CacheCounters VulkanBinder::getPipelineCounters() const noexcept {
+    CacheCounters counters = mPipelineCounters;
+    counters.size = uint32_t(mPipelines.size());
+    return counters;
+}
+
+CacheCounters VulkanBinder::getDescriptorCounters() const noexcept {
+    CacheCounters counters = mDescriptorCounters;
+    counters.size = uint32_t(mDescriptorSets.size());
+    return counters;
+}
+
+// Recycles the descriptor sets of an evicted descriptor if possible, otherwise allocates them.
+// Descriptor sets are never freed individually, only when their pool is destroyed.
+void VulkanBinder::allocateDescriptors(VkDescriptorSet descriptors[2]) noexcept {
+    if (!mDescriptorFreeList.empty()) {
+        descriptors[0] = mDescriptorFreeList.back()[0];
+        descriptors[1] = mDescriptorFreeList.back()[1];
+        mDescriptorFreeList.pop_back();
+        return;
+    }
+    if (mDescriptorPools.empty() || mDescriptorPoolUsage == DESCRIPTORS_PER_POOL) {
+        createDescriptorPool();
+    }
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = mDescriptorPools.back();
+    allocInfo.descriptorSetCount = 2;
+    allocInfo.pSetLayouts = mDescriptorSetLayouts;
+    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptors);
+    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    mDescriptorPoolUsage++;
+}
+
+void VulkanBinder::createDescriptorPool() noexcept {
+    // Each descriptor holds a set of uniform buffers and a set of samplers.
+    VkDescriptorPoolSize poolSizes[2] = {};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = DESCRIPTORS_PER_POOL * 2,
+        .poolSizeCount = 2,
+        .pPoolSizes = &poolSizes[0]
+    };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = DESCRIPTORS_PER_POOL * UBUFFER_BINDING_COUNT;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = DESCRIPTORS_PER_POOL * SAMPLER_BINDING_COUNT;
+    VkDescriptorPool pool;
+    VkResult err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    mDescriptorPools.push_back(pool);
+    mDescriptorPoolUsage = 0;
+}
+
 void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     VkDescriptorSetLayoutBinding binding = {};
     binding.descriptorCount = 1; // NOTE: We never use arrays-of-blocks.
@@ -552,22 +680,6 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     pPipelineLayoutCreateInfo.pSetLayouts = mDescriptorSetLayouts;
     VkResult err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC, &mPipelineLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
-
-    // Create the VkDescriptorPool.
-    VkDescriptorPoolSize poolSizes[2] = {};
-    VkDescriptorPoolCreateInfo poolInfo {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .poolSizeCount = 2,
-        .pPoolSizes = &poolSizes[0],
-        .maxSets = MAX_NUM_DESCRIPTORS,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
-    };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = poolInfo.maxSets * UBUFFER_BINDING_COUNT;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = poolInfo.maxSets * SAMPLER_BINDING_COUNT;
-    err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &mDescriptorPool);
-    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
 }
 
 void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
@@ -588,8 +700,14 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayouts[0], VKALLOC);
     vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayouts[1], VKALLOC);
     mDescriptorSetLayouts[0] = mDescriptorSetLayouts[1] = {};
-    vkDestroyDescriptorPool(mDevice, mDescriptorPool, VKALLOC);
-    mDescriptorPool = VK_NULL_HANDLE;
+    // Destroying the pools frees all the descriptor sets.
+    for (VkDescriptorPool pool : mDescriptorPools) {
+        vkDestroyDescriptorPool(mDevice, pool, VKALLOC);
+    }
+    mDescriptorPools.clear();
+    mDescriptorPoolUsage = 0;
+    mDescriptorFreeList.clear();
+    mDescriptorGraveyard.clear();
     mCurrentDescriptor = nullptr;
     mDirtyDescriptor = true;
 }
@@ -18,6 +18,7 @@
 #define TNT_FILAMENT_DRIVER_VULKANBINDER_H
 
 #include <backend/DriverEnums.h>
+#include <backend/Platform.h>
 
 #include <private/backend/Program.h>
 
@@ -27,6 +28,9 @@
 #include <utils/Hash.h>
 
 #include <tsl/robin_map.h>
+
+#include <array>
+#include <chrono>
 #include <vector>
 
 namespace filament {
@@ -112,6 +116,29 @@ public:
     ~VulkanBinder();
     void setDevice(VkDevice device) { mDevice = device; }
 
+    // Pipelines are created through this cache, which is owned by the client. Optional.
+    void setPipelineCache(VkPipelineCache cache) { mPipelineCache = cache; }
+
+    // Bounds the number of pipelines and descriptor sets kept, see gc().
+    void setCacheBudgets(Platform::CacheBudgets const& budgets) noexcept {
+        mPipelineBudget = budgets.pipelines;
+        mDescriptorBudget = budgets.descriptorSets;
+    }
+
+    // The hits, misses and evictions are counted since the last call to resetCounters().
+    CacheCounters getPipelineCounters() const noexcept;
+    CacheCounters getDescriptorCounters() const noexcept;
+    void resetCounters() noexcept {
+        mPipelineCounters = {};
+        mDescriptorCounters = {};
+    }
+
+    // Number of pipelines created, and the total time spent in vkCreateGraphicsPipelines.
+    uint32_t getPipelineCreationCount() const noexcept { return mPipelineCreationCount; }
+    std::chrono::nanoseconds getPipelineCreationTime() const noexcept {
+        return mPipelineCreationTime;
+    }
+
     // Clients should initialize their copy of the raster state using this method. They can then
     // mutate their copy and pass it back through bindRasterState().
     const RasterState& getDefaultRasterState() const { return mDefaultRasterState; }
@@ -143,7 +170,15 @@ public:
     // This is only necessary when the client knows that a texture is about to be destroyed.
     void unbindImageView(VkImageView imageView) noexcept;
 
-    // NOTE: In theory we should proffer "unbindSampler" but in practice we never destroy samplers.
+    // Destroys all cached pipelines that refer to the given render pass, since its handle could be
+    // reused by an incompatible render pass. This is only necessary when the client knows that the
+    // render pass is about to be destroyed.
+    void unbindRenderPass(VkRenderPass renderPass) noexcept;
+
+    // Checks if a sampler is bound to any slot, and if so resets that particular slot.
+    // Also invalidates all cached descriptors that refer to the given sampler.
+    // This is only necessary when the client knows that a sampler is about to be destroyed.
+    void unbindSampler(VkSampler sampler) noexcept;
 
     // Destroys all managed Vulkan objects. This should be called before changing the VkDevice, or
     // when the cache gets too big.
@@ -154,7 +189,8 @@ public:
     // be called after every swap if the VulkanBinder is shared amongst command buffers.
     void resetBindings() noexcept;
 
-    // Evicts old unused Vulkan objects. Call this once per frame.
+    // Evicts old unused Vulkan objects, then the least recently used ones if the caches are over
+    // budget. Call this once per frame, after resetBindings().
     void gc() noexcept;
 
 private:
@@ -225,8 +261,12 @@ private:
     void createLayoutsAndDescriptors() noexcept;
     void destroyLayoutsAndDescriptors() noexcept;
     void evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept;
+    void releaseBindings() noexcept;
+    void allocateDescriptors(VkDescriptorSet descriptors[2]) noexcept;
+    void createDescriptorPool() noexcept;
 
     VkDevice mDevice = nullptr;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
     const RasterState mDefaultRasterState;
 
     // These structs are used only in a transient way but are stored for convenience.
@@ -256,9 +296,22 @@ private:
     VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
     tsl::robin_map<PipelineKey, PipelineVal, PipelineHashFn, PipelineEqual> mPipelines;
     tsl::robin_map<DescriptorKey, DescriptorVal, DescHashFn, DescEqual> mDescriptorSets;
-    VkDescriptorPool mDescriptorPool;
     std::vector<DescriptorVal> mDescriptorGraveyard;
 
+    // Evicted descriptor sets aren't freed, but recycled for new descriptors. A new pool is
+    // created when all the descriptor sets of the previous ones are used.
+    std::vector<VkDescriptorPool> mDescriptorPools;
+    std::vector<std::array<VkDescriptorSet, 2>> mDescriptorFreeList;
+    uint32_t mDescriptorPoolUsage = 0; // descriptor sets allocated from the last pool
+
+    Platform::CacheBudget mPipelineBudget = Platform::CacheBudgets().pipelines;
+    Platform::CacheBudget mDescriptorBudget = Platform::CacheBudgets().descriptorSets;
+    CacheCounters mPipelineCounters;
+    CacheCounters mDescriptorCounters;
+
+    uint32_t mPipelineCreationCount = 0;
+    std::chrono::nanoseconds mPipelineCreationTime = {};
+
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint32_t mCurrentTime = 0;
     static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
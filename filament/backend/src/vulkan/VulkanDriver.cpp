@@ -27,7 +27,9 @@
 #include <utils/CString.h>
 #include <utils/trap.h>
 
+#include <chrono>
 #include <set>
+#include <vector>
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
 // to a stack-allocated variable.
@@ -173,6 +175,12 @@ VulkanDriver::VulkanDriver(VulkanPlatform* platform,
     // Initialize device and graphicsQueue.
     createVirtualDevice(mContext);
     mBinder.setDevice(mContext.device);
+    createPipelineCache();
+
+    const Platform::CacheBudgets& budgets = mContextManager.getCacheBudgets();
+    mBinder.setCacheBudgets(budgets);
+    mFramebufferCache.setCacheBudgets(budgets);
+    mSamplerCache.setCacheBudget(budgets.samplers);
 
     // Choose a depth format that meets our requirements. Take care not to include stencil formats
     // just yet, since that would require a corollary change to the "aspect" flags for the VkImage.
@@ -192,6 +200,92 @@ Driver* VulkanDriver::create(VulkanPlatform* const platform,
     return driver;
 }
 
+// Checks that the pipeline cache data was created by this driver and device, as described in the
+// header of the data. Drivers are supposed to reject incompatible data, but not all of them do.
+static bool isPipelineCacheCompatible(VulkanContext const& context,
+        std::vector<uint8_t> const& data) noexcept {
+    struct Header {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    } header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    VkPhysicalDeviceProperties const& props = context.physicalDeviceProperties;
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == props.vendorID && header.deviceID == props.deviceID &&
+           !memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+// key of the pipeline cache data in the platform's blob cache
+static constexpr char PIPELINE_CACHE_KEY[] = "filament.vulkan.VkPipelineCache";
+
+void VulkanDriver::createPipelineCache() noexcept {
+    std::vector<uint8_t> data;
+    if (mContextManager.hasBlobCache()) {
+        const size_t size = mContextManager.retrieveBlob(
+                PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY), nullptr, 0);
+        if (size) {
+            data.resize(size);
+            if (mContextManager.retrieveBlob(PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY),
+                    data.data(), size) != size || !isPipelineCacheCompatible(mContext, data)) {
+                data.clear();
+            }
+        }
+        mContextManager.recordBlobCacheLookup(!data.empty());
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    VkResult err = vkCreatePipelineCache(mContext.device, &createInfo, VKALLOC, &mPipelineCache);
+    if (err && !data.empty()) {
+        // start from an empty cache if the driver rejects the data
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        err = vkCreatePipelineCache(mContext.device, &createInfo, VKALLOC, &mPipelineCache);
+    }
+    if (err) {
+        utils::slog.w << "Unable to create pipeline cache." << utils::io::endl;
+        mPipelineCache = VK_NULL_HANDLE;
+    }
+    mBinder.setPipelineCache(mPipelineCache);
+}
+
+void VulkanDriver::destroyPipelineCache() noexcept {
+    // report how long it took to create the pipelines, this is what the cache saves
+    const uint32_t count = mBinder.getPipelineCreationCount();
+    if (count) {
+        utils::slog.i << "Created " << count << " pipelines in "
+                << std::chrono::duration<float, std::milli>(
+                        mBinder.getPipelineCreationTime()).count()
+                << " ms." << utils::io::endl;
+    }
+
+    if (mPipelineCache == VK_NULL_HANDLE) {
+        return;
+    }
+    if (mContextManager.hasBlobCache()) {
+        size_t size = 0;
+        vkGetPipelineCacheData(mContext.device, mPipelineCache, &size, nullptr);
+        std::vector<uint8_t> data(size);
+        if (size && vkGetPipelineCacheData(mContext.device, mPipelineCache, &size,
+                data.data()) == VK_SUCCESS) {
+            mContextManager.insertBlob(PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY),
+                    data.data(), size);
+        }
+    }
+    mBinder.setPipelineCache(VK_NULL_HANDLE);
+    vkDestroyPipelineCache(mContext.device, mPipelineCache, VKALLOC);
+    mPipelineCache = VK_NULL_HANDLE;
+}
+
 ShaderModel VulkanDriver::getShaderModel() const noexcept {
 #if defined(ANDROID) || defined(IOS)
     return ShaderModel::GL_ES_30;
@@ -221,6 +315,7 @@ void VulkanDriver::terminate() {
 
     mStagePool.reset();
     mBinder.destroyCache();
+    destroyPipelineCache();
     mFramebufferCache.reset();
     mSamplerCache.reset();
 
@@ -264,11 +359,33 @@ void VulkanDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId) {
     // interest of maintaining a small memory footprint.
     mBinder.resetBindings();
 
-    // Free old unused objects.
+    // Free old unused objects. The binder must forget the render passes and samplers before they
+    // are destroyed, since their handles could be reused by new objects.
     mStagePool.gc();
-    mFramebufferCache.gc();
+    mFramebufferCache.gc([this](VkRenderPass renderPass) {
+        mBinder.unbindRenderPass(renderPass);
+    });
+    mSamplerCache.gc([this](VkSampler sampler) {
+        mBinder.unbindSampler(sampler);
+    });
     mBinder.gc();
     mDisposer.gc();
+
+    // getCacheStats() is called synchronously from the client thread.
+    std::lock_guard<std::mutex> lock(mCacheStatsMutex);
+    mCacheStats.pipelines = mBinder.getPipelineCounters();
+    mCacheStats.descriptorSets = mBinder.getDescriptorCounters();
+    mCacheStats.framebuffers = mFramebufferCache.getFramebufferCounters();
+    mCacheStats.renderPasses = mFramebufferCache.getRenderPassCounters();
+    mCacheStats.samplers = mSamplerCache.getCounters();
+    mCacheStats.pipelineCreationCount = mBinder.getPipelineCreationCount();
+    mCacheStats.pipelineCreationTime = std::chrono::duration<float, std::milli>(
+            mBinder.getPipelineCreationTime()).count();
+
+    // the stats are per frame, cumulative counters would eventually wrap
+    mBinder.resetCounters();
+    mFramebufferCache.resetCounters();
+    mSamplerCache.resetCounters();
 }
 
 void VulkanDriver::setPresentationTime(int64_t monotonic_clock_ns) {
@@ -282,6 +399,14 @@ void VulkanDriver::flush(int) {
     // Todo: equivalent of glFlush()
 }
 
+void VulkanDriver::compilePrograms(ProgramCallback callback, void* user) {
+    // The shader modules are created by createProgram(), so the programs are ready. Their
+    // pipelines are created by the first draw that uses them: a pipeline depends on the render
+    // pass, raster state and vertex layout, none of which is known for a program that was never
+    // drawn. After the first launch these creations mostly hit the persistent pipeline cache.
+    scheduleCallback(callback, user);
+}
+
 void VulkanDriver::createSamplerGroupR(Handle<HwSamplerGroup> sbh, size_t count) {
     construct_handle<VulkanSamplerGroup>(mHandleMap, sbh, mContext, count);
 }
@@ -652,14 +777,29 @@ bool VulkanDriver::canGenerateMipmaps() {
     return false;
 }
 
+void VulkanDriver::getCacheStats(CacheStats* stats) {
+    // The counters are those of the last frame started by the driver thread.
+    std::lock_guard<std::mutex> lock(mCacheStatsMutex);
+    *stats = mCacheStats;
+}
+
 void VulkanDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data) {
     if (data.size > 0) {
         auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-        buffer->loadFromCpu(data.buffer, (uint32_t) data.size);
+        buffer->loadFromCpu(data.buffer, 0, (uint32_t) data.size);
         scheduleDestroy(std::move(data));
     }
 }
 
+void VulkanDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data,
+        uint32_t byteOffset) {
+    if (data.size > 0) {
+        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        buffer->loadFromCpu(data.buffer, byteOffset, (uint32_t) data.size);
+    }
+    scheduleDestroy(std::move(data));
+}
+
 void VulkanDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
         SamplerGroup&& samplerGroup) {
     auto* sb = handle_cast<VulkanSamplerGroup>(mHandleMap, sbh);
@@ -994,6 +1134,11 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
 }
 
 void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> rph) {
+    drawInstanced(pipelineState, rph, 1);
+}
+
+void VulkanDriver::drawInstanced(PipelineState pipelineState, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
     VulkanCommandBuffer* commands = mContext.currentCommands;
     ASSERT_POSTCONDITION(commands, "Draw calls can occur only within a beginFrame / endFrame.");
     VkCommandBuffer cmdbuffer = commands->cmdbuffer;
@@ -1122,11 +1267,11 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
             prim.indexBuffer->indexType);
 
     // Finally, make the actual draw call. TODO: support subranges
+    // gl_InstanceIndex includes the first instance, the shaders rely on it starting at 0.
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
+    const uint32_t firstInstId = 0;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
@@ -1134,6 +1279,7 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
 void VulkanDriver::debugCommand(const char* methodName) {
     static const std::set<utils::StaticString> OUTSIDE_COMMANDS = {
         "loadUniformBuffer",
+        "updateUniformBuffer",
         "updateVertexBuffer",
         "updateIndexBuffer",
         "update2DImage",
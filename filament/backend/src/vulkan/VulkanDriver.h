@@ -77,6 +77,11 @@ private:
     VulkanDriver(VulkanDriver const&) = delete;
     VulkanDriver& operator = (VulkanDriver const&) = delete;
 
+    // The pipeline cache is seeded from the platform's blob cache, and saved back into it when
+    // the driver is terminated.
+    void createPipelineCache() noexcept;
+    void destroyPipelineCache() noexcept;
+
 private:
     backend::VulkanPlatform& mContextManager;
 
@@ -150,6 +155,11 @@ private:
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerGroup* mSamplerBindings[VulkanBinder::SAMPLER_BINDING_COUNT] = {};
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+
+    // Snapshot of the cache counters, taken at the beginning of each frame.
+    CacheStats mCacheStats;
+    std::mutex mCacheStatsMutex;
 };
 
 } // namespace backend
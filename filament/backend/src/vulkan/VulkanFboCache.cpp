@@ -15,9 +15,12 @@
  */
 
 #include "vulkan/VulkanFboCache.h"
+#include "vulkan/VulkanUtility.h"
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace backend {
 
@@ -48,10 +51,12 @@ VulkanFboCache::~VulkanFboCache() {
 
 VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config, uint32_t w, uint32_t h) noexcept {
     auto iter = mFramebufferCache.find(config);
-    if (UTILS_LIKELY(iter != mFramebufferCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
+    if (UTILS_LIKELY(iter != mFramebufferCache.end())) {
+        mFramebufferCounters.hits++;
         iter.value().timestamp = mCurrentTime;
         return iter->second.handle;
     }
+    mFramebufferCounters.misses++;
     uint32_t nAttachments = 0;
     for (auto attachment : config.attachments) {
         if (attachment) {
@@ -77,10 +82,12 @@ VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config, uint32_t w, uint32_t
 
 VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     auto iter = mRenderPassCache.find(config);
-    if (UTILS_LIKELY(iter != mRenderPassCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
+    if (UTILS_LIKELY(iter != mRenderPassCache.end())) {
+        mRenderPassCounters.hits++;
         iter.value().timestamp = mCurrentTime;
         return iter->second.handle;
     }
+    mRenderPassCounters.misses++;
     const bool hasColor = config.colorFormat != VK_FORMAT_UNDEFINED;
     const bool hasDepth = config.depthFormat != VK_FORMAT_UNDEFINED;
     const bool depthOnly = hasDepth && !hasColor;
@@ -183,27 +190,73 @@ void VulkanFboCache::reset() noexcept {
         vkDestroyRenderPass(mContext.device, pair.second.handle, VKALLOC);
     }
     mRenderPassCache.clear();
+    mRenderPassRefCount.clear();
 }
 
-// Frees up old framebuffers and render passes, then nulls out their key.  Doesn't bother removing
-// the actual map entry since it is fairly small.
-void VulkanFboCache::gc() noexcept {
+// Frees up old framebuffers and render passes, then the least recently used ones if there are more
+// than their budget allows. Render passes are only evicted once their framebuffers are.
+void VulkanFboCache::gc(std::function<void(VkRenderPass)> const& onEvictRenderPass) noexcept {
     mCurrentTime++;
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
-    for (auto iter = mFramebufferCache.begin(); iter != mFramebufferCache.end(); ++iter) {
+
+    std::vector<uint32_t> timestamps;
+    timestamps.reserve(std::max(mFramebufferCache.size(), mRenderPassCache.size()));
+    for (const auto& pair : mFramebufferCache) {
+        timestamps.push_back(pair.second.timestamp);
+    }
+    uint32_t evictTime = getEvictionTime(mCurrentTime, TIME_BEFORE_EVICTION, mFramebufferBudget,
+            mFramebufferCache.size(), timestamps);
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (decltype(mFramebufferCache)::const_iterator iter = mFramebufferCache.begin();
+            iter != mFramebufferCache.end();) {
         if (iter->second.timestamp < evictTime) {
+            mRenderPassRefCount[iter->first.renderPass]--;
             vkDestroyFramebuffer(mContext.device, iter->second.handle, VKALLOC);
-            iter.value().handle = VK_NULL_HANDLE;
+            mFramebufferCounters.evictions++;
+            iter = mFramebufferCache.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    timestamps.clear();
+    for (const auto& pair : mRenderPassCache) {
+        if (mRenderPassRefCount[pair.second.handle] == 0) {
+            timestamps.push_back(pair.second.timestamp);
         }
     }
-    for (auto iter = mRenderPassCache.begin(); iter != mRenderPassCache.end(); ++iter) {
-        VkRenderPass handle = iter->second.handle;
+    evictTime = getEvictionTime(mCurrentTime, TIME_BEFORE_EVICTION, mRenderPassBudget,
+            mRenderPassCache.size(), timestamps);
+    for (decltype(mRenderPassCache)::const_iterator iter = mRenderPassCache.begin();
+            iter != mRenderPassCache.end();) {
+        const VkRenderPass handle = iter->second.handle;
         if (iter->second.timestamp < evictTime && mRenderPassRefCount[handle] == 0) {
+            onEvictRenderPass(handle);
             vkDestroyRenderPass(mContext.device, handle, VKALLOC);
-            iter.value().handle = VK_NULL_HANDLE;
+            mRenderPassRefCount.erase(handle);
+            mRenderPassCounters.evictions++;
+            iter = mRenderPassCache.erase(iter);
+        } else {
+            ++iter;
         }
     }
 }
 
+CacheCounters VulkanFboCache::getFramebufferCounters() const noexcept {
+    CacheCounters counters = mFramebufferCounters;
+    counters.size = uint32_t(mFramebufferCache.size());
+    return counters;
+}
+
+CacheCounters VulkanFboCache::getRenderPassCounters() const noexcept {
+    CacheCounters counters = mRenderPassCounters;
+    counters.size = uint32_t(mRenderPassCache.size());
+    return counters;
+}
+
+void VulkanFboCache::resetCounters() noexcept {
+    mFramebufferCounters = {};
+    mRenderPassCounters = {};
+}
+
 } // namespace filament
 } // namespace backend
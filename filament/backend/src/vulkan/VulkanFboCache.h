@@ -19,10 +19,14 @@
 
 #include "VulkanContext.h"
 
+#include <backend/Platform.h>
+
 #include <utils/Hash.h>
 
 #include <tsl/robin_map.h>
 
+#include <functional>
+
 namespace filament {
 namespace backend {
 
@@ -92,8 +96,20 @@ public:
     // Retrieves or creates a VkRenderPass handle.
     VkRenderPass getRenderPass(RenderPassKey config) noexcept;
 
-    // Evicts old unused Vulkan objects. Call this once per frame.
-    void gc() noexcept;
+    // Bounds the number of framebuffers and render passes kept, see gc().
+    void setCacheBudgets(Platform::CacheBudgets const& budgets) noexcept {
+        mFramebufferBudget = budgets.framebuffers;
+        mRenderPassBudget = budgets.renderPasses;
+    }
+
+    // The hits, misses and evictions are counted since the last call to resetCounters().
+    CacheCounters getFramebufferCounters() const noexcept;
+    CacheCounters getRenderPassCounters() const noexcept;
+    void resetCounters() noexcept;
+
+    // Evicts old unused Vulkan objects, then the least recently used ones if the caches are over
+    // budget. Call this once per frame. The callback is invoked before a render pass is destroyed.
+    void gc(std::function<void(VkRenderPass)> const& onEvictRenderPass) noexcept;
 
     // Frees all Vulkan objects. Call this during shutdown before the device is destroyed.
     void reset() noexcept;
@@ -105,6 +121,10 @@ private:
     tsl::robin_map<VkRenderPass, uint32_t> mRenderPassRefCount;
     uint32_t mCurrentTime = 0;
     static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    Platform::CacheBudget mFramebufferBudget = Platform::CacheBudgets().framebuffers;
+    Platform::CacheBudget mRenderPassBudget = Platform::CacheBudgets().renderPasses;
+    CacheCounters mFramebufferCounters;
+    CacheCounters mRenderPassCounters;
 };
 
 } // namespace filament
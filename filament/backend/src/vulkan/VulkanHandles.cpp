@@ -201,7 +201,8 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, nullptr);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
+void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset,
+        uint32_t numBytes) {
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
     void* mapped;
     vmaMapMemory(mContext.allocator, stage->memory, &mapped);
@@ -209,8 +210,8 @@ void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
     vmaUnmapMemory(mContext.allocator, stage->memory);
     vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
 
-    auto copyToDevice = [this, numBytes, stage] (VulkanCommandBuffer& commands) {
-        VkBufferCopy region { .size = numBytes };
+    auto copyToDevice = [this, byteOffset, numBytes, stage] (VulkanCommandBuffer& commands) {
+        VkBufferCopy region { .dstOffset = byteOffset, .size = numBytes };
         vkCmdCopyBuffer(commands.cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
 
         // Ensure that the copy finishes before the next draw call.
@@ -100,8 +100,11 @@ VulkanSamplerCache::VulkanSamplerCache(VulkanContext& context) : mContext(contex
 VkSampler VulkanSamplerCache::getSampler(backend::SamplerParams params) noexcept {
     auto iter = mCache.find(params.u);
     if (UTILS_LIKELY(iter != mCache.end())) {
-        return iter->second;
+        mCounters.hits++;
+        iter.value().timestamp = mCurrentTime;
+        return iter->second.handle;
     }
+    mCounters.misses++;
     VkSamplerCreateInfo samplerInfo {
         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = getFilter(params.filterMag),
@@ -122,13 +125,42 @@ VkSampler VulkanSamplerCache::getSampler(backend::SamplerParams params) noexcept
     VkSampler sampler;
     VkResult error = vkCreateSampler(mContext.device, &samplerInfo, VKALLOC, &sampler);
     ASSERT_POSTCONDITION(!error, "Unable to create sampler.");
-    mCache.insert({params.u, sampler});
+    mCache.insert({params.u, {sampler, mCurrentTime}});
     return sampler;
 }
 
+CacheCounters VulkanSamplerCache::getCounters() const noexcept {
+    CacheCounters counters = mCounters;
+    counters.size = uint32_t(mCache.size());
+    return counters;
+}
+
+void VulkanSamplerCache::gc(std::function<void(VkSampler)> const& onEvict) noexcept {
+    mCurrentTime++;
+
+    std::vector<uint32_t> timestamps;
+    timestamps.reserve(mCache.size());
+    for (const auto& pair : mCache) {
+        timestamps.push_back(pair.second.timestamp);
+    }
+    const uint32_t evictTime = getEvictionTime(mCurrentTime, TIME_BEFORE_EVICTION, mBudget,
+            mCache.size(), timestamps);
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (decltype(mCache)::const_iterator iter = mCache.begin(); iter != mCache.end();) {
+        if (iter->second.timestamp < evictTime) {
+            onEvict(iter->second.handle);
+            vkDestroySampler(mContext.device, iter->second.handle, VKALLOC);
+            mCounters.evictions++;
+            iter = mCache.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
 void VulkanSamplerCache::reset() noexcept {
     for (auto pair : mCache) {
-        vkDestroySampler(mContext.device, pair.second, VKALLOC);
+        vkDestroySampler(mContext.device, pair.second.handle, VKALLOC);
     }
     mCache.clear();
 }
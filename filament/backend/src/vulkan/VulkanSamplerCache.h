@@ -20,8 +20,12 @@
 #include "VulkanContext.h"
 #include "VulkanUtility.h"
 
+#include <backend/Platform.h>
+
 #include <tsl/robin_map.h>
 
+#include <functional>
+
 namespace filament {
 namespace backend {
 
@@ -30,10 +34,30 @@ class VulkanSamplerCache {
 public:
     explicit VulkanSamplerCache(VulkanContext&);
     VkSampler getSampler(backend::SamplerParams params) noexcept;
+
+    // Bounds the number of samplers kept, see gc().
+    void setCacheBudget(Platform::CacheBudget budget) noexcept { mBudget = budget; }
+
+    // The hits, misses and evictions are counted since the last call to resetCounters().
+    CacheCounters getCounters() const noexcept;
+    void resetCounters() noexcept { mCounters = {}; }
+
+    // Evicts the least recently used samplers if the cache is over budget. Call this once per
+    // frame. The callback is invoked before a sampler is destroyed.
+    void gc(std::function<void(VkSampler)> const& onEvict) noexcept;
+
     void reset() noexcept;
 private:
+    struct SamplerVal {
+        VkSampler handle;
+        uint32_t timestamp;
+    };
     VulkanContext& mContext;
-    tsl::robin_map<uint32_t, VkSampler> mCache;
+    tsl::robin_map<uint32_t, SamplerVal> mCache;
+    uint32_t mCurrentTime = 0;
+    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    Platform::CacheBudget mBudget = Platform::CacheBudgets().samplers;
+    CacheCounters mCounters;
 };
 
 } // namespace filament
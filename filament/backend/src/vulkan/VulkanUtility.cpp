@@ -20,6 +20,8 @@
 
 #include <details/Texture.h> // for FTexture::getFormatSize
 
+#include <algorithm>
+
 namespace filament {
 namespace backend {
 
@@ -277,5 +279,38 @@ VkFrontFace getFrontFace(bool inverseFrontFaces) {
             VkFrontFace::VK_FRONT_FACE_CLOCKWISE : VkFrontFace::VK_FRONT_FACE_COUNTER_CLOCKWISE;
 }
 
+uint32_t getEvictionTime(uint32_t currentTime, uint32_t minAge, Platform::CacheBudget budget,
+        size_t size, std::vector<uint32_t>& timestamps) {
+    // Avoid wrapping unsigned integers during the first few frames.
+    if (currentTime <= minAge) {
+        return 0;
+    }
+    const uint32_t safeTime = currentTime - minAge;
+    uint32_t evictTime = 0;
+    if (budget.maxAge) {
+        const uint32_t maxAge = std::max(budget.maxAge, minAge);
+        evictTime = currentTime > maxAge ? currentTime - maxAge : 0;
+    }
+
+    // Objects evicted because of their age go last, followed by the objects used too recently.
+    auto first = timestamps.begin();
+    auto aged = std::partition(first, timestamps.end(),
+            [evictTime](uint32_t t) { return t >= evictTime; });
+    auto recent = std::partition(first, aged,
+            [safeTime](uint32_t t) { return t < safeTime; });
+    size -= std::distance(aged, timestamps.end());
+
+    if (size > budget.maxCount) {
+        const size_t excess = size - budget.maxCount;
+        if (excess >= size_t(std::distance(first, recent))) {
+            evictTime = safeTime;
+        } else {
+            std::nth_element(first, first + excess - 1, recent);
+            evictTime = first[excess - 1] + 1;
+        }
+    }
+    return evictTime;
+}
+
 } // namespace filament
 } // namespace backend
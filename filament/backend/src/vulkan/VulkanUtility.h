@@ -18,9 +18,12 @@
 #define TNT_FILAMENT_DRIVER_VULKANUTILITY_H
 
 #include <backend/DriverEnums.h>
+#include <backend/Platform.h>
 
 #include <bluevk/BlueVK.h>
 
+#include <vector>
+
 namespace filament {
 namespace backend {
 
@@ -33,6 +36,17 @@ VkBlendFactor getBlendFactor(BlendFunction mode);
 VkCullModeFlags getCullMode(CullingMode mode);
 VkFrontFace getFrontFace(bool inverseFrontFaces);
 
+// The caches of Vulkan objects evict the objects unused for more than the budget's maxAge frames,
+// then the least recently used objects until they hold no more than maxCount objects. Objects used
+// during the last minAge frames may be referenced by command buffers in flight and are never
+// evicted.
+// Given the last use of the objects that could be evicted (reordered by this function) and the
+// number of objects in the cache, returns the time before which the objects must be evicted.
+// Objects last used in the same frame are evicted together, so a few more objects than necessary
+// can be evicted.
+uint32_t getEvictionTime(uint32_t currentTime, uint32_t minAge, Platform::CacheBudget budget,
+        size_t size, std::vector<uint32_t>& timestamps);
+
 } // namespace filament
 } // namespace backend
 
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <backend/Platform.h>
+
+#include <utils/Path.h>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace filament::backend;
+using namespace utils;
+
+namespace {
+
+// Platform is abstract, only its blob cache is tested here
+class BlobCachePlatform : public Platform {
+public:
+    int getOSVersion() const noexcept override { return 0; }
+    Driver* createDriver(void*) noexcept override { return nullptr; }
+};
+
+class BlobCacheTest : public testing::Test {
+protected:
+    void SetUp() override {
+        mDirectory = Path::getCurrentExecutable().getParent() + Path("test_blob_cache");
+        mDirectory.mkdirRecursive();
+        clear();
+        mPlatform.setBlobCacheDirectory(mDirectory.c_str());
+    }
+
+    void TearDown() override {
+        clear();
+    }
+
+    void clear() {
+        for (Path file : mDirectory.listContents()) {
+            file.unlinkFile();
+        }
+    }
+
+    Path mDirectory;
+    BlobCachePlatform mPlatform;
+};
+
+} // anonymous namespace
+
+TEST_F(BlobCacheTest, Disabled) {
+    BlobCachePlatform platform;
+    EXPECT_FALSE(platform.hasBlobCache());
+
+    const uint32_t key = 1;
+    const uint8_t value[] = { 1, 2, 3 };
+    platform.insertBlob(&key, sizeof(key), value, sizeof(value));
+    EXPECT_EQ(platform.retrieveBlob(&key, sizeof(key), nullptr, 0), 0);
+    EXPECT_TRUE(mDirectory.listContents().empty());
+}
+
+TEST_F(BlobCacheTest, RoundTrip) {
+    EXPECT_TRUE(mPlatform.hasBlobCache());
+
+    const uint32_t key[] = { 1, 2, 3 };
+    const std::vector<uint8_t> value = { 4, 5, 6, 7, 8 };
+    mPlatform.insertBlob(key, sizeof(key), value.data(), value.size());
+
+    // the size can be queried with a null buffer
+    ASSERT_EQ(mPlatform.retrieveBlob(key, sizeof(key), nullptr, 0), value.size());
+
+    // the blob isn't copied into a buffer that's too small
+    std::vector<uint8_t> small(value.size() - 1, 0);
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), small.data(), small.size()), value.size());
+    EXPECT_EQ(small, std::vector<uint8_t>(value.size() - 1, 0));
+
+    std::vector<uint8_t> result(value.size());
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), result.data(), result.size()), value.size());
+    EXPECT_EQ(result, value);
+
+    // inserting with the same key replaces the blob
+    const std::vector<uint8_t> other = { 9, 10 };
+    mPlatform.insertBlob(key, sizeof(key), other.data(), other.size());
+    result.assign(other.size(), 0);
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), result.data(), result.size()), other.size());
+    EXPECT_EQ(result, other);
+
+    // no temporary file is left behind
+    EXPECT_EQ(mDirectory.listContents().size(), 1);
+}
+
+TEST_F(BlobCacheTest, MismatchedKey) {
+    const uint32_t key[] = { 1, 2, 3 };
+    const uint8_t value[] = { 4, 5, 6 };
+    mPlatform.insertBlob(key, sizeof(key), value, sizeof(value));
+
+    const uint32_t otherKey[] = { 1, 2, 4 };
+    EXPECT_EQ(mPlatform.retrieveBlob(otherKey, sizeof(otherKey), nullptr, 0), 0);
+
+    // a key that's a prefix of the stored key doesn't match either
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key) - sizeof(uint32_t), nullptr, 0), 0);
+
+    // the blob's file starts with the key, a hash collision must be a miss: store the file of
+    // the first key under the name of the second
+    std::vector<Path> files = mDirectory.listContents();
+    ASSERT_EQ(files.size(), 1);
+    mPlatform.insertBlob(otherKey, sizeof(otherKey), value, sizeof(value));
+    files = mDirectory.listContents();
+    ASSERT_EQ(files.size(), 2);
+    std::vector<char> content[2];
+    for (size_t i = 0; i < 2; i++) {
+        std::ifstream in(files[i].getPath(), std::ios::binary);
+        content[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    for (size_t i = 0; i < 2; i++) {
+        std::ofstream out(files[i].getPath(), std::ios::binary | std::ios::trunc);
+        out.write(content[1 - i].data(), content[1 - i].size());
+    }
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), nullptr, 0), 0);
+    EXPECT_EQ(mPlatform.retrieveBlob(otherKey, sizeof(otherKey), nullptr, 0), 0);
+}
+
+TEST_F(BlobCacheTest, TruncatedFile) {
+    const uint32_t key[] = { 1, 2, 3 };
+    const uint8_t value[] = { 4, 5, 6 };
+    mPlatform.insertBlob(key, sizeof(key), value, sizeof(value));
+
+    std::vector<Path> files = mDirectory.listContents();
+    ASSERT_EQ(files.size(), 1);
+    std::vector<char> content;
+    {
+        std::ifstream in(files[0].getPath(), std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // the file holds the size of the key, the key, then the blob
+    ASSERT_EQ(content.size(), sizeof(uint32_t) + sizeof(key) + sizeof(value));
+
+    // truncated in the key, or right after it: there's no blob
+    for (size_t size : { size_t(0), sizeof(uint32_t) / 2, sizeof(uint32_t) + sizeof(key) / 2,
+            sizeof(uint32_t) + sizeof(key) }) {
+        std::ofstream out(files[0].getPath(), std::ios::binary | std::ios::trunc);
+        out.write(content.data(), size);
+        out.close();
+        EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), nullptr, 0), 0) << size;
+    }
+
+    // an empty blob can't be stored
+    mPlatform.insertBlob(key, sizeof(key), value, 0);
+    EXPECT_EQ(mPlatform.retrieveBlob(key, sizeof(key), nullptr, 0), 0);
+}
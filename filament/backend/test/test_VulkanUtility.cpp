@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vulkan/VulkanUtility.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace filament::backend;
+
+namespace {
+
+// The caches evict the objects last used before the returned time
+size_t countEvicted(std::vector<uint32_t> const& timestamps, uint32_t evictTime) {
+    return size_t(std::count_if(timestamps.begin(), timestamps.end(),
+            [evictTime](uint32_t t) { return t < evictTime; }));
+}
+
+} // anonymous namespace
+
+TEST(VulkanUtilityTest, EvictionDuringFirstFrames) {
+    // nothing is evicted until the current time is past the minimum age, whatever the budget
+    std::vector<uint32_t> timestamps = { 0, 1, 2 };
+    EXPECT_EQ(getEvictionTime(0, 2, { 1, 0 }, timestamps.size(), timestamps), 0);
+    EXPECT_EQ(getEvictionTime(2, 2, { 1, 0 }, timestamps.size(), timestamps), 0);
+}
+
+TEST(VulkanUtilityTest, EvictionByAge) {
+    // with maxAge == 0 the objects are kept for as long as the cache is within its budget
+    std::vector<uint32_t> timestamps = { 1, 5, 9 };
+    uint32_t evictTime = getEvictionTime(10, 2, { 0, 10 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 0);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 0);
+
+    timestamps = { 1, 5, 9 };
+    evictTime = getEvictionTime(10, 2, { 4, 10 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 6);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 2);
+
+    // objects are never evicted before the minimum age, even with a smaller maxAge
+    timestamps = { 1, 5, 9 };
+    evictTime = getEvictionTime(10, 2, { 1, 10 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 8);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 2);
+}
+
+TEST(VulkanUtilityTest, EvictionByCount) {
+    // the least recently used objects are evicted first
+    std::vector<uint32_t> timestamps = { 6, 1, 7, 5, 4 };
+    uint32_t evictTime = getEvictionTime(10, 2, { 0, 3 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 5);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 2);
+
+    // the objects evicted because of their age count towards the budget
+    timestamps = { 1, 5, 6, 7, 9 };
+    evictTime = getEvictionTime(10, 2, { 4, 2 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 7);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 3);
+}
+
+TEST(VulkanUtilityTest, EvictionTies) {
+    // objects last used in the same frame are evicted together
+    std::vector<uint32_t> timestamps = { 3, 6, 3, 3 };
+    uint32_t evictTime = getEvictionTime(10, 2, { 0, 3 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 4);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 3);
+}
+
+TEST(VulkanUtilityTest, EvictionOfRecentObjects) {
+    // the objects used recently are kept, and the cache stays over budget
+    std::vector<uint32_t> timestamps = { 8, 9, 10 };
+    uint32_t evictTime = getEvictionTime(10, 2, { 1, 1 }, timestamps.size(), timestamps);
+    EXPECT_EQ(evictTime, 8);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 0);
+
+    // the objects that can't be evicted (e.g. bound ones) count towards the budget
+    timestamps = { 1, 2, 9 };
+    evictTime = getEvictionTime(10, 2, { 0, 3 }, timestamps.size() + 3, timestamps);
+    EXPECT_EQ(evictTime, 8);
+    EXPECT_EQ(countEvicted(timestamps, evictTime), 2);
+}
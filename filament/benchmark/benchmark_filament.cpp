@@ -21,14 +21,37 @@
 
 #include <filament/Box.h>
 #include <filament/Frustum.h>
+#include "components/TransformManager.h"
+
+#include "details/Allocators.h"
 #include "details/Culler.h"
 
+#include "fg/FrameGraph.h"
+#include "fg/FrameGraphCache.h"
+#include "fg/FrameGraphPassResources.h"
+#include "fg/ResourceAllocator.h"
+
+#include "private/backend/CommandStream.h"
+
+#include "RenderPass.h"
+#include "UniformBuffer.h"
+
+#include <backend/Platform.h>
+
+#include <private/filament/UniformInterfaceBlock.h>
+
 #include <utils/Allocator.h>
+#include <utils/CString.h>
+#include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 
+#include <algorithm>
 #include <vector>
 #include <random>
+#include <string>
 
 using namespace filament;
+using namespace filament::backend;
 using namespace filament::details;
 using namespace filament::math;
 using namespace utils;
@@ -104,3 +127,367 @@ BENCHMARK_F(FilamentFixture, sphereCulling)(benchmark::State& state) {
         state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
     }
 }
+
+// The benchmarks below run a specific culling kernel, the argument is a Culler::Isa
+
+static const char* isaName(Culler::Isa isa) {
+    switch (isa) {
+        case Culler::Isa::GENERIC:  return "generic";
+        case Culler::Isa::SSE2:     return "sse2";
+        case Culler::Isa::AVX2:     return "avx2";
+        case Culler::Isa::NEON:     return "neon";
+    }
+    return "";
+}
+
+BENCHMARK_DEFINE_F(FilamentFixture, boxCullingIsa)(benchmark::State& state) {
+    const Culler::Isa isa = Culler::Isa(state.range(0));
+    if (!Culler::Test::isSupported(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    state.SetLabel(isaName(isa));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            Culler::Test::intersects(visibles, frustum,
+                    boxesCenter.data(), boxesExtent.data(), BATCH_SIZE, isa);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+    }
+}
+
+BENCHMARK_DEFINE_F(FilamentFixture, sphereCullingIsa)(benchmark::State& state) {
+    const Culler::Isa isa = Culler::Isa(state.range(0));
+    if (!Culler::Test::isSupported(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    state.SetLabel(isaName(isa));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            Culler::Test::intersects(visibles, frustum, spheres.data(), BATCH_SIZE, isa);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+    }
+}
+
+BENCHMARK_REGISTER_F(FilamentFixture, boxCullingIsa)->DenseRange(
+        int(Culler::Isa::GENERIC), int(Culler::Isa::NEON));
+
+BENCHMARK_REGISTER_F(FilamentFixture, sphereCullingIsa)->DenseRange(
+        int(Culler::Isa::GENERIC), int(Culler::Isa::NEON));
+
+class CommandSortFixture : public benchmark::Fixture {
+protected:
+    using Command = RenderPass::Command;
+
+    // large enough for the biggest benchmark below
+    static constexpr size_t ARENA_SIZE = 16 * 1024 * 1024;
+
+    std::vector<Command> reference;
+    std::vector<Command> commands;
+    LinearAllocatorArena arena{ "CommandSortFixture", ARENA_SIZE };
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        std::default_random_engine gen; // NOLINT
+        std::uniform_int_distribution<uint32_t> material(0, 255);
+        std::uniform_int_distribution<uint32_t> instance(0, 1023);
+        std::uniform_int_distribution<uint32_t> zbucket(0, 1023);
+
+        // The layout of these keys mimics a color pass without depth pre-pass:
+        // one out of two commands is discarded, and pass/blending/priority are constant.
+        const size_t count = size_t(state.range(0));
+        reference.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            Command& cmd = reference[i];
+            if (i & 1) {
+                cmd.key = uint64_t(RenderPass::Pass::SENTINEL);
+            } else {
+                cmd.key = uint64_t(RenderPass::Pass::COLOR);
+                cmd.key |= RenderPass::makeField(zbucket(gen),
+                        RenderPass::Z_BUCKET_MASK, RenderPass::Z_BUCKET_SHIFT);
+                cmd.key |= RenderPass::makeMaterialSortingKey(material(gen), instance(gen));
+            }
+            cmd.primitive.index = uint16_t(i);
+        }
+        commands.resize(count);
+    }
+};
+
+BENCHMARK_DEFINE_F(CommandSortFixture, stdSort)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::copy(reference.begin(), reference.end(), commands.begin());
+            state.ResumeTiming();
+            std::sort(commands.begin(), commands.end());
+            benchmark::DoNotOptimize(std::partition_point(commands.begin(), commands.end(),
+                    [](Command const& c) {
+                        return ((c.key & RenderPass::PASS_MASK) >> RenderPass::PASS_SHIFT) != 0xFF;
+                    }));
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_DEFINE_F(CommandSortFixture, radixSort)(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::copy(reference.begin(), reference.end(), commands.begin());
+            state.ResumeTiming();
+            filament::details::ArenaScope scope(arena);
+            benchmark::DoNotOptimize(RenderPass::sortCommands(js, scope,
+                    commands.data(), commands.data() + commands.size()));
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    js.emancipate();
+}
+
+BENCHMARK_REGISTER_F(CommandSortFixture, stdSort)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(CommandSortFixture, radixSort)->Arg(1000)->Arg(10000)->Arg(100000);
+
+class FrameGraphFixture : public benchmark::Fixture {
+protected:
+    // number of post-processing passes following the color pass
+    static constexpr size_t POST_PROCESS_PASS_COUNT = 8;
+
+    Backend backend = Backend::NOOP;
+    DefaultPlatform* platform = DefaultPlatform::create(&backend);
+    CircularBuffer buffer{ 1024 * 1024 };
+    CommandStream driverApi{ *platform->createDriver(nullptr), buffer };
+    ResourceAllocator resourceAllocator;
+    FrameGraphCache cache;
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource color;
+        FrameGraphResource depth;
+    };
+
+    // a depth pre-pass and a color pass followed by a post-processing chain, similar to what
+    // the renderer declares every frame
+    static void buildGraph(FrameGraph& fg) {
+        auto& depthPrepass = fg.addPass<PassData>("depth prepass",
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    FrameGraphResource::Descriptor desc{ .width = 1920, .height = 1080 };
+                    desc.format = TextureFormat::DEPTH24;
+                    data.depth = builder.createTexture("depth buffer", desc);
+                    FrameGraphRenderTarget::Descriptor outputDesc{};
+                    outputDesc.attachments.textures[1] = data.depth;
+                    data.depth = builder.useRenderTarget("depth target", outputDesc).textures[1];
+                },
+                [](FrameGraphPassResources const&, PassData const&, DriverApi&) {});
+
+        auto& colorPass = fg.addPass<PassData>("color pass",
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    FrameGraphResource::Descriptor desc{ .width = 1920, .height = 1080 };
+                    desc.format = TextureFormat::RGBA16F;
+                    data.color = builder.createTexture("color buffer", desc);
+                    FrameGraphRenderTarget::Descriptor outputDesc{};
+                    outputDesc.attachments.textures[0] = data.color;
+                    outputDesc.attachments.textures[1] = depthPrepass.getData().depth;
+                    auto attachments = builder.useRenderTarget("color target", outputDesc);
+                    data.color = attachments.textures[0];
+                    data.depth = attachments.textures[1];
+                },
+                [](FrameGraphPassResources const&, PassData const&, DriverApi&) {});
+
+        FrameGraphResource input = colorPass.getData().color;
+        for (size_t i = 0; i < POST_PROCESS_PASS_COUNT; i++) {
+            auto& pass = fg.addPass<PassData>("post-process",
+                    [&](FrameGraph::Builder& builder, PassData& data) {
+                        FrameGraphResource::Descriptor desc = builder.getDescriptor(input);
+                        data.input = builder.read(input);
+                        data.color = builder.createTexture("post-process output", desc);
+                        data.color = builder.useRenderTarget(data.color).textures[0];
+                    },
+                    [](FrameGraphPassResources const& resources, PassData const& data,
+                            DriverApi&) {
+                        benchmark::DoNotOptimize(resources.getTexture(data.input));
+                        benchmark::DoNotOptimize(resources.getRenderTarget(data.color));
+                    });
+            input = pass.getData().color;
+        }
+        fg.present(input);
+    }
+
+public:
+    ~FrameGraphFixture() override {
+        resourceAllocator.terminate(driverApi);
+    }
+};
+
+// Arg 0: the graph is compiled every frame, Arg 1: the compiled graph is reused
+BENCHMARK_DEFINE_F(FrameGraphFixture, compileAndExecute)(benchmark::State& state) {
+    FrameGraphCache* const frameGraphCache = state.range(0) ? &cache : nullptr;
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            FrameGraph fg(resourceAllocator, frameGraphCache);
+            buildGraph(fg);
+            fg.compile();
+            fg.execute(driverApi);
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+    }
+}
+
+BENCHMARK_REGISTER_F(FrameGraphFixture, compileAndExecute)->Arg(0)->Arg(1);
+
+class TransformManagerFixture : public benchmark::Fixture {
+protected:
+    JobSystem js;
+    FTransformManager tcm{ &js };
+    std::vector<Entity> entities;
+    std::vector<TransformManager::Instance> instances;
+    std::vector<mat4f> transforms;
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        js.adopt();
+
+        // the entities are attached to 100 roots, like bodies simulated in a few scenes
+        const size_t count = size_t(state.range(0));
+        entities.resize(count);
+        EntityManager::get().create(count, entities.data());
+        for (size_t i = 0; i < count; i++) {
+            tcm.create(entities[i], i < 100 ? TransformManager::Instance{} :
+                    tcm.getInstance(entities[i % 100]), mat4f{});
+        }
+        tcm.openLocalTransformTransaction();
+        tcm.commitLocalTransformTransaction();
+
+        instances.resize(count);
+        transforms.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            instances[i] = tcm.getInstance(entities[i]);
+            transforms[i] = mat4f::translation(float3{ float(i), 0, 0 });
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        for (Entity e : entities) {
+            tcm.destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        js.emancipate();
+    }
+};
+
+BENCHMARK_DEFINE_F(TransformManagerFixture, setTransform)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            tcm.openLocalTransformTransaction();
+            for (size_t i = 0, c = instances.size(); i < c; i++) {
+                tcm.setTransform(instances[i], transforms[i]);
+            }
+            tcm.commitLocalTransformTransaction();
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_DEFINE_F(TransformManagerFixture, setTransforms)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            tcm.setTransforms(instances.data(), transforms.data(), instances.size());
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_REGISTER_F(TransformManagerFixture, setTransform)->Arg(1000)->Arg(10000);
+BENCHMARK_REGISTER_F(TransformManagerFixture, setTransforms)->Arg(1000)->Arg(10000);
+
+// Sets every parameter of a material instance, by name, as MaterialInstance::setParameter(name)
+// does, and from offsets resolved ahead of time, as Material::getParameterHandle() does.
+class MaterialParameterFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t PARAMETER_COUNT = 32;
+
+    UniformInterfaceBlock uib;
+    UniformBuffer uniforms;
+    std::vector<CString> names;
+    std::vector<size_t> offsets;
+    std::vector<float4> values;
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        UniformInterfaceBlock::Builder builder;
+        builder.name("MaterialParams");
+        for (size_t i = 0; i < PARAMETER_COUNT; i++) {
+            names.emplace_back(("materialParams" + std::to_string(i)).c_str());
+            builder.add(names.back(), 1, UniformInterfaceBlock::Type::FLOAT4);
+        }
+        uib = builder.build();
+        uniforms = UniformBuffer(uib.getSize());
+
+        for (size_t i = 0; i < PARAMETER_COUNT; i++) {
+            offsets.push_back(uib.getUniformInfo(names[i].c_str())->getBufferOffset());
+            values.push_back(float4{ float(i) });
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        names.clear();
+        offsets.clear();
+        values.clear();
+    }
+};
+
+BENCHMARK_F(MaterialParameterFixture, setParameterByName)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            for (size_t i = 0; i < PARAMETER_COUNT; i++) {
+                ssize_t offset = uib.getUniformOffset(names[i].c_str(), 0);
+                if (offset >= 0) {
+                    uniforms.setUniform(size_t(offset), values[i]);
+                }
+            }
+            uniforms.clean();
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * PARAMETER_COUNT);
+    }
+}
+
+BENCHMARK_F(MaterialParameterFixture, setParameterByHandle)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            for (size_t i = 0; i < PARAMETER_COUNT; i++) {
+                uniforms.setUniform(offsets[i], values[i]);
+            }
+            uniforms.clean();
+        }
+        benchmark::ClobberMemory();
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * PARAMETER_COUNT);
+    }
+}
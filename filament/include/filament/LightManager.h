@@ -117,6 +117,9 @@ class FLightManager;
  * It therefore makes sense to provide artists with a parameter to disable this coupling. This
  * is the difference between Type.SPOT and Type.FOCUSED_SPOT.
  *
+ * Spot lights are able to cast shadows. Their shadow maps are packed in a shadow atlas with
+ * the directional light's, see View::setShadowAtlasOptions().
+ *
  * @see Builder.position(), Builder.direction(), Builder.falloff(), Builder.spotLightCone()
  *
  * Performance considerations
@@ -176,7 +179,9 @@ public:
      * Control the quality / performance of the shadow map associated to this light
      */
     struct ShadowOptions {
-        /** Size of the shadow map in texels. Must be a power-of-two. */
+        /** Size of the shadow map in texels. Must be a power-of-two. For spot lights this is the
+         * largest size of the shadow map, its actual size depends on the light's size on screen.
+         */
         uint32_t mapSize = 1024;
 
         /** Constant bias in world units (e.g. meters) by which shadows are moved away from the
@@ -232,6 +237,107 @@ public:
          * Setting this value correctly is essential for LISPSM shadow-maps.
          */
         float polygonOffsetSlope = 2.0f;
+
+        /**
+         * Number of shadow cascades to use for this light. Must be between 1 and 4 (inclusive).
+         * A value greater than 1 turns on cascaded shadow mapping (CSM).
+         * Only applicable to Type::SUN or Type::DIRECTIONAL lights.
+         *
+         * When using shadow cascades, cascadeSplitPositions must also be set.
+         *
+         * Each cascade is rendered in its own mapSize x mapSize tile of the shadow map.
+         *
+         * @see ShadowOptions::cascadeSplitPositions
+         */
+        uint8_t shadowCascades = 1;
+
+        /**
+         * The split positions for shadow cascades.
+         *
+         * Cascaded shadow mapping (CSM) partitions the camera frustum into cascades. These values
+         * determine the planes along the camera's Z axis to split the frustum. The camera near
+         * plane is represented by 0.0f and the far plane (or shadowFar if set) by 1.0f.
+         *
+         * For example, if using 4 cascades, these values would set a uniform split scheme:
+         * { 0.25f, 0.50f, 0.75f }
+         *
+         * For N cascades, N - 1 split positions will be read from this array, they must be
+         * in increasing order.
+         *
+         * Filament provides utility methods inside LightManager::ShadowCascades to help set these
+         * values. For example, to use a uniform split scheme:
+         *
+         * ~~~~~~~~~~~{.cpp}
+         *   LightManager::ShadowCascades::computeUniformSplits(options.cascadeSplitPositions, 4);
+         * ~~~~~~~~~~~
+         *
+         * @see ShadowCascades::computeUniformSplits
+         * @see ShadowCascades::computeLogSplits
+         * @see ShadowCascades::computePracticalSplits
+         */
+        float cascadeSplitPositions[3] = { 0.125f, 0.25f, 0.50f };
+
+        /**
+         * Whether the shadow map can be reused across frames. When enabled, the shadow map is
+         * rendered again only when the light, the fitting of the shadow map to the camera or the
+         * shadow casters (their transforms, geometry and material instances) change.
+         * Only applicable to Type::SUN or Type::DIRECTIONAL lights.
+         *
+         * Changes to the content of vertex buffers or to the parameters of material instances
+         * are not detected. Skinned shadow casters disable caching for the frames they're
+         * visible in.
+         */
+        bool shadowCaching = false;
+    };
+
+    /**
+     * Utilities to compute the ShadowOptions::cascadeSplitPositions of a cascaded shadow map.
+     */
+    struct ShadowCascades {
+        /**
+         * Utility method to compute ShadowOptions::cascadeSplitPositions according to a uniform
+         * split scheme.
+         *
+         * @param splitPositions    a float array of at least size (cascades - 1) to write the split
+         *                          positions into
+         * @param cascades          the number of shadow cascades, at most 4
+         */
+        static void computeUniformSplits(float* splitPositions, uint8_t cascades);
+
+        /**
+         * Utility method to compute ShadowOptions::cascadeSplitPositions according to a
+         * logarithmic split scheme.
+         *
+         * @param splitPositions    a float array of at least size (cascades - 1) to write the split
+         *                          positions into
+         * @param cascades          the number of shadow cascades, at most 4
+         * @param near              the camera near plane, a near plane at 0 is treated as a very
+         *                          small positive value
+         * @param far               the camera far plane (or shadowFar)
+         */
+        static void computeLogSplits(float* splitPositions, uint8_t cascades,
+                float near, float far);
+
+        /**
+         * Utility method to compute ShadowOptions::cascadeSplitPositions according to a
+         * practical split scheme.
+         *
+         * The practical split scheme uses a lambda value to interpolate between the
+         * logarithmic and uniform split schemes. Start with a lambda value of 0.5f and adjust
+         * for your scene.
+         *
+         * See: Zhang et al 2006, "Parallel-split shadow maps for large-scale virtual environments"
+         *
+         * @param splitPositions    a float array of at least size (cascades - 1) to write the split
+         *                          positions into
+         * @param cascades          the number of shadow cascades, at most 4
+         * @param near              the camera near plane
+         * @param far               the camera far plane (or shadowFar)
+         * @param lambda            a float in the range [0, 1] that interpolates between log and
+         *                          uniform split schemes
+         */
+        static void computePracticalSplits(float* splitPositions, uint8_t cascades,
+                float near, float far, float lambda);
     };
 
     //! Use Builder to construct a Light object instance
@@ -258,7 +364,10 @@ public:
          * @return This Builder, for chaining calls.
          *
          * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * - Only Type.DIRECTIONAL, Type.SUN, Type.SPOT and Type.FOCUSED_SPOT lights can cast
+         *   shadows
+         * - At most CONFIG_MAX_SHADOWED_SPOT_LIGHTS (16) spot lights have shadows in a View,
+         *   the ones with the largest size on screen
          */
         Builder& castShadows(bool enable) noexcept;
 
@@ -114,6 +114,38 @@ public:
         friend class details::FMaterial;
     };
 
+    /**
+     * A material is rendered with a different program, called a variant, for each combination
+     * of the features below that it's used with.
+     */
+    using VariantMask = uint8_t;
+    static constexpr VariantMask DIRECTIONAL_LIGHTING = 0x01;  //!< the scene has a directional light
+    static constexpr VariantMask DYNAMIC_LIGHTING     = 0x02;  //!< the scene has point or spot lights
+    static constexpr VariantMask SHADOW_RECEIVER      = 0x04;  //!< the renderable receives shadows
+    static constexpr VariantMask SKINNING             = 0x08;  //!< the renderable is skinned
+    static constexpr VariantMask ALL_VARIANTS         = 0x0F;
+
+    //! Callback invoked when the variants requested with compile() are ready.
+    using CompileCallback = void(*)(void* user);
+
+    /**
+     * Compiles variants of this material ahead of time.
+     *
+     * A variant is compiled the first time it's needed. Until it's ready, renderables are drawn
+     * with a variant of this material that has fewer lighting or shadowing features, when one is
+     * available, so that rendering doesn't wait for the compilation. Compiling the variants
+     * ahead of time, for instance when a scene is loaded, avoids both.
+     *
+     * The variants are compiled asynchronously by the backend.
+     *
+     * @param variants  The variants with a subset of these features are compiled.
+     * @param callback  Called when the variants are ready, on the thread calling Engine::flush()
+     *                  or Renderer::endFrame(). Can be nullptr.
+     * @param user      Passed to the callback.
+     */
+    void compile(VariantMask variants = ALL_VARIANTS,
+            CompileCallback callback = nullptr, void* user = nullptr) noexcept;
+
     /**
      * Creates a new instance of this material. Material instances should be freed using
      * Engine::destroy(const MaterialInstance*).
@@ -186,6 +218,21 @@ public:
     //! Indicates whether a parameter of the given name exists on this material.
     bool hasParameter(const char* name) const noexcept;
 
+    using ParameterHandle = MaterialInstance::ParameterHandle;
+
+    /**
+     * Resolves a parameter of this material ahead of time. The handle can then be passed to
+     * MaterialInstance::setParameter() on any instance of this material, which avoids looking
+     * up the parameter by name every time it's set.
+     *
+     * @param name The name of the material parameter
+     *
+     * @return A handle to the parameter, invalid if the parameter doesn't exist.
+     *
+     * @see MaterialInstance::ParameterHandle::isValid()
+     */
+    ParameterHandle getParameterHandle(const char* name) const noexcept;
+
     /**
      * Sets the value of the given parameter on this material's default instance.
      *
@@ -21,8 +21,12 @@
 #include <filament/Color.h>
 #include <filament/TextureSampler.h>
 
+#include <backend/DriverEnums.h>
+
 #include <utils/compiler.h>
 
+#include <stdint.h>
+
 namespace filament {
 
 class Material;
@@ -30,8 +34,50 @@ class Texture;
 class UniformBuffer;
 class UniformInterfaceBlock;
 
+namespace details {
+class FMaterial;
+class FMaterialInstance;
+} // namespace details
+
 class UTILS_PUBLIC MaterialInstance : public FilamentAPI {
 public:
+    /**
+     * A parameter of a Material, resolved by Material::getParameterHandle().
+     *
+     * Setting a parameter with its handle doesn't look up its name, which makes it cheaper
+     * when parameters are updated every frame. A handle can be used with all the instances of
+     * the Material that created it, and only with those.
+     */
+    class ParameterHandle {
+    public:
+        ParameterHandle() noexcept = default;
+
+        //! Indicates whether the parameter exists on the Material that created this handle.
+        bool isValid() const noexcept { return mOffset != INVALID; }
+
+        //! Indicates whether the parameter is a sampler (texture).
+        bool isSampler() const noexcept { return mIsSampler; }
+
+        //! Size of the parameter when the parameter is an array, 1 otherwise.
+        uint32_t getCount() const noexcept { return mCount; }
+
+        /**
+         * Type of the parameter when it isn't a sampler. Setting the parameter with a value of
+         * another type is an error.
+         */
+        backend::UniformType getType() const noexcept { return mType; }
+
+    private:
+        friend class details::FMaterial;
+        friend class details::FMaterialInstance;
+        static constexpr uint32_t INVALID = 0xFFFFFFFFu;
+        uint32_t mMaterialId = 0;
+        uint32_t mOffset = INVALID;     // offset in bytes in the uniform buffer, or sampler index
+        uint32_t mCount = 0;
+        backend::UniformType mType = backend::UniformType::FLOAT;
+        bool mIsSampler = false;
+    };
+
     /**
      * @return the Material associated with this instance
      */
@@ -91,6 +137,58 @@ public:
      */
     void setParameter(const char* name, RgbaType type, math::float4 color) noexcept;
 
+    /**
+     * Set a uniform from its handle
+     *
+     * @param handle    Handle of the parameter, returned by Material::getParameterHandle().
+     * @param value     Value of the parameter to set.
+     * @note This is a no-op if the handle is not valid.
+     */
+    template<typename T>
+    void setParameter(ParameterHandle handle, T value) noexcept;
+
+    /**
+     * Set a uniform array from its handle
+     *
+     * @param handle    Handle of the parameter array, returned by Material::getParameterHandle().
+     * @param values    Array of values to set to the parameter array.
+     * @param count     Size of the array to set.
+     * @note This is a no-op if the handle is not valid.
+     */
+    template<typename T>
+    void setParameter(ParameterHandle handle, const T* values, size_t count) noexcept;
+
+    /**
+     * Set a texture as the parameter of the given handle
+     *
+     * @param handle    Handle of the parameter, returned by Material::getParameterHandle().
+     * @param texture   Non nullptr Texture object pointer.
+     * @param sampler   Sampler parameters.
+     * @note This is a no-op if the handle is not valid.
+     */
+    void setParameter(ParameterHandle handle,
+            Texture const* texture, TextureSampler const& sampler) noexcept;
+
+    /**
+     * Set an RGB color as the parameter of the given handle.
+     * A conversion might occur depending on the specified type
+     *
+     * @param handle    Handle of the parameter, returned by Material::getParameterHandle().
+     * @param type      Whether the color value is encoded as Linear or sRGB.
+     * @param color     Array of read, green, blue channels values.
+     */
+    void setParameter(ParameterHandle handle, RgbType type, math::float3 color) noexcept;
+
+    /**
+     * Set an RGBA color as the parameter of the given handle.
+     * A conversion might occur depending on the specified type
+     *
+     * @param handle    Handle of the parameter, returned by Material::getParameterHandle().
+     * @param type      Whether the color value is encoded as Linear or sRGB/A.
+     * @param color     Array of read, green, blue and alpha channels values.
+     */
+    void setParameter(ParameterHandle handle, RgbaType type, math::float4 color) noexcept;
+
     /**
      * Set up a custom scissor rectangle; by default this encompasses the View.
      * 
@@ -49,6 +49,12 @@ public:
     using Instance = utils::EntityInstance<RenderableManager>;
     using PrimitiveType = backend::PrimitiveType;
 
+    // Maximum number of levels of detail of a Renderable, including level 0
+    static constexpr size_t MAX_LOD_COUNT = 8;
+
+    // Maximum number of instances of a Renderable, see Builder::instances()
+    static constexpr size_t MAX_INSTANCE_COUNT = 65535;
+
     bool hasComponent(utils::Entity e) const noexcept;
 
     Instance getInstance(utils::Entity e) const noexcept;
@@ -74,18 +80,65 @@ public:
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
         Builder& material(size_t index, MaterialInstance const* materialInstance) noexcept;
+
+        /**
+         * Specifies the geometry of a primitive for a level of detail other than 0, the
+         * geometry(size_t, ...) overloads above set level 0, which is the most detailed one.
+         * Primitives of a level that have no geometry are not rendered, in particular a level
+         * without any geometry hides the Renderable.
+         *
+         * @param level Level of detail, between 0 and MAX_LOD_COUNT - 1.
+         * @param index Index of the primitive, between 0 and the count passed to the Builder.
+         */
+        Builder& geometry(uint8_t level, size_t index, PrimitiveType type,
+                VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
+
+        // The material of a primitive for a given level of detail, defaults to the material
+        // of the same primitive in level 0.
+        Builder& material(uint8_t level, size_t index,
+                MaterialInstance const* materialInstance) noexcept;
+
+        /**
+         * Enables a level of detail. Level 'level' is selected when the Renderable's bounding
+         * sphere covers less than 'screenCoverage' of the viewport's height, unless a coarser
+         * level also qualifies. Screen coverages must be decreasing with the level, and level 0
+         * is used when no other level qualifies. See also View::setLodBias().
+         *
+         * @param level Level of detail, between 1 and MAX_LOD_COUNT - 1.
+         * @param screenCoverage Fraction of the viewport's height, e.g. 0.25.
+         */
+        Builder& levelOfDetail(uint8_t level, float screenCoverage) noexcept;
         // The axis aligned bounding box of the Renderable. Mandatory unless culling is disabled.
         Builder& boundingBox(const Box& axisAlignedBoundingBox) noexcept;
         Builder& layerMask(uint8_t select, uint8_t values) noexcept;
         // The priority is clamped to the range [0..7], defaults to 4; 7 is lowest priority
         Builder& priority(uint8_t priority) noexcept;
         Builder& culling(bool enable) noexcept; // true by default
+        // Whether this renderable hides what's behind it when occlusion culling is enabled on
+        // the View (see View::setOcclusionCullingEnabled()). Occluders are approximated by their
+        // bounding box, so they must be opaque and fill it (e.g. walls, buildings).
+        Builder& occluder(bool enable) noexcept; // false by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
         Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
         Builder& skinning(size_t boneCount, Bone const* bones) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
 
+        /**
+         * Draws this Renderable 'instanceCount' times, each instance is transformed by its own
+         * transform, relative to the Renderable's transform. Instances are drawn with instanced
+         * draw calls, which is much more efficient than creating as many Renderables.
+         *
+         * The bounding box (see boundingBox()) is the one of a single instance, in its own
+         * space. Instances are culled in groups of consecutive instances, so spatially coherent
+         * instances cull better.
+         *
+         * @param instanceCount Number of instances, between 1 and MAX_INSTANCE_COUNT. 1 by default.
+         * @param transforms Transforms of the instances, identity if null.
+         */
+        Builder& instances(size_t instanceCount) noexcept;
+        Builder& instances(size_t instanceCount, math::mat4f const* transforms) noexcept;
+
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
@@ -142,19 +195,26 @@ public:
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
+    // Updates the instance transforms in the range [offset, offset + count).
+    // The instances must be pre-allocated using Builder::instances().
+    void setInstanceTransforms(Instance instance, math::mat4f const* transforms,
+            size_t count = 1, size_t offset = 0) noexcept;
 
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
+    // number of instances drawn for this renderable, see Builder::instances()
+    size_t getInstanceCount(Instance instance) const noexcept;
+
     // number of render primitives in this renderable
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
-    // set/change the material of a given render primitive
+    // set/change the material of a given render primitive, in all levels of detail
     void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept;
     MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
 
-    // set/change the geometry (vertex/index buffers) of a given primitive
+    // set/change the geometry (vertex/index buffers) of a given primitive of level of detail 0
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
             size_t offset, size_t count) noexcept;
@@ -163,7 +223,8 @@ public:
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
 
-    // set the blend order of the given primitive, only the first 15 bits are used
+    // set the blend order of the given primitive in all levels of detail, only the first 15 bits
+    // are used
     void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept;
 
     AttributeBitset getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept;
@@ -129,6 +129,28 @@ public:
      * @return Whether the given entity is in the Scene.
      */
     bool hasEntity(utils::Entity entity) const noexcept;
+
+    /**
+     * Enables or disables the culling hierarchy of this Scene.
+     *
+     * When enabled, the Scene maintains a bounding volume hierarchy of its Renderables, which
+     * allows frustum culling (both for the camera and the shadow casters) to reject or accept
+     * groups of Renderables at once. This is beneficial for large scenes where only a small
+     * fraction of the Renderables are visible at any given time, and that are mostly static.
+     *
+     * The hierarchy is rebuilt when entities are added to or removed from the Scene, so it is
+     * best to avoid doing so every frame. Disabled by default.
+     *
+     * @param enabled true to enable the culling hierarchy, false to disable it.
+     */
+    void setCullingHierarchyEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether the culling hierarchy is enabled.
+     *
+     * @return true if the culling hierarchy is enabled, false otherwise.
+     */
+    bool isCullingHierarchyEnabled() const noexcept;
 };
 
 } // namespace filament
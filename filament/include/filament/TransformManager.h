@@ -147,6 +147,44 @@ public:
      */
     void setTransform(Instance ci, const math::mat4f& localTransform) noexcept;
 
+    /**
+     * Sets the local transforms of many transform components at once.
+     *
+     * The local transforms are written first, and the world transforms of the components and
+     * of their descendants are then updated in a single pass, as
+     * commitLocalTransformTransaction() does. If a local transform transaction is open, the
+     * world transforms are only updated when it's committed.
+     *
+     * @param instances         Pointer to an array of "count" instances. Null instances are
+     *                          skipped.
+     * @param localTransforms   Pointer to an array of "count" local transforms (i.e. relative to
+     *                          the parent).
+     * @param count             Number of transforms to set.
+     *
+     * @note When no transaction is open, components can be reordered by this call, which
+     *       invalidates their Instance.
+     *
+     * @see setTransform(), commitLocalTransformTransaction()
+     */
+    void setTransforms(Instance const* instances,
+            math::mat4f const* localTransforms, size_t count) noexcept;
+
+    /**
+     * Sets the local transforms of many transform components at once, from their translation,
+     * rotation and scale. Each local transform is translation * rotation * scale.
+     *
+     * @param instances     Pointer to an array of "count" instances. Null instances are skipped.
+     * @param translations  Pointer to an array of "count" translations.
+     * @param rotations     Pointer to an array of "count" unit quaternions.
+     * @param scales        Pointer to an array of "count" scales.
+     * @param count         Number of transforms to set.
+     *
+     * @see setTransforms(Instance const*, math::mat4f const*, size_t)
+     */
+    void setTransforms(Instance const* instances,
+            math::float3 const* translations, math::quatf const* rotations,
+            math::float3 const* scales, size_t count) noexcept;
+
     /**
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
@@ -184,6 +222,11 @@ public:
      * Commits the currently open local transform transaction. When this returns, calls
      * to getWorldTransform() will return the proper value.
      *
+     * Only the world transforms of the components whose local transform changed, and of their
+     * descendants, are computed. Each level of the hierarchy is updated in parallel.
+     *
+     * @note Components can be reordered by this call, which invalidates their Instance.
+     *
      * @attention failing to call this method when done updating the local transform will cause
      *            a lot of rendering problems. The system never closes the transaction
      *            automatically.
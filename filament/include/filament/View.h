@@ -139,6 +139,24 @@ public:
         QualityLevel hdrColorBuffer = QualityLevel::HIGH; //!< quality of the color buffer
     };
 
+    /**
+     * Options of the shadow atlas, the depth texture all the shadow maps of a View are
+     * rendered in.
+     *
+     * The cascades of the directional light are always rendered at the resolution set by
+     * LightManager::ShadowOptions::mapSize. Each shadow casting spot light gets a shadow map
+     * sized from its projected size on screen, up to its own mapSize. When the shadow maps
+     * don't fit in the atlas, the largest shadow maps of the spot lights are made smaller
+     * first, down to minShadowMapSize, and then the spot lights that are the smallest on
+     * screen stop casting shadows.
+     *
+     * @see setShadowAtlasOptions, LightManager::ShadowOptions
+     */
+    struct ShadowAtlasOptions {
+        uint32_t maxSize = 4096;            //!< maximum width and height of the atlas, in texels
+        uint32_t minShadowMapSize = 128;    //!< minimum size of a spot light's shadow map
+    };
+
     /**
      * List of available post-processing anti-aliasing techniques.
      * @see setAntiAliasing, getAntiAliasing
@@ -343,6 +361,20 @@ public:
      */
     void setShadowsEnabled(bool enabled) noexcept;
 
+    /**
+     * Sets the budget of the texture the shadow maps of this view are rendered in.
+     * Refer to ShadowAtlasOptions for more information.
+     *
+     * @param options The shadow atlas options to use on this view
+     */
+    void setShadowAtlasOptions(ShadowAtlasOptions const& options) noexcept;
+
+    /**
+     * Returns the shadow atlas options used by this view.
+     * @return value set by setShadowAtlasOptions().
+     */
+    ShadowAtlasOptions getShadowAtlasOptions() const noexcept;
+
     /**
      * Specifies which buffers can be discarded before rendering.
      *
@@ -524,6 +556,45 @@ public:
      */
     bool isFrontFaceWindingInverted() const noexcept;
 
+    /**
+     * Enables or disables occlusion culling.
+     *
+     * When enabled, the renderables flagged as occluders (see
+     * RenderableManager::Builder::occluder()) are rasterized into a low resolution depth buffer
+     * on the CPU, and the renderables entirely hidden behind them are culled. This happens after
+     * frustum culling and doesn't affect shadow casters.
+     *
+     * Occlusion culling is disabled by default.
+     *
+     * @param enabled true to enable occlusion culling, false otherwise.
+     */
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether occlusion culling is enabled.
+     * See setOcclusionCullingEnabled() for more information.
+     */
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Sets the bias applied to the selection of the renderables' levels of detail (see
+     * RenderableManager::Builder::levelOfDetail()).
+     *
+     * Each unit of bias halves the screen coverage used to select the level of detail, so a
+     * positive bias selects coarser levels and a negative bias more detailed ones.
+     *
+     * The default bias is 0.
+     *
+     * @param bias level of detail bias, in powers of two of the screen coverage.
+     */
+    void setLodBias(float bias) noexcept;
+
+    /**
+     * Returns the level of detail bias.
+     * See setLodBias() for more information.
+     */
+    float getLodBias() const noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable frustum culling. (culling enabled by default).
@@ -18,23 +18,42 @@
 
 #include <math/fast.h>
 
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define FILAMENT_CULLER_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#   define FILAMENT_CULLER_SSE2 1
+#   if defined(__GNUC__) && !defined(WIN32)
+        // needs __builtin_cpu_supports()
+#       define FILAMENT_CULLER_AVX2 1
+#   endif
+#endif
+
 using namespace filament::math;
 
 namespace filament {
 namespace details {
 
-void Culler::intersects(
+namespace {
+
+using result_type = Culler::result_type;
+
+// ------------------------------------------------------------------------------------------------
+// Generic kernels
+// ------------------------------------------------------------------------------------------------
+
+void spheresGeneric(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT planes,
         float4 const* UTILS_RESTRICT b,
         size_t count) noexcept {
 
-    float4 const * const UTILS_RESTRICT planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allow the compiler to write 8
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -54,19 +73,16 @@ void Culler::intersects(
     }
 }
 
-void Culler::intersects(
+void boxesGeneric(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT planes,
         float3 const* UTILS_RESTRICT center,
         float3 const* UTILS_RESTRICT extent,
         size_t count, size_t bit) noexcept {
 
-    float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -88,6 +104,406 @@ void Culler::intersects(
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+// SSE2 kernels
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * The SIMD kernels below all work the same way: the objects are loaded and transposed in
+ * registers so that each register holds the x, y or z components of 4 (or 8) objects, the
+ * distance to each plane is then computed for all objects at once, in the same order as the
+ * generic kernels, so that all kernels produce the same results.
+ */
+
+#if FILAMENT_CULLER_SSE2
+
+// loads 4 float3 and transposes them into x, y and z
+UTILS_ALWAYS_INLINE
+inline void load3(float const* UTILS_RESTRICT p, __m128& x, __m128& y, __m128& z) noexcept {
+    const __m128 a = _mm_loadu_ps(p + 0);   // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(p + 4);   // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(p + 8);   // z2 x3 y3 z3
+    const __m128 t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));  // x2 y2 x3 y3
+    const __m128 t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 1));  // y0 z0 y1 y1
+    const __m128 t2 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));  // z0 z0 z1 z1
+    x = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm_shuffle_ps(t2, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+// converts the sign bits of 4 floats to 4 bytes, each shifted by 'shift'
+UTILS_ALWAYS_INLINE
+inline uint32_t toResults(__m128 visible, __m128i shift) noexcept {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_srli_epi32(_mm_castps_si128(visible), 31);
+    v = _mm_sll_epi32(v, shift);
+    v = _mm_packus_epi16(_mm_packs_epi32(v, zero), zero);
+    return uint32_t(_mm_cvtsi128_si32(v));
+}
+
+void spheresSSE2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (size_t j = 0; j < 6; j++) {
+        px[j] = _mm_set1_ps(planes[j].x);
+        py[j] = _mm_set1_ps(planes[j].y);
+        pz[j] = _mm_set1_ps(planes[j].z);
+        pw[j] = _mm_set1_ps(planes[j].w);
+    }
+    const __m128i shift = _mm_cvtsi32_si128(0);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(&b[i + 0].x);
+        __m128 y = _mm_loadu_ps(&b[i + 1].x);
+        __m128 z = _mm_loadu_ps(&b[i + 2].x);
+        __m128 w = _mm_loadu_ps(&b[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m128 dot = _mm_mul_ps(px[j], x);
+            dot = _mm_add_ps(dot, _mm_mul_ps(py[j], y));
+            dot = _mm_add_ps(dot, _mm_mul_ps(pz[j], z));
+            dot = _mm_sub_ps(_mm_add_ps(dot, pw[j]), w);
+            visible = _mm_and_ps(visible, dot);
+        }
+        const uint32_t r = toResults(visible, shift);
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+void boxesSSE2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    __m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for (size_t j = 0; j < 6; j++) {
+        px[j] = _mm_set1_ps(planes[j].x);
+        py[j] = _mm_set1_ps(planes[j].y);
+        pz[j] = _mm_set1_ps(planes[j].z);
+        pw[j] = _mm_set1_ps(planes[j].w);
+        ax[j] = _mm_set1_ps(std::abs(planes[j].x));
+        ay[j] = _mm_set1_ps(std::abs(planes[j].y));
+        az[j] = _mm_set1_ps(std::abs(planes[j].z));
+    }
+    const __m128i shift = _mm_cvtsi32_si128(int(bit));
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 cx, cy, cz, ex, ey, ez;
+        load3(&center[i].x, cx, cy, cz);
+        load3(&extent[i].x, ex, ey, ez);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m128 dot = _mm_mul_ps(px[j], cx);
+            dot = _mm_sub_ps(dot, _mm_mul_ps(ax[j], ex));
+            dot = _mm_add_ps(dot, _mm_mul_ps(py[j], cy));
+            dot = _mm_sub_ps(dot, _mm_mul_ps(ay[j], ey));
+            dot = _mm_add_ps(dot, _mm_mul_ps(pz[j], cz));
+            dot = _mm_sub_ps(dot, _mm_mul_ps(az[j], ez));
+            dot = _mm_add_ps(dot, pw[j]);
+            visible = _mm_and_ps(visible, dot);
+        }
+        uint32_t r;
+        memcpy(&r, results + i, sizeof(r));
+        r |= toResults(visible, shift);
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+#endif // FILAMENT_CULLER_SSE2
+
+// ------------------------------------------------------------------------------------------------
+// AVX2 kernels
+// ------------------------------------------------------------------------------------------------
+
+#if FILAMENT_CULLER_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// loads 8 float3 and transposes them into x, y and z
+AVX2_TARGET UTILS_ALWAYS_INLINE
+inline void load3(float const* UTILS_RESTRICT p, __m256& x, __m256& y, __m256& z) noexcept {
+    // the low and high lanes hold the first and last 4 float3 respectively, after that
+    // we use the same shuffles as the SSE2 version, which work within each lane.
+    const __m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p +  0)),
+            _mm_loadu_ps(p + 12), 1);
+    const __m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p +  4)),
+            _mm_loadu_ps(p + 16), 1);
+    const __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p +  8)),
+            _mm_loadu_ps(p + 20), 1);
+    const __m256 t0 = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+    const __m256 t1 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 1));
+    const __m256 t2 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    x = _mm256_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm256_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm256_shuffle_ps(t2, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+// converts the sign bits of 8 floats to 8 bytes, each shifted by 'shift'
+AVX2_TARGET UTILS_ALWAYS_INLINE
+inline __m128i toResults(__m256 visible, __m128i shift) noexcept {
+    __m256i v = _mm256_srli_epi32(_mm256_castps_si256(visible), 31);
+    v = _mm256_sll_epi32(v, shift);
+    const __m128i s = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_packus_epi16(s, _mm_setzero_si128());
+}
+
+AVX2_TARGET
+void spheresAVX2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (size_t j = 0; j < 6; j++) {
+        px[j] = _mm256_set1_ps(planes[j].x);
+        py[j] = _mm256_set1_ps(planes[j].y);
+        pz[j] = _mm256_set1_ps(planes[j].z);
+        pw[j] = _mm256_set1_ps(planes[j].w);
+    }
+    const __m128i shift = _mm_cvtsi32_si128(0);
+    for (size_t i = 0; i < count; i += 8) {
+        // 4x4 transpose within each lane, the low lane holds spheres 0 to 3
+        const __m256 r0 = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&b[i + 0].x)), _mm_loadu_ps(&b[i + 4].x), 1);
+        const __m256 r1 = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&b[i + 1].x)), _mm_loadu_ps(&b[i + 5].x), 1);
+        const __m256 r2 = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&b[i + 2].x)), _mm_loadu_ps(&b[i + 6].x), 1);
+        const __m256 r3 = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&b[i + 3].x)), _mm_loadu_ps(&b[i + 7].x), 1);
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1);   // x0 x1 y0 y1
+        const __m256 t1 = _mm256_unpacklo_ps(r2, r3);   // x2 x3 y2 y3
+        const __m256 t2 = _mm256_unpackhi_ps(r0, r1);   // z0 z1 w0 w1
+        const __m256 t3 = _mm256_unpackhi_ps(r2, r3);   // z2 z3 w2 w3
+        const __m256 x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 w = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 dot = _mm256_mul_ps(px[j], x);
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(py[j], y));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(pz[j], z));
+            dot = _mm256_sub_ps(_mm256_add_ps(dot, pw[j]), w);
+            visible = _mm256_and_ps(visible, dot);
+        }
+        _mm_storel_epi64((__m128i*)(results + i), toResults(visible, shift));
+    }
+}
+
+AVX2_TARGET
+void boxesAVX2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    __m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for (size_t j = 0; j < 6; j++) {
+        px[j] = _mm256_set1_ps(planes[j].x);
+        py[j] = _mm256_set1_ps(planes[j].y);
+        pz[j] = _mm256_set1_ps(planes[j].z);
+        pw[j] = _mm256_set1_ps(planes[j].w);
+        ax[j] = _mm256_set1_ps(std::abs(planes[j].x));
+        ay[j] = _mm256_set1_ps(std::abs(planes[j].y));
+        az[j] = _mm256_set1_ps(std::abs(planes[j].z));
+    }
+    const __m128i shift = _mm_cvtsi32_si128(int(bit));
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 cx, cy, cz, ex, ey, ez;
+        load3(&center[i].x, cx, cy, cz);
+        load3(&extent[i].x, ex, ey, ez);
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 dot = _mm256_mul_ps(px[j], cx);
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(ax[j], ex));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(py[j], cy));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(ay[j], ey));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(pz[j], cz));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(az[j], ez));
+            dot = _mm256_add_ps(dot, pw[j]);
+            visible = _mm256_and_ps(visible, dot);
+        }
+        __m128i* const p = (__m128i*)(results + i);
+        _mm_storel_epi64(p, _mm_or_si128(_mm_loadl_epi64(p), toResults(visible, shift)));
+    }
+}
+
+#undef AVX2_TARGET
+
+#endif // FILAMENT_CULLER_AVX2
+
+// ------------------------------------------------------------------------------------------------
+// NEON kernels
+// ------------------------------------------------------------------------------------------------
+
+#if FILAMENT_CULLER_NEON
+
+// tests 4 spheres, returns all bits set in each lane where the sphere is visible
+UTILS_ALWAYS_INLINE
+inline uint32x4_t spheres4(float32x4_t const* UTILS_RESTRICT p,
+        float const* UTILS_RESTRICT b) noexcept {
+    // vld4q does the transposition for us
+    const float32x4x4_t s = vld4q_f32(b);
+    uint32x4_t visible = vdupq_n_u32(~0u);
+    for (size_t j = 0; j < 6; j++) {
+        float32x4_t const* plane = p + j * 4;
+        float32x4_t dot = vmulq_f32(plane[0], s.val[0]);
+        dot = vaddq_f32(dot, vmulq_f32(plane[1], s.val[1]));
+        dot = vaddq_f32(dot, vmulq_f32(plane[2], s.val[2]));
+        dot = vsubq_f32(vaddq_f32(dot, plane[3]), s.val[3]);
+        visible = vandq_u32(visible, vreinterpretq_u32_f32(dot));
+    }
+    return visible;
+}
+
+// tests 4 boxes, returns all bits set in each lane where the box is visible
+UTILS_ALWAYS_INLINE
+inline uint32x4_t boxes4(float32x4_t const* UTILS_RESTRICT p,
+        float const* UTILS_RESTRICT center, float const* UTILS_RESTRICT extent) noexcept {
+    // vld3q does the transposition for us
+    const float32x4x3_t c = vld3q_f32(center);
+    const float32x4x3_t e = vld3q_f32(extent);
+    uint32x4_t visible = vdupq_n_u32(~0u);
+    for (size_t j = 0; j < 6; j++) {
+        float32x4_t const* plane = p + j * 7;
+        float32x4_t dot = vmulq_f32(plane[0], c.val[0]);
+        dot = vsubq_f32(dot, vmulq_f32(plane[4], e.val[0]));
+        dot = vaddq_f32(dot, vmulq_f32(plane[1], c.val[1]));
+        dot = vsubq_f32(dot, vmulq_f32(plane[5], e.val[1]));
+        dot = vaddq_f32(dot, vmulq_f32(plane[2], c.val[2]));
+        dot = vsubq_f32(dot, vmulq_f32(plane[6], e.val[2]));
+        dot = vaddq_f32(dot, plane[3]);
+        visible = vandq_u32(visible, vreinterpretq_u32_f32(dot));
+    }
+    return visible;
+}
+
+// converts the sign bits of 8 floats to 8 bytes, each shifted by 'shift'
+UTILS_ALWAYS_INLINE
+inline uint8x8_t toResults(uint32x4_t v0, uint32x4_t v1, int32x4_t shift) noexcept {
+    v0 = vshlq_u32(vshrq_n_u32(v0, 31), shift);
+    v1 = vshlq_u32(vshrq_n_u32(v1, 31), shift);
+    return vmovn_u16(vcombine_u16(vmovn_u32(v0), vmovn_u32(v1)));
+}
+
+void spheresNEON(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    float32x4_t p[6 * 4];
+    for (size_t j = 0; j < 6; j++) {
+        p[j * 4 + 0] = vdupq_n_f32(planes[j].x);
+        p[j * 4 + 1] = vdupq_n_f32(planes[j].y);
+        p[j * 4 + 2] = vdupq_n_f32(planes[j].z);
+        p[j * 4 + 3] = vdupq_n_f32(planes[j].w);
+    }
+    const int32x4_t shift = vdupq_n_s32(0);
+    for (size_t i = 0; i < count; i += 8) {
+        const uint32x4_t v0 = spheres4(p, &b[i + 0].x);
+        const uint32x4_t v1 = spheres4(p, &b[i + 4].x);
+        vst1_u8(results + i, toResults(v0, v1, shift));
+    }
+}
+
+void boxesNEON(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    float32x4_t p[6 * 7];
+    for (size_t j = 0; j < 6; j++) {
+        p[j * 7 + 0] = vdupq_n_f32(planes[j].x);
+        p[j * 7 + 1] = vdupq_n_f32(planes[j].y);
+        p[j * 7 + 2] = vdupq_n_f32(planes[j].z);
+        p[j * 7 + 3] = vdupq_n_f32(planes[j].w);
+        p[j * 7 + 4] = vdupq_n_f32(std::abs(planes[j].x));
+        p[j * 7 + 5] = vdupq_n_f32(std::abs(planes[j].y));
+        p[j * 7 + 6] = vdupq_n_f32(std::abs(planes[j].z));
+    }
+    const int32x4_t shift = vdupq_n_s32(int32_t(bit));
+    for (size_t i = 0; i < count; i += 8) {
+        const uint32x4_t v0 = boxes4(p, &center[i + 0].x, &extent[i + 0].x);
+        const uint32x4_t v1 = boxes4(p, &center[i + 4].x, &extent[i + 4].x);
+        vst1_u8(results + i, vorr_u8(vld1_u8(results + i), toResults(v0, v1, shift)));
+    }
+}
+
+#endif // FILAMENT_CULLER_NEON
+
+} // anonymous namespace
+
+// ------------------------------------------------------------------------------------------------
+// Dispatch
+// ------------------------------------------------------------------------------------------------
+
+Culler::Kernels const* Culler::getKernels(Isa isa) noexcept {
+    switch (isa) {
+        case Isa::GENERIC: {
+            static const Kernels kernels{ &boxesGeneric, &spheresGeneric };
+            return &kernels;
+        }
+#if FILAMENT_CULLER_SSE2
+        case Isa::SSE2: {
+            static const Kernels kernels{ &boxesSSE2, &spheresSSE2 };
+            return &kernels;
+        }
+#endif
+#if FILAMENT_CULLER_AVX2
+        case Isa::AVX2: {
+            static const Kernels kernels{ &boxesAVX2, &spheresAVX2 };
+            return __builtin_cpu_supports("avx2") ? &kernels : nullptr;
+        }
+#endif
+#if FILAMENT_CULLER_NEON
+        case Isa::NEON: {
+            static const Kernels kernels{ &boxesNEON, &spheresNEON };
+            return &kernels;
+        }
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+Culler::Kernels const& Culler::getKernels() noexcept {
+    static Kernels const& kernels = []() -> Kernels const& {
+        // from best to worst
+        for (Isa isa : { Isa::AVX2, Isa::NEON, Isa::SSE2 }) {
+            Kernels const* k = getKernels(isa);
+            if (k) {
+                return *k;
+            }
+        }
+        return *getKernels(Isa::GENERIC);
+    }();
+    return kernels;
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    getKernels().spheres(results, frustum.mPlanes, b, count);
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    getKernels().boxes(results, frustum.mPlanes, center, extent, count, bit);
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -135,5 +551,25 @@ void Culler::Test::intersects(
     Culler::intersects(results, frustum, b, count);
 }
 
+bool Culler::Test::isSupported(Isa isa) noexcept {
+    return getKernels(isa) != nullptr;
+}
+
+void Culler::Test::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT c,
+        float3 const* UTILS_RESTRICT e,
+        size_t count, Isa isa) noexcept {
+    getKernels(isa)->boxes(results, frustum.mPlanes, c, e, round(count), 0);
+}
+
+void Culler::Test::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float4 const* UTILS_RESTRICT b, size_t count, Isa isa) noexcept {
+    getKernels(isa)->spheres(results, frustum.mPlanes, b, round(count));
+}
+
 } // namespace details
 } // namespace filament
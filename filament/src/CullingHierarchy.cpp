@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/CullingHierarchy.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+// when the tree's cost grows above this factor of its cost after sorting, we ask for a new sort
+static constexpr float MAX_COST_DEGRADATION = 2.0f;
+
+// spreads the 10 low bits of v so that there are two 0 bits between each of them
+static inline uint32_t expandBits(uint32_t v) noexcept {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// quantize a coordinate in [0, 1023], this also maps NaNs to 0
+static inline uint32_t quantize(float v) noexcept {
+    v = v >= 0.0f ? v : 0.0f;
+    return uint32_t(std::min(v, 1023.0f));
+}
+
+CullingHierarchy::CullingHierarchy() noexcept = default;
+
+CullingHierarchy::~CullingHierarchy() noexcept = default;
+
+void CullingHierarchy::sort(uint32_t* indices, float3 const* center, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    if (!count) {
+        return;
+    }
+
+    float3 lo = center[0];
+    float3 hi = center[0];
+    for (size_t i = 1; i < count; i++) {
+        lo = min(lo, center[i]);
+        hi = max(hi, center[i]);
+    }
+    const float3 scale = 1023.0f / max(hi - lo, float3{ std::numeric_limits<float>::min() });
+
+    std::vector<uint32_t> codes(count);
+    for (size_t i = 0; i < count; i++) {
+        const float3 p = (center[i] - lo) * scale;
+        codes[i] = (expandBits(quantize(p.x)) << 2u) |
+                   (expandBits(quantize(p.y)) << 1u) |
+                    expandBits(quantize(p.z));
+        indices[i] = uint32_t(i);
+    }
+
+    std::sort(indices, indices + count, [&codes](uint32_t lhs, uint32_t rhs) {
+        return codes[lhs] < codes[rhs];
+    });
+}
+
+bool CullingHierarchy::refit(
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    const Node empty{ float3{ std::numeric_limits<float>::max() },
+                      float3{ std::numeric_limits<float>::lowest() }};
+
+    const size_t leafCount = (count + LEAF_SIZE - 1) / LEAF_SIZE;
+    if (mNodes.empty() || leafCount != mLeafCount) {
+        size_t firstLeaf = 1;
+        while (firstLeaf < leafCount) {
+            firstLeaf *= 2;
+        }
+        mFirstLeaf = firstLeaf;
+        mLeafCount = leafCount;
+        mNodes.assign(firstLeaf * 2, empty);
+        mChanged.assign(firstLeaf * 2, 1);
+    }
+    mCount = count;
+
+    Node* const UTILS_RESTRICT nodes = mNodes.data();
+    uint8_t* const UTILS_RESTRICT changed = mChanged.data();
+
+    // recompute the leaves
+    float cost = 0;
+    for (size_t l = 0; l < leafCount; l++) {
+        const size_t first = l * LEAF_SIZE;
+        const size_t last = std::min(count, first + LEAF_SIZE);
+        Node leaf = empty;
+        for (size_t i = first; i < last; i++) {
+            leaf.min = min(leaf.min, center[i] - extent[i]);
+            leaf.max = max(leaf.max, center[i] + extent[i]);
+        }
+        Node& node = nodes[mFirstLeaf + l];
+        changed[mFirstLeaf + l] = uint8_t(
+                any(notEqual(leaf.min, node.min)) || any(notEqual(leaf.max, node.max)));
+        node = leaf;
+
+        const float3 d = leaf.max - leaf.min;
+        cost += d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    // and propagate the changes up the tree
+    for (size_t i = mFirstLeaf - 1; i > 0; i--) {
+        const size_t l = i * 2;
+        const size_t r = i * 2 + 1;
+        changed[i] = changed[l] | changed[r];
+        if (changed[i]) {
+            nodes[i].min = min(nodes[l].min, nodes[r].min);
+            nodes[i].max = max(nodes[l].max, nodes[r].max);
+        }
+    }
+
+    // the padding leaves never change
+    std::fill(changed + mFirstLeaf + leafCount, changed + mFirstLeaf * 2, 0);
+
+    if (mReferenceCost == 0) {
+        mReferenceCost = cost;
+    }
+    return cost <= mReferenceCost * MAX_COST_DEGRADATION;
+}
+
+CullingHierarchy::Classification CullingHierarchy::classify(
+        float4 const* UTILS_RESTRICT planes, Node const& node) noexcept {
+    if (UTILS_UNLIKELY(any(greaterThan(node.min, node.max)))) {
+        // empty node
+        return Classification::OUTSIDE;
+    }
+
+    // this uses the same test than Culler::intersects(), so that a node rejected here would
+    // have all its renderables rejected by the Culler.
+    const float3 center = (node.max + node.min) * 0.5f;
+    const float3 extent = (node.max - node.min) * 0.5f;
+    bool inside = true;
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), extent);
+        if (d - r >= 0) {
+            return Classification::OUTSIDE;
+        }
+        inside &= d + r < 0;
+    }
+    return inside ? Classification::INSIDE : Classification::INTERSECTS;
+}
+
+void CullingHierarchy::getLeafRange(size_t node, size_t* first, size_t* last) const noexcept {
+    size_t l = node;
+    size_t r = node;
+    while (l < mFirstLeaf) {
+        l = l * 2;
+        r = r * 2 + 1;
+    }
+    *first = l - mFirstLeaf;
+    *last = std::min(r - mFirstLeaf + 1, mLeafCount);
+}
+
+void CullingHierarchy::cull(JobSystem& js, Frustum const& frustum,
+        float3 const* center, float3 const* extent,
+        Culler::result_type* results, size_t count, size_t bit) noexcept {
+    SYSTRACE_CALL();
+
+    assert(count == mCount);
+
+    float4 const* const planes = frustum.getNormalizedPlanes();
+    const Culler::result_type visible = Culler::result_type(1u << bit);
+    Node const* const UTILS_RESTRICT nodes = mNodes.data();
+
+    // walk the tree, renderables in nodes entirely inside the frustum are visible, the ones
+    // in nodes entirely outside are not, leaves intersecting the frustum are tested below.
+    std::vector<uint32_t>& leavesToCull = mLeavesToCull;
+    leavesToCull.clear();
+
+    size_t stack[64];
+    size_t size = 0;
+    stack[size++] = 1;
+    while (size) {
+        const size_t n = stack[--size];
+        switch (classify(planes, nodes[n])) {
+            case Classification::OUTSIDE:
+                break;
+            case Classification::INSIDE: {
+                size_t firstLeaf, lastLeaf;
+                getLeafRange(n, &firstLeaf, &lastLeaf);
+                const size_t last = std::min(count, lastLeaf * LEAF_SIZE);
+                for (size_t i = firstLeaf * LEAF_SIZE; i < last; i++) {
+                    results[i] |= visible;
+                }
+                break;
+            }
+            case Classification::INTERSECTS:
+                if (n >= mFirstLeaf) {
+                    leavesToCull.push_back(uint32_t(n - mFirstLeaf));
+                } else {
+                    stack[size++] = n * 2 + 1;
+                    stack[size++] = n * 2;
+                }
+                break;
+        }
+    }
+
+    SYSTRACE_VALUE32("leavesToCull", leavesToCull.size());
+
+    // culling job (this runs on multiple threads)
+    auto functor = [&frustum, &leavesToCull, center, extent, results, count, bit]
+            (uint32_t index, uint32_t c) {
+        for (uint32_t i = index; i < index + c; i++) {
+            const size_t first = leavesToCull[i] * LEAF_SIZE;
+            Culler::intersects(results + first, frustum, center + first, extent + first,
+                    std::min(LEAF_SIZE, count - first), bit);
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(leavesToCull.size()),
+            std::cref(functor), jobs::CountSplitter<2, 8>());
+    js.runAndWait(job);
+}
+
+} // namespace details
+} // namespace filament
@@ -132,7 +132,7 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
         mSharedGLContext(sharedGLContext),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
-        mTransformManager(),
+        mTransformManager(&mJobSystem),
         mLightManager(*this),
         mCameraManager(*this),
         mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
@@ -309,6 +309,10 @@ void FEngine::shutdown() {
         mDriverThread.join();
     }
 
+    // the driver may have scheduled callbacks up to its termination, e.g. the compilePrograms()
+    // requests it won't complete, they must still be called
+    getDriver().purge();
+
     // detach this thread from the jobsystem
     mJobSystem.emancipate();
 
@@ -23,8 +23,10 @@
 
 #include <filament/Viewport.h>
 
+#include <utils/algorithm.h>
 #include <utils/Allocator.h>
 #include <utils/BinaryTreeArray.h>
+#include <utils/Hash.h>
 #include <utils/Systrace.h>
 
 #include <math/mat4.h>
@@ -35,6 +37,14 @@
 
 #include <stddef.h>
 
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define FILAMENT_FROXELIZER_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define FILAMENT_FROXELIZER_SSE2 1
+#endif
+
 using namespace filament::math;
 using namespace utils;
 
@@ -72,8 +82,15 @@ constexpr size_t FROXEL_BUFFER_HEIGHT       = (FROXEL_BUFFER_ENTRY_COUNT_MAX + F
 constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 5u;
 constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
 
-constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
-constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
+// The record buffer grows as needed, from 8K entries up to 64K entries, which is the most a
+// FroxelEntry can address.
+constexpr size_t RECORD_BUFFER_MIN_HEIGHT   = 256;
+constexpr size_t RECORD_BUFFER_MAX_HEIGHT   = 2048;
+constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_MAX_HEIGHT; // 64K
+
+constexpr GPUBuffer::ElementType RECORD_BUFFER_TYPE =
+        std::is_same<Froxelizer::RecordBufferType, uint8_t>::value
+        ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
 
 // Buffer needed for Froxelizer internal data structures (~256 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
@@ -82,14 +99,6 @@ constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                   FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
 
 
-// number of lights processed by one group (e.g. 32)
-static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8;
-
-// number of groups (i.e. jobs) to use for froxelization (e.g. 8)
-static constexpr size_t GROUP_COUNT =
-        (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
-
-
 // record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
 // so its maximum size is 128 KiB
 static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
@@ -101,11 +110,17 @@ Froxelizer::Froxelizer(FEngine& engine)
     DriverApi& driverApi = engine.getDriverApi();
 
     // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
-    GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
-                                  ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
-    mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
+    mRecordsBuffer = GPUBuffer(driverApi, { RECORD_BUFFER_TYPE, 1 },
+            RECORD_BUFFER_WIDTH, RECORD_BUFFER_MIN_HEIGHT);
     mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+
+    mFroxels.resize(FROXEL_BUFFER_ENTRY_COUNT_MAX);
+    mFroxelBufferUser = { mFroxels.data(), mFroxels.size() };
+
+    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
+    debugRegistry.registerProperty("d.froxelizer.skipped",
+            &engine.debug.froxelizer.skipped);
 }
 
 Froxelizer::~Froxelizer() {
@@ -160,45 +175,22 @@ bool Froxelizer::prepare(
         uniformsNeedUpdating = update();
     }
 
-    /*
-     * Allocations that need to persists until the driver consumes them are done from
-     * the command stream.
-     */
-
-    // froxel buffer (~32 KiB)
-    mFroxelBufferUser = {
-            driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
-
-    // record buffer (~64 KiB)
-    mRecordBufferUser = {
-            driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
-            RECORD_BUFFER_ENTRY_COUNT };
+    // the froxel and record buffers are copied to the command stream in commit(), and only
+    // when they changed
 
     /*
      * Temporary allocations for processing all froxel data
      */
 
-    // light records per froxel (~256 KiB)
-    mLightRecords = {
-            arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
+    // lights per froxel (~96 KiB)
+    mFroxelLights = {
+            arena.allocate<FroxelLights>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
-    mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
-    };
-
-    assert(mFroxelBufferUser.begin());
-    assert(mRecordBufferUser.begin());
-    assert(mLightRecords.begin());
-    assert(mFroxelShardedData.begin());
+    assert(mFroxelLights.begin());
 
 #ifndef NDEBUG
-    memset(mFroxelBufferUser.data(),    0x55, mFroxelBufferUser.sizeInBytes());
-    memset(mRecordBufferUser.data(),    0xEB, mRecordBufferUser.sizeInBytes());
-    memset(mFroxelShardedData.data(),   0xFD, mFroxelShardedData.sizeInBytes());
+    memset(mFroxelLights.data(),        0xFD, mFroxelLights.sizeInBytes());
 #endif
 
     return uniformsNeedUpdating;
@@ -522,23 +514,64 @@ std::pair<size_t, size_t> Froxelizer::clipToIndices(float2 const& clip) const no
 }
 
 
-void Froxelizer::commit(backend::DriverApi& driverApi) {
+bool Froxelizer::commit(backend::DriverApi& driverApi) {
+    if (mFroxelizationSkipped) {
+        // the GPU buffers already have the right content
+        return false;
+    }
+
     // send data to GPU
-    mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
-    mRecordsBuffer.commit(driverApi, mRecordBufferUser);
+    FroxelEntry* const froxels = driverApi.allocatePod<FroxelEntry>(mFroxelBufferUser.size());
+    std::copy(mFroxelBufferUser.begin(), mFroxelBufferUser.end(), froxels);
+    mFroxelBuffer.commit(driverApi, froxels, froxels + mFroxelBufferUser.size());
+
+    // only the rows of the record buffer in use are sent, the buffer grows by powers of two
+    const size_t rowCount = std::max(size_t(1),
+            (mRecordBufferUser.size() + RECORD_BUFFER_WIDTH - 1) / RECORD_BUFFER_WIDTH);
+    assert(rowCount <= RECORD_BUFFER_MAX_HEIGHT);
+
+    bool reallocated = false;
+    if (UTILS_UNLIKELY(rowCount > mRecordsBuffer.getRowCount())) {
+        size_t height = mRecordsBuffer.getRowCount();
+        while (height < rowCount) {
+            height *= 2;
+        }
+        GPUBuffer recordsBuffer(driverApi, { RECORD_BUFFER_TYPE, 1 },
+                RECORD_BUFFER_WIDTH, std::min(height, RECORD_BUFFER_MAX_HEIGHT));
+        mRecordsBuffer.swap(recordsBuffer);
+        recordsBuffer.terminate(driverApi);
+        reallocated = true;
+    }
+
+    const size_t count = rowCount * RECORD_BUFFER_WIDTH;
+    RecordBufferType* const records = driverApi.allocatePod<RecordBufferType>(count);
+    std::copy(mRecordBufferUser.begin(), mRecordBufferUser.end(), records);
+    std::fill(records + mRecordBufferUser.size(), records + count, RecordBufferType(0));
+    mRecordsBuffer.commit(driverApi, records, records + count);
+
 #ifndef NDEBUG
-    mFroxelBufferUser.clear();
     mRecordBufferUser.clear();
-    mFroxelShardedData.clear();
 #endif
+    return reallocated;
 }
 
 void Froxelizer::froxelizeLights(FEngine& engine,
         CameraInfo const& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
+
+    // with a static camera and static lights, the froxels and records don't change
+    const uint64_t hash = hashFroxelizationInputs(engine, camera, lightData);
+    mFroxelizationSkipped = mHasFroxelization && hash == mFroxelizationHash;
+    if (mFroxelizationSkipped) {
+        engine.debug.froxelizer.skipped++;
+        return;
+    }
+    mFroxelizationHash = hash;
+    mHasFroxelization = true;
+
     froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    froxelizeAssignRecordsCompress(lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
 
 #ifndef NDEBUG
     if (lightData.size()) {
@@ -564,27 +597,102 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
+uint64_t Froxelizer::hashFroxelizationInputs(FEngine& engine,
+        const CameraInfo& UTILS_RESTRICT camera,
+        const FScene::LightSoa& UTILS_RESTRICT lightData) const noexcept {
+    SYSTRACE_CALL();
+
+    hash::Murmur3x2 hasher;
+
+    // the froxels depend on the viewport, the projection and the light near/far planes
+    const struct {
+        mat4f projection;
+        mat4f view;
+        int32_t left;
+        int32_t bottom;
+        uint32_t width;
+        uint32_t height;
+        float zLightNear;
+        float zLightFar;
+        uint32_t lightCount;
+    } view = {
+            mProjection, camera.view,
+            mViewport.left, mViewport.bottom, mViewport.width, mViewport.height,
+            mZLightNear, mZLightFar,
+            uint32_t(lightData.size())
+    };
+    hasher.add(&view, sizeof(view));
+
+    // and on the position, radius, direction and cone of each light
+    auto& lcm = engine.getLightManager();
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        const struct {
+            float4 sphere;
+            float3 direction;
+            float cosSqr;
+            float invSin;
+        } light = {
+                spheres[i], directions[i],
+                lcm.getCosOuterSquared(instances[i]), lcm.getSinInverse(instances[i])
+        };
+        hasher.add(&light, sizeof(light));
+    }
+
+    return hasher.get();
+}
+
 void Froxelizer::froxelizeLoop(FEngine& engine,
         const CameraInfo& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    JobSystem& js = engine.getJobSystem();
+
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    const size_t groupCount = (lightCount + LIGHTS_PER_JOB - 1) / LIGHTS_PER_JOB;
+
+    // With few lights there are fewer light groups than threads, in that case we also split
+    // the z-slices into slabs, each froxelized by its own job. This also keeps the bounding
+    // spheres a job works on in a smaller part of the cache.
+    const size_t froxelCountZ = mFroxelCountZ;
+    const size_t threadCount = size_t(1) << js.getParallelSplitCount();
+    const size_t slabCount = groupCount ? clamp((threadCount + groupCount - 1) / groupCount,
+            size_t(1), froxelCountZ) : 0;
+    const size_t jobCount = groupCount * slabCount;
+
+    // these keep their capacity from frame to frame
+    if (mJobFroxels.size() < jobCount) {
+        mJobFroxels.resize(jobCount);
+    }
+    // the lights' froxels are stored slab by slab, so that each froxel sees its lights in order
+    mLightFroxels.resize(lightCount * slabCount);
 
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    LightFroxels* const UTILS_RESTRICT lightFroxels = mLightFroxels.data();
 
-    auto process = [ this, &froxelThreadData,
+    auto process = [ this, lightFroxels, lightCount, slabCount, froxelCountZ,
                      spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
+            (size_t job) {
 
         const mat4f& projection = mProjection;
         const mat3f& vn = camera.view.upperLeft();
+        const size_t group = job / slabCount;
+        const size_t slab = job % slabCount;
+        const size_t zbegin = (slab * froxelCountZ) / slabCount;
+        const size_t zend = ((slab + 1) * froxelCountZ) / slabCount;
 
-        for (size_t i = offset; i < count; i += stride) {
+        // each job lists the froxels touched by LIGHTS_PER_JOB consecutive lights in its slab
+        std::vector<uint16_t>& froxels = mJobFroxels[job];
+        froxels.clear();
+
+        for (size_t i = group * LIGHTS_PER_JOB,
+                c = std::min(lightCount, i + LIGHTS_PER_JOB); i < c; i++) {
             const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
             FLightManager::Instance li = instances[j];
             LightParams light = {
@@ -595,72 +703,97 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
                     .radius = spheres[j].w,
             };
 
-            const size_t group = i % GROUP_COUNT;
-            const size_t bit   = i / GROUP_COUNT;
-            assert(bit < LIGHT_PER_GROUP);
-
-            FroxelThreadData& threadData = froxelThreadData[group];
-            const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
-            threadData[0] |= isSpot << bit;
-            froxelizePointAndSpotLight(threadData, bit, projection, light);
+            const size_t begin = froxels.size();
+            froxelizePointAndSpotLight(froxels, projection, light, zbegin, zend);
+            lightFroxels[slab * lightCount + i] = {
+                    .begin = uint32_t(begin),
+                    .end = uint32_t(froxels.size()),
+                    .job = uint16_t(job),
+                    .isSpot = light.invSin != std::numeric_limits<float>::infinity()
+            };
         }
     };
 
-    // we do 64 lights per job
-    JobSystem& js = engine.getJobSystem();
-
     constexpr bool SINGLE_THREADED = false;
     if (!SINGLE_THREADED) {
         auto parent = js.createJob();
-        for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+        for (size_t i = 0; i < jobCount; i++) {
+            js.run(jobs::createJob(js, parent, std::cref(process), i));
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        for (size_t i = 0; i < jobCount; i++) {
+            process(i);
+        }
     }
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
+void Froxelizer::froxelizeAssignRecordsCompress(size_t lightCount) noexcept {
 
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-
-    // convert froxel data from N groups of M bits to LightRecord::bitset, so we can
-    // easily compare adjacent froxels, for compaction. The conversion loops below get
-    // inlined and vectorized in release builds.
-
-    // keep these two loops separate, it helps the compiler a lot
-    LightRecord::bitset spotLights;
-    for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-        using container_type = LightRecord::bitset::container_type;
-        constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-        container_type b = froxelThreadData[i * r][0];
-        for (size_t k = 0; k < r; k++) {
-            b |= (container_type(froxelThreadData[i * r + k][0]) << (LIGHT_PER_GROUP * k));
+    // The froxelization produced the list of froxels touched by each light, here we build the
+    // list of lights of each froxel, with a counting sort. All the steps below are linear in
+    // the number of (light, froxel) pairs, or in the number of froxels.
+
+    const size_t froxelCount = getFroxelCount();
+    const size_t entryCount = mLightFroxels.size();
+    LightFroxels const* const UTILS_RESTRICT lightFroxels = mLightFroxels.data();
+    FroxelLights* const UTILS_RESTRICT froxelLights = mFroxelLights.data();
+    std::fill_n(froxelLights, froxelCount, FroxelLights{});
+
+    // count the point and spot lights of each froxel
+    for (size_t k = 0; k < entryCount; k++) {
+        LightFroxels const& lf = lightFroxels[k];
+        uint16_t const* const UTILS_RESTRICT froxels = mJobFroxels[lf.job].data();
+        if (lf.isSpot) {
+            for (size_t i = lf.begin; i < lf.end; i++) {
+                froxelLights[froxels[i]].spotCount++;
+            }
+        } else {
+            for (size_t i = lf.begin; i < lf.end; i++) {
+                froxelLights[froxels[i]].pointCount++;
+            }
         }
-        spotLights.getBitsAt(i) = b;
     }
 
-    // this gets very well vectorized...
-    utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 1, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
-        for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-            using container_type = LightRecord::bitset::container_type;
-            constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-            container_type b = froxelThreadData[i * r][j];
-            for (size_t k = 0; k < r; k++) {
-                b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+    // assign its range of the scratch buffer to each froxel, point lights first
+    uint32_t scratchCount = 0;
+    for (size_t i = 0; i < froxelCount; i++) {
+        FroxelLights& f = froxelLights[i];
+        f.point = scratchCount;
+        f.spot = scratchCount + f.pointCount;
+        scratchCount += f.pointCount + f.spotCount;
+    }
+
+    // scatter the light indices, a froxel belongs to a single slab, so this keeps them sorted
+    // in each froxel
+    mRecordsScratch.resize(scratchCount);
+    RecordBufferType* const UTILS_RESTRICT scratch = mRecordsScratch.data();
+    for (size_t k = 0; k < entryCount; k++) {
+        LightFroxels const& lf = lightFroxels[k];
+        uint16_t const* const UTILS_RESTRICT froxels = mJobFroxels[lf.job].data();
+        const size_t l = k % lightCount;
+        if (lf.isSpot) {
+            for (size_t i = lf.begin; i < lf.end; i++) {
+                scratch[froxelLights[froxels[i]].spot++] = RecordBufferType(l);
+            }
+        } else {
+            for (size_t i = lf.begin; i < lf.end; i++) {
+                scratch[froxelLights[froxels[i]].point++] = RecordBufferType(l);
             }
-            records[j - 1].lights.getBitsAt(i) = b;
         }
     }
+    // from here, point and spot are the end of the point and spot lights of each froxel
+
+    auto sameLights = [froxelLights, scratch](size_t a, size_t b) -> bool {
+        FroxelLights const& fa = froxelLights[a];
+        FroxelLights const& fb = froxelLights[b];
+        return fa.pointCount == fb.pointCount && fa.spotCount == fb.spotCount &&
+               std::equal(scratch + fa.point - fa.pointCount, scratch + fa.spot,
+                       scratch + fb.point - fb.pointCount);
+    };
 
-    uint16_t offset = 0;
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
     const size_t froxelCountX = mFroxelCountX;
@@ -672,27 +805,43 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         return i;
     };
 
-    RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
+    // there can't be more records than (light, froxel) pairs
+    mRecords.resize(std::min(size_t(scratchCount), RECORD_BUFFER_ENTRY_COUNT));
+    RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecords.data();
 
     // how many froxel record entries were reused (for debugging)
     UTILS_UNUSED size_t reused = 0;
 
-    for (size_t i = 0, c = getFroxelCount(); i < c;) {
-        LightRecord b = records[i];
-        if (b.lights.none()) {
-            froxels[remap(i++)].u32 = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < froxelCount; i++) {
+        FroxelLights const& f = froxelLights[i];
+        if (!f.pointCount && !f.spotCount) {
+            froxels[remap(i)].u32 = 0;
+            continue;
+        }
+
+        // If this froxel has the same lights as the one on its left, or the one above it, we
+        // reuse its records, which saves many froxel records (north of 10% in practice).
+        if (i >= 1 && sameLights(i, i - 1)) {
+            froxels[remap(i)].u32 = froxels[remap(i - 1)].u32;
+            reused++;
+            continue;
+        }
+        if (i >= froxelCountX && sameLights(i, i - froxelCountX)) {
+            froxels[remap(i)].u32 = froxels[remap(i - froxelCountX)].u32;
+            reused++;
             continue;
         }
 
         // We have a limitation of 255 spot + 255 point lights per froxel.
         FroxelEntry entry = {
-                .offset = offset,
-                .pointLightCount = (uint8_t)std::min(size_t(255), (b.lights & ~spotLights).count()),
-                .spotLightCount  = (uint8_t)std::min(size_t(255), (b.lights &  spotLights).count())
+                .offset = uint16_t(offset),
+                .pointLightCount = (uint8_t)std::min(uint16_t(255), f.pointCount),
+                .spotLightCount  = (uint8_t)std::min(uint16_t(255), f.spotCount)
         };
-        const size_t lightCount = entry.count[0] + entry.count[1];
+        const size_t recordCount = entry.count[0] + entry.count[1];
 
-        if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+        if (UTILS_UNLIKELY(offset + recordCount > RECORD_BUFFER_ENTRY_COUNT)) {
 #ifndef NDEBUG
             slog.d << "out of space: " << i << ", at " << offset << io::endl;
 #endif
@@ -700,55 +849,19 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
             // filed up.
             do { // this compiles to memset() when remap() is identity
                 froxels[remap(i++)].u32 = 0;
-            } while(i < c);
-            goto out_of_memory;
+            } while(i < froxelCount);
+            break;
         }
 
-        // iterate the bitfield
-        auto beginPoint = froxelRecords + offset;
-        auto beginSpot  = froxelRecords + offset + entry.count[0];
-        b.lights.forEachSetBit([&spotLights,
-                point = beginPoint, spot = beginSpot, beginPoint, beginSpot]
-                (size_t l) mutable {
+        std::copy_n(scratch + f.point - f.pointCount, entry.count[0], froxelRecords + offset);
+        std::copy_n(scratch + f.spot - f.spotCount, entry.count[1],
+                froxelRecords + offset + entry.count[0]);
+        offset += recordCount;
 
-            // make sure to keep this code branch-less
-            const bool isSpot = spotLights[l];
-            auto& p = isSpot ? spot      : point;
-            auto  s = isSpot ? beginSpot : beginPoint;
-
-            const size_t word = l / LIGHT_PER_GROUP;
-            const size_t bit  = l % LIGHT_PER_GROUP;
-            l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
-
-            *p = (RecordBufferType)l;
-            // we need to "cancel" the write if we have more than 255 spot or point lights
-            // (this is a limitation of the data type used to store the light counts per froxel)
-            p += (p - s < 255) ? 1 : 0;
-        });
-
-        offset += lightCount;
-
-#ifndef NDEBUG
-        if (lightCount) { reused--; }
-#endif
-        do {
-#ifndef NDEBUG
-            if (lightCount) { reused++; }
-#endif
-            froxels[remap(i++)].u32 = entry.u32;
-            if (i >= c) break;
-
-            if (records[i].lights != b.lights && i >= froxelCountX) {
-                // if this froxel record doesn't match the previous one on its left,
-                // we re-try with the record above it, which saves many froxel records
-                // (north of 10% in practice).
-                b = records[i - froxelCountX];
-                entry.u32 = froxels[remap(i - froxelCountX)].u32;
-            }
-        } while(records[i].lights == b.lights);
+        froxels[remap(i)].u32 = entry.u32;
     }
-out_of_memory:
-    ;
+
+    mRecordBufferUser = { froxelRecords, offset };
 }
 
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
@@ -773,10 +886,141 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
     return float2{ x, y } * (1 / w);
 }
 
+/*
+ * The helpers below test 4 consecutive froxels (or froxel planes) of a row at once. They compute
+ * the same expressions than spherePlaneDistanceSquared() and sphereConeIntersectionFast(), and
+ * return one bit per froxel.
+ */
+
+#if FILAMENT_FROXELIZER_NEON
+UTILS_ALWAYS_INLINE
+inline uint32_t toMask(uint32x4_t m) noexcept {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    const uint32x4_t t = vandq_u32(m, bits);
+    const uint32x2_t s = vorr_u32(vget_low_u32(t), vget_high_u32(t));
+    return vget_lane_u32(vpadd_u32(s, s), 0);
+}
+#endif
+
+// bit i is set if the circle 'c' (radius squared) intersects the plane {x,0,z,0} planes[i]
+UTILS_ALWAYS_INLINE
+inline uint32_t planesXIntersect4(float4 const* UTILS_RESTRICT planes, float4 const& c) noexcept {
+#if FILAMENT_FROXELIZER_NEON
+    const float32x4x4_t p = vld4q_f32(&planes[0].x);  // transposed to x, y, z, w
+    const float32x4_t d = vaddq_f32(vmulq_n_f32(p.val[0], c.x), vmulq_n_f32(p.val[2], c.z));
+    const float32x4_t rr = vsubq_f32(vdupq_n_f32(c.w), vmulq_f32(d, d));
+    return toMask(vcgtq_f32(rr, vdupq_n_f32(0.0f)));
+#elif FILAMENT_FROXELIZER_SSE2
+    __m128 x = _mm_loadu_ps(&planes[0].x);
+    __m128 y = _mm_loadu_ps(&planes[1].x);
+    __m128 z = _mm_loadu_ps(&planes[2].x);
+    __m128 w = _mm_loadu_ps(&planes[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    const __m128 d = _mm_add_ps(
+            _mm_mul_ps(x, _mm_set1_ps(c.x)), _mm_mul_ps(z, _mm_set1_ps(c.z)));
+    const __m128 rr = _mm_sub_ps(_mm_set1_ps(c.w), _mm_mul_ps(d, d));
+    return uint32_t(_mm_movemask_ps(_mm_cmpgt_ps(rr, _mm_setzero_ps())));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 4; i++) {
+        mask |= (spherePlaneDistanceSquared(c, planes[i].x, planes[i].z) > 0 ? 1u : 0u) << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i is set if the bounding sphere spheres[i] (radius squared) intersects the cone
+UTILS_ALWAYS_INLINE
+inline uint32_t spheresConeIntersect4(float4 const* UTILS_RESTRICT spheres,
+        float3 const& position, float3 const& axis, float invSin, float cosSqr) noexcept {
+#if FILAMENT_FROXELIZER_NEON
+    const float32x4x4_t s = vld4q_f32(&spheres[0].x);  // transposed to x, y, z, w
+    const float32x4_t k = vmulq_n_f32(s.val[3], invSin);
+    // d = sphere - (position - k * axis)
+    const float32x4_t dx = vsubq_f32(s.val[0], vmlsq_n_f32(vdupq_n_f32(position.x), k, axis.x));
+    const float32x4_t dy = vsubq_f32(s.val[1], vmlsq_n_f32(vdupq_n_f32(position.y), k, axis.y));
+    const float32x4_t dz = vsubq_f32(s.val[2], vmlsq_n_f32(vdupq_n_f32(position.z), k, axis.z));
+    const float32x4_t e = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(dx, axis.x), dy, axis.y), dz, axis.z);
+    const float32x4_t dd = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz);
+    const uint32x4_t m = vandq_u32(
+            vcgeq_f32(vmulq_f32(e, e), vmulq_n_f32(dd, cosSqr)),
+            vcgtq_f32(e, vdupq_n_f32(0.0f)));
+    return toMask(m);
+#elif FILAMENT_FROXELIZER_SSE2
+    __m128 x = _mm_loadu_ps(&spheres[0].x);
+    __m128 y = _mm_loadu_ps(&spheres[1].x);
+    __m128 z = _mm_loadu_ps(&spheres[2].x);
+    __m128 w = _mm_loadu_ps(&spheres[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    const __m128 ax = _mm_set1_ps(axis.x);
+    const __m128 ay = _mm_set1_ps(axis.y);
+    const __m128 az = _mm_set1_ps(axis.z);
+    const __m128 k = _mm_mul_ps(w, _mm_set1_ps(invSin));
+    // d = sphere - (position - k * axis)
+    const __m128 dx = _mm_sub_ps(x, _mm_sub_ps(_mm_set1_ps(position.x), _mm_mul_ps(k, ax)));
+    const __m128 dy = _mm_sub_ps(y, _mm_sub_ps(_mm_set1_ps(position.y), _mm_mul_ps(k, ay)));
+    const __m128 dz = _mm_sub_ps(z, _mm_sub_ps(_mm_set1_ps(position.z), _mm_mul_ps(k, az)));
+    const __m128 e = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(dx, ax), _mm_mul_ps(dy, ay)), _mm_mul_ps(dz, az));
+    const __m128 dd = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    const __m128 m = _mm_and_ps(
+            _mm_cmpge_ps(_mm_mul_ps(e, e), _mm_mul_ps(dd, _mm_set1_ps(cosSqr))),
+            _mm_cmpgt_ps(e, _mm_setzero_ps()));
+    return uint32_t(_mm_movemask_ps(m));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 4; i++) {
+        mask |= (sphereConeIntersectionFast(spheres[i], position, axis, invSin, cosSqr)
+                ? 1u : 0u) << i;
+    }
+    return mask;
+#endif
+}
+
+// returns the first plane in [begin, end) intersecting the circle 'c', end if there are none,
+// or begin if the range is empty.
+static size_t findFirstPlaneX(float4 const* UTILS_RESTRICT planesX,
+        size_t begin, size_t end, float4 const& c) noexcept {
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const uint32_t mask = planesXIntersect4(planesX + i, c);
+        if (mask) {
+            return i + utils::ctz(mask);
+        }
+    }
+    for (; i < end; i++) {
+        if (spherePlaneDistanceSquared(c, planesX[i].x, planesX[i].z) > 0) {
+            return i;
+        }
+    }
+    return std::max(begin, end);
+}
+
+// returns one past the last plane in [begin, end) intersecting the circle 'c', begin if there
+// are none, or end if the range is empty.
+static size_t findLastPlaneX(float4 const* UTILS_RESTRICT planesX,
+        size_t begin, size_t end, float4 const& c) noexcept {
+    size_t i = end;
+    for (; i >= begin + 4; i -= 4) {
+        const uint32_t mask = planesXIntersect4(planesX + i - 4, c);
+        if (mask) {
+            return i - 4 + (32 - utils::clz(mask));
+        }
+    }
+    for (; i > begin; i--) {
+        if (spherePlaneDistanceSquared(c, planesX[i - 1].x, planesX[i - 1].z) > 0) {
+            return i;
+        }
+    }
+    return std::min(begin, end);
+}
+
 void Froxelizer::froxelizePointAndSpotLight(
-        FroxelThreadData& froxelThread, size_t bit,
+        std::vector<uint16_t>& froxels,
         mat4f const& UTILS_RESTRICT p,
-        const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
+        const Froxelizer::LightParams& UTILS_RESTRICT light,
+        size_t zbegin, size_t zend) const noexcept {
 
     if (UTILS_UNLIKELY(light.position.z + light.radius < -mZLightFar)) { // z values are negative
         // This light is fully behind LightFar, it doesn't light anything
@@ -793,8 +1037,8 @@ void Froxelizer::froxelizePointAndSpotLight(
     const size_t x1 = mFroxelCountX;
     const size_t y0 = 0;
     const size_t y1 = mFroxelCountY - 1;
-    const size_t z0 = 0;
-    const size_t z1 = mFroxelCountZ - 1;
+    const size_t z0 = zbegin;
+    const size_t z1 = zend - 1;
 #else
     // find a reasonable bounding-box in froxel space for the sphere by projecting
     // it's (clipped) bounding-box to clip-space and converting to froxel indices.
@@ -816,16 +1060,19 @@ void Froxelizer::froxelizePointAndSpotLight(
     const auto imin = clipToIndices(min(xyLeftNear, xyLeftFar));
     const size_t x0 = imin.first;
     const size_t y0 = imin.second;
-    const size_t z0 = findSliceZ(znear);
+    const size_t z0 = std::max(zbegin, findSliceZ(znear));
 
     const auto imax = clipToIndices(max(xyRightNear, xyRightFar));
     const size_t x1 = imax.first  + 1;  // x1 points to 1 past the last value (like end() does
     const size_t y1 = imax.second;      // y1 points to the last value
-    const size_t z1 = findSliceZ(zfar); // z1 points to the last value
+    const size_t z1 = std::min(zend - 1, findSliceZ(zfar)); // z1 points to the last value
 
     assert(x0 < x1);
     assert(y0 <= y1);
-    assert(z0 <= z1);
+    if (z0 > z1) {
+        // the light doesn't touch the slices we're interested in
+        return;
+    }
 #endif
 
     const size_t zcenter = findSliceZ(s.z);
@@ -854,47 +1101,46 @@ void Froxelizer::froxelizePointAndSpotLight(
                     cy = spherePlaneIntersection(cz, plane.y, plane.z);
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
-                    size_t bx, ex; // horizontal begin/end indices
-                    // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
-
-                    // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
-                    ++ex;
-
+                    // find the begin index (left side) and the end index (right side),
+                    // x1 is past the end
+                    const size_t bx = findFirstPlaneX(planesX, x0, xcenter + 1, cy);
+                    const size_t ex = findLastPlaneX(planesX, xcenter + 1, x1, cy);
                     if (UTILS_UNLIKELY(bx >= ex)) {
                         continue;
                     }
 
                     assert(bx < mFroxelCountX && ex <= mFroxelCountX);
 
-                    // The first entry reserved for type of light, i.e. point/spot
-                    size_t fi = getFroxelIndex(bx, iy, iz) + 1;
+                    uint16_t fi = getFroxelIndex(bx, iy, iz);
+                    size_t n = froxels.size();
+                    froxels.resize(n + (ex - bx));
+                    uint16_t* const UTILS_RESTRICT out = froxels.data();
                     if (light.invSin != std::numeric_limits<float>::infinity()) {
                         // This is a spotlight (common case)
-                        // this loops gets vectorized (on arm64) w/ clang
-                        while (bx++ != ex) {
+                        // all froxels are written, but only the ones intersecting the cone
+                        // are kept, which keeps this loop branch-less
+                        size_t ix = bx;
+                        for (; ix + 4 <= ex; ix += 4, fi += 4) {
+                            const uint32_t mask = spheresConeIntersect4(boundingSpheres + fi,
+                                    light.position, light.axis, light.invSin, light.cosSqr);
+                            for (size_t k = 0; k < 4; k++) {
+                                out[n] = uint16_t(fi + k);
+                                n += (mask >> k) & 1u;
+                            }
+                        }
+                        for (; ix < ex; ix++) {
                             // see if this froxel intersects the cone
-                            bool intersect = sphereConeIntersectionFast(boundingSpheres[fi - 1],
+                            bool intersect = sphereConeIntersectionFast(boundingSpheres[fi],
                                     light.position, light.axis, light.invSin, light.cosSqr);
-                            froxelThread[fi++] |= LightGroupType(intersect) << bit;
+                            out[n] = fi++;
+                            n += intersect ? 1 : 0;
                         }
                     } else {
-                        // this loops gets vectorized (on arm64) w/ clang
-                        while (bx++ != ex) {
-                            froxelThread[fi++] |= LightGroupType(1) << bit;
+                        for (size_t ix = bx; ix < ex; ix++) {
+                            out[n++] = fi++;
                         }
                     }
+                    froxels.resize(n);
                 }
             }
         }
@@ -120,7 +120,9 @@ void GPUBuffer::terminate(backend::DriverApi& driverApi) noexcept {
 void GPUBuffer::commitSlow(backend::DriverApi& driverApi, void const* begin, void const* end) noexcept {
     const uintptr_t sizeInBytes = uintptr_t(end) - uintptr_t(begin);
     assert(sizeInBytes <= mRowSizeInBytes * mHeight);
-    driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, mHeight,
+    assert(sizeInBytes % mRowSizeInBytes == 0);
+    const uint32_t rowCount = uint32_t(sizeInBytes / mRowSizeInBytes);
+    driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, rowCount,
             { begin, sizeInBytes, mFormat, mType });
 }
 
@@ -60,8 +60,10 @@ public:
     void terminate(backend::DriverApi& driverApi) noexcept;
 
     size_t getSize() const noexcept { return mSize; }
+    size_t getRowCount() const noexcept { return mHeight; }
 
-    // source data isn't copied and must stay valid until the command-buffer is executed
+    // Source data isn't copied and must stay valid until the command-buffer is executed.
+    // Only the rows covered by the data are updated, the data must be made of whole rows.
     void commit(backend::DriverApi& driverApi, void const* begin, void const* end) noexcept {
         commitSlow(driverApi, begin, end);
     }
@@ -36,6 +36,7 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
 #include <sstream>
 
 using namespace utils;
@@ -242,6 +243,11 @@ void FMaterial::terminate(FEngine& engine) {
     DriverApi& driverApi = engine.getDriverApi();
     auto& cachedPrograms = mCachedPrograms;
     for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
+        if (mPendingPrograms[i]) {
+            // the cached program, if any, is a fallback owned by another variant
+            driverApi.destroyProgram(mPendingPrograms[i]);
+            continue;
+        }
         if (!mIsDefaultMaterial) {
             // The depth variants may be shared with the default material, in which case
             // we should not free it now.
@@ -253,6 +259,12 @@ void FMaterial::terminate(FEngine& engine) {
         }
         driverApi.destroyProgram(cachedPrograms[i]);
     }
+    // the driver still has our compilePrograms() requests, they're freed by onProgramsCompiled()
+    // at the latest when the Engine shuts down
+    for (CompileRequest* request : mCompileRequests) {
+        request->material = nullptr;
+    }
+    mCompileRequests.clear();
     mDefaultInstance.terminate(engine);
 }
 
@@ -267,10 +279,100 @@ bool FMaterial::hasParameter(const char* name) const noexcept {
     return true;
 }
 
+MaterialInstance::ParameterHandle FMaterial::getParameterHandle(
+        const char* name) const noexcept {
+    ParameterHandle handle;
+    handle.mMaterialId = mMaterialId;
+    if (UniformInterfaceBlock::UniformInfo const* info =
+            mUniformInterfaceBlock.getUniformInfo(name)) {
+        handle.mOffset = uint32_t(info->getBufferOffset());
+        handle.mCount = info->size;
+        handle.mType = info->type;
+    } else if (mSamplerInterfaceBlock.hasSampler(name)) {
+        handle.mOffset = mSamplerInterfaceBlock.getSamplerInfo(name)->offset;
+        handle.mCount = 1;
+        handle.mIsSampler = true;
+    }
+    return handle;
+}
+
 backend::Handle<backend::HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
-    const ShaderModel sm = mEngine.getDriver().getShaderModel();
+    // Until the program is compiled, a variant that's ready is used in its place, so that
+    // rendering doesn't wait for the compilation.
+    const uint8_t fallbackKey = getFallbackVariant(variantKey);
+    Handle<HwProgram> program = mPendingPrograms[variantKey];
+    if (fallbackKey == variantKey) {
+        // there is nothing to render with in the meantime
+        if (!program) {
+            program = createProgram(variantKey);
+        }
+        mPendingPrograms[variantKey].clear();
+        mCachedPrograms[variantKey] = program;
+        return program;
+    }
+    if (!program) {
+        mPendingPrograms[variantKey] = createProgram(variantKey);
+        compilePrograms(1u << variantKey, nullptr, nullptr);
+    }
+    mCachedPrograms[variantKey] = mCachedPrograms[fallbackKey];
+    return mCachedPrograms[variantKey];
+}
+
+uint8_t FMaterial::getFallbackVariant(uint8_t variantKey) const noexcept {
+    // a variant is ready when its program was created and isn't being compiled
+    uint32_t readyVariants = 0;
+    for (size_t k = 0; k < VARIANT_COUNT; k++) {
+        if (mCachedPrograms[k] && !mPendingPrograms[k]) {
+            readyVariants |= 1u << k;
+        }
+    }
+    return Variant::getFallbackVariant(variantKey, readyVariants);
+}
 
-    assert(!Variant::isReserved(variantKey));
+void FMaterial::compile(VariantMask variants,
+        CompileCallback callback, void* user) noexcept {
+    uint32_t requested = 0;
+    for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+        if ((k & ~variants) || Variant::filterVariant(k, mIsVariantLit) != k) {
+            continue;
+        }
+        if (!mCachedPrograms[k] && !mPendingPrograms[k]) {
+            mPendingPrograms[k] = createProgram(k);
+        }
+        requested |= 1u << k;
+    }
+    compilePrograms(requested, callback, user);
+}
+
+void FMaterial::compilePrograms(uint32_t variants,
+        CompileCallback callback, void* user) const noexcept {
+    // the request is freed by onProgramsCompiled()
+    CompileRequest* request = new CompileRequest{ this, variants, callback, user };
+    mCompileRequests.push_back(request);
+    mEngine.getDriverApi().compilePrograms(&FMaterial::onProgramsCompiled, request);
+}
+
+void FMaterial::onProgramsCompiled(void* user) {
+    CompileRequest* request = static_cast<CompileRequest*>(user);
+    if (FMaterial const* material = request->material) {
+        // the programs requested are ready, stop using their fallbacks
+        for (size_t k = 0; k < VARIANT_COUNT; k++) {
+            if ((request->variants & (1u << k)) && material->mPendingPrograms[k]) {
+                material->mCachedPrograms[k] = material->mPendingPrograms[k];
+                material->mPendingPrograms[k].clear();
+            }
+        }
+        auto& requests = material->mCompileRequests;
+        requests.erase(std::find(requests.begin(), requests.end(), request));
+    }
+    if (request->callback) {
+        request->callback(request->user);
+    }
+    delete request;
+}
+
+backend::Handle<backend::HwProgram> FMaterial::createProgram(uint8_t variantKey) const noexcept {
+    const ShaderModel sm = mEngine.getDriver().getShaderModel();
 
     uint8_t vertexVariantKey = Variant::filterVariantVertex(variantKey);
     uint8_t fragmentVariantKey = Variant::filterVariantFragment(variantKey);
@@ -308,7 +410,6 @@ backend::Handle<backend::HwProgram> FMaterial::getProgramSlow(uint8_t variantKey
             .withVertexShader(vsBuilder.data(), vsBuilder.size())
             .withFragmentShader(fsBuilder.data(), fsBuilder.size())
             .setUniformBlock(BindingPoints::PER_VIEW, UibGenerator::getPerViewUib().getName())
-            .setUniformBlock(BindingPoints::LIGHTS, UibGenerator::getLightsUib().getName())
             .setUniformBlock(BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib().getName())
             .setUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, mUniformInterfaceBlock.getName());
 
@@ -340,8 +441,6 @@ backend::Handle<backend::HwProgram> FMaterial::getProgramSlow(uint8_t variantKey
 
     auto program = mEngine.getDriverApi().createProgram(std::move(pb));
     assert(program);
-
-    mCachedPrograms[variantKey] = program;
     return program;
 }
 
@@ -383,6 +482,19 @@ size_t FMaterial::getParameters(ParameterInfo* parameters, size_t count) const n
 
 using namespace details;
 
+static_assert(Material::DIRECTIONAL_LIGHTING == Variant::DIRECTIONAL_LIGHTING &&
+              Material::DYNAMIC_LIGHTING == Variant::DYNAMIC_LIGHTING &&
+              Material::SHADOW_RECEIVER == Variant::SHADOW_RECEIVER &&
+              Material::SKINNING == Variant::SKINNING &&
+              Material::ALL_VARIANTS == VARIANT_COUNT - 1,
+        "Material::VariantMask doesn't match Variant");
+
+constexpr Material::VariantMask Material::DIRECTIONAL_LIGHTING;
+constexpr Material::VariantMask Material::DYNAMIC_LIGHTING;
+constexpr Material::VariantMask Material::SHADOW_RECEIVER;
+constexpr Material::VariantMask Material::SKINNING;
+constexpr Material::VariantMask Material::ALL_VARIANTS;
+
 MaterialInstance* Material::createInstance() const noexcept {
     return upcast(this)->createInstance();
 }
@@ -455,6 +567,14 @@ bool Material::hasParameter(const char* name) const noexcept {
     return upcast(this)->hasParameter(name);
 }
 
+void Material::compile(VariantMask variants, CompileCallback callback, void* user) noexcept {
+    upcast(this)->compile(variants, callback, user);
+}
+
+Material::ParameterHandle Material::getParameterHandle(const char* name) const noexcept {
+    return upcast(this)->getParameterHandle(name);
+}
+
 MaterialInstance* Material::getDefaultInstance() noexcept {
     return upcast(this)->getDefaultInstance();
 }
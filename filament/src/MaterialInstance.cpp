@@ -28,6 +28,8 @@
 
 #include <utils/Log.h>
 
+#include <type_traits>
+
 #include <string.h>
 
 using namespace filament::math;
@@ -138,6 +140,64 @@ void FMaterialInstance::setParameter(const char* name,
     mSamplers.setSampler(index, { upcast(texture)->getHwHandle(), sampler.getSamplerParams() });
 }
 
+// The handle versions skip the name lookup, the handle must come from our material.
+
+// the uniform type of each of the types the handle versions are instantiated with
+template<UniformType TYPE> using TypeConstant = std::integral_constant<UniformType, TYPE>;
+template<typename T> struct UniformTypeOf;
+template<> struct UniformTypeOf<bool>     : TypeConstant<UniformType::BOOL> {};
+template<> struct UniformTypeOf<bool2>    : TypeConstant<UniformType::BOOL2> {};
+template<> struct UniformTypeOf<bool3>    : TypeConstant<UniformType::BOOL3> {};
+template<> struct UniformTypeOf<bool4>    : TypeConstant<UniformType::BOOL4> {};
+template<> struct UniformTypeOf<float>    : TypeConstant<UniformType::FLOAT> {};
+template<> struct UniformTypeOf<float2>   : TypeConstant<UniformType::FLOAT2> {};
+template<> struct UniformTypeOf<float3>   : TypeConstant<UniformType::FLOAT3> {};
+template<> struct UniformTypeOf<float4>   : TypeConstant<UniformType::FLOAT4> {};
+template<> struct UniformTypeOf<int32_t>  : TypeConstant<UniformType::INT> {};
+template<> struct UniformTypeOf<int2>     : TypeConstant<UniformType::INT2> {};
+template<> struct UniformTypeOf<int3>     : TypeConstant<UniformType::INT3> {};
+template<> struct UniformTypeOf<int4>     : TypeConstant<UniformType::INT4> {};
+template<> struct UniformTypeOf<uint32_t> : TypeConstant<UniformType::UINT> {};
+template<> struct UniformTypeOf<uint2>    : TypeConstant<UniformType::UINT2> {};
+template<> struct UniformTypeOf<uint3>    : TypeConstant<UniformType::UINT3> {};
+template<> struct UniformTypeOf<uint4>    : TypeConstant<UniformType::UINT4> {};
+template<> struct UniformTypeOf<mat3f>    : TypeConstant<UniformType::MAT3> {};
+template<> struct UniformTypeOf<mat4f>    : TypeConstant<UniformType::MAT4> {};
+
+// An invalid handle, e.g. a default constructed one, is a no-op and isn't checked further.
+
+template<typename T>
+inline void FMaterialInstance::setParameter(ParameterHandle handle, T value) noexcept {
+    if (!handle.isValid() || handle.mIsSampler) {
+        return;
+    }
+    assert(handle.mMaterialId == mMaterial->getId());
+    assert(handle.mType == UniformTypeOf<T>::value);
+    mUniforms.setUniform<T>(handle.mOffset, value);  // handles specialization for mat3f
+}
+
+template <typename T>
+inline void FMaterialInstance::setParameter(ParameterHandle handle,
+        const T* value, size_t count) noexcept {
+    if (!handle.isValid() || handle.mIsSampler) {
+        return;
+    }
+    assert(handle.mMaterialId == mMaterial->getId());
+    assert(handle.mType == UniformTypeOf<T>::value);
+    assert(count <= handle.mCount);
+    mUniforms.setUniformArray<T>(handle.mOffset, value, count);
+}
+
+void FMaterialInstance::setParameter(ParameterHandle handle,
+        Texture const* texture, TextureSampler const& sampler) noexcept {
+    if (!handle.isValid() || !handle.mIsSampler) {
+        return;
+    }
+    assert(handle.mMaterialId == mMaterial->getId());
+    mSamplers.setSampler(handle.mOffset,
+            { upcast(texture)->getHwHandle(), sampler.getSamplerParams() });
+}
+
 void FMaterialInstance::setDoubleSided(bool doubleSided) noexcept {
     if (!mMaterial->hasDoubleSidedCapability()) {
         slog.w << "Parent material does not have double-sided capability." << io::endl;
@@ -217,6 +277,70 @@ void MaterialInstance::setParameter(const char* name, RgbaType type, float4 colo
     upcast(this)->setParameter<float4>(name, Color::toLinear(type, color));
 }
 
+template <typename T>
+void MaterialInstance::setParameter(ParameterHandle handle, T value) noexcept {
+    upcast(this)->setParameter<T>(handle, value);
+}
+
+// explicit template instantiation of our supported types
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool>    (ParameterHandle h, bool     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float>   (ParameterHandle h, float    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int32_t> (ParameterHandle h, int32_t  v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint32_t>(ParameterHandle h, uint32_t v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool2>   (ParameterHandle h, bool2    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool3>   (ParameterHandle h, bool3    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool4>   (ParameterHandle h, bool4    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int2>    (ParameterHandle h, int2     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int3>    (ParameterHandle h, int3     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int4>    (ParameterHandle h, int4     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint2>   (ParameterHandle h, uint2    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint3>   (ParameterHandle h, uint3    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint4>   (ParameterHandle h, uint4    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float2>  (ParameterHandle h, float2   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float3>  (ParameterHandle h, float3   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float4>  (ParameterHandle h, float4   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat3f>   (ParameterHandle h, mat3f    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat4f>   (ParameterHandle h, mat4f    v);
+
+template <typename T>
+void MaterialInstance::setParameter(ParameterHandle handle,
+        const T* value, size_t count) noexcept {
+    upcast(this)->setParameter<T>(handle, value, count);
+}
+
+// explicit template instantiation of our supported types
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool>    (ParameterHandle h, const bool     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float>   (ParameterHandle h, const float    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int32_t> (ParameterHandle h, const int32_t  *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint32_t>(ParameterHandle h, const uint32_t *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool2>   (ParameterHandle h, const bool2    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool3>   (ParameterHandle h, const bool3    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool4>   (ParameterHandle h, const bool4    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int2>    (ParameterHandle h, const int2     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int3>    (ParameterHandle h, const int3     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int4>    (ParameterHandle h, const int4     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint2>   (ParameterHandle h, const uint2    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint3>   (ParameterHandle h, const uint3    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint4>   (ParameterHandle h, const uint4    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float2>  (ParameterHandle h, const float2   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float3>  (ParameterHandle h, const float3   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float4>  (ParameterHandle h, const float4   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat3f>   (ParameterHandle h, const mat3f    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat4f>   (ParameterHandle h, const mat4f    *v, size_t c);
+
+void MaterialInstance::setParameter(ParameterHandle handle, Texture const* texture,
+        TextureSampler const& sampler) noexcept {
+    upcast(this)->setParameter(handle, texture, sampler);
+}
+
+void MaterialInstance::setParameter(ParameterHandle handle, RgbType type, float3 color) noexcept {
+    upcast(this)->setParameter<float3>(handle, Color::toLinear(type, color));
+}
+
+void MaterialInstance::setParameter(ParameterHandle handle, RgbaType type, float4 color) noexcept {
+    upcast(this)->setParameter<float4>(handle, Color::toLinear(type, color));
+}
+
 void MaterialInstance::setScissor(uint32_t left, uint32_t bottom, uint32_t width,
         uint32_t height) noexcept {
     upcast(this)->setScissor(left, bottom, width, height);
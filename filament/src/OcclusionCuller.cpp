@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+#include <math.h>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+// the faces of an AABB, counter-clockwise when seen from the outside. The corner i of the
+// AABB is at center + extent * (bit0 ? 1 : -1, bit1 ? 1 : -1, bit2 ? 1 : -1).
+static constexpr uint8_t sFaces[6][4] = {
+        { 0, 4, 6, 2 },     // -x
+        { 1, 3, 7, 5 },     // +x
+        { 0, 1, 5, 4 },     // -y
+        { 2, 6, 7, 3 },     // +y
+        { 0, 2, 3, 1 },     // -z
+        { 4, 5, 7, 6 },     // +z
+};
+
+static inline float cross(float3 const& o, float3 const& a, float3 const& b) noexcept {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+OcclusionCuller::OcclusionCuller() noexcept {
+    size_t w = WIDTH;
+    size_t h = HEIGHT;
+    size_t level = 0;
+    while (w >= 1 && h >= 1 && level < sizeof(mLevels) / sizeof(*mLevels)) {
+        mLevels[level++].resize(w * h, std::numeric_limits<float>::max());
+        w /= 2;
+        h /= 2;
+    }
+    mLevelCount = level;
+}
+
+OcclusionCuller::~OcclusionCuller() noexcept = default;
+
+bool OcclusionCuller::project(mat4f const& clipFromWorld,
+        float3 const& center, float3 const& extent, float3* corners) noexcept {
+    const float4 c = clipFromWorld * float4{ center, 1 };
+    const float4 x = clipFromWorld[0] * extent.x;
+    const float4 y = clipFromWorld[1] * extent.y;
+    const float4 z = clipFromWorld[2] * extent.z;
+    for (size_t i = 0; i < 8; i++) {
+        const float4 p = c + (i & 1 ? x : -x) + (i & 2 ? y : -y) + (i & 4 ? z : -z);
+        // all corners must be in front of the near plane
+        if (!(p.w > 0 && p.z >= -p.w)) {
+            return false;
+        }
+        const float3 ndc = p.xyz * (1.0f / p.w);
+        corners[i] = float3{
+                (ndc.x * 0.5f + 0.5f) * WIDTH,
+                (ndc.y * 0.5f + 0.5f) * HEIGHT,
+                ndc.z };
+    }
+    return true;
+}
+
+bool OcclusionCuller::setupOccluder(float3 const* corners, Occluder* occluder) noexcept {
+    // compute the convex hull of the projected corners (monotone chain), counter-clockwise
+    float3 points[8];
+    std::copy(corners, corners + 8, points);
+    std::sort(points, points + 8, [](float3 const& lhs, float3 const& rhs) {
+        return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+    });
+    float3 hull[16];
+    size_t k = 0;
+    for (size_t i = 0; i < 8; i++) {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = 7, t = k + 1; i > 0; i--) {
+        while (k >= t && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) k--;
+        hull[k++] = points[i - 1];
+    }
+    const size_t hullSize = k - 1;  // the last point is the same as the first one
+
+    // the projection of an AABB has at most 6 sides
+    if (hullSize < 3 || hullSize > 6) {
+        return false;
+    }
+
+    float xmin = hull[0].x, xmax = hull[0].x;
+    float ymin = hull[0].y, ymax = hull[0].y;
+    for (size_t i = 0; i < hullSize; i++) {
+        float3 const& a = hull[i];
+        float3 const& b = hull[i + 1];
+        // a pixel is inside if its 4 corners are on the inner side of the edge
+        const float A = a.y - b.y;
+        const float B = b.x - a.x;
+        const float C = a.x * b.y - a.y * b.x;
+        occluder->edges[i] = { A, B, C - 0.5f * (std::abs(A) + std::abs(B)) };
+        xmin = std::min(xmin, a.x);
+        xmax = std::max(xmax, a.x);
+        ymin = std::min(ymin, a.y);
+        ymax = std::max(ymax, a.y);
+    }
+    occluder->edgeCount = uint8_t(hullSize);
+
+    if (xmax <= 0 || xmin >= WIDTH || ymax <= 0 || ymin >= HEIGHT) {
+        return false;
+    }
+    occluder->ymin = uint16_t(std::max(0.0f, std::floor(ymin)));
+    occluder->ymax = uint16_t(std::min(float(HEIGHT), std::ceil(ymax)));
+
+    // Along any ray hitting the box, the depth of the box's surface is the farthest of the depths
+    // of its front faces' planes, we store these planes here. Planes of faces seen almost
+    // edge-on have a very steep gradient, but they're only large near the box's silhouette, so
+    // they're correctly accounted for.
+    size_t depthCount = 0;
+    for (auto const& face : sFaces) {
+        float3 const& p0 = corners[face[0]];
+        float3 const& p1 = corners[face[1]];
+        float3 const& p2 = corners[face[2]];
+        const float area = cross(p0, p1, p2);
+        if (area <= std::numeric_limits<float>::epsilon()) {
+            // back-facing or degenerate
+            continue;
+        }
+        const float zx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / area;
+        const float zy = ((p1.x - p0.x) * (p2.z - p0.z) - (p2.x - p0.x) * (p1.z - p0.z)) / area;
+        const float zc = p0.z - zx * p0.x - zy * p0.y;
+        // offset the plane to the farthest corner of the pixel
+        occluder->depth[depthCount++] = { zx, zy, zc + 0.5f * (std::abs(zx) + std::abs(zy)) };
+        if (depthCount == 3) {
+            break;
+        }
+    }
+    occluder->depthCount = uint8_t(depthCount);
+    for (size_t i = depthCount; i < 3; i++) {
+        occluder->depth[i] = { 0, 0, std::numeric_limits<float>::lowest() };
+    }
+    return depthCount > 0;
+}
+
+void OcclusionCuller::rasterize(JobSystem& js, mat4f const& clipFromWorld,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        uint32_t const* UTILS_RESTRICT occluders, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    mClipFromWorld = clipFromWorld;
+
+    mOccluders.clear();
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t index = occluders[i];
+        float3 corners[8];
+        Occluder occluder; // NOLINT
+        if (project(clipFromWorld, center[index], extent[index], corners) &&
+            setupOccluder(corners, &occluder)) {
+            mOccluders.push_back(occluder);
+        }
+    }
+
+    SYSTRACE_VALUE32("occluders", mOccluders.size());
+
+    // rasterization job (this runs on multiple threads)
+    auto functor = [this](uint32_t index, uint32_t c) {
+        for (uint32_t band = index; band < index + c; band++) {
+            rasterizeBand(band);
+        }
+    };
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(HEIGHT / BAND_HEIGHT),
+            std::cref(functor), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    buildHierarchy();
+}
+
+void OcclusionCuller::rasterizeBand(size_t band) noexcept {
+    const size_t y0 = band * BAND_HEIGHT;
+    const size_t y1 = y0 + BAND_HEIGHT;
+    float* const UTILS_RESTRICT depth = mLevels[0].data();
+
+    std::fill(depth + y0 * WIDTH, depth + y1 * WIDTH, std::numeric_limits<float>::max());
+
+    for (Occluder const& occluder : mOccluders) {
+        const size_t ymin = std::max(y0, size_t(occluder.ymin));
+        const size_t ymax = std::min(y1, size_t(occluder.ymax));
+        for (size_t y = ymin; y < ymax; y++) {
+            const float py = y + 0.5f;
+
+            // find the span of pixels fully covered by the occluder on this line
+            float lo = 0.0f;
+            float hi = float(WIDTH);
+            for (size_t i = 0; i < occluder.edgeCount; i++) {
+                Plane const& e = occluder.edges[i];
+                const float v = e.b * py + e.c;
+                if (e.a > 0) {
+                    lo = std::max(lo, -v / e.a);
+                } else if (e.a < 0) {
+                    hi = std::min(hi, -v / e.a);
+                } else if (v < 0) {
+                    hi = lo;
+                }
+            }
+            const float xs = std::ceil(lo - 0.5f);
+            const float xe = std::floor(hi - 0.5f);
+            if (xs > xe) {
+                continue;
+            }
+
+            const Plane d0 = occluder.depth[0];
+            const Plane d1 = occluder.depth[1];
+            const Plane d2 = occluder.depth[2];
+            const float c0 = d0.b * py + d0.c;
+            const float c1 = d1.b * py + d1.c;
+            const float c2 = d2.b * py + d2.c;
+            float* const UTILS_RESTRICT line = depth + y * WIDTH;
+            // this loop is vectorized
+            for (size_t x = size_t(xs), e = size_t(xe); x <= e; x++) {
+                const float px = x + 0.5f;
+                const float z = std::max(d0.a * px + c0,
+                                std::max(d1.a * px + c1, d2.a * px + c2));
+                line[x] = std::min(line[x], z);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildHierarchy() noexcept {
+    SYSTRACE_CALL();
+    size_t w = WIDTH;
+    for (size_t level = 1; level < mLevelCount; level++) {
+        float const* const UTILS_RESTRICT src = mLevels[level - 1].data();
+        float* const UTILS_RESTRICT dst = mLevels[level].data();
+        const size_t h = HEIGHT >> level;
+        w /= 2;
+        for (size_t y = 0; y < h; y++) {
+            float const* const UTILS_RESTRICT l0 = src + (y * 2 + 0) * w * 2;
+            float const* const UTILS_RESTRICT l1 = src + (y * 2 + 1) * w * 2;
+            for (size_t x = 0; x < w; x++) {
+                dst[y * w + x] = std::max(
+                        std::max(l0[x * 2], l0[x * 2 + 1]),
+                        std::max(l1[x * 2], l1[x * 2 + 1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(ScreenBounds const& bounds) const noexcept {
+    if (bounds.max.x <= 0 || bounds.min.x >= WIDTH ||
+        bounds.max.y <= 0 || bounds.min.y >= HEIGHT) {
+        // this is not visible at all, but that's not for us to decide
+        return false;
+    }
+
+    const size_t x0 = size_t(std::max(0.0f, bounds.min.x));
+    const size_t y0 = size_t(std::max(0.0f, bounds.min.y));
+    const size_t x1 = std::min(size_t(bounds.max.x), WIDTH - 1);
+    const size_t y1 = std::min(size_t(bounds.max.y), HEIGHT - 1);
+
+    // pick the level where the bounds cover at most 2x2 texels
+    size_t level = 0;
+    while (level + 1 < mLevelCount &&
+           ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+
+    float const* const UTILS_RESTRICT depth = mLevels[level].data();
+    const size_t w = WIDTH >> level;
+    float farthest = std::numeric_limits<float>::lowest();
+    for (size_t y = y0 >> level; y <= y1 >> level; y++) {
+        for (size_t x = x0 >> level; x <= x1 >> level; x++) {
+            farthest = std::max(farthest, depth[y * w + x]);
+        }
+    }
+    return bounds.min.z > farthest;
+}
+
+size_t OcclusionCuller::cull(JobSystem& js,
+        float3 const* center, float3 const* extent,
+        uint32_t const* occludees, size_t count,
+        uint8_t* results, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (mOccluders.empty()) {
+        return 0;
+    }
+
+    std::atomic<uint32_t> culled = { 0 };
+    const uint8_t mask = uint8_t(~(1u << bit));
+
+    // culling job (this runs on multiple threads)
+    auto functor = [this, center, extent, occludees, results, mask, &culled]
+            (uint32_t index, uint32_t c) {
+        uint32_t hidden = 0;
+        for (uint32_t i = index; i < index + c; i++) {
+            const uint32_t j = occludees[i];
+            float3 corners[8];
+            if (!project(mClipFromWorld, center[j], extent[j], corners)) {
+                continue;
+            }
+            ScreenBounds bounds{ corners[0], corners[0] };
+            for (size_t k = 1; k < 8; k++) {
+                bounds.min = min(bounds.min, corners[k]);
+                bounds.max = max(bounds.max, corners[k]);
+            }
+            if (isOccluded(bounds)) {
+                results[j] &= mask;
+                hidden++;
+            }
+        }
+        culled.fetch_add(hidden, std::memory_order_relaxed);
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(functor), jobs::CountSplitter<64, 8>());
+    js.runAndWait(job);
+
+    SYSTRACE_VALUE32("occlusionCulled", culled.load(std::memory_order_relaxed));
+
+    return culled.load(std::memory_order_relaxed);
+}
+
+} // namespace details
+} // namespace filament
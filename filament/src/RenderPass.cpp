@@ -31,6 +31,8 @@
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <iterator>
 #include <utility>
 
 using namespace utils;
@@ -60,13 +62,18 @@ void RenderPass::setRenderFlags(RenderPass::RenderFlags flags) noexcept {
     mFlags = flags;
 }
 
+void RenderPass::setVisibilityMask(Culler::result_type mask) noexcept {
+    mVisibilityMask = mask;
+}
+
 void RenderPass::overridePolygonOffset(backend::PolygonOffset* polygonOffset) noexcept {
     if ((mPolygonOffsetOverride = (polygonOffset != nullptr))) {
         mPolygonOffset = *polygonOffset;
     }
 }
 
-void RenderPass::generateSortedCommands(CommandTypeFlags const commandTypeFlags) noexcept {
+Slice<RenderPass::Command> RenderPass::generateSortedCommands(
+        CommandTypeFlags const commandTypeFlags) noexcept {
     SYSTRACE_CONTEXT();
 
     FEngine& engine = mEngine;
@@ -90,15 +97,26 @@ void RenderPass::generateSortedCommands(CommandTypeFlags const commandTypeFlags)
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
     growBy *= uint32_t(colorPass * 2 + depthPass);
+
+    // the renderables drawn are the ones visible in this pass
+    Culler::result_type visibilityMask = mVisibilityMask;
+    if (!visibilityMask) {
+        visibilityMask = (commandTypeFlags & CommandTypeFlags::SHADOW) ?
+                FScene::VISIBLE_SHADOW_CASTER : FScene::VISIBLE_RENDERABLE;
+    }
+
+    // commands generated by previous passes are kept
+    const uint32_t first = uint32_t(commands.size());
     Command* const curr = commands.grow(growBy);
 
     // we extract camera position/forward outside of the loop, because these are not cheap.
     const float3 cameraPosition(camera.getPosition());
     const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
+    auto work = [commandTypeFlags, curr, &soa, renderFlags, visibilityMask,
+            cameraPosition, cameraForwardVector]
             (uint32_t startIndex, uint32_t indexCount) {
         RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags,
+                soa, { startIndex, startIndex + indexCount }, renderFlags, visibilityMask,
                 cameraPosition, cameraForwardVector);
     };
 
@@ -110,33 +128,230 @@ void RenderPass::generateSortedCommands(CommandTypeFlags const commandTypeFlags)
         js.runAndWait(jobCommandsParallel);
     }
 
-    // always add an "eof" command
-    // "eof" command. these commands are guaranteed to be sorted last in the
-    // command buffer.
-    commands.grow(1)->key = uint64_t(Pass::SENTINEL);
+    mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
 
-    { // sort all commands
+    { // sort the commands of this pass and drop the ones we don't need
         SYSTRACE_NAME("sort commands");
-        std::sort(commands.begin(), commands.end());
+        ArenaScope arena(engine.getPerRenderPassAllocator());
+        bool outOfMemory = false;
+        Command const* const last = sortCommands(js, arena, curr, commands.end(), &outOfMemory);
+        commands.resize(uint32_t(last - commands.begin()));
+        if (UTILS_UNLIKELY(outOfMemory)) {
+            engine.debug.renderer.sort_fallbacks++;
+        }
     }
 
-    mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
+    return { commands.begin() + first, commands.end() };
+}
 
+/* static */
+RenderPass::Command* RenderPass::sortCommands(JobSystem& js, ArenaScope& arena,
+        Command* const begin, Command* const end, bool* outOfMemory) noexcept {
+    if (size_t(end - begin) >= RADIX_SORT_MIN_COMMAND_COUNT) {
+        Command* const last = sortCommandsRadix(js, arena, begin, end);
+        if (UTILS_LIKELY(last)) {
+            return last;
+        }
+        // we ran out of scratch memory, fallback to std::sort
+        if (outOfMemory) {
+            *outOfMemory = true;
+        }
+    }
 
+    std::sort(begin, end);
 
     // find the last command
-    Command const* const last = std::partition_point(commands.begin(), commands.end(),
+    return std::partition_point(begin, end,
             [](Command const& c) {
                 return ((c.key & PASS_MASK) >> PASS_SHIFT) != 0xFF;
             });
+}
+
+/* static */
+UTILS_NOINLINE
+RenderPass::Command* RenderPass::sortCommandsRadix(JobSystem& js, ArenaScope& rootArena,
+        Command* const UTILS_RESTRICT begin, Command* const end) noexcept {
+
+    struct alignas(CACHELINE_SIZE) Chunk {
+        uint32_t histogram[256];
+        CommandKey keyOr;
+        CommandKey keyAnd;
+        uint32_t first;     // first command of this chunk
+        uint32_t last;      // last command of this chunk
+        uint32_t offset;    // where this chunk's keys go in the SortKey array
+        uint32_t count;     // number of keys this chunk produces
+    };
+
+    ArenaScope arena(rootArena.getAllocator());
+
+    const uint32_t commandCount = uint32_t(end - begin);
+    const uint32_t chunkCount = uint32_t(std::min(RADIX_SORT_MAX_CHUNK_COUNT,
+            std::max(size_t(1), commandCount / RADIX_SORT_MIN_CHUNK_SIZE)));
+
+    Chunk* const UTILS_RESTRICT chunks = arena.allocate<Chunk>(chunkCount, CACHELINE_SIZE);
+    if (UTILS_UNLIKELY(!chunks)) {
+        return nullptr;
+    }
+
+    // runs work(chunkIndex) for each chunk, in parallel
+    auto parallelChunks = [&js, chunkCount](auto const& work) {
+        auto perChunk = [&work](uint32_t start, uint32_t count) {
+            for (uint32_t c = start, e = start + count; c < e; ++c) {
+                work(c);
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(perChunk), jobs::CountSplitter<1>());
+        js.runAndWait(job);
+    };
+
+    auto setChunkRanges = [chunks, chunkCount](uint32_t count) {
+        const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        for (uint32_t c = 0; c < chunkCount; c++) {
+            chunks[c].first = std::min(count, c * chunkSize);
+            chunks[c].last = std::min(count, chunks[c].first + chunkSize);
+        }
+    };
+
+    /*
+     * Count the commands we keep and find which bits of the keys actually vary
+     */
+
+    setChunkRanges(commandCount);
+    parallelChunks([begin, chunks](uint32_t c) {
+        Chunk& chunk = chunks[c];
+        CommandKey keyOr = 0;
+        CommandKey keyAnd = ~CommandKey(0);
+        uint32_t count = 0;
+        for (uint32_t i = chunk.first; i < chunk.last; i++) {
+            const CommandKey key = begin[i].key;
+            // commands in the SENTINEL pass are discarded
+            const bool keep = (key & PASS_MASK) != PASS_MASK;
+            keyOr  |= keep ? key : 0;
+            keyAnd &= keep ? key : ~CommandKey(0);
+            count += keep;
+        }
+        chunk.keyOr = keyOr;
+        chunk.keyAnd = keyAnd;
+        chunk.count = count;
+    });
+
+    uint32_t count = 0;
+    CommandKey keyOr = 0;
+    CommandKey keyAnd = ~CommandKey(0);
+    for (uint32_t c = 0; c < chunkCount; c++) {
+        chunks[c].offset = count;
+        count += chunks[c].count;
+        keyOr |= chunks[c].keyOr;
+        keyAnd &= chunks[c].keyAnd;
+    }
+
+    if (UTILS_UNLIKELY(!count)) {
+        return begin;
+    }
+
+    // Bytes that are the same in all keys don't need to be sorted. This is the case for most
+    // of the fields that don't change within a frame (e.g. pass, blending, priority, z-bucket).
+    const CommandKey varyingBits = keyOr ^ keyAnd;
+
+    // The SortKey ping-pong buffers are later reused to hold the sorted commands, so
+    // we need at least as much space as the commands themselves.
+    static_assert(2 * sizeof(SortKey) == sizeof(Command), "SortKey must be half a Command");
+    SortKey* const UTILS_RESTRICT sortKeys = arena.allocate<SortKey>(count * 2, CACHELINE_SIZE);
+    uint32_t* const UTILS_RESTRICT indices = arena.allocate<uint32_t>(count, CACHELINE_SIZE);
+    if (UTILS_UNLIKELY(!sortKeys || !indices)) {
+        return nullptr;
+    }
+
+    /*
+     * Extract the (key, index) pairs
+     */
+
+    parallelChunks([begin, chunks, sortKeys](uint32_t c) {
+        Chunk const& chunk = chunks[c];
+        SortKey* UTILS_RESTRICT out = sortKeys + chunk.offset;
+        for (uint32_t i = chunk.first; i < chunk.last; i++) {
+            const CommandKey key = begin[i].key;
+            if ((key & PASS_MASK) != PASS_MASK) {
+                *out++ = { key, i, 0 };
+            }
+        }
+    });
+
+    /*
+     * LSD radix sort, one pass per varying byte
+     */
+
+    SortKey* UTILS_RESTRICT src = sortKeys;
+    SortKey* UTILS_RESTRICT dst = sortKeys + count;
+    setChunkRanges(count);
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        if (!((varyingBits >> shift) & 0xFF)) {
+            continue;
+        }
+
+        parallelChunks([src, chunks, shift](uint32_t c) {
+            Chunk& chunk = chunks[c];
+            std::fill(std::begin(chunk.histogram), std::end(chunk.histogram), 0);
+            for (uint32_t i = chunk.first; i < chunk.last; i++) {
+                chunk.histogram[(src[i].key >> shift) & 0xFF]++;
+            }
+        });
+
+        // turn the histograms into output offsets, ordered by digit, then by chunk,
+        // which keeps the sort stable.
+        uint32_t offset = 0;
+        for (size_t d = 0; d < 256; d++) {
+            for (uint32_t c = 0; c < chunkCount; c++) {
+                const uint32_t n = chunks[c].histogram[d];
+                chunks[c].histogram[d] = offset;
+                offset += n;
+            }
+        }
+
+        parallelChunks([src, dst, chunks, shift](uint32_t c) {
+            Chunk& chunk = chunks[c];
+            for (uint32_t i = chunk.first; i < chunk.last; i++) {
+                dst[chunk.histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+            }
+        });
+
+        std::swap(src, dst);
+    }
 
-    commands.resize(uint32_t(last - commands.begin()));
+    /*
+     * Finally, move the commands in their sorted order. We only need the indices at this point,
+     * so the SortKey buffers become our scratch Command buffer.
+     */
+
+    parallelChunks([src, indices, chunks](uint32_t c) {
+        Chunk const& chunk = chunks[c];
+        for (uint32_t i = chunk.first; i < chunk.last; i++) {
+            indices[i] = src[i].index;
+        }
+    });
+
+    Command* const UTILS_RESTRICT sorted = reinterpret_cast<Command*>(sortKeys);
+    parallelChunks([begin, sorted, indices, chunks](uint32_t c) {
+        Chunk const& chunk = chunks[c];
+        for (uint32_t i = chunk.first; i < chunk.last; i++) {
+            sorted[i] = begin[indices[i]];
+        }
+    });
+
+    parallelChunks([begin, sorted, chunks](uint32_t c) {
+        Chunk const& chunk = chunks[c];
+        std::copy(sorted + chunk.first, sorted + chunk.last, begin + chunk.first);
+    });
+
+    return begin + count;
 }
 
 void RenderPass::execute(const char* name,
         backend::Handle<backend::HwRenderTarget> renderTarget,
         backend::RenderPassParams params,
-        Command const* first, Command const* last) const noexcept {
+        Command const* first, Command const* last,
+        Culler::result_type visibleMask) const noexcept {
 
     FEngine& engine = mEngine;
     FScene& scene = *mScene;
@@ -147,7 +362,7 @@ void RenderPass::execute(const char* name,
     // Now, execute all commands
     driver.pushGroupMarker(name);
     driver.beginRenderPass(renderTarget, params);
-    RenderPass::recordDriverCommands(driver, scene, first, last);
+    RenderPass::recordDriverCommands(driver, scene, first, last, visibleMask);
     driver.endRenderPass();
     driver.popGroupMarker();
 
@@ -157,7 +372,8 @@ void RenderPass::execute(const char* name,
 
 UTILS_NOINLINE // no need to be inlined
 void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
-        const Command* UTILS_RESTRICT first, const Command* last)  const noexcept {
+        const Command* UTILS_RESTRICT first, const Command* last,
+        Culler::result_type visibleMask) const noexcept {
     SYSTRACE_CALL();
 
     if (first != last) {
@@ -169,8 +385,18 @@ void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
                 mPolygonOffsetOverride ? &dummyPolyOffset : &pipeline.polygonOffset;
 
         Handle<HwUniformBuffer> uboHandle = scene.getRenderableUBO();
+        FScene::InstanceGroupSoa const& instanceGroupData = scene.getInstanceGroupData();
+        auto const* const UTILS_RESTRICT groupInstanceCount =
+                instanceGroupData.data<FScene::GROUP_INSTANCE_COUNT>();
+        auto const* const UTILS_RESTRICT groupVisibleMask =
+                instanceGroupData.data<FScene::GROUP_VISIBLE_MASK>();
+
+        // the size of the range bound must be the size of the uniform block
+        constexpr size_t uboSize = sizeof(PerRenderableUib) * CONFIG_MAX_INSTANCES;
         FMaterialInstance const* UTILS_RESTRICT mi = nullptr;
         FMaterial const* UTILS_RESTRICT ma = nullptr;
+        size_t drawCalls = 0;
+        size_t mergedDraws = 0;
         while (first != last) {
             /*
              * Be careful when changing code below, this is the hot inner-loop
@@ -187,15 +413,53 @@ void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
                 mi->use(driver);
             }
 
-            pipeline.program = ma->getProgram(info.materialVariant.key);
-            size_t offset = info.index * sizeof(PerRenderableUib);
+            pipeline.program = ma->getProgram(uint8_t(info.materialVariant));
             if (info.perRenderableBones) {
                 driver.bindUniformBuffer(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
             }
-            driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, sizeof(PerRenderableUib));
-            driver.draw(pipeline, info.primitiveHandle);
+            if (UTILS_LIKELY(!info.instanced)) {
+                // Consecutive commands drawing the same geometry with the same material, whose
+                // uniforms are in consecutive slots, are merged into a single instanced draw.
+                // The shader finds the uniforms of each renderable with the instance index.
+                size_t instanceCount = 1;
+                if (!info.perRenderableBones) {
+                    while (first + instanceCount != last &&
+                            instanceCount < CONFIG_MAX_INSTANCES &&
+                            canMerge(info, first[instanceCount].primitive, instanceCount)) {
+                        instanceCount++;
+                    }
+                }
+                size_t offset = info.index * sizeof(PerRenderableUib);
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, uboSize);
+                if (UTILS_LIKELY(instanceCount == 1)) {
+                    driver.draw(pipeline, info.primitiveHandle);
+                } else {
+                    driver.drawInstanced(pipeline, info.primitiveHandle, uint32_t(instanceCount));
+                    mergedDraws += instanceCount - 1;
+                    first += instanceCount - 1;
+                }
+                drawCalls++;
+            } else {
+                // one instanced draw call per group of instances visible in this pass
+                for (size_t group = info.index; ; group++) {
+                    const size_t count = groupInstanceCount[group];
+                    if (groupVisibleMask[group] & visibleMask) {
+                        size_t offset = scene.getInstanceGroupSlot(group) * sizeof(PerRenderableUib);
+                        driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, uboSize);
+                        driver.drawInstanced(pipeline, info.primitiveHandle,
+                                uint32_t(std::min(count, CONFIG_MAX_INSTANCES)));
+                        drawCalls++;
+                    }
+                    if (count <= CONFIG_MAX_INSTANCES) {
+                        break;
+                    }
+                }
+            }
             ++first;
         }
+
+        mEngine.debug.renderer.draw_calls += int(drawCalls);
+        mEngine.debug.renderer.merged_draws += int(mergedDraws);
     }
 }
 
@@ -207,7 +471,7 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 
     FMaterial const * const UTILS_RESTRICT ma = mi->getMaterial();
     uint8_t variant =
-            Variant::filterVariant(cmdDraw.primitive.materialVariant.key, ma->isVariantLit());
+            Variant::filterVariant(uint8_t(cmdDraw.primitive.materialVariant), ma->isVariantLit());
 
     // Below, we evaluate both commands to avoid a branch
 
@@ -227,7 +491,7 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
     cmdDraw.key = hasBlending ? keyBlending : keyDraw;
     cmdDraw.primitive.rasterState = ma->getRasterState();
     cmdDraw.primitive.mi = mi;
-    cmdDraw.primitive.materialVariant.key = variant;
+    cmdDraw.primitive.materialVariant = variant;
 
     // Code below is branch-less with clang.
 
@@ -251,6 +515,7 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 UTILS_NOINLINE
 void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
         FScene::RenderableSoa const& soa, Range<uint32_t> range, RenderFlags renderFlags,
+        Culler::result_type visibilityMask,
         float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
@@ -286,15 +551,15 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
         default: // squash IDE warning -- should never happen.
         case CommandTypeFlags::COLOR:
             generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::DEPTH_AND_COLOR:
             generateCommandsImpl<CommandTypeFlags::DEPTH_AND_COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::SHADOW:
             generateCommandsImpl<CommandTypeFlags::SHADOW>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibilityMask, cameraPosition, cameraForward);
             break;
     }
 }
@@ -305,7 +570,7 @@ UTILS_NOINLINE
 void RenderPass::generateCommandsImpl(uint32_t,
         Command* UTILS_RESTRICT curr,
         FScene::RenderableSoa const& UTILS_RESTRICT soa, Range<uint32_t> range,
-        RenderFlags renderFlags,
+        RenderFlags renderFlags, Culler::result_type visibilityMask,
         float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
@@ -321,8 +586,15 @@ void RenderPass::generateCommandsImpl(uint32_t,
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
     auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaUboIndex        = soa.data<FScene::UBO_INDEX>();
+    auto const* const UTILS_RESTRICT soaInstanceCount   = soa.data<FScene::INSTANCE_COUNT>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
+    // shadows are received from the directional light or the spot lights, without either the
+    // shadow receiver variant would be the depth variant
+    const bool hasShadowReceivers = hasShadowing &&
+            (renderFlags & (HAS_DIRECTIONAL_LIGHT | HAS_DYNAMIC_LIGHTING));
     const bool inverseFrontFaces = renderFlags & HAS_INVERSE_FRONT_FACES;
 
     Variant materialVariant;
@@ -332,8 +604,9 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
     Command cmdColor;
 
+    Variant depthVariant{ Variant::DEPTH_VARIANT };
+
     Command cmdDepth;
-    cmdDepth.primitive.materialVariant = Variant{ Variant::DEPTH_VARIANT };
     cmdDepth.primitive.rasterState = {};
     cmdDepth.primitive.rasterState.colorWrite = false;
     cmdDepth.primitive.rasterState.depthWrite = true;
@@ -373,9 +646,10 @@ void RenderPass::generateCommandsImpl(uint32_t,
         const uint32_t distanceBits = reinterpret_cast<uint32_t&>(distance);
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
-        cmdColor.primitive.index = (uint16_t)i;
+        cmdColor.primitive.index = soaUboIndex[i];
+        cmdColor.primitive.instanced = soaInstanceCount[i] != 0;
         cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
-        materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
+        materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowReceivers);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
         // we're assuming we're always doing the depth (either way, it's correct)
@@ -383,13 +657,19 @@ void RenderPass::generateCommandsImpl(uint32_t,
         cmdDepth.key = uint64_t(Pass::DEPTH);
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
-        cmdDepth.primitive.index = (uint16_t)i;
+        cmdDepth.primitive.index = soaUboIndex[i];
+        cmdDepth.primitive.instanced = soaInstanceCount[i] != 0;
         cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
-        cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
+        depthVariant.setSkinning(soaVisibility[i].skinning);
+        cmdDepth.primitive.materialVariant = depthVariant.key;
 
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
 
+        // the range can contain renderables that are not visible in this pass, e.g. the shadow
+        // casters of another cascade, their commands are cancelled
+        const bool visible = soaVisibleMask[i] & visibilityMask;
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
         /*
@@ -400,7 +680,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
             FMaterialInstance const* const mi = primitive.getMaterialInstance();
             if (colorPass) {
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
-                cmdColor.primitive.materialVariant = materialVariant;
+                cmdColor.primitive.materialVariant = materialVariant.key;
                 RenderPass::setupColorCommand(cmdColor, depthPass, mi);
                 // Inverting front faces applies to all renderables and primitives in the view
                 cmdColor.primitive.rasterState.inverseFrontFaces = inverseFrontFaces;
@@ -445,6 +725,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
+                    key |= select(!visible);
 
                     *curr = cmdColor;
                     curr->key = key;
@@ -480,6 +761,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 *curr = cmdColor;
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(!visible);
                 ++curr;
             }
 
@@ -505,6 +787,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(!visible);
                 ++curr;
             }
         }
@@ -173,14 +173,19 @@ public:
     }
 
     struct PrimitiveInfo { // 24 bytes
+        PrimitiveInfo() noexcept : index(0), instanced(false), materialVariant(0) { }
         FMaterialInstance const* mi = nullptr;                          // 8 bytes (4)
         backend::Handle<backend::HwRenderPrimitive> primitiveHandle;    // 4 bytes
         backend::Handle<backend::HwUniformBuffer> perRenderableBones;   // 4 bytes
         backend::RasterState rasterState;                               // 4 bytes
-        uint16_t index = 0;                                             // 2 bytes
-        Variant materialVariant;                                        // 1 byte
-        uint8_t reserved = {};                                          // 1 byte
+        // the renderable's UBO_INDEX, i.e. its first instance group if it's instanced,
+        // see FScene::MAX_UNIFORM_SLOT_COUNT
+        uint32_t index : 23;                                            // 23 bits
+        uint32_t instanced : 1;                                         //  1 bit
+        uint32_t materialVariant : 8;                                   //  1 byte (Variant::key)
     };
+    static_assert(FScene::MAX_UNIFORM_SLOT_COUNT <= 1u << 23,
+            "PrimitiveInfo::index can't hold all the uniform slots");
 
     struct alignas(8) Command {     // 32 bytes
         CommandKey key = 0;         //  8 bytes
@@ -207,11 +212,22 @@ public:
     void setGeometry(FScene& scene, utils::Range<uint32_t> vr) noexcept;
     void setCamera(const CameraInfo& camera) noexcept;
     void setRenderFlags(RenderFlags flags) noexcept;
-    void generateSortedCommands(CommandTypeFlags commandType) noexcept;
+
+    // Selects the renderables drawn by the next generateSortedCommands(), i.e. the ones whose
+    // VISIBLE_MASK intersects 'mask'. Zero selects the default for the pass type, i.e.
+    // VISIBLE_SHADOW_CASTER for the shadow pass and VISIBLE_RENDERABLE otherwise.
+    void setVisibilityMask(Culler::result_type mask) noexcept;
+
+    // Appends the sorted commands of this pass to the command list and returns them. Commands
+    // already in the list are left untouched, so that several passes can be generated up front.
+    utils::Slice<Command> generateSortedCommands(CommandTypeFlags commandType) noexcept;
+
+    // 'visibleMask' selects the instances of instanced renderables drawn by this pass.
     void execute(const char* name,
             backend::Handle <backend::HwRenderTarget> renderTarget,
             backend::RenderPassParams params,
-            Command const* first, Command const* last) const noexcept;
+            Command const* first, Command const* last,
+            Culler::result_type visibleMask = FScene::VISIBLE_RENDERABLE) const noexcept;
 
     utils::GrowingSlice<Command>& getCommands() { return mCommands; }
     utils::Slice<Command> const& getCommands() const { return mCommands; }
@@ -220,6 +236,14 @@ public:
         return mCommandsHighWatermark * sizeof(Command);
     }
 
+    // Sorts [begin, end) by CommandKey and drops all commands belonging to Pass::SENTINEL
+    // (i.e. whose pass is 0xFF). Returns the new end of the command list.
+    // This is a parallel LSD radix sort on (key, index) pairs which skips the key bytes that
+    // are identical for all commands. Scratch memory is taken from the given arena, if it
+    // cannot accommodate the sort, we fall back to std::sort and set outOfMemory.
+    static Command* sortCommands(utils::JobSystem& js, ArenaScope& arena,
+            Command* begin, Command* end, bool* outOfMemory = nullptr) noexcept;
+
 private:
     friend class FRenderer;
 
@@ -232,20 +256,50 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // below this many commands, the job overhead of the radix sort isn't worth it
+    static constexpr size_t RADIX_SORT_MIN_COMMAND_COUNT = 512;
+    // minimum number of commands processed by each radix sort job
+    static constexpr size_t RADIX_SORT_MIN_CHUNK_SIZE = 1024;
+    // maximum number of radix sort jobs (each has a 1 KiB histogram)
+    static constexpr size_t RADIX_SORT_MAX_CHUNK_COUNT = 16;
+
+    struct SortKey {                // 16 bytes
+        CommandKey key;             //  8 bytes
+        uint32_t index;             //  4 bytes
+        uint32_t reserved;          //  4 bytes
+    };
+
+    static Command* sortCommandsRadix(utils::JobSystem& js, ArenaScope& arena,
+            Command* begin, Command* end) noexcept;
+
     static inline void generateCommands(uint32_t commandTypeFlags, Command* commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+            Culler::result_type visibilityMask,
             math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
-            utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
+            utils::Range<uint32_t> range, RenderFlags renderFlags,
+            Culler::result_type visibilityMask, math::float3 cameraPosition,
             math::float3 cameraForward) noexcept;
 
     static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
             FMaterialInstance const* mi) noexcept;
 
     void recordDriverCommands(FEngine::DriverApi& driver, FScene& scene,
-            const Command* first, const Command* last) const noexcept;
+            const Command* first, const Command* last,
+            Culler::result_type visibleMask) const noexcept;
+
+    // whether 'next' can be drawn as the instance 'instance' of the draw call of 'info'
+    static inline bool canMerge(PrimitiveInfo const& info, PrimitiveInfo const& next,
+            size_t instance) noexcept {
+        return next.mi == info.mi &&
+               next.primitiveHandle.getId() == info.primitiveHandle.getId() &&
+               next.materialVariant == info.materialVariant &&
+               next.rasterState == info.rasterState &&
+               !next.perRenderableBones && !next.instanced &&
+               next.index == info.index + instance;
+    }
 
     static void updateSummedPrimitiveCounts(
             FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
@@ -257,6 +311,7 @@ private:
     utils::Range<uint32_t> mVisibleRenderables{};
     CameraInfo mCamera;
     RenderFlags mFlags{};
+    Culler::result_type mVisibilityMask = 0;
     bool mPolygonOffsetOverride = false;
     backend::PolygonOffset mPolygonOffset{};
     size_t mCommandsHighWatermark = 0;
@@ -21,54 +21,74 @@
 #include "details/IndexBuffer.h"
 #include "details/Material.h"
 
+using namespace filament::backend;
+
 namespace filament {
 namespace details {
 
-void FRenderPrimitive::init(backend::DriverApi& driver,
+void FRenderPrimitive::init(FEngine& engine,
         const RenderableManager::Builder::Entry& entry) noexcept {
 
     assert(entry.materialInstance);
 
-    mHandle = driver.createRenderPrimitive();
     mMaterialInstance = upcast(entry.materialInstance);
     mBlendOrder = entry.blendOrder;
 
+    RenderPrimitiveCache::Geometry geometry;
     if (entry.indices && entry.vertices) {
         FVertexBuffer* vertexBuffer = upcast(entry.vertices);
         FIndexBuffer* indexBuffer = upcast(entry.indices);
 
         AttributeBitset enabledAttributes = vertexBuffer->getDeclaredAttributes();
 
-        auto const& ebh = vertexBuffer->getHwHandle();
-        auto const& ibh = indexBuffer->getHwHandle();
-
-        driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-        driver.setRenderPrimitiveRange(mHandle, entry.type,
-                (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
-                (uint32_t)entry.count);
+        geometry.vertices = vertexBuffer->getHwHandle();
+        geometry.indices = indexBuffer->getHwHandle();
+        geometry.enabledAttributes = (uint32_t)enabledAttributes.getValue();
+        geometry.offset = (uint32_t)entry.offset;
+        geometry.minIndex = (uint32_t)entry.minIndex;
+        geometry.maxIndex = (uint32_t)entry.maxIndex;
+        geometry.count = (uint32_t)entry.count;
+        geometry.type = (uint32_t)entry.type;
 
         mPrimitiveType = entry.type;
         mEnabledAttributes = enabledAttributes;
     }
+
+    mGeometry = geometry;
+    mHandle = engine.getRenderPrimitiveCache().acquire(engine.getDriverApi(), mGeometry);
 }
 
 void FRenderPrimitive::terminate(FEngine& engine) {
+    engine.getRenderPrimitiveCache().release(engine.getDriverApi(), mGeometry);
+    mHandle.clear();
+}
+
+void FRenderPrimitive::setGeometry(FEngine& engine,
+        RenderPrimitiveCache::Geometry const& geometry) noexcept {
+    // acquire before releasing, so the driver object survives if the geometry didn't change
+    RenderPrimitiveCache& cache = engine.getRenderPrimitiveCache();
     FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyRenderPrimitive(mHandle);
+    Handle<HwRenderPrimitive> handle = cache.acquire(driver, geometry);
+    cache.release(driver, mGeometry);
+    mGeometry = geometry;
+    mHandle = handle;
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
         FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
     AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
-    auto const& ebh = vertices->getHwHandle();
-    auto const& ibh = indices->getHwHandle();
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
-    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    RenderPrimitiveCache::Geometry geometry;
+    geometry.vertices = vertices->getHwHandle();
+    geometry.indices = indices->getHwHandle();
+    geometry.enabledAttributes = (uint32_t)enabledAttributes.getValue();
+    geometry.offset = (uint32_t)offset;
+    geometry.minIndex = (uint32_t)minIndex;
+    geometry.maxIndex = (uint32_t)maxIndex;
+    geometry.count = (uint32_t)count;
+    geometry.type = (uint32_t)type;
+    setGeometry(engine, geometry);
 
     mPrimitiveType = type;
     mEnabledAttributes = enabledAttributes;
@@ -76,9 +96,14 @@ void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType typ
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    RenderPrimitiveCache::Geometry geometry = mGeometry;
+    geometry.offset = (uint32_t)offset;
+    geometry.minIndex = (uint32_t)minIndex;
+    geometry.maxIndex = (uint32_t)maxIndex;
+    geometry.count = (uint32_t)count;
+    geometry.type = (uint32_t)type;
+    setGeometry(engine, geometry);
+
     mPrimitiveType = type;
 }
 
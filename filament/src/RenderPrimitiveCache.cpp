@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/RenderPrimitiveCache.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/Panic.h>
+
+using namespace filament::backend;
+
+namespace filament {
+namespace details {
+
+RenderPrimitiveCache::RenderPrimitiveCache() noexcept = default;
+
+RenderPrimitiveCache::~RenderPrimitiveCache() noexcept {
+    // all primitives should have been released by FRenderableManager::terminate()
+    assert(mEntries.empty());
+}
+
+Handle<HwRenderPrimitive> RenderPrimitiveCache::acquire(
+        DriverApi& driver, Geometry const& geometry) noexcept {
+    auto pos = mEntries.find(geometry);
+    if (pos != mEntries.end()) {
+        pos.value().refs++;
+        return pos->second.handle;
+    }
+
+    Handle<HwRenderPrimitive> handle = driver.createRenderPrimitive();
+    if (geometry.vertices && geometry.indices) {
+        driver.setRenderPrimitiveBuffer(handle,
+                geometry.vertices, geometry.indices, geometry.enabledAttributes);
+    }
+    if (PrimitiveType(geometry.type) != PrimitiveType::NONE) {
+        driver.setRenderPrimitiveRange(handle, PrimitiveType(geometry.type),
+                geometry.offset, geometry.minIndex, geometry.maxIndex, geometry.count);
+    }
+    mEntries.insert({ geometry, { handle, 1 }});
+    return handle;
+}
+
+void RenderPrimitiveCache::release(DriverApi& driver, Geometry const& geometry) noexcept {
+    auto pos = mEntries.find(geometry);
+    assert(pos != mEntries.end());
+    if (pos != mEntries.end() && --pos.value().refs == 0) {
+        driver.destroyRenderPrimitive(pos->second.handle);
+        mEntries.erase(pos);
+    }
+}
+
+} // namespace details
+} // namespace filament
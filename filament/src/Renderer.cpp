@@ -56,6 +56,57 @@ FRenderer::FRenderer(FEngine& engine) :
         mIsRGB8Supported(false),
         mPerRenderPassArena(engine.getPerRenderPassAllocator())
 {
+    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
+    debugRegistry.registerProperty("d.renderer.draw_calls",
+            &engine.debug.renderer.draw_calls);
+    debugRegistry.registerProperty("d.renderer.merged_draws",
+            &engine.debug.renderer.merged_draws);
+    debugRegistry.registerProperty("d.renderer.sort_fallbacks",
+            &engine.debug.renderer.sort_fallbacks);
+    debugRegistry.registerProperty("d.framegraph.transient_kb",
+            &engine.debug.framegraph.transient_kb);
+    debugRegistry.registerProperty("d.framegraph.aliased_transient_kb",
+            &engine.debug.framegraph.aliased_transient_kb);
+    debugRegistry.registerProperty("d.framegraph.textures_created",
+            &engine.debug.framegraph.textures_created);
+    debugRegistry.registerProperty("d.framegraph.render_targets_created",
+            &engine.debug.framegraph.render_targets_created);
+    debugRegistry.registerProperty("d.framegraph.compile_cache_hits",
+            &engine.debug.framegraph.compile_cache_hits);
+    debugRegistry.registerProperty("d.framegraph.compile_cache_misses",
+            &engine.debug.framegraph.compile_cache_misses);
+
+    auto& caches = engine.debug.backend;
+    debugRegistry.registerProperty("d.backend.pipeline_hits", &caches.pipeline_hits);
+    debugRegistry.registerProperty("d.backend.pipeline_misses", &caches.pipeline_misses);
+    debugRegistry.registerProperty("d.backend.pipeline_evictions", &caches.pipeline_evictions);
+    debugRegistry.registerProperty("d.backend.pipeline_count", &caches.pipeline_count);
+    debugRegistry.registerProperty("d.backend.descriptor_set_hits",
+            &caches.descriptor_set_hits);
+    debugRegistry.registerProperty("d.backend.descriptor_set_misses",
+            &caches.descriptor_set_misses);
+    debugRegistry.registerProperty("d.backend.descriptor_set_evictions",
+            &caches.descriptor_set_evictions);
+    debugRegistry.registerProperty("d.backend.descriptor_set_count",
+            &caches.descriptor_set_count);
+    debugRegistry.registerProperty("d.backend.framebuffer_hits", &caches.framebuffer_hits);
+    debugRegistry.registerProperty("d.backend.framebuffer_misses", &caches.framebuffer_misses);
+    debugRegistry.registerProperty("d.backend.framebuffer_evictions",
+            &caches.framebuffer_evictions);
+    debugRegistry.registerProperty("d.backend.framebuffer_count", &caches.framebuffer_count);
+    debugRegistry.registerProperty("d.backend.render_pass_hits", &caches.render_pass_hits);
+    debugRegistry.registerProperty("d.backend.render_pass_misses", &caches.render_pass_misses);
+    debugRegistry.registerProperty("d.backend.render_pass_evictions",
+            &caches.render_pass_evictions);
+    debugRegistry.registerProperty("d.backend.render_pass_count", &caches.render_pass_count);
+    debugRegistry.registerProperty("d.backend.sampler_hits", &caches.sampler_hits);
+    debugRegistry.registerProperty("d.backend.sampler_misses", &caches.sampler_misses);
+    debugRegistry.registerProperty("d.backend.sampler_evictions", &caches.sampler_evictions);
+    debugRegistry.registerProperty("d.backend.sampler_count", &caches.sampler_count);
+    debugRegistry.registerProperty("d.backend.pipeline_creation_count",
+            &caches.pipeline_creation_count);
+    debugRegistry.registerProperty("d.backend.pipeline_creation_ms",
+            &caches.pipeline_creation_ms);
 }
 
 void FRenderer::init() noexcept {
@@ -87,6 +138,7 @@ void FRenderer::terminate(FEngine& engine) {
     // shut down threads if we created any.
     DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderTarget(mRenderTarget);
+    mResourceAllocator.terminate(driver);
 
     // before we can destroy this Renderer's resources, we must make sure
     // that all pending commands have been executed (as they could reference data in this
@@ -201,6 +253,10 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
             arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
 
 
+    // these are accumulated by all the passes of this view
+    engine.debug.renderer.draw_calls = 0;
+    engine.debug.renderer.merged_draws = 0;
+
     RenderPass pass(engine, commands);
     RenderPass::RenderFlags renderFlags = 0;
     if (view.hasShadowing())               renderFlags |= RenderPass::HAS_SHADOWING;
@@ -211,19 +267,18 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
 
     /*
-     * Shadow pass
+     * Frame graph
      */
 
-    if (view.hasShadowing()) {
-        view.getShadowMap().render(driver, pass, view);
-        commands.clear();
-    }
+    FrameGraph fg(mResourceAllocator, &mFrameGraphCache);
 
     /*
-     * Frame graph
+     * Shadow pass
      */
 
-    FrameGraph fg;
+    if (view.hasShadowing()) {
+        view.getShadowMapManager().render(fg, engine, pass, view);
+    }
 
     const TextureFormat hdrFormat = getHdrFormat(view);
 
@@ -248,8 +303,6 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     view.updatePrimitivesLod(engine, cameraInfo,
             scene.getRenderableData(), view.getVisibleRenderables());
-    view.prepareCamera(cameraInfo, svp);
-    view.commitUniforms(driver);
 
     TargetBufferFlags clearFlags = view.getClearFlags();
     if (hasPostProcess) {
@@ -277,7 +330,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
             break;
     }
 
-    pass.generateSortedCommands(commandType);
+    const Slice<Command> colorCommands = pass.generateSortedCommands(commandType);
 
 
     struct ColorPassData {
@@ -310,21 +363,24 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
                 data.color = attachments.color;
                 data.depth = attachments.depth;
             },
-            [&pass, jobFroxelize, &js, &view]
+            [&pass, &colorCommands, &cameraInfo, &svp, jobFroxelize, &js, &view]
                     (FrameGraphPassResources const& resources,
                             ColorPassData const& data, DriverApi& driver) {
                 auto out = resources.getRenderTarget(data.color);
                 out.params.clearColor = view.getClearColor();
 
+                // the shadow pass, if any, has set up the view's uniforms for its cameras
+                view.prepareCamera(cameraInfo, svp);
+                view.commitUniforms(driver);
+
                 if (jobFroxelize) {
                     auto sync = jobFroxelize;
                     js.waitAndRelease(sync);
                     view.commitFroxels(driver);
                 }
 
-                Slice<Command> const& commands = pass.getCommands();
                 pass.execute("Color Pass", out.target, out.params,
-                        commands.begin(), commands.end());
+                        colorCommands.begin(), colorCommands.end());
             });
 
     jobFroxelize = nullptr;
@@ -378,6 +434,14 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     //fg.export_graphviz(slog.d);
     fg.execute(driver);
 
+    engine.debug.framegraph.transient_kb = int(fg.getTransientMemorySize() / 1024);
+    engine.debug.framegraph.aliased_transient_kb = int(fg.getAliasedTransientMemorySize() / 1024);
+    engine.debug.framegraph.textures_created = int(mResourceAllocator.getCreatedTextureCount());
+    engine.debug.framegraph.render_targets_created =
+            int(mResourceAllocator.getCreatedRenderTargetCount());
+    engine.debug.framegraph.compile_cache_hits = int(mFrameGraphCache.getHitCount());
+    engine.debug.framegraph.compile_cache_misses = int(mFrameGraphCache.getMissCount());
+
     commands.clear();
 
     recordHighWatermark(pass.getCommandsHighWatermark());
@@ -509,6 +573,34 @@ void FRenderer::endFrame() {
 
     driver.endFrame(mFrameId);
 
+    // destroy the FrameGraph textures that haven't been used for a while
+    mResourceAllocator.gc(driver);
+
+    // NOTE: this makes a synchronous call to the driver
+    CacheStats cacheStats;
+    driver.getCacheStats(&cacheStats);
+    auto setCacheCounters = [](CacheCounters const& counters,
+            int& hits, int& misses, int& evictions, int& count) {
+        hits = int(counters.hits);
+        misses = int(counters.misses);
+        evictions = int(counters.evictions);
+        count = int(counters.size);
+    };
+    auto& caches = engine.debug.backend;
+    setCacheCounters(cacheStats.pipelines, caches.pipeline_hits, caches.pipeline_misses,
+            caches.pipeline_evictions, caches.pipeline_count);
+    setCacheCounters(cacheStats.descriptorSets, caches.descriptor_set_hits,
+            caches.descriptor_set_misses, caches.descriptor_set_evictions,
+            caches.descriptor_set_count);
+    setCacheCounters(cacheStats.framebuffers, caches.framebuffer_hits,
+            caches.framebuffer_misses, caches.framebuffer_evictions, caches.framebuffer_count);
+    setCacheCounters(cacheStats.renderPasses, caches.render_pass_hits,
+            caches.render_pass_misses, caches.render_pass_evictions, caches.render_pass_count);
+    setCacheCounters(cacheStats.samplers, caches.sampler_hits, caches.sampler_misses,
+            caches.sampler_evictions, caches.sampler_count);
+    caches.pipeline_creation_count = int(cacheStats.pipelineCreationCount);
+    caches.pipeline_creation_ms = cacheStats.pipelineCreationTime;
+
     // Run the component managers' GC in parallel
     // WARNING: while doing this we can't access any component manager
     auto& js = engine.getJobSystem();
@@ -23,15 +23,23 @@
 
 #include "details/Culler.h"
 #include "details/Engine.h"
+#include "details/Froxelizer.h"
 #include "details/IndirectLight.h"
 #include "details/Skybox.h"
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <string.h>
 
 using namespace filament::math;
 using namespace utils;
@@ -44,177 +52,636 @@ namespace details {
 FScene::FScene(FEngine& engine) :
         mEngine(engine),
         mIndirectLight(engine.getDefaultIndirectLight()) {
+    engine.getEntityManager().registerListener(this);
+}
+
+FScene::~FScene() noexcept {
+    mEngine.getEntityManager().unregisterListener(this);
 }
 
-FScene::~FScene() noexcept = default;
+// Versions wrap around. With this test, a row can be updated when it didn't need to, but it's
+// never considered up-to-date when it's not.
+static inline bool isNewer(uint32_t version, uint32_t last) noexcept {
+    return int32_t(version - last) > 0;
+}
 
+template<typename SoA, size_t ... Indices>
+static void copyData(SoA& dst, SoA const& src, std::index_sequence<Indices...>) noexcept {
+    const size_t count = src.size();
+    dst.resize(count);
+    int UTILS_UNUSED dummy[] = {
+            (std::copy_n(src.template data<Indices>(), count, dst.template data<Indices>()), 0)... };
+}
 
-void FScene::prepare(const mat4f& worldOriginTransform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+template<typename SoA, size_t ... Indices>
+static void copyRow(SoA& dst, SoA const& src, size_t row, std::index_sequence<Indices...>) noexcept {
+    int UTILS_UNUSED dummy[] = {
+            (dst.template elementAt<Indices>(row) = src.template elementAt<Indices>(row), 0)... };
+}
 
+void FScene::prepare(const mat4f& worldOriginTransform) {
     FEngine& engine = mEngine;
-    EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
     FLightManager& lcm = engine.getLightManager();
-    // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
     auto& lightData = mLightData;
-    auto const& entities = mEntities;
 
+    // the cached data needs to be gathered again if the instances it refers to have changed
+    const bool entitiesDestroyed = mEntitiesDestroyed.exchange(false, std::memory_order_relaxed);
+    bool regather = mEntitiesDirty ||
+            (mCullingHierarchyEnabled && mSortedEntitiesDirty) ||
+            tcm.getLayoutVersion() != mTransformLayoutVersion ||
+            rcm.getLayoutVersion() != mRenderableLayoutVersion ||
+            lcm.getLayoutVersion() != mLightLayoutVersion ||
+            memcmp(&worldOriginTransform, &mWorldOriginTransform, sizeof(mat4f)) != 0;
+    if (!regather && entitiesDestroyed) {
+        regather = hasDeadEntities();
+    }
 
-    // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
-    // component can be added after the entity is added to the scene.
+    bool renderablesChanged = true;
+    if (UTILS_UNLIKELY(regather)) {
+        gather(worldOriginTransform);
+        if (mCullingHierarchyEnabled && mSortedEntitiesDirty) {
+            // the set of entities changed or the hierarchy degraded too much, compute a new
+            // order and gather everything again in that order.
+            sortEntities();
+            gather(worldOriginTransform);
+            mCullingHierarchy.invalidate();
+            mSortedEntitiesDirty = false;
+        }
+        mWorldOriginTransform = worldOriginTransform;
+        mTransformLayoutVersion = tcm.getLayoutVersion();
+        mRenderableLayoutVersion = rcm.getLayoutVersion();
+        mLightLayoutVersion = lcm.getLayoutVersion();
+        mEntitiesDirty = false;
+    } else {
+        renderablesChanged = update(worldOriginTransform);
+    }
+    mTransformVersion = tcm.getVersion();
+    mRenderableVersion = rcm.getVersion();
+    mLightVersion = lcm.getVersion();
+
+    if (mCullingHierarchyEnabled && renderablesChanged) {
+        mSortedEntitiesDirty = !mCullingHierarchy.refit(
+                mRenderableCache.data<WORLD_AABB_CENTER>(),
+                mRenderableCache.data<WORLD_AABB_EXTENT>(),
+                mRenderableCache.size());
+    }
+
+    // The cached data is copied because the views reorder (and trim) the per-frame data.
 
-    size_t renderableDataCapacity = entities.size();
+    size_t renderableDataCapacity = mRenderableCache.size();
     // we need the capacity to be multiple of 16 for SIMD loops
     renderableDataCapacity = (renderableDataCapacity + 0xF) & ~0xF;
     // we need 1 extra entry at the end for the summed primitive count
     renderableDataCapacity = renderableDataCapacity + 1;
 
-    sceneData.clear();
     if (sceneData.capacity() < renderableDataCapacity) {
+        sceneData.clear();
         sceneData.setCapacity(renderableDataCapacity);
     }
 
-    // The light data list will always contain at least one entry for the
-    // dominating directional light, even if there are no entities.
-    size_t lightDataCapacity = std::max<size_t>(1, entities.size());
-    // we need the capacity to be multiple of 16 for SIMD loops
-    lightDataCapacity = (lightDataCapacity + 0xF) & ~0xF;
+    // When the views didn't reorder the per-frame data (e.g. all the renderables are visible),
+    // its rows still match the cache's and only the rows that changed need to be copied. The
+    // columns the views write (e.g. VISIBLE_MASK) are recomputed by each view.
+    const size_t renderableCount = mRenderableCache.size();
+    const bool inCacheOrder = !mRenderableCacheGathered && sceneData.size() == renderableCount &&
+            std::equal(mRenderableCache.begin<RENDERABLE_INSTANCE>(),
+                    mRenderableCache.end<RENDERABLE_INSTANCE>(),
+                    sceneData.begin<RENDERABLE_INSTANCE>());
+    if (inCacheOrder) {
+        uint8_t const* const UTILS_RESTRICT changedRows = mChangedRows.data();
+        for (size_t i = 0; i < renderableCount; i++) {
+            if (changedRows[i]) {
+                copyRow(sceneData, mRenderableCache, i,
+                        std::make_index_sequence<RenderableSoa::getArrayCount()>());
+            }
+        }
+    } else {
+        copyData(sceneData, mRenderableCache,
+                std::make_index_sequence<RenderableSoa::getArrayCount()>());
+    }
+    std::fill(mChangedRows.begin(), mChangedRows.end(), 0);
+    mRenderableCacheGathered = false;
 
-    lightData.clear();
+    // we need the capacity to be multiple of 16 for SIMD loops
+    const size_t lightDataCapacity = (mLightCache.size() + 0xF) & ~0xF;
     if (lightData.capacity() < lightDataCapacity) {
+        lightData.clear();
         lightData.setCapacity(lightDataCapacity);
     }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+    copyData(lightData, mLightCache,
+            std::make_index_sequence<LightSoa::getArrayCount()>());
 
+    // some elements past the end of the array will be accessed by SIMD code, we need to make
+    // sure the data is valid enough as not to produce errors such as divide-by-zero
+    // (e.g. in computeLightRanges())
+    for (size_t i = lightData.size(), e = (lightData.size() + 3) & ~3; i < e; i++) {
+        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+    }
+}
 
-    // find the max intensity directional light index in our local array
-    float maxIntensity = 0;
+void FScene::gather(const mat4f& worldOriginTransform) noexcept {
+    SYSTRACE_CALL();
 
-    for (Entity e : entities) {
-        if (!em.isAlive(e))
-            continue;
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+    EntityManager& em = engine.getEntityManager();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& sceneData = mRenderableCache;
+    auto& lightData = mLightCache;
 
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li)
-            continue;
+    // go through the list of entities, and gather the data of those that are renderables
+    // or lights. This happens in parallel, so we need random access to the entities.
+    std::vector<Entity> const* entityList = &mSortedEntities;
+    if (!mCullingHierarchyEnabled || mSortedEntitiesDirty) {
+        mEntityList.assign(mEntities.begin(), mEntities.end());
+        entityList = &mEntityList;
+    }
+    Entity const* const entities = entityList->data();
+    const size_t count = entityList->size();
+
+    // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
+    // component can be added after the entity is added to the scene.
+    // Each chunk of entities writes its renderables and lights at the beginning of its own range
+    // of the arrays below, which are compacted afterwards.
+
+    sceneData.clear();
+    if (sceneData.capacity() < count) {
+        sceneData.setCapacity(count);
+    }
+    sceneData.resize(count);
+    mRenderableTransforms.resize(count);
 
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
-
-        // don't even draw this object if it doesn't have a transform (which shouldn't happen
-        // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
+    // The light data list will always contain at least one entry for the
+    // dominating directional light, even if there are no entities.
+    // the first entries are reserved for the directional lights (currently only one)
+    lightData.clear();
+    if (lightData.capacity() < DIRECTIONAL_LIGHTS_COUNT + count) {
+        lightData.setCapacity(DIRECTIONAL_LIGHTS_COUNT + count);
+    }
+    lightData.resize(DIRECTIONAL_LIGHTS_COUNT + count);
+    mLightSources.resize(DIRECTIONAL_LIGHTS_COUNT + count);
+
+    const size_t chunkCount = (count + GATHER_CHUNK_SIZE - 1) / GATHER_CHUNK_SIZE;
+    mChunkSizes.resize(chunkCount);
+
+    auto gatherChunks = [&, entities, count](uint32_t firstChunk, uint32_t chunks) {
+        for (size_t chunk = firstChunk; chunk < firstChunk + chunks; chunk++) {
+            const size_t first = chunk * GATHER_CHUNK_SIZE;
+            const size_t last = std::min(count, first + GATHER_CHUNK_SIZE);
+            size_t r = first;
+            size_t l = DIRECTIONAL_LIGHTS_COUNT + first;
+            for (size_t i = first; i < last; i++) {
+                const Entity e = entities[i];
+                if (!em.isAlive(e))
+                    continue;
+
+                // getInstance() always returns null if the entity is the Null entity
+                // so we don't need to check for that, but we need to check it's alive
+                auto ri = rcm.getInstance(e);
+                auto li = lcm.getInstance(e);
+                if (!ri & !li)
+                    continue;
+
+                auto ti = tcm.getInstance(e);
+
+                // don't even draw this object if it doesn't have a transform (which shouldn't happen
+                // because one is always created when creating a Renderable component).
+                if (ri && ti) {
+                    sceneData.elementAt<RENDERABLE_INSTANCE>(r) = ri;
+                    mRenderableTransforms[r] = ti;
+                    gatherRenderable(r, worldOriginTransform);
+                    r++;
+                }
+
+                if (li) {
+                    // directional lights are sorted out during compaction
+                    lightData.elementAt<LIGHT_INSTANCE>(l) = li;
+                    lightData.elementAt<SHADOW_INDEX>(l) = 0;
+                    mLightSources[l] = { e, li, ti };
+                    if (!lcm.isDirectionalLight(li)) {
+                        updateLight(l, worldOriginTransform);
+                    }
+                    l++;
+                }
+            }
+
+            computeWorldAABBs(
+                    sceneData.data<WORLD_AABB_CENTER>() + first,
+                    sceneData.data<WORLD_AABB_EXTENT>() + first,
+                    sceneData.data<WORLD_TRANSFORM>() + first, r - first);
+
+            mChunkSizes[chunk] = { uint32_t(r - first),
+                                   uint32_t(l - (DIRECTIONAL_LIGHTS_COUNT + first)) };
         }
+    };
+
+    if (chunkCount > 1) {
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(chunkCount),
+                std::cref(gatherChunks), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+    } else {
+        gatherChunks(0, uint32_t(chunkCount));
+    }
+
+    // compact the chunks
+    mDirectionalLights.clear();
+    size_t renderableCount = 0;
+    size_t lightCount = DIRECTIONAL_LIGHTS_COUNT;
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        const size_t first = chunk * GATHER_CHUNK_SIZE;
+        const size_t renderables = mChunkSizes[chunk].renderables;
+        if (renderableCount != first) {
+            sceneData.forEach([=](auto* p) {
+                std::move(p + first, p + first + renderables, p + renderableCount);
+            });
+            std::move(mRenderableTransforms.begin() + first,
+                    mRenderableTransforms.begin() + first + renderables,
+                    mRenderableTransforms.begin() + renderableCount);
+        }
+        renderableCount += renderables;
 
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+        for (size_t i = DIRECTIONAL_LIGHTS_COUNT + first,
+                e = i + mChunkSizes[chunk].lights; i < e; i++) {
+            if (UTILS_UNLIKELY(lcm.isDirectionalLight(mLightSources[i].li))) {
                 // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                mDirectionalLights.push_back(mLightSources[i]);
+                continue;
+            }
+            if (lightCount != i) {
+                lightData.forEach([=](auto* p) { p[lightCount] = std::move(p[i]); });
+                mLightSources[lightCount] = mLightSources[i];
+            }
+            lightCount++;
+        }
+    }
+    sceneData.resize(renderableCount);
+    mRenderableTransforms.resize(renderableCount);
+    lightData.resize(lightCount);
+    mLightSources.resize(lightCount);
+
+    // the renderables moved, all their uniforms need to be uploaded again
+    assignUniformSlots();
+    mDirtyUniforms.assign(renderableCount, 1);
+    mHasDirtyUniforms = true;
+    mChangedRows.assign(renderableCount, 0);
+    mRenderableCacheGathered = true;
+
+    updateDirectionalLight(worldOriginTransform);
+}
+
+bool FScene::update(const mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    const uint32_t transformVersion = mTransformVersion;
+    const uint32_t renderableVersion = mRenderableVersion;
+    const uint32_t lightVersion = mLightVersion;
+    const bool transformsChanged = tcm.getVersion() != transformVersion;
+
+    std::atomic<bool> renderablesChanged = { false };
+    if (transformsChanged || rcm.getVersion() != renderableVersion) {
+        SYSTRACE_NAME("updateRenderables");
+        auto& sceneData = mRenderableCache;
+        uint8_t* const dirtyUniforms = mDirtyUniforms.data();
+        uint8_t* const changedRows = mChangedRows.data();
+        auto updateRows = [&](uint32_t first, uint32_t c) {
+            auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+            auto const* const UTILS_RESTRICT transforms = mRenderableTransforms.data();
+            bool changed = false;
+            for (size_t i = first; i < first + c; i++) {
+                if (isNewer(tcm.getVersion(transforms[i]), transformVersion) ||
+                    isNewer(rcm.getVersion(instances[i]), renderableVersion)) {
+                    gatherRenderable(i, worldOriginTransform);
+                    computeWorldAABBs(
+                            sceneData.data<WORLD_AABB_CENTER>() + i,
+                            sceneData.data<WORLD_AABB_EXTENT>() + i,
+                            sceneData.data<WORLD_TRANSFORM>() + i, 1);
+                    if (UTILS_UNLIKELY(sceneData.elementAt<INSTANCE_COUNT>(i))) {
+                        updateInstanceGroups(i);
+                    }
+                    dirtyUniforms[i] = 1;
+                    changedRows[i] = 1;
+                    changed = true;
                 }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
             }
+            if (changed) {
+                renderablesChanged.store(true, std::memory_order_relaxed);
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(sceneData.size()),
+                std::cref(updateRows), jobs::CountSplitter<GATHER_CHUNK_SIZE, 8>());
+        js.runAndWait(job);
+    }
+
+    if (transformsChanged || lcm.getVersion() != lightVersion) {
+        auto isDirty = [&](LightSource const& source) {
+            return isNewer(tcm.getVersion(source.ti), transformVersion) ||
+                   isNewer(lcm.getVersion(source.li), lightVersion);
+        };
+        for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = mLightCache.size(); i < c; i++) {
+            if (isDirty(mLightSources[i])) {
+                updateLight(i, worldOriginTransform);
+            }
+        }
+        if (std::any_of(mDirectionalLights.begin(), mDirectionalLights.end(), isDirty)) {
+            updateDirectionalLight(worldOriginTransform);
         }
     }
 
-    // some elements past the end of the array will be accessed by SIMD code, we need to make
-    // sure the data is valid enough as not to produce errors such as divide-by-zero
-    // (e.g. in computeLightRanges())
-    for (size_t i = lightData.size(), e = (lightData.size() + 3) & ~3; i < e; i++) {
-        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+    mHasDirtyUniforms |= renderablesChanged.load(std::memory_order_relaxed);
+    return renderablesChanged.load(std::memory_order_relaxed);
+}
+
+void FScene::gatherRenderable(size_t index, const mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    auto& sceneData = mRenderableCache;
+    auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(index);
+    auto ti = mRenderableTransforms[index];
+
+    // the world AABB is computed from the local AABB and the world transform in
+    // computeWorldAABBs(), so that it can be done for many renderables at once.
+    Box const& aabb = rcm.getAABB(ri);
+
+    sceneData.elementAt<WORLD_TRANSFORM>(index)   = worldOriginTransform * tcm.getWorldTransform(ti);
+    sceneData.elementAt<VISIBILITY_STATE>(index)  = rcm.getVisibility(ri);
+    sceneData.elementAt<BONES_UBH>(index)         = rcm.getBonesUbh(ri);
+    sceneData.elementAt<INSTANCE_COUNT>(index)    =
+            uint16_t(rcm.getInstanceTransforms(ri) ? rcm.getInstanceCount(ri) : 0);
+    sceneData.elementAt<WORLD_AABB_CENTER>(index) = aabb.center;
+    sceneData.elementAt<VISIBLE_MASK>(index)      = 0;
+    sceneData.elementAt<LAYERS>(index)            = rcm.getLayerMask(ri);
+    sceneData.elementAt<WORLD_AABB_EXTENT>(index) = aabb.halfExtent;
+}
+
+void FScene::assignUniformSlots() noexcept {
+    auto& sceneData = mRenderableCache;
+    auto const* const UTILS_RESTRICT instanceCounts = sceneData.data<INSTANCE_COUNT>();
+    uint32_t* const UTILS_RESTRICT slots = sceneData.data<UBO_INDEX>();
+    const size_t count = sceneData.size();
+
+    // the renderables that are not instanced use one slot each, in order...
+    size_t slot = 0;
+    size_t groupCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (UTILS_LIKELY(!instanceCounts[i])) {
+            slots[i] = uint32_t(slot++);
+        } else {
+            groupCount += (instanceCounts[i] + CONFIG_MAX_INSTANCES - 1) / CONFIG_MAX_INSTANCES;
+        }
+    }
+
+    // ...and are followed by the instance groups
+    mFirstInstanceSlot =
+            (slot + CONFIG_MAX_INSTANCES - 1) / CONFIG_MAX_INSTANCES * CONFIG_MAX_INSTANCES;
+    mUniformSlotCount = mFirstInstanceSlot + groupCount * CONFIG_MAX_INSTANCES;
+    ASSERT_POSTCONDITION(mUniformSlotCount <= MAX_UNIFORM_SLOT_COUNT,
+            "The scene needs %u uniform slots, the maximum is %u. Use fewer renderables or "
+            "instances.", unsigned(mUniformSlotCount), unsigned(MAX_UNIFORM_SLOT_COUNT));
+
+    mInstanceGroupData.clear();
+    mInstanceGroupData.resize(Culler::round(groupCount));
+    for (size_t i = 0, group = 0; i < count && groupCount; i++) {
+        if (UTILS_UNLIKELY(instanceCounts[i])) {
+            slots[i] = uint32_t(group);
+            group += (instanceCounts[i] + CONFIG_MAX_INSTANCES - 1) / CONFIG_MAX_INSTANCES;
+            updateInstanceGroups(i);
+        }
     }
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept {
-    FEngine::DriverApi& driver = mEngine.getDriverApi();
-    const size_t size = visibleRenderables.size() * sizeof(PerRenderableUib);
+void FScene::updateInstanceGroups(size_t index) noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    auto& sceneData = mRenderableCache;
+    auto& groupData = mInstanceGroupData;
+    auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(index);
+    Box const* const bounds = rcm.getInstanceGroupBounds(ri);
+    mat4f const& worldTransform = sceneData.elementAt<WORLD_TRANSFORM>(index);
+    const Culler::result_type cullingMask = sceneData.elementAt<VISIBILITY_STATE>(index).culling ?
+            0 : VISIBLE_ALL | VISIBLE_SHADOW_MAPS;
+
+    const size_t first = sceneData.elementAt<UBO_INDEX>(index);
+    const size_t instanceCount = sceneData.elementAt<INSTANCE_COUNT>(index);
+    for (size_t g = 0; g * CONFIG_MAX_INSTANCES < instanceCount; g++) {
+        groupData.elementAt<GROUP_WORLD_AABB_CENTER>(first + g) = bounds[g].center;
+        groupData.elementAt<GROUP_WORLD_AABB_EXTENT>(first + g) = bounds[g].halfExtent;
+        groupData.elementAt<GROUP_INSTANCE_COUNT>(first + g) =
+                uint16_t(instanceCount - g * CONFIG_MAX_INSTANCES);
+        groupData.elementAt<GROUP_CULLING_MASK>(first + g) = cullingMask;
+        computeWorldAABBs(
+                groupData.data<GROUP_WORLD_AABB_CENTER>() + first + g,
+                groupData.data<GROUP_WORLD_AABB_EXTENT>() + first + g,
+                &worldTransform, 1);
+    }
+}
 
-    // allocate space into the command stream directly
-    void* const buffer = driver.allocate(size);
+void FScene::updateLight(size_t index, const mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightCache;
+    LightSource const& source = mLightSources[index];
+    auto li = source.li;
+
+    // get the world transform
+    const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(source.ti);
+
+    const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+    float3 d = 0;
+    if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+        d = lcm.getLocalDirection(li);
+        // using the inverse-transpose handles non-uniform scaling
+        d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+    }
+    lightData.elementAt<POSITION_RADIUS>(index) = float4{ p.xyz, lcm.getRadius(li) };
+    lightData.elementAt<DIRECTION>(index)       = d;
+}
 
-    auto& sceneData = mRenderableData;
-    for (uint32_t i : visibleRenderables) {
-        mat4f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
-        const size_t offset = i * sizeof(PerRenderableUib);
+void FScene::updateDirectionalLight(const mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightCache;
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelMatrix),
-                model);
+    lightData.elementAt<FScene::POSITION_RADIUS>(0) = {};
+    lightData.elementAt<FScene::DIRECTION>(0)       = {};
+    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = {};
+    lightData.elementAt<FScene::SHADOW_INDEX>(0)    = 0;
 
-        // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
-        // the transformed normals will have unit-length, therefore they need to be normalized
-        // in the shader (that's already the case anyways, since normalization is needed after
-        // interpolation).
-        //
-        // We pre-scale normals by the inverse of the largest scale factor to avoid
-        // large post-transform magnitudes in the shader, especially in the fragment shader, where
-        // we use medium precision.
-        //
-        // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
+    // find the max intensity directional light index in our local array
+    float maxIntensity = 0;
 
-        mat3f m = transpose(inverse(model.upperLeft()));
-        m *= mat3f(1.0f / std::sqrt(max(float3{length2(m[0]), length2(m[1]), length2(m[2])})));
+    for (LightSource const& source : mDirectionalLights) {
+        auto li = source.li;
+        if (lcm.getIntensity(li) >= maxIntensity) {
+            const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(source.ti);
+            float3 d = lcm.getLocalDirection(li);
+            // using the inverse-transpose handles non-uniform scaling
+            d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+            lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+            lightData.elementAt<FScene::DIRECTION>(0)       = d;
+            lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
+        }
+    }
+}
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
+bool FScene::hasDeadEntities() const noexcept {
+    FEngine& engine = mEngine;
+    EntityManager& em = engine.getEntityManager();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    auto const* const instances = mRenderableCache.data<RENDERABLE_INSTANCE>();
+    for (size_t i = 0, c = mRenderableCache.size(); i < c; i++) {
+        if (!em.isAlive(rcm.getEntity(instances[i]))) {
+            return true;
+        }
     }
+    auto isDead = [&em](LightSource const& source) { return !em.isAlive(source.entity); };
+    return std::any_of(mLightSources.begin() + DIRECTIONAL_LIGHTS_COUNT, mLightSources.end(), isDead)
+        || std::any_of(mDirectionalLights.begin(), mDirectionalLights.end(), isDead);
+}
+
+void FScene::onEntitiesDestroyed(size_t n, Entity const* entities) noexcept {
+    // this can be called from any thread, the cached entities are checked in prepare()
+    mEntitiesDestroyed.store(true, std::memory_order_relaxed);
+}
+
+void FScene::onAllEntitiesDestroyed() noexcept {
+    mEntitiesDestroyed.store(true, std::memory_order_relaxed);
+}
 
-    // TODO: handle static objects separately
-    mRenderableViewUbh = renderableUbh;
-    driver.loadUniformBuffer(renderableUbh, { buffer, size });
+void FScene::setRenderableUniforms(void* buffer, size_t offset, mat4f const& model) noexcept {
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelMatrix),
+            model);
+
+    // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
+    // the transformed normals will have unit-length, therefore they need to be normalized
+    // in the shader (that's already the case anyways, since normalization is needed after
+    // interpolation).
+    //
+    // We pre-scale normals by the inverse of the largest scale factor to avoid
+    // large post-transform magnitudes in the shader, especially in the fragment shader, where
+    // we use medium precision.
+    //
+    // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
+
+    mat3f m = transpose(inverse(model.upperLeft()));
+    m *= mat3f(1.0f / std::sqrt(max(float3{length2(m[0]), length2(m[1]), length2(m[2])})));
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
+}
+
+void FScene::updateUBOs() noexcept {
+    if (!mHasDirtyUniforms) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    FRenderableManager& rcm = mEngine.getRenderableManager();
+    const size_t count = mRenderableCache.size();
+    uint8_t* const UTILS_RESTRICT dirty = mDirtyUniforms.data();
+
+    // Each draw binds CONFIG_MAX_INSTANCES slots starting at the renderable's slot, because
+    // that's the size of the uniform block, so the UBO must extend that far past the last slot.
+    const size_t slotCount = mUniformSlotCount + CONFIG_MAX_INSTANCES - 1;
+    if (mRenderableUboCount < slotCount) {
+        // allocate 1/3 extra, with a minimum of 16 objects
+        mRenderableUboCount = std::max(size_t(16u), (4u * slotCount + 2u) / 3u);
+        driver.destroyUniformBuffer(mRenderableUbh);
+        mRenderableUbh = driver.createUniformBuffer(
+                mRenderableUboCount * sizeof(PerRenderableUib), backend::BufferUsage::DYNAMIC);
+        // the new UBO needs all the uniforms
+        std::fill_n(dirty, count, 1);
+    } else {
+        // TODO: should we shrink the underlying UBO at some point?
+    }
+
+    // upload each run of consecutive dirty renderables whose slots are contiguous
+    auto const* const UTILS_RESTRICT transforms = mRenderableCache.data<WORLD_TRANSFORM>();
+    auto const* const UTILS_RESTRICT instances = mRenderableCache.data<RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT instanceCounts = mRenderableCache.data<INSTANCE_COUNT>();
+    auto const* const UTILS_RESTRICT indices = mRenderableCache.data<UBO_INDEX>();
+    auto getSlot = [this, indices, instanceCounts](size_t i) {
+        return UTILS_UNLIKELY(instanceCounts[i]) ? getInstanceGroupSlot(indices[i]) : indices[i];
+    };
+    size_t uploadedSize = 0;    // bytes allocated from the command stream since the last flush
+    for (size_t first = 0; first < count;) {
+        if (!dirty[first]) {
+            first++;
+            continue;
+        }
+        size_t last = first;
+        size_t endSlot = getSlot(first);
+        while (last < count && dirty[last] && getSlot(last) == endSlot) {
+            endSlot += std::max(instanceCounts[last], uint16_t(1));
+            dirty[last++] = 0;
+        }
+
+        // instanced renderables can have many slots, so runs are uploaded in batches small
+        // enough to be allocated into the command stream directly
+        size_t i = first;   // renderable of the slot being written
+        size_t j = 0;       // instance of the slot being written
+        for (size_t slot = getSlot(first); slot < endSlot;) {
+            const size_t batch = std::min(endSlot - slot, MAX_UNIFORM_SLOTS_PER_UPLOAD);
+            const size_t size = batch * sizeof(PerRenderableUib);
+
+            // the command stream can't hold all the uniforms of a large scene, e.g. after a
+            // regather, so it's flushed whenever the uploads would fill too much of it
+            if (UTILS_UNLIKELY(uploadedSize + size > MAX_UNIFORM_UPLOAD_SIZE_PER_FLUSH)) {
+                mEngine.flush();
+                if (!UTILS_HAS_THREADING) {
+                    mEngine.execute();
+                }
+                uploadedSize = 0;
+            }
+            uploadedSize += size;
+
+            void* const buffer = driver.allocate(size);
+            for (size_t k = 0; k < batch; k++) {
+                setRenderableUniforms(buffer, k * sizeof(PerRenderableUib),
+                        UTILS_UNLIKELY(instanceCounts[i]) ?
+                                transforms[i] * rcm.getInstanceTransforms(instances[i])[j] :
+                                transforms[i]);
+                if (++j >= instanceCounts[i]) {
+                    j = 0;
+                    i++;
+                }
+            }
+            driver.updateUniformBuffer(mRenderableUbh, { buffer, size },
+                    uint32_t(slot * sizeof(PerRenderableUib)));
+            slot += batch;
+        }
+        first = last;
+    }
+
+    mHasDirtyUniforms = false;
 }
 
 void FScene::terminate(FEngine& engine) {
-    // DO NOT destroy this UBO, it's owned by the View
-    mRenderableViewUbh.clear();
+    engine.getDriverApi().destroyUniformBuffer(mRenderableUbh);
+    mRenderableUbh.clear();
 }
 
-void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept {
+void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena, GPUBuffer& lightsBuffer) noexcept {
     FEngine::DriverApi& driver = mEngine.getDriverApi();
     FLightManager& lcm = mEngine.getLightManager();
     FScene::LightSoa& lightData = getLightData();
 
     /*
      * Here we copy our lights data into the GPU buffer, some lights might be left out if there
-     * are more than the GPU buffer allows (i.e. 256).
+     * are more than the GPU buffer allows (i.e. CONFIG_MAX_LIGHT_COUNT).
      *
      * We always sort lights by distance to the camera plane so that:
      * - we can build light trees
@@ -245,20 +712,33 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
     float2* const zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>();
     computeLightRanges(zrange, camera, spheres + DIRECTIONAL_LIGHTS_COUNT, positionalLightCount);
 
-    LightsUib* const lp = driver.allocatePod<LightsUib>(positionalLightCount);
+    if (!positionalLightCount) {
+        return;
+    }
+
+    // the lights texture is updated by whole rows
+    const size_t rowCount =
+            (positionalLightCount + Froxelizer::LIGHTS_PER_ROW - 1) / Froxelizer::LIGHTS_PER_ROW;
+    const size_t gpuLightCount = rowCount * Froxelizer::LIGHTS_PER_ROW;
+    assert(rowCount <= lightsBuffer.getRowCount());
+
+    LightsData* const lp = driver.allocatePod<LightsData>(gpuLightCount);
 
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT shadows      = lightData.data<FScene::SHADOW_INDEX>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         const size_t gpuIndex = i - DIRECTIONAL_LIGHTS_COUNT;
         auto li = instances[i];
         lp[gpuIndex].positionFalloff      = { spheres[i].xyz, lcm.getSquaredFalloffInv(li) };
         lp[gpuIndex].colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp[gpuIndex].directionIES         = { directions[i], 0 };
-        lp[gpuIndex].spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp[gpuIndex].spotScaleOffset      = { lcm.getSpotParams(li).scaleOffset, shadows[i], 0 };
     }
 
-    driver.loadUniformBuffer(lightUbh, { lp, positionalLightCount * sizeof(LightsUib) });
+    std::fill(lp + positionalLightCount, lp + gpuLightCount, LightsData{});
+
+    lightsBuffer.commit(driver, lp, lp + gpuLightCount);
 }
 
 // These methods need to exist so clang honors the __restrict__ keyword, which in turn
@@ -313,16 +793,117 @@ inline void FScene::computeLightRanges(
     }
 }
 
+// These methods need to exist so clang honors the __restrict__ keyword, which in turn
+// produces much better vectorization. The ALWAYS_INLINE keyword makes sure we actually don't
+// pay the price of the call!
+UTILS_ALWAYS_INLINE
+inline void FScene::computeWorldAABBs(
+        float3* UTILS_RESTRICT const center,
+        float3* UTILS_RESTRICT const extent,
+        mat4f const* UTILS_RESTRICT const transforms, size_t count) noexcept {
+    // This is rigidTransform() applied in place to the local AABBs. The AABBs and the upper 3x4
+    // of the transforms are transposed in blocks, so that the computation works on separate
+    // x, y and z components and can be vectorized, like the generic culling kernels.
+    constexpr size_t BLOCK_SIZE = 8;
+    for (size_t first = 0; first < count; first += BLOCK_SIZE) {
+        const size_t n = std::min(BLOCK_SIZE, count - first);
+        float cx[BLOCK_SIZE], cy[BLOCK_SIZE], cz[BLOCK_SIZE];
+        float ex[BLOCK_SIZE], ey[BLOCK_SIZE], ez[BLOCK_SIZE];
+        float m[12][BLOCK_SIZE]; // m[column * 3 + row]
+
+        for (size_t i = 0; i < n; i++) {
+            float3 const& c = center[first + i];
+            float3 const& e = extent[first + i];
+            mat4f const& t = transforms[first + i];
+            cx[i] = c.x;
+            cy[i] = c.y;
+            cz[i] = c.z;
+            ex[i] = e.x;
+            ey[i] = e.y;
+            ez[i] = e.z;
+            for (size_t j = 0; j < 4; j++) {
+                m[j * 3 + 0][i] = t[j].x;
+                m[j * 3 + 1][i] = t[j].y;
+                m[j * 3 + 2][i] = t[j].z;
+            }
+        }
+
+        float wcx[BLOCK_SIZE], wcy[BLOCK_SIZE], wcz[BLOCK_SIZE];
+        float wex[BLOCK_SIZE], wey[BLOCK_SIZE], wez[BLOCK_SIZE];
+        #pragma clang loop vectorize_width(8)
+        for (size_t i = 0; i < n; i++) {
+            wcx[i] = m[0][i] * cx[i] + m[3][i] * cy[i] + m[6][i] * cz[i] + m[ 9][i];
+            wcy[i] = m[1][i] * cx[i] + m[4][i] * cy[i] + m[7][i] * cz[i] + m[10][i];
+            wcz[i] = m[2][i] * cx[i] + m[5][i] * cy[i] + m[8][i] * cz[i] + m[11][i];
+            wex[i] = std::abs(m[0][i]) * ex[i] + std::abs(m[3][i]) * ey[i] +
+                     std::abs(m[6][i]) * ez[i];
+            wey[i] = std::abs(m[1][i]) * ex[i] + std::abs(m[4][i]) * ey[i] +
+                     std::abs(m[7][i]) * ez[i];
+            wez[i] = std::abs(m[2][i]) * ex[i] + std::abs(m[5][i]) * ey[i] +
+                     std::abs(m[8][i]) * ez[i];
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            center[first + i] = { wcx[i], wcy[i], wcz[i] };
+            extent[first + i] = { wex[i], wey[i], wez[i] };
+        }
+    }
+}
+
+void FScene::sortEntities() noexcept {
+    FEngine& engine = mEngine;
+    EntityManager& em = engine.getEntityManager();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    auto const& sceneData = mRenderableCache;
+    const size_t count = sceneData.size();
+
+    std::vector<uint32_t> order(count);
+    CullingHierarchy::sort(order.data(), sceneData.data<WORLD_AABB_CENTER>(), count);
+
+    mSortedEntities.clear();
+    mSortedEntities.reserve(mEntities.size());
+
+    // first the renderables, in a spatially coherent order...
+    auto const* instances = sceneData.data<RENDERABLE_INSTANCE>();
+    for (uint32_t i : order) {
+        mSortedEntities.push_back(rcm.getEntity(instances[i]));
+    }
+
+    // ...then all the other entities (e.g. lights)
+    for (Entity e : mEntities) {
+        if (em.isAlive(e) && !(rcm.getInstance(e) && tcm.getInstance(e))) {
+            mSortedEntities.push_back(e);
+        }
+    }
+}
+
+void FScene::setCullingHierarchyEnabled(bool enabled) noexcept {
+    mCullingHierarchyEnabled = enabled;
+    mSortedEntitiesDirty = true;
+    mEntitiesDirty = true;
+    if (!enabled) {
+        mSortedEntities.clear();
+        mSortedEntities.shrink_to_fit();
+    }
+}
+
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mSortedEntitiesDirty = true;
+    mEntitiesDirty = true;
 }
 
 void FScene::addEntities(const Entity* entities, size_t count) {
     mEntities.insert(entities, entities + count);
+    mSortedEntitiesDirty = true;
+    mEntitiesDirty = true;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    mSortedEntitiesDirty = true;
+    mEntitiesDirty = true;
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -403,4 +984,12 @@ bool Scene::hasEntity(Entity entity) const noexcept {
     return upcast(this)->hasEntity(entity);
 }
 
+void Scene::setCullingHierarchyEnabled(bool enabled) noexcept {
+    upcast(this)->setCullingHierarchyEnabled(enabled);
+}
+
+bool Scene::isCullingHierarchyEnabled() const noexcept {
+    return upcast(this)->isCullingHierarchyEnabled();
+}
+
 } // namespace filament
@@ -21,11 +21,6 @@
 #include "details/Engine.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
-#include "details/View.h"
-
-#include "RenderPass.h"
-
-#include <private/filament/SibGenerator.h>
 
 #include <backend/DriverEnums.h>
 
@@ -50,15 +45,6 @@ ShadowMap::ShadowMap(FEngine& engine) noexcept :
                           engine.getBackend() == Backend::METAL) {
     mCamera = mEngine.createCamera(EntityManager::get().create());
     mDebugCamera = mEngine.createCamera(EntityManager::get().create());
-    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
-    debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
-    debugRegistry.registerProperty("d.shadowmap.far_uses_shadowcasters", &engine.debug.shadowmap.far_uses_shadowcasters);
-    debugRegistry.registerProperty("d.shadowmap.checkerboard", &engine.debug.shadowmap.checkerboard);
-    if (ENABLE_LISPSM) {
-        debugRegistry.registerProperty("d.shadowmap.lispsm", &engine.debug.shadowmap.lispsm);
-        debugRegistry.registerProperty("d.shadowmap.dzn", &engine.debug.shadowmap.dzn);
-        debugRegistry.registerProperty("d.shadowmap.dzf", &engine.debug.shadowmap.dzf);
-    }
 }
 
 ShadowMap::~ShadowMap() {
@@ -66,41 +52,11 @@ ShadowMap::~ShadowMap() {
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
-UTILS_NOINLINE
-void ShadowMap::fillWithDebugPattern(backend::DriverApi& driverApi) const noexcept {
-    const size_t dim = mShadowMapDimension;
-    size_t size = dim * dim;
-    uint8_t* ptr = (uint8_t*)malloc(size);
-    driverApi.update2DImage(mShadowMapHandle, 0, 0, 0, dim, dim, {
-        ptr, size, PixelDataFormat::DEPTH_COMPONENT, PixelDataType::UBYTE, (BufferDescriptor::Callback)&free
-    });
-    for (size_t y = 0; y < dim; ++y) {
-        for (size_t x = 0; x < dim; ++x) {
-            ptr[x + y * dim] = ((x ^ y) & 0x8u) ? 0u : 0xFFu;
-        }
-    }
-}
-
-void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
-    assert(mShadowMapDimension);
-
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
-        // nothing to do here.
-        assert(mShadowMapHandle);
-        return;
-    }
-
-    // destroy the current rendertarget and texture
-    if (mShadowMapRenderTarget) {
-        driver.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driver.destroyTexture(mShadowMapHandle);
-    }
+void ShadowMap::setAtlasTile(uint32_t x, uint32_t y, uint32_t dimension,
+        uint32_t width, uint32_t height, TextureFormat format) noexcept {
+    assert(dimension > 2);
+    assert(x + dimension <= width && y + dimension <= height);
 
-    // allocate new ones...
     // we set a viewport with a 1-texel border for when we index outside of the texture
     // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
     // see: computeLightSpaceMatrix()
@@ -108,11 +64,12 @@ void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
     // clamping in the shadow shader (see sampleDepth inside shadowing.fs). Unfortunately, the APIs
     // don't seem let us clear depth attachments to anything greater than 1.0, so we'd need a way to
     // do this other than clearing.
-    mViewport = { 1, 1, dim - 2, dim - 2 };
-    mShadowMapResolution.xy = 1.0f / (dim - 2);
+    mViewport = { int32_t(x + 1), int32_t(y + 1), dimension - 2, dimension - 2 };
+    mAtlasTile = { x, y };
+    mAtlasDimension = { width, height };
+    mShadowMapDimension = dimension;
+    mShadowMapResolution.xy = 1.0f / (dimension - 2);
 
-    // 16-bits seems enough. TODO: make it an option.
-    TextureFormat format = TextureFormat::DEPTH16;
     switch (format) {
         default:
             // this should not happen
@@ -127,99 +84,38 @@ void ShadowMap::prepare(DriverApi& driver, SamplerGroup& sb) noexcept {
             break;
     }
 
-    mShadowMapHandle = driver.createTexture(
-            SamplerType::SAMPLER_2D, 1, format, 1, dim, dim, 1,
-            TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE);
-
-    mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::DEPTH, dim, dim, 1,
-            {}, { mShadowMapHandle }, {});
-
-    SamplerParams s;
-    s.filterMag = SamplerMagFilter::LINEAR;
-    s.filterMin = SamplerMinFilter::LINEAR;
-    s.compareFunc = SamplerCompareFunc::LE;
-    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
-    s.depthStencil = true;
-    sb.setSampler(PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
-}
-
-void ShadowMap::render(DriverApi& driver, RenderPass& pass, FView& view) noexcept {
-    FEngine& engine = mEngine;
-
-    if (UTILS_UNLIKELY(engine.debug.shadowmap.checkerboard)) {
-        // TODO: eventually this will be handled as a optional pass in the framefraph
-        fillWithDebugPattern(driver);
-        return;
-    }
-
-    FScene& scene = *view.getScene();
-    filament::Viewport const& viewport = mViewport;
-
-    // FIXME: in the future this will come from the framegraph
-    RenderPassParams params = {};
-    params.flags.clear = TargetBufferFlags::DEPTH;
-    params.flags.discardStart = TargetBufferFlags::DEPTH;
-    params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
-    params.clearDepth = 1.0;
-    params.viewport = viewport;
-    // disable scissor for clearing so the whole surface, but set the viewport to the
-    // the inset-by-1 rectangle.
-    params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
-
-    FCamera const& camera = getCamera();
-    details::CameraInfo cameraInfo = {
-            .projection         = mat4f{ camera.getProjectionMatrix() },
-            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
-            .model              = camera.getModelMatrix(),
-            .view               = camera.getViewMatrix(),
-            .zn                 = camera.getNear(),
-            .zf                 = camera.getCullingFar(),
-    };
-    pass.setCamera(cameraInfo);
-
-    FView::Range visibleRenderables = view.getVisibleShadowCasters();
-    pass.setGeometry(scene, visibleRenderables);
-
-    view.updatePrimitivesLod(engine, cameraInfo, scene.getRenderableData(), visibleRenderables);
-    view.prepareCamera(cameraInfo, viewport);
-    view.commitUniforms(driver);
-
-    pass.overridePolygonOffset(&mPolygonOffset);
-    pass.generateSortedCommands(RenderPass::SHADOW);
-    pass.execute("Shadow map Pass", getRenderTarget(), params,
-            pass.getCommands().begin(), pass.getCommands().end());
-    pass.overridePolygonOffset(nullptr);
-}
-
-void ShadowMap::terminate(DriverApi& driverApi) noexcept {
-    if (mShadowMapRenderTarget) {
-        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driverApi.destroyTexture(mShadowMapHandle);
-    }
+    // The shader clamps the texture coordinates to the center of the border texels, so that
+    // the neighboring tiles are never sampled, even with PCF.
+    const mat4f A = getAtlasMapping();
+    const float b = 0.5f / dimension;
+    const float3 lo = mat4f::project(A, float3{ b, b, 0 });
+    const float3 hi = mat4f::project(A, float3{ 1.0f - b, 1.0f - b, 0 });
+    mTextureCoordsBounds = { lo.x, lo.y, hi.x, hi.y };
 }
 
 void ShadowMap::update(
         const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+        details::CameraInfo const& camera, uint8_t visibleLayers,
+        float zNear, float zFar) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
+    assert(mShadowMapDimension);
+
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
-    mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
 
     FLightManager::ShadowParams params = lcm.getShadowParams(li);
     mPolygonOffset = {
             .constant = params.options.polygonOffsetConstant,
             .slope = params.options.polygonOffsetSlope
     };
+
+    // the shadow map only covers the [zNear, zFar] slice of the view frustum
     mat4f projection(camera.cullingProjection);
-    if (params.options.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.options.shadowFar;
+    if (zNear != camera.zn || zFar != camera.zf) {
+        float n = zNear;
+        float f = zFar;
         if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
             // perspective projection
             projection[2].z =     (f + n) / (n - f);
@@ -235,14 +131,14 @@ void ShadowMap::update(
             .projection = projection,
             .model = camera.model,
             .view = camera.view,
-            .zn = camera.zn,
-            .zf = camera.zf,
+            .zn = zNear,
+            .zf = zFar,
             .frustum = Frustum(projection * camera.view),
             .worldOrigin = camera.worldOrigin
     };
 
     // debugging...
-    const float dz = cameraInfo.zf - cameraInfo.zn;
+    const float dz = camera.zf - camera.zn;
     float& dzn = mEngine.debug.shadowmap.dzn;
     float& dzf = mEngine.debug.shadowmap.dzf;
     if (dzn < 0)    dzn = std::max(0.0f, params.options.shadowNearHint - camera.zn) / dz;
@@ -261,6 +157,10 @@ void ShadowMap::update(
             break;
         case Type::FOCUSED_SPOT:
         case Type::SPOT:
+            computeShadowCameraSpot(
+                    lightData.elementAt<FScene::POSITION_RADIUS>(index),
+                    lightData.elementAt<FScene::DIRECTION>(index), cameraInfo,
+                    lcm.getSpotParams(li), params);
             break;
         case Type::POINT:
             break;
@@ -499,6 +399,7 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // Computes St the transform to use in the shader to access the shadow map texture
         // i.e. it transform a world-space vertex to a texture coordinate in the shadow-map
+        // tile, and A maps the tile into the shadow map atlas.
         const mat4f MbMt = getTextureCoordsMapping();
         const mat4f St = MbMt * S;
 
@@ -510,7 +411,7 @@ void ShadowMap::computeShadowCameraDirectional(
             // We know we're using an ortho projection
             mTexelSizeWs = texelSizeWorldSpace(St.upperLeft());
         }
-        mLightSpace = St;
+        mLightSpace = getAtlasMapping() * St;
 
         // We apply the constant bias in world space (as opposed to light-space) to account
         // for perspective and lispsm shadow maps. This also allows us to do this at zero-cost
@@ -524,6 +425,60 @@ void ShadowMap::computeShadowCameraDirectional(
     }
 }
 
+void ShadowMap::computeShadowCameraSpot(
+        float4 const& sphere, float3 const& dir, CameraInfo const& camera,
+        FLightManager::SpotParams const& spot, FLightManager::ShadowParams const& params) noexcept {
+
+    /*
+     * The light's camera is a perspective projection from the light's position, covering the
+     * light's outer cone up to its falloff distance.
+     */
+
+    const float3 lightPosition = sphere.xyz;
+    // the up vector must not be parallel to the light's direction
+    const float3 up = std::abs(dir.y) < 0.9f ? float3{ 0, 1, 0 } : float3{ 1, 0, 0 };
+    const mat4f M = mat4f::lookAt(lightPosition, lightPosition + dir, up);
+    const mat4f Mv = FCamera::rigidTransformInverse(M);
+
+    // The near plane is a fraction of the falloff distance, so that the depth precision
+    // of a 16-bits shadow map is still usable at the far plane. Shadow casters closer to the
+    // light than the near plane don't cast shadows.
+    const float zfar = sphere.w;
+    const float znear = std::max(0.01f, zfar * (1.0f / 128.0f));
+    if (UTILS_UNLIKELY(znear >= zfar)) {
+        mHasVisibleShadows = false;
+        return;
+    }
+
+    // tangent of the cone's half-aperture, wide cones are clamped to ~85 degrees because the
+    // resolution of the shadow map vanishes as the aperture gets closer to 90 degrees.
+    const float cosOuter = std::sqrt(spot.cosOuterSquared);
+    const float tanOuter = std::min(11.4f,
+            std::sqrt(std::max(0.0f, 1.0f - spot.cosOuterSquared)) / std::max(cosOuter, 1e-3f));
+
+    const float t = tanOuter * znear;
+    const mat4f Mp = mat4f::frustum(-t, t, -t, t, znear, zfar);
+    const mat4f S = Mp * Mv;
+
+    // Computes St the transform to use in the shader to access the shadow map texture,
+    // the perspective divide happens in the shader.
+    const mat4f St = getTextureCoordsMapping() * S;
+
+    // the size of a texel grows linearly with the distance to the light, the shader scales
+    // this by the distance of the fragment to the light.
+    mTexelSizeWs = 2.0f * tanOuter * mShadowMapResolution.x;
+    mLightSpace = getAtlasMapping() * St;
+
+    // the constant bias is applied in world space, along the light's direction
+    const mat4f Sb = S * mat4f::translation(dir * params.options.constantBias);
+    mCamera->setCustomProjection(mat4(Sb), znear, zfar);
+
+    // for the debug camera, we need to undo the world origin
+    mDebugCamera->setCustomProjection(mat4(Sb * camera.worldOrigin), znear, zfar);
+
+    mHasVisibleShadows = true;
+}
+
 mat4f ShadowMap::applyLISPSM(math::mat4f& Wp,
         CameraInfo const& camera, FLightManager::ShadowParams const& params,
         mat4f const& LMpMv,
@@ -628,6 +583,22 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
     return Mb * Mt;
 }
 
+mat4f ShadowMap::getAtlasMapping() const noexcept {
+    // remapping from the tile's texture coordinates to the atlas' texture coordinates.
+    // The viewport's origin is the bottom-left corner, but when the clip-space is flipped
+    // the texture's origin is its top-left corner.
+    const uint32_t y = mClipSpaceFlipped ?
+            mAtlasDimension.y - mAtlasTile.y - mShadowMapDimension : mAtlasTile.y;
+    const float2 s = float(mShadowMapDimension) / float2(mAtlasDimension);
+    const float2 o = float2(mAtlasTile.x, y) / float2(mAtlasDimension);
+    return mat4f(mat4f::row_major_init{
+            s.x,   0, 0, o.x,
+              0, s.y, 0, o.y,
+              0,   0, 1,   0,
+              0,   0, 0,   1
+    });
+}
+
 // This construct a frustum (similar to glFrustum or frustum), except
 // it looks towards the +y axis, and assumes -1,1 for the left/right and bottom/top planes.
 mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
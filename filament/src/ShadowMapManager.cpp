@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowMapManager.h"
+
+#include "components/LightManager.h"
+#include "components/RenderableManager.h"
+
+#include "details/Engine.h"
+#include "details/RenderPrimitive.h"
+#include "details/View.h"
+
+#include "fg/FrameGraph.h"
+
+#include "RenderPass.h"
+#include "UniformBuffer.h"
+
+#include <private/filament/SibGenerator.h>
+#include <private/filament/UibGenerator.h>
+
+#include <utils/algorithm.h>
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+
+using namespace backend;
+
+namespace details {
+
+ShadowMapManager::ShadowMapManager(FEngine& engine) noexcept : mEngine(engine) {
+    for (auto& cascade : mCascades) {
+        cascade.reset(new ShadowMap(engine));
+    }
+
+    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
+    debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
+    debugRegistry.registerProperty("d.shadowmap.far_uses_shadowcasters", &engine.debug.shadowmap.far_uses_shadowcasters);
+    debugRegistry.registerProperty("d.shadowmap.checkerboard", &engine.debug.shadowmap.checkerboard);
+    debugRegistry.registerProperty("d.shadowmap.lispsm", &engine.debug.shadowmap.lispsm);
+    debugRegistry.registerProperty("d.shadowmap.dzn", &engine.debug.shadowmap.dzn);
+    debugRegistry.registerProperty("d.shadowmap.dzf", &engine.debug.shadowmap.dzf);
+    debugRegistry.registerProperty("d.shadowmap.cache_hits", &engine.debug.shadowmap.cache_hits);
+    debugRegistry.registerProperty("d.shadowmap.cache_misses", &engine.debug.shadowmap.cache_misses);
+}
+
+ShadowMapManager::~ShadowMapManager() = default;
+
+void ShadowMapManager::terminate(DriverApi& driver) noexcept {
+    if (mShadowMapRenderTarget) {
+        driver.destroyRenderTarget(mShadowMapRenderTarget);
+    }
+    if (mShadowMapHandle) {
+        driver.destroyTexture(mShadowMapHandle);
+    }
+}
+
+static inline uint32_t roundUpPow2(uint32_t v) noexcept {
+    return v <= 1u ? 1u : 1u << (32u - utils::clz(v - 1u));
+}
+
+static inline uint32_t floorPow2(uint32_t v) noexcept {
+    assert(v);
+    return 1u << (31u - utils::clz(v));
+}
+
+// extracts the even bits of a morton code
+static inline uint32_t compact1By1(uint32_t x) noexcept {
+    x &= 0x55555555u;
+    x = (x ^ (x >> 1u)) & 0x33333333u;
+    x = (x ^ (x >> 2u)) & 0x0f0f0f0fu;
+    x = (x ^ (x >> 4u)) & 0x00ff00ffu;
+    x = (x ^ (x >> 8u)) & 0x0000ffffu;
+    return x;
+}
+
+bool ShadowMapManager::update(FScene::LightSoa& lightData, FScene const* scene,
+        details::CameraInfo const& camera, uint8_t visibleLayers,
+        filament::Viewport const& viewport, View::ShadowAtlasOptions const& options) noexcept {
+    SYSTRACE_CALL();
+
+    auto& lcm = mEngine.getLightManager();
+
+    mCascadeCount = 0;
+    mSpotShadowCount = 0;
+    mHasVisibleShadows = false;
+    mShadowCaching = true;
+
+    // dominant directional light is always as index 0
+    FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
+    if (directionalLight && lcm.isShadowCaster(directionalLight)) {
+        FLightManager::ShadowParams const& params = lcm.getShadowParams(directionalLight);
+        mCascadeCount = std::min(std::max(size_t(params.options.shadowCascades),
+                size_t(1)), CONFIG_MAX_SHADOW_CASCADES);
+        // each cascade's tile (including its 1-texel border) is as large as the light's
+        // shadow map, rounded up to a power of two so that it can be packed in the atlas
+        mCascadeDimension = roundUpPow2(std::max(4u, lcm.getShadowMapSize(directionalLight)));
+        mCascadeNormalBias = params.options.normalBias;
+        mShadowCaching = params.options.shadowCaching;
+    }
+
+    // Pick the shadow casting spot lights with the largest projected size on screen, their
+    // shadow map is sized from it, e.g. a light covering 300 pixels gets a 512 texels tile.
+    const uint32_t minDimension = options.minShadowMapSize;
+    const float pixelScale = camera.projection[1][1] * float(viewport.height);
+    auto const* UTILS_RESTRICT instances = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT spheres   = lightData.data<FScene::POSITION_RADIUS>();
+    auto      * UTILS_RESTRICT shadowIndices = lightData.data<FScene::SHADOW_INDEX>();
+    float diameters[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        shadowIndices[i] = 0;
+        FLightManager::Instance li = instances[i];
+        if (!lcm.isSpotLight(li) || !lcm.isShadowCaster(li)) {
+            continue;
+        }
+        const float4 v = camera.view * float4{ spheres[i].xyz, 1.0f };
+        const float diameter = spheres[i].w * pixelScale / std::max(-v.z, camera.zn);
+
+        // insertion in the list of lights sorted by decreasing diameter
+        size_t k = mSpotShadowCount;
+        if (k == CONFIG_MAX_SHADOWED_SPOT_LIGHTS) {
+            if (diameter <= diameters[k - 1]) {
+                continue;
+            }
+            k--;
+        } else {
+            mSpotShadowCount++;
+        }
+        for (; k > 0 && diameters[k - 1] < diameter; k--) {
+            diameters[k] = diameters[k - 1];
+            mSpotShadowInfos[k] = mSpotShadowInfos[k - 1];
+        }
+        const uint32_t maxDimension = roundUpPow2(std::max(lcm.getShadowMapSize(li), minDimension));
+        diameters[k] = diameter;
+        mSpotShadowInfos[k] = {
+                .light = uint32_t(i),
+                .dimension = std::min(std::max(roundUpPow2(uint32_t(std::min(diameter, 65536.0f))),
+                        minDimension), maxDimension),
+                .normalBias = lcm.getShadowNormalBias(li)
+        };
+    }
+
+    if (!layoutAtlas(options)) {
+        return false;
+    }
+
+    // the cascades split the [near, shadowFar] range of the view frustum
+    if (mCascadeCount) {
+        FLightManager::ShadowParams const& params = lcm.getShadowParams(directionalLight);
+        const float zn = camera.zn;
+        const float zf = params.options.shadowFar > 0.0f ? params.options.shadowFar : camera.zf;
+        float cascadeNear = zn;
+        for (size_t i = 0; i < mCascadeCount; i++) {
+            const float cascadeFar = (i < mCascadeCount - 1) ?
+                    zn + params.options.cascadeSplitPositions[i] * (zf - zn) : zf;
+            mCascadeSplits[i] = cascadeFar;
+
+            ShadowMap& shadowMap = *mCascades[i];
+            shadowMap.update(lightData, 0, scene, camera, visibleLayers, cascadeNear, cascadeFar);
+            mHasVisibleShadows |= shadowMap.hasVisibleShadows();
+
+            cascadeNear = cascadeFar;
+        }
+    }
+
+    for (size_t k = 0; k < mSpotShadowCount; k++) {
+        SpotShadow const& spot = mSpotShadowInfos[k];
+        ShadowMap& shadowMap = *mSpotShadows[k];
+        shadowMap.update(lightData, spot.light, scene, camera, visibleLayers,
+                camera.zn, camera.zf);
+        if (shadowMap.hasVisibleShadows()) {
+            shadowIndices[spot.light] = uint8_t(k + 1);
+            mHasVisibleShadows = true;
+        }
+        mShadowCaching &= lcm.getShadowParams(instances[spot.light]).options.shadowCaching;
+    }
+
+    return mHasVisibleShadows;
+}
+
+bool ShadowMapManager::layoutAtlas(View::ShadowAtlasOptions const& options) noexcept {
+    const uint32_t minDimension = options.minShadowMapSize;
+    const uint32_t maxSize = floorPow2(std::max(options.maxSize, minDimension));
+    const uint64_t maxArea = uint64_t(maxSize) * maxSize;
+
+    auto area = [this]() {
+        uint64_t total = uint64_t(mCascadeDimension) * mCascadeDimension * mCascadeCount;
+        for (size_t k = 0; k < mSpotShadowCount; k++) {
+            total += uint64_t(mSpotShadowInfos[k].dimension) * mSpotShadowInfos[k].dimension;
+        }
+        return total;
+    };
+
+    // Shrink the spot lights' tiles until they all fit in the atlas, starting with the largest
+    // and least important ones. When they're all at the minimum size the least important lights
+    // lose their shadows. Spot lights are sorted by decreasing importance.
+    while (mSpotShadowCount && area() > maxArea) {
+        size_t largest = mSpotShadowCount - 1;
+        for (size_t k = largest; k-- > 0;) {
+            if (mSpotShadowInfos[k].dimension > mSpotShadowInfos[largest].dimension) {
+                largest = k;
+            }
+        }
+        if (mSpotShadowInfos[largest].dimension > minDimension) {
+            mSpotShadowInfos[largest].dimension /= 2u;
+        } else {
+            mSpotShadowCount--;
+        }
+    }
+
+    const size_t tileCount = mCascadeCount + mSpotShadowCount;
+    if (!tileCount) {
+        return false;
+    }
+
+    struct Tile {
+        ShadowMap* shadowMap;
+        uint32_t dimension;
+    };
+    Tile tiles[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        tiles[i] = { mCascades[i].get(), mCascadeDimension };
+    }
+    for (size_t k = 0; k < mSpotShadowCount; k++) {
+        if (!mSpotShadows[k]) {
+            mSpotShadows[k].reset(new ShadowMap(mEngine));
+        }
+        tiles[mCascadeCount + k] = { mSpotShadows[k].get(), mSpotShadowInfos[k].dimension };
+    }
+    std::stable_sort(tiles, tiles + tileCount, [](Tile const& lhs, Tile const& rhs) {
+        return lhs.dimension > rhs.dimension;
+    });
+
+    uint32_t dimensions[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    uint2 positions[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    for (size_t i = 0; i < tileCount; i++) {
+        dimensions[i] = tiles[i].dimension;
+    }
+    const uint2 atlasSize = packAtlas(dimensions, tileCount, positions);
+    mAtlasWidth = atlasSize.x;
+    mAtlasHeight = atlasSize.y;
+
+    for (size_t i = 0; i < tileCount; i++) {
+        tiles[i].shadowMap->setAtlasTile(positions[i].x, positions[i].y,
+                tiles[i].dimension, mAtlasWidth, mAtlasHeight, SHADOW_MAP_FORMAT);
+    }
+    return true;
+}
+
+uint2 ShadowMapManager::packAtlas(uint32_t const* dimensions, size_t count,
+        uint2* positions) noexcept {
+    assert(count);
+
+    uint64_t totalArea = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert(i == 0 || dimensions[i] <= dimensions[i - 1]);
+        totalArea += uint64_t(dimensions[i]) * dimensions[i];
+    }
+
+    // the atlas is the smallest power-of-two square that fits all the tiles, or its bottom half
+    uint32_t size = dimensions[0];
+    while (uint64_t(size) * size < totalArea) {
+        size *= 2u;
+    }
+    const uint32_t height = totalArea * 2u <= uint64_t(size) * size ? size / 2u : size;
+
+    // The tiles are placed along a Z-order curve at the offset given by the area of the tiles
+    // before them: since all tile sizes are powers of two and the tiles are sorted by decreasing
+    // size, each tile starts on a multiple of its own area and is therefore a square of the curve.
+    // In the bottom half of the atlas the offsets are below size * size / 2, so y < size / 2.
+    uint32_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        positions[i] = { compact1By1(offset), compact1By1(offset >> 1u) };
+        offset += dimensions[i] * dimensions[i];
+    }
+    return { size, height };
+}
+
+void ShadowMapManager::prepare(DriverApi& driver, UniformBuffer& u, SamplerGroup& sb) noexcept {
+    assert(mAtlasWidth && mAtlasHeight);
+
+    if (mShadowMapWidth != mAtlasWidth || mShadowMapHeight != mAtlasHeight) {
+        // destroy the current rendertarget and texture
+        terminate(driver);
+
+        // allocate new ones...
+        mShadowMapWidth = mAtlasWidth;
+        mShadowMapHeight = mAtlasHeight;
+        mHasShadowCache = false;
+
+        mShadowMapHandle = driver.createTexture(
+                SamplerType::SAMPLER_2D, 1, SHADOW_MAP_FORMAT, 1,
+                mShadowMapWidth, mShadowMapHeight, 1,
+                TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE);
+
+        mShadowMapRenderTarget = driver.createRenderTarget(
+                TargetBufferFlags::DEPTH, mShadowMapWidth, mShadowMapHeight, 1,
+                {}, { mShadowMapHandle }, {});
+
+        SamplerParams s;
+        s.filterMag = SamplerMagFilter::LINEAR;
+        s.filterMin = SamplerMinFilter::LINEAR;
+        s.compareFunc = SamplerCompareFunc::LE;
+        s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+        s.depthStencil = true;
+        sb.setSampler(PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
+    }
+
+    float4 cascadeSplits{ std::numeric_limits<float>::lowest() };
+    float4 cascadeNormalBias{};
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        ShadowMap const& shadowMap = *mCascades[i];
+        u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix) + sizeof(mat4f) * i,
+                shadowMap.getLightSpaceMatrix());
+        u.setUniform(offsetof(PerViewUib, cascadeTiles) + sizeof(float4) * i,
+                shadowMap.getTextureCoordsBounds());
+        cascadeNormalBias[i] = mCascadeNormalBias * shadowMap.getTexelSizeWorldSpace();
+        if (i < mCascadeCount - 1) {
+            // the view-space z of the cascade's far plane, the last cascade covers everything
+            cascadeSplits[i] = -mCascadeSplits[i];
+        }
+    }
+
+    u.setUniform(offsetof(PerViewUib, shadowBias), float3{ 0, cascadeNormalBias[0], 0 });
+    u.setUniform(offsetof(PerViewUib, cascadeSplits), cascadeSplits);
+    u.setUniform(offsetof(PerViewUib, cascadeNormalBias), cascadeNormalBias);
+    u.setUniform(offsetof(PerViewUib, cascades), uint32_t(mCascadeCount));
+
+    // the spot lights' normal bias is the size of a texel at 1m, the shader scales it by the
+    // distance to the light
+    float4 spotNormalBias[CONFIG_MAX_SHADOWED_SPOT_LIGHTS / 4]{};
+    for (size_t k = 0; k < mSpotShadowCount; k++) {
+        ShadowMap const& shadowMap = *mSpotShadows[k];
+        if (shadowMap.hasVisibleShadows()) {
+            u.setUniform(offsetof(PerViewUib, spotLightFromWorldMatrix) + sizeof(mat4f) * k,
+                    shadowMap.getLightSpaceMatrix());
+            u.setUniform(offsetof(PerViewUib, spotShadowTiles) + sizeof(float4) * k,
+                    shadowMap.getTextureCoordsBounds());
+            spotNormalBias[k / 4][k % 4] =
+                    mSpotShadowInfos[k].normalBias * shadowMap.getTexelSizeWorldSpace();
+        }
+    }
+    u.setUniformArray(offsetof(PerViewUib, spotShadowNormalBias),
+            spotNormalBias, CONFIG_MAX_SHADOWED_SPOT_LIGHTS / 4);
+}
+
+void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, RenderPass& pass,
+        FView& view) noexcept {
+    SYSTRACE_CALL();
+
+    if (UTILS_UNLIKELY(engine.debug.shadowmap.checkerboard)) {
+        // TODO: eventually this will be handled as a optional pass in the framefraph
+        fillWithDebugPattern(engine.getDriverApi());
+        mHasShadowCache = false;
+        return;
+    }
+
+    FScene& scene = *view.getScene();
+    FView::Range visibleRenderables = view.getVisibleShadowCasters();
+
+    // shadow casters use the levels of detail seen from the viewer's camera, so that their
+    // shadows match their geometry
+    view.updatePrimitivesLod(engine, view.getCameraInfo(),
+            scene.getRenderableData(), visibleRenderables);
+
+    if (checkShadowCache(engine, scene.getRenderableData(), visibleRenderables)) {
+        // the atlas already has the content this frame would render
+        return;
+    }
+
+    constexpr size_t SHADOW_MAP_COUNT =
+            CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS;
+
+    struct ShadowPassData {
+        FrameGraphResource shadowMap;
+        // the commands of each cascade, then of each spot light, empty if the shadow map has
+        // no visible shadows
+        Slice<RenderPass::Command> commands[SHADOW_MAP_COUNT];
+    };
+
+    // The commands of all the shadow maps are generated upfront, each shadow map draws the
+    // shadow casters visible in its light frustum. The commands of a spot light are generated
+    // right after its casters are selected, because they all share the same visibility bit.
+    ShadowPassData shadowMaps{};
+    pass.setGeometry(scene, visibleRenderables);
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        ShadowMap const& shadowMap = *mCascades[i];
+        if (shadowMap.hasVisibleShadows()) {
+            pass.setCamera(getCameraInfo(shadowMap.getCamera()));
+            pass.setVisibilityMask(FScene::visibleCascade(i));
+            shadowMaps.commands[i] = pass.generateSortedCommands(RenderPass::SHADOW);
+        }
+    }
+    for (size_t k = 0; k < mSpotShadowCount; k++) {
+        ShadowMap const& shadowMap = *mSpotShadows[k];
+        if (shadowMap.hasVisibleShadows()) {
+            cullSpotShadowCasters(engine.getJobSystem(), scene.getRenderableData(),
+                    visibleRenderables, shadowMap.getCamera().getFrustum());
+            pass.setCamera(getCameraInfo(shadowMap.getCamera()));
+            pass.setVisibilityMask(FScene::VISIBLE_SPOT_SHADOW);
+            shadowMaps.commands[CONFIG_MAX_SHADOW_CASCADES + k] =
+                    pass.generateSortedCommands(RenderPass::SHADOW);
+        }
+    }
+    pass.setVisibilityMask(0);
+
+    FrameGraphResource atlas = fg.importResource("Shadow map",
+            { .viewport = { 0, 0, mShadowMapWidth, mShadowMapHeight }},
+            mShadowMapRenderTarget, mShadowMapWidth, mShadowMapHeight,
+            TargetBufferFlags::DEPTH, TargetBufferFlags::COLOR_AND_STENCIL);
+
+    fg.addPass<ShadowPassData>("Shadow pass",
+            [atlas, &shadowMaps](FrameGraph::Builder& builder, ShadowPassData& data) {
+                data = shadowMaps;
+                auto attachments = builder.useRenderTarget(atlas, TargetBufferFlags::DEPTH);
+                data.shadowMap = attachments.color;
+            },
+            [this, &pass, &view](FrameGraphPassResources const& resources,
+                    ShadowPassData const& data, DriverApi& driver) {
+                // the imported render target is only depth, so we set up the render pass
+                // ourselves. The whole atlas is cleared by the first shadow map.
+                Handle<HwRenderTarget> target = resources.getRenderTarget(data.shadowMap).target;
+                bool first = true;
+                auto renderShadowMap = [&](ShadowMap const& shadowMap,
+                        Slice<RenderPass::Command> const& commands,
+                        Culler::result_type visibilityMask) {
+                    if (commands.empty() && !first) {
+                        return;
+                    }
+
+                    RenderPassParams params = {};
+                    if (first) {
+                        // disable scissor for clearing so the whole atlas is cleared, but set
+                        // the viewport to the inset-by-1 rectangle.
+                        params.flags.clear = TargetBufferFlags::DEPTH;
+                        params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR;
+                        params.flags.discardStart = TargetBufferFlags::DEPTH;
+                        first = false;
+                    }
+                    params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+                    params.clearDepth = 1.0;
+                    params.viewport = shadowMap.getViewport();
+
+                    view.prepareCamera(getCameraInfo(shadowMap.getCamera()), shadowMap.getViewport());
+                    view.commitUniforms(driver);
+
+                    PolygonOffset polygonOffset = shadowMap.getPolygonOffset();
+                    pass.overridePolygonOffset(&polygonOffset);
+                    pass.execute("Shadow pass", target, params,
+                            commands.begin(), commands.end(), visibilityMask);
+                };
+
+                for (size_t i = 0; i < mCascadeCount; i++) {
+                    renderShadowMap(*mCascades[i], data.commands[i], FScene::visibleCascade(i));
+                }
+                // instance groups are culled against all the spot lights at once
+                for (size_t k = 0; k < mSpotShadowCount; k++) {
+                    renderShadowMap(*mSpotShadows[k],
+                            data.commands[CONFIG_MAX_SHADOW_CASCADES + k],
+                            FScene::VISIBLE_SPOT_SHADOWS);
+                }
+                pass.overridePolygonOffset(nullptr);
+            });
+}
+
+void ShadowMapManager::cullSpotShadowCasters(JobSystem& js,
+        FScene::RenderableSoa& renderableData, Range<uint32_t> const& casters,
+        Frustum const& frustum) noexcept {
+    SYSTRACE_CALL();
+
+    if (casters.empty()) {
+        return;
+    }
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t* visibleArray = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // Culler::intersects() processes groups of Culler::MODULO renderables, so the jobs work on
+    // aligned groups, otherwise they would race on the bit cleared at the end of each range.
+    const uint32_t first = casters.first & ~uint32_t(Culler::MODULO - 1);
+    auto functor = [=](uint32_t index, uint32_t c) {
+        index = first + index * Culler::MODULO;
+        c *= Culler::MODULO;
+        for (uint32_t i = index; i < index + c; i++) {
+            visibleArray[i] &= ~FScene::VISIBLE_SPOT_SHADOW;
+        }
+        Culler::intersects(visibleArray + index, frustum,
+                worldAABBCenter + index, worldAABBExtent + index, c,
+                FScene::VISIBLE_SPOT_SHADOW_BIT);
+        for (uint32_t i = index; i < index + c; i++) {
+            if (!visibility[i].culling) {
+                visibleArray[i] |= FScene::VISIBLE_SPOT_SHADOW;
+            }
+        }
+    };
+
+    const uint32_t groupCount = (casters.last - first + Culler::MODULO - 1) / Culler::MODULO;
+    auto job = jobs::parallel_for(js, nullptr, 0, groupCount, std::ref(functor),
+            jobs::CountSplitter<Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.runAndWait(job);
+}
+
+bool ShadowMapManager::checkShadowCache(FEngine& engine,
+        FScene::RenderableSoa const& renderableData,
+        utils::Range<uint32_t> const& visibleRenderables) noexcept {
+    if (!mShadowCaching) {
+        mHasShadowCache = false;
+        return false;
+    }
+
+    uint64_t hash = 0;
+    const bool cacheable = hashShadowInputs(engine, renderableData, visibleRenderables, &hash);
+    if (mHasShadowCache && cacheable && hash == mShadowCacheHash) {
+        engine.debug.shadowmap.cache_hits++;
+        return true;
+    }
+    engine.debug.shadowmap.cache_misses++;
+    mShadowCacheHash = hash;
+    mHasShadowCache = cacheable;
+    return false;
+}
+
+bool ShadowMapManager::hashShadowInputs(FEngine& engine,
+        FScene::RenderableSoa const& renderableData,
+        utils::Range<uint32_t> const& visibleRenderables, uint64_t* hash) const noexcept {
+    SYSTRACE_CALL();
+
+    hash::Murmur3x2 hasher;
+
+    // the atlas depends on its layout and on the light camera and bias of each shadow map
+    const struct {
+        uint32_t width;
+        uint32_t height;
+        uint32_t cascadeCount;
+        uint32_t spotShadowCount;
+        uint32_t casterCount;
+    } atlas = {
+            mShadowMapWidth, mShadowMapHeight,
+            uint32_t(mCascadeCount), uint32_t(mSpotShadowCount),
+            uint32_t(visibleRenderables.size())
+    };
+    hasher.add(&atlas, sizeof(atlas));
+
+    for (size_t i = 0; i < mCascadeCount + mSpotShadowCount; i++) {
+        ShadowMap const& shadowMap = i < mCascadeCount ?
+                *mCascades[i] : *mSpotShadows[i - mCascadeCount];
+        const details::CameraInfo cameraInfo = getCameraInfo(shadowMap.getCamera());
+        const PolygonOffset polygonOffset = shadowMap.getPolygonOffset();
+        const filament::Viewport& viewport = shadowMap.getViewport();
+        const struct {
+            mat4f projection;
+            mat4f view;
+            int32_t left;
+            int32_t bottom;
+            uint32_t width;
+            uint32_t height;
+            float slope;
+            float constant;
+            uint32_t hasVisibleShadows;
+        } cascade = {
+                cameraInfo.projection, cameraInfo.view,
+                viewport.left, viewport.bottom, viewport.width, viewport.height,
+                polygonOffset.slope, polygonOffset.constant,
+                uint32_t(shadowMap.hasVisibleShadows())
+        };
+        hasher.add(&cascade, sizeof(cascade));
+    }
+
+    // and on the transform, visibility, geometry and material instances of each caster
+    auto& rcm = engine.getRenderableManager();
+    auto const* UTILS_RESTRICT instances    = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* UTILS_RESTRICT transforms   = renderableData.data<FScene::WORLD_TRANSFORM>();
+    auto const* UTILS_RESTRICT visibility   = renderableData.data<FScene::VISIBILITY_STATE>();
+    auto const* UTILS_RESTRICT visibleMasks = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const* UTILS_RESTRICT primitives   = renderableData.data<FScene::PRIMITIVES>();
+    for (uint32_t i : visibleRenderables) {
+        if (visibility[i].skinning) {
+            // the bones can change without anything we can see here changing
+            return false;
+        }
+
+        const struct {
+            mat4f transform;
+            uint32_t instance;
+            uint32_t visibleShadowMaps;
+            uint32_t primitiveCount;
+        } caster = {
+                transforms[i], instances[i].asValue(),
+                uint32_t(visibleMasks[i] & (FScene::VISIBLE_CASCADES | FScene::VISIBLE_SPOT_SHADOWS)),
+                uint32_t(primitives[i].size())
+        };
+        hasher.add(&caster, sizeof(caster));
+
+        for (FRenderPrimitive const& primitive : primitives[i]) {
+            const struct {
+                uint64_t materialInstance;
+                uint32_t handle;
+                uint32_t type;
+            } geometry = {
+                    uint64_t(uintptr_t(primitive.getMaterialInstance())),
+                    primitive.getHwHandle().getId(),
+                    uint32_t(primitive.getPrimitiveType())
+            };
+            hasher.add(&geometry, sizeof(geometry));
+        }
+
+        mat4f const* instanceTransforms = rcm.getInstanceTransforms(instances[i]);
+        if (instanceTransforms) {
+            hasher.add(instanceTransforms, sizeof(mat4f) * rcm.getInstanceCount(instances[i]));
+        }
+    }
+
+    *hash = hasher.get();
+    return true;
+}
+
+details::CameraInfo ShadowMapManager::getCameraInfo(FCamera const& camera) noexcept {
+    return {
+            .projection         = mat4f{ camera.getProjectionMatrix() },
+            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+            .model              = camera.getModelMatrix(),
+            .view               = camera.getViewMatrix(),
+            .zn                 = camera.getNear(),
+            .zf                 = camera.getCullingFar(),
+    };
+}
+
+UTILS_NOINLINE
+void ShadowMapManager::fillWithDebugPattern(DriverApi& driverApi) const noexcept {
+    const size_t width = mShadowMapWidth;
+    const size_t height = mShadowMapHeight;
+    size_t size = width * height;
+    uint8_t* ptr = (uint8_t*)malloc(size);
+    driverApi.update2DImage(mShadowMapHandle, 0, 0, 0, width, height, {
+        ptr, size, PixelDataFormat::DEPTH_COMPONENT, PixelDataType::UBYTE, (BufferDescriptor::Callback)&free
+    });
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            ptr[x + y * width] = ((x ^ y) & 0x8u) ? 0u : 0xFFu;
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
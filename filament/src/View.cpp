@@ -50,27 +50,32 @@ using namespace backend;
 
 namespace details {
 
-// values of the 'VISIBLE_MASK' after culling (0: not visible)
-static constexpr size_t VISIBLE_RENDERABLE_BIT = 0u;
-static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
-static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
-static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
-static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
+// the lights texture initially fits 256 lights
+static constexpr size_t LIGHT_BUFFER_MIN_HEIGHT = 256 / Froxelizer::LIGHTS_PER_ROW;
+static constexpr size_t LIGHT_BUFFER_MAX_HEIGHT = CONFIG_MAX_LIGHT_COUNT / Froxelizer::LIGHTS_PER_ROW;
 
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(PerViewUib::getUib().getSize()),
       mPerViewSb(PerViewSib::SAMPLER_COUNT),
-      mDirectionalShadowMap(engine) {
+      mShadowMapManager(engine) {
     DriverApi& driver = engine.getDriverApi();
 
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
     debugRegistry.registerProperty("d.view.camera_at_origin",
             &engine.debug.view.camera_at_origin);
+    debugRegistry.registerProperty("d.view.occluders",
+            &engine.debug.view.occluders);
+    debugRegistry.registerProperty("d.view.occlusion_culled",
+            &engine.debug.view.occlusion_culled);
+
+    mLightsBuffer = GPUBuffer(driver, { GPUBuffer::ElementType::FLOAT, 4 },
+            Froxelizer::LIGHT_BUFFER_WIDTH, LIGHT_BUFFER_MIN_HEIGHT);
 
     // set-up samplers
     mFroxelizer.getRecordBuffer().setSampler(PerViewSib::RECORDS, mPerViewSb);
     mFroxelizer.getFroxelBuffer().setSampler(PerViewSib::FROXELS, mPerViewSb);
+    mLightsBuffer.setSampler(PerViewSib::PUNCTUAL_LIGHTS, mPerViewSb);
     if (engine.getDFG()->isValid()) {
         TextureSampler sampler(TextureSampler::MagFilter::LINEAR);
         mPerViewSb.setSampler(PerViewSib::IBL_DFG_LUT,
@@ -80,7 +85,6 @@ FView::FView(FEngine& engine)
 
     // allocate ubos
     mPerViewUbh = driver.createUniformBuffer(mPerViewUb.getSize(), backend::BufferUsage::DYNAMIC);
-    mLightUbh = driver.createUniformBuffer(CONFIG_MAX_LIGHT_COUNT * sizeof(LightsUib), backend::BufferUsage::DYNAMIC);
 
     mIsDynamicResolutionSupported = driver.isFrameTimeSupported();
 }
@@ -91,10 +95,9 @@ void FView::terminate(FEngine& engine) {
     // Here we would cleanly free resources we've allocated or we own (currently none).
     DriverApi& driver = engine.getDriverApi();
     driver.destroyUniformBuffer(mPerViewUbh);
-    driver.destroyUniformBuffer(mLightUbh);
+    mLightsBuffer.terminate(driver);
     driver.destroySamplerGroup(mPerViewSbh);
-    driver.destroyUniformBuffer(mRenderableUbh);
-    mDirectionalShadowMap.terminate(driver);
+    mShadowMapManager.terminate(driver);
     mFroxelizer.terminate(driver);
 }
 
@@ -277,38 +280,31 @@ bool FView::isSkyboxVisible() const noexcept {
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
 }
 
+void FView::setShadowAtlasOptions(ShadowAtlasOptions const& options) noexcept {
+    ShadowAtlasOptions o = options;
+    o.minShadowMapSize = std::max(16u, o.minShadowMapSize);
+    o.maxSize = std::max(o.minShadowMapSize, o.maxSize);
+    mShadowAtlasOptions = o;
+}
+
 void FView::prepareShadowing(FEngine& engine, backend::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+        FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+        filament::Viewport const& viewport) noexcept {
     SYSTRACE_CALL();
 
-    // setup shadow mapping
-    // TODO: for now we only consider THE directional light
-
-    auto& lcm = engine.getLightManager();
-
-    // dominant directional light is always as index 0
-    FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
-    mHasShadowing = mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
+    // setup shadow mapping for the directional light and the shadow casting spot lights
+    mHasShadowing = mShadowingEnabled;
     if (UTILS_UNLIKELY(mHasShadowing)) {
-        // compute the frustum for this light
-        ShadowMap& shadowMap = mDirectionalShadowMap;
-        shadowMap.update(lightData, 0, mScene, mViewingCameraInfo, mVisibleLayers);
-        if (shadowMap.hasVisibleShadows()) {
+        // compute the frustum of each shadow map and lay them out in the atlas
+        ShadowMapManager& shadowMapManager = mShadowMapManager;
+        if (shadowMapManager.update(lightData, mScene, mViewingCameraInfo, mVisibleLayers,
+                viewport, mShadowAtlasOptions)) {
             // Cull shadow casters
-            UniformBuffer& u = mPerViewUb;
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            FView::prepareVisibleShadowCasters(engine.getJobSystem(), frustum, renderableData);
-
-            // allocates shadowmap driver resources
-            shadowMap.prepare(driver, mPerViewSb);
+            FView::prepareVisibleShadowCasters(engine.getJobSystem(), shadowMapManager,
+                    renderableData, mScene->getInstanceGroupData(), mScene->getCullingHierarchy());
 
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
-
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
-            const float normalBias = lcm.getShadowNormalBias(directionalLight);
-            u.setUniform(offsetof(PerViewUib, shadowBias),
-                    float3{ 0, normalBias * texelSizeWorldSpace, 0 });
+            // allocates shadowmap driver resources and sets the shadow uniforms
+            shadowMapManager.prepare(driver, mPerViewUb, mPerViewSb);
         }
     }
 }
@@ -321,7 +317,22 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     const CameraInfo& camera = mViewingCameraInfo;
     FScene* const scene = mScene;
 
-    scene->prepareDynamicLights(camera, arena, mLightUbh);
+    // the lights texture grows by powers of two to fit the visible lights, it never shrinks
+    const size_t lightCount = std::min(CONFIG_MAX_LIGHT_COUNT,
+            scene->getLightData().size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
+    if (UTILS_UNLIKELY(lightCount > mLightsBuffer.getRowCount() * Froxelizer::LIGHTS_PER_ROW)) {
+        size_t height = mLightsBuffer.getRowCount();
+        while (height * Froxelizer::LIGHTS_PER_ROW < lightCount) {
+            height *= 2;
+        }
+        GPUBuffer lightsBuffer(driver, { GPUBuffer::ElementType::FLOAT, 4 },
+                Froxelizer::LIGHT_BUFFER_WIDTH, std::min(height, LIGHT_BUFFER_MAX_HEIGHT));
+        mLightsBuffer.swap(lightsBuffer);
+        lightsBuffer.terminate(driver);
+        mLightsBuffer.setSampler(PerViewSib::PUNCTUAL_LIGHTS, mPerViewSb);
+    }
+
+    scene->prepareDynamicLights(camera, arena, mLightsBuffer);
 
     // here the array of visible lights has been shrunk to CONFIG_MAX_LIGHT_COUNT
     auto const& lightData = scene->getLightData();
@@ -458,9 +469,10 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
             // world origin transform, use only for debugging
             .worldOrigin        = worldOriginCamera
     };
+    const mat4f cullingView{
+            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()) };
     mCullingFrustum = FCamera::getFrustum(
-            mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+            mCullingCamera->getCullingProjectionMatrix(), cullingView);
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
@@ -493,13 +505,26 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
 
         prepareVisibleRenderables(js, mCullingFrustum, renderableData);
 
+        /*
+         * Occlusion culling: rasterize the occluders and cull what they hide
+         * (this will clear the VISIBLE_RENDERABLE bit)
+         */
+
+        if (isOcclusionCullingEnabled()) {
+            const mat4f clipFromWorld{
+                    mat4f{ mCullingCamera->getCullingProjectionMatrix() } * cullingView };
+            cullOccludedRenderables(engine, js, clipFromWorld, renderableData);
+        }
+
 
         /*
-         * Shadowing: compute the shadow camera and cull shadow casters
-         * (this will set the VISIBLE_SHADOW_CASTER bit)
+         * Shadowing: compute the shadow cameras and cull shadow casters
+         * (this will set the VISIBLE_CASCADES and VISIBLE_SPOT_SHADOWS bits)
+         * Relies on prepareVisibleLights(), spot lights only cast shadows when visible.
          */
 
-        prepareShadowing(engine, driver, renderableData, scene->getLightData());
+        js.waitAndRelease(prepareVisibleLightsJob);
+        prepareShadowing(engine, driver, renderableData, scene->getLightData(), viewport);
 
         /*
          * partition the array of renderable w.r.t their visibility:
@@ -517,10 +542,12 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
                 renderableData.size());
 
         auto const beginRenderables = renderableData.begin();
-        auto beginCasters = partition(beginRenderables, renderableData.end(), VISIBLE_RENDERABLE);
-        auto beginCastersOnly = partition(beginCasters, renderableData.end(), VISIBLE_ALL);
+        auto beginCasters = partition(beginRenderables, renderableData.end(),
+                FScene::VISIBLE_RENDERABLE);
+        auto beginCastersOnly = partition(beginCasters, renderableData.end(),
+                FScene::VISIBLE_ALL);
         auto endCastersOnly = partition(beginCastersOnly, renderableData.end(),
-                VISIBLE_SHADOW_CASTER);
+                FScene::VISIBLE_SHADOW_CASTER);
 
         // convert to indices
         uint32_t iEnd = uint32_t(endCastersOnly - beginRenderables);
@@ -528,19 +555,8 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
         mVisibleShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
         merged = Range{ 0, iEnd };
 
-        // update those UBOs
-        const size_t size = merged.size() * sizeof(PerRenderableUib);
-        if (mRenderableUBOSize < size) {
-            // allocate 1/3 extra, with a minimum of 16 objects
-            const size_t count = std::max(size_t(16u), (4u * merged.size() + 2u) / 3u);
-            mRenderableUBOSize = uint32_t(count * sizeof(PerRenderableUib));
-            driver.destroyUniformBuffer(mRenderableUbh);
-            mRenderableUbh = driver.createUniformBuffer(mRenderableUBOSize,
-                    backend::BufferUsage::STREAM);
-        } else {
-            // TODO: should we shrink the underlying UBO at some point?
-        }
-        scene->updateUBOs(merged, mRenderableUbh);
+        // update the UBOs of the renderables that changed
+        scene->updateUBOs();
     }
 
     /*
@@ -549,7 +565,6 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
      * Relies on FScene::prepare() and prepareVisibleLights()
      */
 
-    js.waitAndRelease(prepareVisibleLightsJob);
     prepareLighting(engine, driver, arena, viewport);
 
     /*
@@ -577,14 +592,20 @@ void FView::computeVisibilityMasks(
     // important here, otherwise, this loop doesn't get vectorized.
     // This is vectorized 16x.
     count = (count + 0xF) & ~0xF; // capacity guaranteed to be multiple of 16
+    constexpr Culler::result_type SHADOW_MAPS = FScene::VISIBLE_CASCADES | FScene::VISIBLE_SPOT_SHADOWS;
     for (size_t i = 0; i < count; ++i) {
         Culler::result_type mask = visibleMask[i];
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
-        bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
-        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
+        bool visRenderables   = (!v.culling || (mask & FScene::VISIBLE_RENDERABLE))
+                && inVisibleLayer;
+        bool visShadowCasters = (!v.culling || (mask & SHADOW_MAPS))
+                && inVisibleLayer && v.castShadows;
+        // the shadow maps bits are kept, they select the shadow casters of each shadow map
+        Culler::result_type shadowMaps = v.culling ? mask : SHADOW_MAPS;
         visibleMask[i] = Culler::result_type(visRenderables) |
-                         Culler::result_type(visShadowCasters << 1);
+                         Culler::result_type(visShadowCasters << 1) |
+                         Culler::result_type(visShadowCasters ? shadowMaps & SHADOW_MAPS : 0);
     }
 }
 
@@ -594,7 +615,8 @@ UTILS_NOINLINE
         FScene::RenderableSoa::iterator end,
         uint8_t mask) noexcept {
     return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
+        // the cascades bits are ignored
+        return (it.template get<FScene::VISIBLE_MASK>() & FScene::VISIBLE_ALL) == mask;
     });
 }
 
@@ -647,7 +669,11 @@ void FView::commitUniforms(backend::DriverApi& driver) const noexcept {
 
 void FView::commitFroxels(backend::DriverApi& driverApi) const noexcept {
     if (mHasDynamicLighting) {
-        mFroxelizer.commit(driverApi);
+        if (UTILS_UNLIKELY(mFroxelizer.commit(driverApi))) {
+            // the record buffer was reallocated
+            mFroxelizer.getRecordBuffer().setSampler(PerViewSib::RECORDS, mPerViewSb);
+            driverApi.updateSamplerGroup(mPerViewSbh, std::move(mPerViewSb.toCommandStream()));
+        }
     }
 }
 
@@ -655,36 +681,151 @@ UTILS_NOINLINE
 void FView::prepareVisibleRenderables(JobSystem& js,
         Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
+    // the instance groups of renderables with culling disabled are always visible
+    FScene::InstanceGroupSoa& instanceGroupData = mScene->getInstanceGroupData();
+    std::copy(instanceGroupData.begin<FScene::GROUP_CULLING_MASK>(),
+            instanceGroupData.end<FScene::GROUP_CULLING_MASK>(),
+            instanceGroupData.begin<FScene::GROUP_VISIBLE_MASK>());
+
     if (UTILS_LIKELY(isFrustumCullingEnabled())) {
-        FView::cullRenderables(js, renderableData, frustum, VISIBLE_RENDERABLE_BIT);
+        FView::cullRenderables(js, renderableData, mScene->getCullingHierarchy(),
+                frustum, FScene::VISIBLE_RENDERABLE_BIT);
+        FView::cullInstanceGroups(instanceGroupData, frustum, FScene::VISIBLE_RENDERABLE_BIT);
     } else {
         std::uninitialized_fill(renderableData.begin<FScene::VISIBLE_MASK>(),
-                  renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
+                  renderableData.end<FScene::VISIBLE_MASK>(), FScene::VISIBLE_RENDERABLE);
+        for (Culler::result_type& mask : instanceGroupData.slice<FScene::GROUP_VISIBLE_MASK>()) {
+            mask |= FScene::VISIBLE_RENDERABLE;
+        }
+    }
+}
+
+void FView::cullOccludedRenderables(FEngine& engine, JobSystem& js,
+        mat4f const& clipFromWorld, FScene::RenderableSoa& renderableData) noexcept {
+    SYSTRACE_CALL();
+
+    uint8_t const* const layers = renderableData.data<FScene::LAYERS>();
+    auto const* const visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t* const visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+    const uint8_t visibleLayers = getVisibleLayers();
+
+    // only the renderables that survived frustum culling are considered
+    std::vector<uint32_t>& occluders = mOccluders;
+    std::vector<uint32_t>& occludees = mOccludees;
+    occluders.clear();
+    occludees.clear();
+    for (uint32_t i = 0, c = uint32_t(renderableData.size()); i < c; i++) {
+        if ((visibleMask[i] & FScene::VISIBLE_RENDERABLE) && (layers[i] & visibleLayers)) {
+            if (visibility[i].occluder) {
+                occluders.push_back(i);
+            }
+            if (visibility[i].culling) {
+                occludees.push_back(i);
+            }
+        }
     }
+
+    float3 const* const worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* const worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+
+    size_t culled = 0;
+    OcclusionCuller& occlusionCuller = mOcclusionCuller;
+    if (!occluders.empty()) {
+        occlusionCuller.rasterize(js, clipFromWorld, worldAABBCenter, worldAABBExtent,
+                occluders.data(), occluders.size());
+        culled = occlusionCuller.cull(js, worldAABBCenter, worldAABBExtent,
+                occludees.data(), occludees.size(), visibleMask, FScene::VISIBLE_RENDERABLE_BIT);
+    }
+
+    engine.debug.view.occluders = int(occluders.empty() ?
+            0 : occlusionCuller.getRasterizedOccluderCount());
+    engine.debug.view.occlusion_culled = int(culled);
 }
 
 UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
-        Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept {
+        ShadowMapManager const& shadowMapManager, FScene::RenderableSoa& renderableData,
+        FScene::InstanceGroupSoa& instanceGroupData, CullingHierarchy* hierarchy) noexcept {
     SYSTRACE_CALL();
-    FView::cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+
+    // gather the light frustum of each shadow map with visible shadows, all the spot lights
+    // share the same bit, their casters are selected again when generating their commands.
+    Frustum frusta[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    uint8_t bits[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    size_t count = 0;
+    for (size_t i = 0, c = shadowMapManager.getCascadeCount(); i < c; i++) {
+        ShadowMap const& shadowMap = shadowMapManager.getCascade(i);
+        if (shadowMap.hasVisibleShadows()) {
+            frusta[count] = shadowMap.getCamera().getFrustum();
+            bits[count] = uint8_t(FScene::VISIBLE_CASCADE_BIT + i);
+            count++;
+        }
+    }
+    for (size_t i = 0, c = shadowMapManager.getSpotShadowCount(); i < c; i++) {
+        ShadowMap const& shadowMap = shadowMapManager.getSpotShadow(i);
+        if (shadowMap.hasVisibleShadows()) {
+            frusta[count] = shadowMap.getCamera().getFrustum();
+            bits[count] = uint8_t(FScene::VISIBLE_SPOT_SHADOWS_BIT);
+            count++;
+        }
+    }
+
+    FView::cullRenderables(js, renderableData, hierarchy, frusta, bits, count);
+    for (size_t i = 0; i < count; i++) {
+        FView::cullInstanceGroups(instanceGroupData, frusta[i], bits[i]);
+    }
+}
+
+void FView::cullInstanceGroups(FScene::InstanceGroupSoa& instanceGroupData,
+        Frustum const& frustum, size_t bit) noexcept {
+    // there are typically few groups, so this doesn't need to run on multiple threads
+    Culler::intersects(
+            instanceGroupData.data<FScene::GROUP_VISIBLE_MASK>(),
+            frustum,
+            instanceGroupData.data<FScene::GROUP_WORLD_AABB_CENTER>(),
+            instanceGroupData.data<FScene::GROUP_WORLD_AABB_EXTENT>(),
+            instanceGroupData.size(), bit);
 }
 
 void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+        FScene::RenderableSoa& renderableData, CullingHierarchy* hierarchy,
+        Frustum const& frustum, size_t bit) noexcept {
+    const uint8_t b = uint8_t(bit);
+    FView::cullRenderables(js, renderableData, hierarchy, &frustum, &b, 1);
+}
+
+void FView::cullRenderables(JobSystem& js,
+        FScene::RenderableSoa& renderableData, CullingHierarchy* hierarchy,
+        Frustum const* frusta, uint8_t const* bits, size_t count) noexcept {
+    if (!count) {
+        return;
+    }
 
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
     uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
 
-    // culling job (this runs on multiple threads)
-    auto functor = [&frustum, worldAABBCenter, worldAABBExtent, visibleArray, bit]
+    if (hierarchy) {
+        // only the renderables in leaves intersecting the frustum are tested, each frustum
+        // is culled on multiple threads
+        for (size_t i = 0; i < count; i++) {
+            hierarchy->cull(js, frusta[i], worldAABBCenter, worldAABBExtent, visibleArray,
+                    renderableData.size(), bits[i]);
+        }
+        return;
+    }
+
+    // culling job (this runs on multiple threads), each job tests its range of renderables
+    // against all the frusta, so that the jobs never write to the same visibility masks.
+    auto functor = [frusta, bits, count, worldAABBCenter, worldAABBExtent, visibleArray]
             (uint32_t index, uint32_t c) {
-        Culler::intersects(
-                visibleArray + index,
-                frustum,
-                worldAABBCenter + index,
-                worldAABBExtent + index, c, bit);
+        for (size_t i = 0; i < count; i++) {
+            Culler::intersects(
+                    visibleArray + index,
+                    frusta[i],
+                    worldAABBCenter + index,
+                    worldAABBExtent + index, c, bits[i]);
+        }
     };
 
     // launch the computation on multiple threads
@@ -750,13 +891,50 @@ void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
     lightData.resize(visibleLightCount);
 }
 
-void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
+void FView::computeScreenCoverage(float* UTILS_RESTRICT coverage,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        float3 const& eye, float4 const& wFromWorld, float scale, size_t count) noexcept {
+    // this loop gets vectorized
+    for (size_t i = 0; i < count; i++) {
+        const float r = length(extent[i]);
+        const float w = dot(wFromWorld.xyz, center[i]) + wFromWorld.w;
+        const float3 d = center[i] - eye;
+        // When the camera is inside the bounding sphere, we use the most detailed level.
+        // Otherwise w <= 0 means the center is behind the camera. This happens for the shadow
+        // casters, which are only visible from the light, and we use the least detailed level.
+        const bool inside = dot(d, d) < r * r;
+        coverage[i] = inside ? std::numeric_limits<float>::infinity() :
+                w > 0 ? (r * scale) / w : 0.0f;
+    }
+}
+
+void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo& camera,
         FScene::RenderableSoa& renderableData, Range visible) noexcept {
+    SYSTRACE_CALL();
+
     FRenderableManager const& rcm = engine.getRenderableManager();
+    auto const* UTILS_RESTRICT instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto* UTILS_RESTRICT primitives = renderableData.data<FScene::PRIMITIVES>();
+
+    // The screen coverage is the projected diameter of the renderable's bounding sphere, as a
+    // fraction of the viewport's height: 2r / (w * 2 / projection[1][1]).
+    // Each unit of LOD bias halves it.
+    const mat4f clipFromWorld{ camera.projection * camera.view };
+    const float4 wFromWorld{ clipFromWorld[0].w, clipFromWorld[1].w,
+                             clipFromWorld[2].w, clipFromWorld[3].w };
+    const float scale = camera.projection[1][1] * std::exp2(-mLodBias);
+
+    std::vector<float>& coverage = mScreenCoverage;
+    coverage.resize(visible.size());
+    computeScreenCoverage(coverage.data(),
+            renderableData.data<FScene::WORLD_AABB_CENTER>() + visible.first,
+            renderableData.data<FScene::WORLD_AABB_EXTENT>() + visible.first,
+            camera.getPosition(), wFromWorld, scale, visible.size());
+
     for (uint32_t index : visible) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
-        auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
-        renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
+        auto ri = instances[index];
+        uint8_t level = rcm.getLevelOfDetail(ri, coverage[index - visible.first]);
+        primitives[index] = rcm.getRenderPrimitives(ri, level);
     }
 }
 
@@ -815,6 +993,22 @@ bool View::isFrustumCullingEnabled() const noexcept {
     return upcast(this)->isFrustumCullingEnabled();
 }
 
+void View::setOcclusionCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setOcclusionCullingEnabled(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::setLodBias(float bias) noexcept {
+    upcast(this)->setLodBias(bias);
+}
+
+float View::getLodBias() const noexcept {
+    return upcast(this)->getLodBias();
+}
+
 void View::setDebugCamera(Camera* camera) noexcept {
     upcast(this)->setViewingCamera(upcast(camera));
 }
@@ -839,6 +1033,14 @@ void View::setShadowsEnabled(bool enabled) noexcept {
     upcast(this)->setShadowsEnabled(enabled);
 }
 
+void View::setShadowAtlasOptions(ShadowAtlasOptions const& options) noexcept {
+    upcast(this)->setShadowAtlasOptions(options);
+}
+
+View::ShadowAtlasOptions View::getShadowAtlasOptions() const noexcept {
+    return upcast(this)->getShadowAtlasOptions();
+}
+
 void View::setRenderTarget(TargetBufferFlags discard) noexcept {
     upcast(this)->setRenderTarget(discard);
 }
@@ -20,10 +20,17 @@
 
 #include "details/Engine.h"
 
+#include <private/filament/EngineEnums.h>
+
 #include <math/fast.h>
 #include <math/scalar.h>
 #include <filament/LightManager.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
 
 using namespace filament::math;
 using namespace utils;
@@ -157,6 +164,7 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
     }
     Instance i = manager.addComponent(entity);
     assert(i);
+    mLayoutVersion++;
 
     if (i) {
         // This needs to happen before we call the set() methods below
@@ -173,6 +181,11 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         shadowParams.options.shadowFar      = std::max(builder->mShadowOptions.shadowFar, 0.0f);
         shadowParams.options.shadowNearHint = std::max(builder->mShadowOptions.shadowNearHint, 0.0f);
         shadowParams.options.shadowFarHint  = std::max(builder->mShadowOptions.shadowFarHint, 0.0f);
+        shadowParams.options.shadowCascades = clamp<uint8_t>(builder->mShadowOptions.shadowCascades,
+                1, CONFIG_MAX_SHADOW_CASCADES);
+        std::copy(std::begin(builder->mShadowOptions.cascadeSplitPositions),
+                std::end(builder->mShadowOptions.cascadeSplitPositions),
+                shadowParams.options.cascadeSplitPositions);
 
         // set default values by calling the setters
         setLocalPosition(i, builder->mPosition);
@@ -198,6 +211,7 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        mLayoutVersion++;
     }
 }
 
@@ -219,12 +233,14 @@ void FLightManager::setLocalPosition(Instance i, const float3& position) noexcep
     assert(i);
     auto& manager = mManager;
     manager[i].position = position;
+    markDirty(i);
 }
 
 void FLightManager::setLocalDirection(Instance i, float3 direction) noexcept {
     assert(i);
     auto& manager = mManager;
     manager[i].direction = direction;
+    markDirty(i);
 }
 
 void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
@@ -268,6 +284,7 @@ void FLightManager::setIntensity(Instance i, float intensity) noexcept {
                 break;
         }
         manager[i].intensity = luminousIntensity;
+        markDirty(i);
     }
 }
 
@@ -278,6 +295,7 @@ void FLightManager::setFalloff(Instance i, float falloff) noexcept {
         SpotParams& spotParams = manager[i].spotParams;
         manager[i].squaredFallOffInv = sqFalloff ? (1 / sqFalloff) : 0;
         spotParams.radius = falloff;
+        markDirty(i);
     }
 }
 
@@ -310,6 +328,7 @@ void FLightManager::setSpotLightCone(Instance i, float inner, float outer) noexc
             float luminousIntensity = luminousPower / (2.0f * float(M_PI) * (1.0f - cosHalfOuter));
             manager[i].intensity = luminousIntensity;
         }
+        markDirty(i);
     }
 }
 
@@ -437,4 +456,40 @@ void LightManager::setShadowOptions(Instance i, ShadowOptions const& options) no
     upcast(this)->setShadowOptions(i, options);
 }
 
+// ------------------------------------------------------------------------------------------------
+
+void LightManager::ShadowCascades::computeUniformSplits(float* splitPositions, uint8_t cascades) {
+    size_t s = 0;
+    cascades = clamp<uint8_t>(cascades, 1, CONFIG_MAX_SHADOW_CASCADES);
+    for (size_t c = 1; c < cascades; c++) {
+        splitPositions[s++] = float(c) / cascades;
+    }
+}
+
+void LightManager::ShadowCascades::computeLogSplits(float* splitPositions, uint8_t cascades,
+        float near, float far) {
+    size_t s = 0;
+    cascades = clamp<uint8_t>(cascades, 1, CONFIG_MAX_SHADOW_CASCADES);
+    // the logarithmic split is undefined for a near plane at 0
+    near = std::max(near, std::numeric_limits<float>::epsilon());
+    for (size_t c = 1; c < cascades; c++) {
+        splitPositions[s++] =
+                (near * std::pow(far / near, float(c) / cascades) - near) / (far - near);
+    }
+}
+
+void LightManager::ShadowCascades::computePracticalSplits(float* splitPositions, uint8_t cascades,
+        float near, float far, float lambda) {
+    float uniformSplits[CONFIG_MAX_SHADOW_CASCADES];
+    float logSplits[CONFIG_MAX_SHADOW_CASCADES];
+    cascades = clamp<uint8_t>(cascades, 1, CONFIG_MAX_SHADOW_CASCADES);
+    computeUniformSplits(uniformSplits, cascades);
+    computeLogSplits(logSplits, cascades, near, far);
+    size_t s = 0;
+    for (size_t c = 1; c < cascades; c++) {
+        splitPositions[s] = lambda * logSplits[s] + (1.0f - lambda) * uniformSplits[s];
+        s++;
+    }
+}
+
 } // namespace filament
@@ -60,7 +60,11 @@ public:
     void prepare(backend::DriverApi& driver) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        const size_t count = mManager.getComponentCount();
         mManager.gc(em);
+        if (count != mManager.getComponentCount()) {
+            mLayoutVersion++;
+        }
     }
 
     struct LightType {
@@ -205,9 +209,26 @@ public:
         static_cast<ShadowParams&>(mManager[i].shadowParams).options = options;
     }
 
+    /*
+     * Change tracking, used by FScene::prepare() to only update what changed
+     */
+
+    // incremented each time the position, direction, intensity or falloff of a light changes
+    uint32_t getVersion() const noexcept { return mVersion; }
+
+    // value of getVersion() when this instance last changed
+    uint32_t getVersion(Instance i) const noexcept { return mManager[i].version; }
+
+    // incremented each time instances are created or destroyed
+    uint32_t getLayoutVersion() const noexcept { return mLayoutVersion; }
+
 private:
     friend class FScene;
 
+    void markDirty(Instance i) noexcept {
+        mManager[i].version = ++mVersion;
+    }
+
     enum {
         LIGHT_TYPE,         // light type
         POSITION,           // position in local-space (i.e. pre-transform)
@@ -220,9 +241,10 @@ private:
         SUN_HALO_FALLOFF,   // state for the directional light sun
         INTENSITY,
         FALLOFF,
+        VERSION,            // version of the last change
     };
 
-    using Base = utils::SingleInstanceComponentManager<  // 120 bytes
+    using Base = utils::SingleInstanceComponentManager<  // 124 bytes
             LightType,      //  1
             math::float3,   // 12
             math::float3,   // 12
@@ -233,7 +255,8 @@ private:
             float,          //  4
             float,          //  4
             float,          //  4
-            float           //  4
+            float,          //  4
+            uint32_t        //  4
     >;
 
     struct Sim : public Base {
@@ -259,6 +282,7 @@ private:
                 Field<SUN_HALO_FALLOFF>     sunHaloFalloff;
                 Field<INTENSITY>            intensity;
                 Field<FALLOFF>              squaredFallOffInv;
+                Field<VERSION>              version;
             };
         };
 
@@ -272,6 +296,8 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint32_t mVersion = 0;
+    uint32_t mLayoutVersion = 0;
 };
 
 FILAMENT_UPCAST(LightManager)
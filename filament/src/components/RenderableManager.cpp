@@ -39,21 +39,40 @@ using namespace details;
 struct RenderableManager::BuilderDetails {
     using Entry = RenderableManager::Builder::Entry;
     std::vector<Entry> mEntries;
+    std::vector<std::vector<Entry>> mLods;  // levels of detail 1 and up
+    float mLodScreenCoverage[MAX_LOD_COUNT - 1] = {};
+    uint8_t mLodCount = 1;
     Box mAABB;
     uint8_t mLayerMask = 0x1;
     uint8_t mPriority = 0x4;
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
+    bool mOccluder : 1;
     size_t mSkinningBoneCount = 0;
     Bone const* mUserBones = nullptr;
     mat4f const* mUserBoneMatrices = nullptr;
+    size_t mInstanceCount = 1;
+    mat4f const* mUserInstanceTransforms = nullptr;
+    bool mInstanced = false;
 
     explicit BuilderDetails(size_t count)
-            : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mOccluder(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
+
+    Entry* getLodEntry(uint8_t level, size_t index) noexcept {
+        if (level >= MAX_LOD_COUNT || index >= mEntries.size()) {
+            return nullptr;
+        }
+        if (mLods.size() < level) {
+            mLods.resize(level);
+        }
+        mLods[level - 1].resize(mEntries.size());
+        return &mLods[level - 1][index];
+    }
 };
 
 using BuilderType = RenderableManager;
@@ -103,6 +122,46 @@ RenderableManager::Builder& RenderableManager::Builder::material(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::geometry(uint8_t level, size_t index,
+        PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
+        size_t offset, size_t count) noexcept {
+    if (level == 0) {
+        return geometry(index, type, vertices, indices, offset, count);
+    }
+    Entry* entry = mImpl->getLodEntry(level, index);
+    if (entry) {
+        entry->vertices = vertices;
+        entry->indices = indices;
+        entry->offset = offset;
+        entry->minIndex = 0;
+        entry->maxIndex = vertices->getVertexCount() - 1;
+        entry->count = count;
+        entry->type = type;
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::material(uint8_t level, size_t index,
+        MaterialInstance const* materialInstance) noexcept {
+    if (level == 0) {
+        return material(index, materialInstance);
+    }
+    Entry* entry = mImpl->getLodEntry(level, index);
+    if (entry) {
+        entry->materialInstance = materialInstance;
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetail(
+        uint8_t level, float screenCoverage) noexcept {
+    if (level > 0 && level < MAX_LOD_COUNT) {
+        mImpl->mLodScreenCoverage[level - 1] = screenCoverage;
+        mImpl->mLodCount = std::max(mImpl->mLodCount, uint8_t(level + 1));
+    }
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::boundingBox(const Box& axisAlignedBoundingBox) noexcept {
     mImpl->mAABB = axisAlignedBoundingBox;
     return *this;
@@ -123,6 +182,11 @@ RenderableManager::Builder& RenderableManager::Builder::culling(bool enable) noe
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::occluder(bool enable) noexcept {
+    mImpl->mOccluder = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::castShadows(bool enable) noexcept {
     mImpl->mCastShadows = enable;
     return *this;
@@ -152,6 +216,20 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::instances(size_t instanceCount) noexcept {
+    mImpl->mInstanceCount = instanceCount;
+    mImpl->mInstanced = true;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::instances(
+        size_t instanceCount, mat4f const* transforms) noexcept {
+    mImpl->mInstanceCount = instanceCount;
+    mImpl->mUserInstanceTransforms = transforms;
+    mImpl->mInstanced = true;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntries.size()) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -167,6 +245,13 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
         return Error;
     }
 
+    if (!ASSERT_PRECONDITION_NON_FATAL(
+            mImpl->mInstanceCount >= 1 && mImpl->mInstanceCount <= MAX_INSTANCE_COUNT,
+            "instance count (%u) must be between 1 and %u",
+            mImpl->mInstanceCount, MAX_INSTANCE_COUNT)) {
+        return Error;
+    }
+
     for (size_t i = 0, c = mImpl->mEntries.size(); i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
@@ -218,6 +303,40 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
         isEmpty = false;
     }
 
+    // geometry given for levels that were not enabled with levelOfDetail() is ignored
+    std::vector<std::vector<Entry>>& lods = mImpl->mLods;
+    lods.resize(mImpl->mLodCount - 1u);
+    for (size_t l = 0, c = lods.size(); l < c; l++) {
+        float const* coverage = mImpl->mLodScreenCoverage;
+        if (!ASSERT_PRECONDITION_NON_FATAL(l == 0 || coverage[l] < coverage[l - 1],
+                "[entity=%u] screen coverage of level %u (%f) >= level %u (%f)",
+                entity.getId(), l + 1, coverage[l], l, coverage[l - 1])) {
+            return Error;
+        }
+
+        lods[l].resize(mImpl->mEntries.size());
+        for (size_t i = 0, n = lods[l].size(); i < n; i++) {
+            auto& entry = lods[l][i];
+
+            // by default, a level of detail uses the materials of level 0
+            if (!entry.materialInstance) {
+                entry.materialInstance = mImpl->mEntries[i].materialInstance;
+            }
+
+            if (!entry.indices || !entry.vertices) {
+                continue;
+            }
+
+            if (!ASSERT_PRECONDITION_NON_FATAL(entry.offset + entry.count <= entry.indices->getIndexCount(),
+                    "[entity=%u, level %u, primitive @ %u] offset (%u) + count (%u) > indexCount (%u)",
+                    entity.getId(), l + 1, i,
+                    entry.offset, entry.count, entry.indices->getIndexCount())) {
+                entry.vertices = nullptr;
+                return Error;
+            }
+        }
+    }
+
     if (!ASSERT_POSTCONDITION_NON_FATAL(
             !mImpl->mAABB.isEmpty() ||
             (!mImpl->mCulling && (!(mImpl->mReceiveShadows || mImpl->mCastShadows)) ||
@@ -258,6 +377,7 @@ void FRenderableManager::create(
     }
     Instance ci = manager.addComponent(entity);
     assert(ci);
+    mLayoutVersion++;
 
     if (ci) {
         // create and initialize all needed RenderPrimitives
@@ -265,16 +385,47 @@ void FRenderableManager::create(
         Builder::Entry const * const entries = builder->mEntries.data();
         FRenderPrimitive* rp = new FRenderPrimitive[builder->mEntries.size()];
         for (size_t i = 0, c = builder->mEntries.size(); i < c; ++i) {
-            rp[i].init(driver, entries[i]);
+            rp[i].init(engine, entries[i]);
         }
         setPrimitives(ci, { rp, size_type(builder->mEntries.size()) });
 
+        // and the ones of the other levels of detail, if any
+        if (UTILS_UNLIKELY(builder->mLodCount > 1)) {
+            std::unique_ptr<LevelsOfDetail>& lods = manager[ci].lods;
+            lods = std::unique_ptr<LevelsOfDetail>(new LevelsOfDetail{});
+            lods->count = builder->mLodCount;
+            for (size_t l = 0, c = builder->mLods.size(); l < c; l++) {
+                std::vector<Builder::Entry> const& levelEntries = builder->mLods[l];
+                FRenderPrimitive* lrp = new FRenderPrimitive[levelEntries.size()];
+                for (size_t i = 0, n = levelEntries.size(); i < n; ++i) {
+                    lrp[i].init(engine, levelEntries[i]);
+                }
+                lods->primitives[l] = { lrp, size_type(levelEntries.size()) };
+                lods->screenCoverage[l] = builder->mLodScreenCoverage[l];
+            }
+        }
+
+        if (UTILS_UNLIKELY(builder->mInstanced)) {
+            // this must be set before the bounding box, which depends on the instances
+            const size_t count = builder->mInstanceCount;
+            std::unique_ptr<Instances>& instances = manager[ci].instances;
+            instances = std::unique_ptr<Instances>(new Instances{});
+            instances->groups.resize((count + CONFIG_MAX_INSTANCES - 1) / CONFIG_MAX_INSTANCES);
+            if (builder->mUserInstanceTransforms) {
+                instances->transforms.assign(builder->mUserInstanceTransforms,
+                        builder->mUserInstanceTransforms + count);
+            } else {
+                instances->transforms.resize(count);
+            }
+        }
+
         setAxisAlignedBoundingBox(ci, builder->mAABB);
         setLayerMask(ci, builder->mLayerMask);
         setPriority(ci, builder->mPriority);
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
         setCulling(ci, builder->mCulling);
+        setOccluder(ci, builder->mOccluder);
         setSkinning(ci, false);
 
         const size_t count = builder->mSkinningBoneCount;
@@ -321,6 +472,7 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mLayoutVersion++;
     }
 }
 
@@ -350,6 +502,13 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
 
+    std::unique_ptr<LevelsOfDetail> const& lods = manager[ci].lods;
+    if (lods) {
+        for (size_t l = 0; l < lods->count - 1u; l++) {
+            destroyComponentPrimitives(engine, lods->primitives[l]);
+        }
+    }
+
     // destroy the bones structures if any
     std::unique_ptr<Bones> const& bones = manager[ci].bones;
     if (bones) {
@@ -495,6 +654,47 @@ void FRenderableManager::setBones(Instance ci,
     }
 }
 
+void FRenderableManager::setInstanceTransforms(Instance ci,
+        mat4f const* transforms, size_t count, size_t offset) noexcept {
+    if (ci) {
+        std::unique_ptr<Instances> const& instances = mManager[ci].instances;
+        assert(instances && offset + count <= instances->transforms.size());
+        if (instances && offset < instances->transforms.size()) {
+            count = std::min(count, instances->transforms.size() - offset);
+            std::copy_n(transforms, count, instances->transforms.begin() + offset);
+            updateInstanceBounds(ci, offset, offset + count);
+            markDirty(ci);
+        }
+    }
+}
+
+void FRenderableManager::updateInstanceBounds(Instance ci,
+        size_t first, size_t last) noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[ci].instances;
+    mat4f const* const transforms = instances->transforms.data();
+    Box const& bounds = instances->bounds;
+    const size_t count = instances->transforms.size();
+
+    // recompute the bounds of the groups containing the instances that changed...
+    for (size_t g = first / CONFIG_MAX_INSTANCES,
+            e = (last + CONFIG_MAX_INSTANCES - 1) / CONFIG_MAX_INSTANCES; g < e; g++) {
+        const size_t begin = g * CONFIG_MAX_INSTANCES;
+        const size_t end = std::min(count, begin + CONFIG_MAX_INSTANCES);
+        Box box = rigidTransform(bounds, transforms[begin]);
+        for (size_t i = begin + 1; i < end; i++) {
+            box.unionSelf(rigidTransform(bounds, transforms[i]));
+        }
+        instances->groups[g] = box;
+    }
+
+    // ...and the bounds of all the instances, which is what the renderable is culled with
+    Box aabb = instances->groups[0];
+    for (size_t g = 1, c = instances->groups.size(); g < c; g++) {
+        aabb.unionSelf(instances->groups[g]);
+    }
+    mManager[ci].aabb = aabb;
+}
+
 void FRenderableManager::makeBone(PerRenderableUibBone* UTILS_RESTRICT out, mat4f const& t) noexcept {
     mat4f m(t);
 
@@ -578,7 +778,11 @@ size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
 
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    FRenderableManager* rcm = upcast(this);
+    for (size_t level = 0, c = instance ? rcm->getLevelCount(instance) : 0; level < c; level++) {
+        rcm->setMaterialInstanceAt(instance, uint8_t(level), primitiveIndex,
+                upcast(materialInstance));
+    }
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
@@ -587,7 +791,10 @@ MaterialInstance* RenderableManager::getMaterialInstanceAt(
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    FRenderableManager* rcm = upcast(this);
+    for (size_t level = 0, c = instance ? rcm->getLevelCount(instance) : 0; level < c; level++) {
+        rcm->setBlendOrderAt(instance, uint8_t(level), primitiveIndex, order);
+    }
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
@@ -616,4 +823,13 @@ void RenderableManager::setBones(Instance instance,
     upcast(this)->setBones(instance, transforms, boneCount, offset);
 }
 
+void RenderableManager::setInstanceTransforms(Instance instance,
+        mat4f const* transforms, size_t count, size_t offset) noexcept {
+    upcast(this)->setInstanceTransforms(instance, transforms, count, offset);
+}
+
+size_t RenderableManager::getInstanceCount(Instance instance) const noexcept {
+    return upcast(this)->getInstanceCount(instance);
+}
+
 } // namespace filament
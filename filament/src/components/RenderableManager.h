@@ -35,6 +35,8 @@
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <vector>
+
 // for gtest
 class FilamentTest_Bones_Test;
 
@@ -54,6 +56,7 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool occluder       : 1;
     };
 
     explicit FRenderableManager(FEngine& engine) noexcept;
@@ -74,6 +77,10 @@ public:
         return mManager.getInstance(e);
     }
 
+    utils::Entity getEntity(Instance i) const noexcept {
+        return mManager.getEntity(i);
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
@@ -85,7 +92,11 @@ public:
             utils::Range<uint32_t> list) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        const size_t count = mManager.getComponentCount();
         mManager.gc(em);
+        if (count != mManager.getComponentCount()) {
+            mLayoutVersion++;
+        }
     }
 
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
@@ -100,26 +111,57 @@ public:
     inline void setLayerMask(Instance instance, uint8_t layerMask) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
+    inline void setOccluder(Instance instance, bool enable) noexcept;
     inline void setSkinning(Instance instance, bool enable) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
+    void setInstanceTransforms(Instance instance, math::mat4f const* transforms, size_t count, size_t offset = 0) noexcept;
 
 
     inline bool isShadowCaster(Instance instance) const noexcept;
     inline bool isShadowReceiver(Instance instance) const noexcept;
     inline bool isCullingEnabled(Instance instance) const noexcept;
+    inline bool isOccluder(Instance instance) const noexcept;
 
+    // bounds of the renderable, i.e. of all its instances if it's instanced
     inline Box const& getAABB(Instance instance) const noexcept;
-    inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept { return getAABB(instance); }
+    inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept;
     inline Visibility getVisibility(Instance instance) const noexcept;
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
 
     inline backend::Handle<backend::HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
 
+    inline size_t getInstanceCount(Instance instance) const noexcept;
+
+    // local transforms of the instances, null if the renderable isn't instanced
+    inline math::mat4f const* getInstanceTransforms(Instance instance) const noexcept;
+
+    // local bounds of each group of CONFIG_MAX_INSTANCES instances, null if the renderable
+    // isn't instanced
+    inline Box const* getInstanceGroupBounds(Instance instance) const noexcept;
+
+    /*
+     * Change tracking, used by FScene::prepare() to only update what changed
+     */
+
+    // incremented each time the AABB, layers or visibility of an instance changes
+    uint32_t getVersion() const noexcept { return mVersion; }
+
+    // value of getVersion() when this instance last changed
+    uint32_t getVersion(Instance instance) const noexcept { return mManager[instance].version; }
+
+    // incremented each time instances are created or destroyed
+    uint32_t getLayoutVersion() const noexcept { return mLayoutVersion; }
+
+
+    inline size_t getLevelCount(Instance instance) const noexcept;
+
+    // Returns the level of detail to use for a given screen coverage of the instance's
+    // bounding sphere (as a fraction of the viewport's height).
+    inline uint8_t getLevelOfDetail(Instance instance, float screenCoverage) const noexcept;
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
     inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
     void setMaterialInstanceAt(Instance instance, uint8_t level,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
@@ -145,16 +187,39 @@ private:
         size_t count;
     };
 
+    // levels of detail other than 0, which is stored in PRIMITIVES
+    struct LevelsOfDetail {
+        utils::Slice<FRenderPrimitive> primitives[MAX_LOD_COUNT - 1];
+        float screenCoverage[MAX_LOD_COUNT - 1];
+        uint8_t count;      // number of levels, including level 0
+    };
+
+    struct Instances {
+        std::vector<math::mat4f> transforms;    // relative to the renderable's transform
+        std::vector<Box> groups;                // bounds of each group of instances
+        Box bounds;                             // bounds of a single instance
+    };
+
     friend class ::FilamentTest_Bones_Test;
 
     static void makeBone(PerRenderableUibBone* out, math::mat4f const& transforms) noexcept;
 
+    // updates the bounds of the instances in [first, last), and the renderable's AABB
+    void updateInstanceBounds(Instance instance, size_t first, size_t last) noexcept;
+
+    void markDirty(Instance instance) noexcept {
+        mManager[instance].version = ++mVersion;
+    }
+
     enum {
         AABB,               // user data
         LAYERS,             // user data
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
         BONES,              // filament data, UBO storing a pointer to the bones information
+        VERSION,            // filament data, version of the last change
+        LODS,               // user data, null unless the renderable has levels of detail
+        INSTANCES,          // user data, null unless the renderable is instanced
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -162,7 +227,10 @@ private:
             uint8_t,
             Visibility,
             utils::Slice<FRenderPrimitive>,
-            std::unique_ptr<Bones>
+            std::unique_ptr<Bones>,
+            uint32_t,
+            std::unique_ptr<LevelsOfDetail>,
+            std::unique_ptr<Instances>
     >;
 
     struct Sim : public Base {
@@ -182,6 +250,9 @@ private:
                 Field<VISIBILITY>   visibility;
                 Field<PRIMITIVES>   primitives;
                 Field<BONES>        bones;
+                Field<VERSION>      version;
+                Field<LODS>         lods;
+                Field<INSTANCES>    instances;
             };
         };
 
@@ -195,13 +266,22 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint32_t mVersion = 0;
+    uint32_t mLayoutVersion = 0;
 };
 
 FILAMENT_UPCAST(RenderableManager)
 
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
-        mManager[instance].aabb = aabb;
+        std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+        if (UTILS_UNLIKELY(instances)) {
+            instances->bounds = aabb;
+            updateInstanceBounds(instance, 0, instances->transforms.size());
+        } else {
+            mManager[instance].aabb = aabb;
+        }
+        markDirty(instance);
     }
 }
 
@@ -210,12 +290,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        markDirty(instance);
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        markDirty(instance);
     }
 }
 
@@ -223,6 +305,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        markDirty(instance);
     }
 }
 
@@ -230,6 +313,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -237,6 +321,7 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -244,6 +329,15 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        markDirty(instance);
+    }
+}
+
+void FRenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.occluder = enable;
+        markDirty(instance);
     }
 }
 
@@ -251,6 +345,7 @@ void FRenderableManager::setSkinning(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.skinning = enable;
+        markDirty(instance);
     }
 }
 
@@ -278,6 +373,10 @@ bool FRenderableManager::isCullingEnabled(Instance instance) const noexcept {
     return getVisibility(instance).culling;
 }
 
+bool FRenderableManager::isOccluder(Instance instance) const noexcept {
+    return getVisibility(instance).occluder;
+}
+
 uint8_t FRenderableManager::getLayerMask(Instance instance) const noexcept {
     return mManager[instance].layers;
 }
@@ -290,6 +389,26 @@ Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
+Box const& FRenderableManager::getAxisAlignedBoundingBox(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return UTILS_UNLIKELY(instances) ? instances->bounds : getAABB(instance);
+}
+
+size_t FRenderableManager::getInstanceCount(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return UTILS_UNLIKELY(instances) ? instances->transforms.size() : 1;
+}
+
+math::mat4f const* FRenderableManager::getInstanceTransforms(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return UTILS_UNLIKELY(instances) ? instances->transforms.data() : nullptr;
+}
+
+Box const* FRenderableManager::getInstanceGroupBounds(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return UTILS_UNLIKELY(instances) ? instances->groups.data() : nullptr;
+}
+
 backend::Handle<backend::HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
     std::unique_ptr<Bones> const& bones = mManager[instance].bones;
     return bones ? bones->handle : backend::Handle<backend::HwUniformBuffer>{};
@@ -297,12 +416,41 @@ backend::Handle<backend::HwUniformBuffer> FRenderableManager::getBonesUbh(Instan
 
 utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
         Instance instance, uint8_t level) const noexcept {
-    return mManager[instance].primitives;
+    if (UTILS_LIKELY(level == 0)) {
+        return mManager[instance].primitives;
+    }
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    assert(lods && level < lods->count);
+    return lods->primitives[level - 1];
 }
 
 utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
         Instance instance, uint8_t level) noexcept {
-    return mManager[instance].primitives;
+    if (UTILS_LIKELY(level == 0)) {
+        return mManager[instance].primitives;
+    }
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    assert(lods && level < lods->count);
+    return lods->primitives[level - 1];
+}
+
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    return lods ? lods->count : 1;
+}
+
+uint8_t FRenderableManager::getLevelOfDetail(Instance instance,
+        float screenCoverage) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    if (UTILS_LIKELY(!lods)) {
+        return 0;
+    }
+    // screen coverages are decreasing, so this counts the levels small enough
+    uint8_t level = 0;
+    for (size_t i = 0, c = lods->count - 1u; i < c; i++) {
+        level += uint8_t(screenCoverage < lods->screenCoverage[i]);
+    }
+    return level;
 }
 
 size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
@@ -16,13 +16,21 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <string.h>
+
 using namespace utils;
 using namespace filament::math;
 
 namespace filament {
 namespace details {
 
-FTransformManager::FTransformManager() noexcept = default;
+FTransformManager::FTransformManager(JobSystem* js) noexcept : mJobSystem(js) {
+}
 
 FTransformManager::~FTransformManager() noexcept = default;
 
@@ -37,19 +45,21 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
     // this always adds at the end, so all existing instances stay valid
     auto& manager = mManager;
 
-    // TODO: try to keep entries sorted with their siblings/parents to improve cache access
+    // entries are sorted by depth in the hierarchy by the next commitLocalTransformTransaction()
     if (UTILS_UNLIKELY(manager.hasComponent(entity))) {
         destroy(entity);
     }
     Instance i = manager.addComponent(entity);
     assert(i);
     assert(i != parent);
+    mLayoutVersion++;
 
     if (i && i != parent) {
         manager[i].parent = 0;
         manager[i].next = 0;
         manager[i].prev = 0;
         manager[i].firstChild = 0;
+        manager[i].dirty = 0;
         insertNode(i, parent);
         setTransform(i, localTransform);
     }
@@ -100,15 +110,18 @@ void FTransformManager::destroy(Entity e) noexcept {
         // 1) remove the entry from the linked lists
         removeNode(i);
 
-        // our children don't have parents anymore
+        // our children don't have parents anymore, their world transform is updated by the
+        // next commitLocalTransformTransaction()
         Instance child = manager[i].firstChild;
         while (child) {
             manager[child].parent = 0;
+            manager[child].dirty = 1;
             child = manager[child].next;
         }
 
         // 2) remove the component
         Instance moved = manager.removeComponent(e);
+        mLayoutVersion++;
 
         // 3) update the references to the entry now with Instance i
         if (moved != i) {
@@ -127,21 +140,57 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     }
 }
 
+void FTransformManager::setTransforms(Instance const* instances,
+        mat4f const* localTransforms, size_t count) noexcept {
+    // write all the local transforms as in a transaction, the world transforms are then
+    // updated in a single pass
+    const bool transactionOpen = mLocalTransformTransactionOpen;
+    openLocalTransformTransaction();
+    auto& manager = mManager;
+    for (size_t k = 0; k < count; k++) {
+        const Instance ci = instances[k];
+        if (ci) {
+            manager[ci].local = localTransforms[k];
+            manager[ci].dirty = 1;
+        }
+    }
+    if (!transactionOpen) {
+        commitLocalTransformTransaction();
+    }
+}
+
+void FTransformManager::setTransforms(Instance const* instances,
+        float3 const* translations, quatf const* rotations, float3 const* scales,
+        size_t count) noexcept {
+    const bool transactionOpen = mLocalTransformTransactionOpen;
+    openLocalTransformTransaction();
+    auto& manager = mManager;
+    for (size_t k = 0; k < count; k++) {
+        const Instance ci = instances[k];
+        if (ci) {
+            // translation * rotation * scale
+            mat3f rs{ rotations[k] };
+            rs[0] *= scales[k].x;
+            rs[1] *= scales[k].y;
+            rs[2] *= scales[k].z;
+            manager[ci].local = mat4f{ rs, translations[k] };
+            manager[ci].dirty = 1;
+        }
+    }
+    if (!transactionOpen) {
+        commitLocalTransformTransaction();
+    }
+}
+
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
     validateNode(i);
     auto& manager = mManager;
     assert(i);
 
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
-        // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
+        // don't update the world transform until commitLocalTransformTransaction() is called,
+        // which updates our descendants as well
+        manager[i].dirty = 1;
         return;
     }
 
@@ -151,12 +200,14 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
     mat4f const& pt = manager.raw_array<WORLD>()[parent];
 
     // compute our world transform
+    const uint32_t version = ++mVersion;
     manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    manager[i].version = version;
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(child, version);
     }
 }
 
@@ -167,23 +218,124 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+        // Ensure that the instances are sorted by depth, so children are always after their
+        // parent, and all the instances of a level can be updated independently.
+        if (mHierarchyChanged) {
+            sortByDepth();
+        }
+        updateWorldTransforms();
+    }
+}
+
+void FTransformManager::sortByDepth() noexcept {
+    SYSTRACE_CALL();
+
+    auto& manager = mManager;
+    const size_t count = manager.getComponentCount();
+
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    // Breadth-first traversal of the hierarchy starting from the roots, this gives the new
+    // order of the instances, level by level, with the siblings next to each other.
+    std::vector<Instance>& order = mQueue;
+    order.clear();
+    order.reserve(count);
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (!Instance(manager[i].parent)) {
+            order.push_back(i);
+        }
+    }
+    mLevels.clear();
+    for (size_t first = 0; first < order.size();) {
+        const size_t last = order.size();
+        mLevels.push_back(uint32_t(manager.begin() + first));
+        for (size_t k = first; k < last; k++) {
+            for (Instance c = manager[order[k]].firstChild; c; c = manager[c].next) {
+                order.push_back(c);
+            }
+        }
+        first = last;
+    }
+    mLevels.push_back(uint32_t(manager.begin() + order.size()));
+    assert(order.size() == count); // otherwise the hierarchy has a cycle
+
+    // Move the instances to their new position. mPositions tracks the current position of
+    // each original instance, and mInstances the original instance at each position.
+    std::vector<uint32_t>& positions = mPositions;
+    std::vector<uint32_t>& instances = mInstances;
+    positions.resize(count + 1);
+    instances.resize(count + 1);
+    for (size_t i = 0; i <= count; i++) {
+        positions[i] = uint32_t(i);
+        instances[i] = uint32_t(i);
+    }
+    for (size_t k = 0; k < count; k++) {
+        const uint32_t position = uint32_t(manager.begin() + k);
+        const uint32_t original = order[k];
+        const uint32_t current = positions[original];
+        if (current != position) {
+            swapNode(position, current);
+            const uint32_t displaced = instances[position];
+            instances[position] = original;
+            instances[current] = displaced;
+            positions[original] = position;
+            positions[displaced] = current;
+        }
+    }
+
+    mHierarchyChanged = false;
+}
+
+void FTransformManager::updateWorldTransforms() noexcept {
+    SYSTRACE_CALL();
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
+    auto& manager = mManager;
+    auto& soa = manager.getSoA();
+
+    // only the transforms that actually changed are marked as such
+    const uint32_t version = ++mVersion;
+    mat4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+    mat4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+    uint32_t* const UTILS_RESTRICT versions = soa.data<VERSION>();
+    uint8_t* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+
+    // An instance is recomputed if its local transform changed or its parent's world transform
+    // changed, its dirty flag then tells its children whether its world transform changed.
+    // The parents are in the previous level, so the instances of a level are independent.
+    // Note: the dirty flag of instance 0 (i.e. no parent) is always 0.
+    auto update = [world, local, parents, versions, dirty, version](uint32_t first, uint32_t count) {
+        for (uint32_t i = first, e = first + count; i < e; i++) {
+            const uint32_t parent = parents[i];
+            if (dirty[i] | dirty[parent]) {
+                const mat4f transform = world[parent] * local[i];
+                const bool changed = memcmp(&world[i], &transform, sizeof(mat4f)) != 0;
+                if (changed) {
+                    world[i] = transform;
+                    versions[i] = version;
+                }
+                dirty[i] = uint8_t(changed);
             }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+        }
+    };
+
+    JobSystem* const js = mJobSystem;
+    for (size_t level = 0; level + 1 < mLevels.size(); level++) {
+        const uint32_t first = mLevels[level];
+        const uint32_t count = mLevels[level + 1] - first;
+        if (js && count >= PARALLEL_UPDATE_MIN_COUNT) {
+            auto job = jobs::parallel_for(*js, nullptr, first, count, std::ref(update),
+                    jobs::CountSplitter<PARALLEL_UPDATE_MIN_COUNT / 2, 8>());
+            js->runAndWait(job);
+        } else {
+            update(first, count);
         }
     }
+
+    std::fill(dirty + manager.begin(), dirty + manager.end(), 0);
 }
 
 // Inserts a parentless node in the hierarchy
@@ -191,6 +343,7 @@ void FTransformManager::insertNode(Instance i, Instance parent) noexcept {
     auto& manager = mManager;
 
     assert(manager[i].parent == Instance{});
+    mHierarchyChanged = true;
 
     manager[i].parent = parent;
     manager[i].prev = 0;
@@ -215,10 +368,13 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     validateNode(j);
 
     auto& manager = mManager;
+    mLayoutVersion++;
 
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<VERSION>(i), manager.elementAt<VERSION>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -252,6 +408,7 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
 // (making everybody orphaned).
 void FTransformManager::removeNode(Instance i) noexcept {
     auto& manager = mManager;
+    mHierarchyChanged = true;
     Instance parent = manager[i].parent;
     Instance prev = manager[i].prev;
     Instance next = manager[i].next;
@@ -305,22 +462,28 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
-    while (ci) {
-        // update child's world transform
-        Instance parent = manager[ci].parent;
-        mat4f const& pt = manager[parent].world;
-        mat4f const& local = manager[ci].local;
-        manager[ci].world = pt * local;
+void FTransformManager::transformChildren(Instance firstChild, uint32_t version) noexcept {
+    auto& manager = mManager;
 
-        // assume we don't have a deep hierarchy
-        Instance child = manager[ci].firstChild;
-        if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
-        }
+    // breadth-first traversal of the descendants, the queue holds the first child of each
+    // list of siblings to update
+    std::vector<Instance>& queue = mQueue;
+    queue.clear();
+    queue.push_back(firstChild);
+    for (size_t k = 0; k < queue.size(); k++) {
+        for (Instance ci = queue[k]; ci; ci = manager[ci].next) {
+            // update child's world transform
+            Instance parent = manager[ci].parent;
+            mat4f const& pt = manager[parent].world;
+            mat4f const& local = manager[ci].local;
+            manager[ci].world = pt * local;
+            manager[ci].version = version;
 
-        // process our next child
-        ci = manager[ci].next;
+            Instance child = manager[ci].firstChild;
+            if (UTILS_UNLIKELY(child)) {
+                queue.push_back(child);
+            }
+        }
     }
 }
 
@@ -402,6 +565,17 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
+void TransformManager::setTransforms(Instance const* instances,
+        mat4f const* localTransforms, size_t count) noexcept {
+    upcast(this)->setTransforms(instances, localTransforms, count);
+}
+
+void TransformManager::setTransforms(Instance const* instances,
+        float3 const* translations, quatf const* rotations, float3 const* scales,
+        size_t count) noexcept {
+    upcast(this)->setTransforms(instances, translations, rotations, scales, count);
+}
+
 const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
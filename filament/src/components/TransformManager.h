@@ -28,6 +28,12 @@
 
 #include <math/mat4.h>
 
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 namespace details {
 
@@ -35,7 +41,9 @@ class UTILS_PRIVATE FTransformManager : public TransformManager {
 public:
     using Instance = TransformManager::Instance;
 
-    FTransformManager() noexcept;
+    // When a JobSystem is given, the levels of the hierarchy are updated in parallel by
+    // commitLocalTransformTransaction(), otherwise everything runs on the calling thread.
+    explicit FTransformManager(utils::JobSystem* js = nullptr) noexcept;
     ~FTransformManager() noexcept;
 
     // free-up all resources
@@ -80,6 +88,13 @@ public:
 
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
+    void setTransforms(Instance const* instances,
+            math::mat4f const* localTransforms, size_t count) noexcept;
+
+    void setTransforms(Instance const* instances,
+            math::float3 const* translations, math::quatf const* rotations,
+            math::float3 const* scales, size_t count) noexcept;
+
     const math::mat4f& getTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
@@ -88,6 +103,19 @@ public:
         return mManager[ci].world;
     }
 
+    /*
+     * Change tracking, used by FScene::prepare() to only update what changed
+     */
+
+    // incremented each time a world transform changes
+    uint32_t getVersion() const noexcept { return mVersion; }
+
+    // value of getVersion() when this instance's world transform last changed
+    uint32_t getVersion(Instance ci) const noexcept { return mManager[ci].version; }
+
+    // incremented each time instances are created, destroyed or moved
+    uint32_t getLayoutVersion() const noexcept { return mLayoutVersion; }
+
 private:
     struct Sim;
 
@@ -97,7 +125,14 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    void transformChildren(Instance firstChild, uint32_t version) noexcept;
+
+    // reorders the instances by depth in the hierarchy and computes mLevels
+    void sortByDepth() noexcept;
+
+    // updates the world transforms of the dirty instances and their descendants, one level
+    // of the hierarchy at a time, requires the instances to be sorted by depth
+    void updateWorldTransforms() noexcept;
 
 
     enum {
@@ -107,6 +142,8 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        VERSION,        // version of the last change of the world transform
+        DIRTY,          // local transform changed in a transaction / world transform changed
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -115,7 +152,9 @@ private:
             Instance,
             Instance,
             Instance,
-            Instance
+            Instance,
+            uint32_t,
+            uint8_t
     >;
 
     struct Sim : public Base {
@@ -138,6 +177,8 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<VERSION>      version;
+                Field<DIRTY>        dirty;
             };
         };
 
@@ -149,8 +190,25 @@ private:
         }
     };
 
+    // minimum number of instances in a level of the hierarchy to update it in parallel
+    static constexpr uint32_t PARALLEL_UPDATE_MIN_COUNT = 512;
+
+    utils::JobSystem* const mJobSystem;
     Sim mManager;
+    uint32_t mVersion = 0;
+    uint32_t mLayoutVersion = 0;
     bool mLocalTransformTransactionOpen = false;
+
+    // set when the parent/child links change, the instances must be sorted by depth again
+    bool mHierarchyChanged = false;
+
+    // once sorted by depth, the instances of level n are in [mLevels[n], mLevels[n + 1])
+    std::vector<uint32_t> mLevels;
+
+    // scratch storage for the breadth-first traversals
+    std::vector<Instance> mQueue;
+    std::vector<uint32_t> mPositions;
+    std::vector<uint32_t> mInstances;
 };
 
 FILAMENT_UPCAST(TransformManager)
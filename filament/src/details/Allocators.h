@@ -22,13 +22,20 @@
 namespace filament {
 namespace details {
 
-// per render pass allocations
-// Froxelization needs about 1 MiB. Command buffer needs about 1 MiB.
-static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 2 * 1024 * 1024;
-
 // size of the high-level draw commands buffer (comes from the per-render pass allocator)
 static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE = 1 * 1024 * 1024;
 
+// scratch memory of the commands radix sort (comes from the per-render pass allocator)
+// The (key, index) ping-pong buffers are as large as the commands, plus an index per command
+// and the per-job histograms.
+static constexpr size_t CONFIG_PER_FRAME_SORT_SCRATCH_SIZE =
+        CONFIG_PER_FRAME_COMMANDS_SIZE + CONFIG_PER_FRAME_COMMANDS_SIZE / 8 + 64 * 1024;
+
+// per render pass allocations
+// Froxelization needs about 1 MiB. Command buffer needs about 1 MiB, and sorting it about as much.
+static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    =
+        1 * 1024 * 1024 + CONFIG_PER_FRAME_COMMANDS_SIZE + CONFIG_PER_FRAME_SORT_SCRATCH_SIZE;
+
 // size of a command-stream buffer (comes from mmap -- not the per-engine arena)
 static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE = 1 * 1024 * 1024;
 static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE     = 3 * CONFIG_MIN_COMMAND_BUFFERS_SIZE;
@@ -33,6 +33,8 @@ namespace details {
  *
  * The implementation assumes 'count' below is multiple of 8
  *
+ * The batch tests below are implemented by several kernels, one per instruction set. The best
+ * kernel supported by the CPU we're running on is picked the first time a test is performed.
  */
 
 class Culler {
@@ -48,6 +50,14 @@ public:
 
     using result_type = uint8_t;
 
+    // instruction sets the batch tests are implemented with
+    enum class Isa : uint8_t {
+        GENERIC,    // portable C++, relies on the compiler's auto-vectorization
+        SSE2,       // x86, 4 objects per iteration
+        AVX2,       // x86, 8 objects per iteration
+        NEON        // ARM, 8 objects per iteration
+    };
+
     /*
      * returns whether each AABB in an array intersects with the frustum
      */
@@ -92,7 +102,39 @@ public:
                 Frustum const& frustum,
                 math::float4 const* b,
                 size_t count) noexcept;
+
+        // whether the kernels for a given instruction set can run on this CPU
+        static bool isSupported(Isa isa) noexcept;
+
+        // same as above, but forces the use of a given instruction set, which must be supported
+        static void intersects(result_type* results,
+                Frustum const& frustum,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count, Isa isa) noexcept;
+
+        static void intersects(result_type* results,
+                Frustum const& frustum,
+                math::float4 const* b,
+                size_t count, Isa isa) noexcept;
+    };
+
+private:
+    using BoxKernel = void (*)(result_type* results, math::float4 const* planes,
+            math::float3 const* center, math::float3 const* extent, size_t count, size_t bit);
+    using SphereKernel = void (*)(result_type* results, math::float4 const* planes,
+            math::float4 const* b, size_t count);
+
+    struct Kernels {
+        BoxKernel boxes;
+        SphereKernel spheres;
     };
+
+    // returns the kernels for a given instruction set, or nullptr if it's not supported
+    static Kernels const* getKernels(Isa isa) noexcept;
+
+    // returns the best kernels for the CPU we're running on
+    static Kernels const& getKernels() noexcept;
 };
 
 } // namespace details
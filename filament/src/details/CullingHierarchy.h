@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
+#define TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy over the renderables of a scene, used to accelerate culling.
+ *
+ * The hierarchy doesn't store renderables, instead it relies on the renderables being laid out
+ * in a spatially coherent order (see sort()), and groups them in leaves of LEAF_SIZE consecutive
+ * renderables. The tree itself is a complete binary tree stored in an array (the children of
+ * node i are 2i and 2i+1, the root is node 1), which makes refitting trivial.
+ *
+ * During culling, the tree is traversed to reject (or accept) whole groups of renderables, and
+ * the leaves intersecting the frustum are processed with the regular Culler.
+ */
+class CullingHierarchy {
+public:
+    // number of renderables per leaf, must be a multiple of Culler::MODULO
+    static constexpr size_t LEAF_SIZE = 64;
+    static_assert(LEAF_SIZE % Culler::MODULO == 0, "LEAF_SIZE must be a multiple of MODULO");
+
+    CullingHierarchy() noexcept;
+    ~CullingHierarchy() noexcept;
+
+    CullingHierarchy(CullingHierarchy const& rhs) = delete;
+    CullingHierarchy& operator=(CullingHierarchy const& rhs) = delete;
+
+    // Computes a spatially coherent order (Morton order) of 'count' world-space AABB centers.
+    // The i-th element in that order is indices[i].
+    static void sort(uint32_t* indices, math::float3 const* center, size_t count) noexcept;
+
+    // Must be called when the order of the renderables has changed, e.g. after calling sort().
+    void invalidate() noexcept { mReferenceCost = 0; }
+
+    // Recomputes the bounds of the tree from the renderables' world-space AABB. Only the nodes
+    // whose bounds changed are propagated up the tree.
+    // Returns false if the hierarchy has degraded enough that the renderables should be sorted
+    // again.
+    bool refit(math::float3 const* center, math::float3 const* extent, size_t count) noexcept;
+
+    // Same as Culler::intersects(), but only visits the renderables that are in a leaf
+    // intersecting the frustum.
+    void cull(utils::JobSystem& js, Frustum const& frustum,
+            math::float3 const* center, math::float3 const* extent,
+            Culler::result_type* results, size_t count, size_t bit) noexcept;
+
+private:
+    struct Node {
+        math::float3 min;
+        math::float3 max;
+    };
+
+    enum class Classification : uint8_t {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE
+    };
+
+    static Classification classify(math::float4 const* planes, Node const& node) noexcept;
+
+    // range of leaves under a given node
+    void getLeafRange(size_t node, size_t* first, size_t* last) const noexcept;
+
+    std::vector<Node> mNodes;
+    std::vector<uint8_t> mChanged;
+    std::vector<uint32_t> mLeavesToCull;
+    size_t mCount = 0;          // number of renderables
+    size_t mLeafCount = 0;      // number of leaves actually used
+    size_t mFirstLeaf = 0;      // index of the first leaf in mNodes (a power of two)
+    float mReferenceCost = 0;   // cost of the tree just after it was sorted
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
@@ -28,6 +28,7 @@
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/DebugRegistry.h"
+#include "details/RenderPrimitiveCache.h"
 #include "details/ResourceList.h"
 #include "details/Skybox.h"
 
@@ -170,6 +171,10 @@ public:
         return mRenderableManager;
     }
 
+    RenderPrimitiveCache& getRenderPrimitiveCache() noexcept {
+        return mRenderPrimitiveCache;
+    }
+
     FLightManager& getLightManager() noexcept {
         return mLightManager;
     }
@@ -298,6 +303,7 @@ private:
     PostProcessManager mPostProcessManager;
 
     utils::EntityManager& mEntityManager;
+    RenderPrimitiveCache mRenderPrimitiveCache;     // must outlive mRenderableManager
     FRenderableManager mRenderableManager;
     FTransformManager mTransformManager;
     FLightManager mLightManager;
@@ -359,10 +365,56 @@ public:
             bool lispsm = true;
             float dzn = -1.0f;
             float dzf =  1.0f;
+            int cache_hits = 0;         // shadow maps reused from the previous frame
+            int cache_misses = 0;       // shadow maps rendered while caching was enabled
         } shadowmap;
         struct {
             bool camera_at_origin = true;
+            int occluders = 0;          // occluders rasterized by the last view prepared
+            int occlusion_culled = 0;   // renderables culled by occlusion in the last view
         } view;
+        struct {
+            int draw_calls = 0;         // draw calls issued by the last view rendered
+            int merged_draws = 0;       // draws merged into instanced draws in the last view
+            int sort_fallbacks = 0;     // command sorts that ran out of radix sort scratch memory
+        } renderer;
+        struct {
+            int skipped = 0;            // froxelizations skipped because nothing changed
+        } froxelizer;
+        struct {
+            int transient_kb = 0;           // transient textures of the last view, unaliased
+            int aliased_transient_kb = 0;   // same, with lifetime-disjoint textures shared
+            int textures_created = 0;       // textures created by the FrameGraph allocator
+            int render_targets_created = 0; // render targets created by the FrameGraph allocator
+            int compile_cache_hits = 0;     // compiled graphs reused from a previous frame
+            int compile_cache_misses = 0;
+        } framegraph;
+        struct {
+            // counters of the backend's object caches during the last frame, see
+            // DriverApi::getCacheStats()
+            int pipeline_hits = 0;
+            int pipeline_misses = 0;
+            int pipeline_evictions = 0;
+            int pipeline_count = 0;
+            int descriptor_set_hits = 0;
+            int descriptor_set_misses = 0;
+            int descriptor_set_evictions = 0;
+            int descriptor_set_count = 0;
+            int framebuffer_hits = 0;
+            int framebuffer_misses = 0;
+            int framebuffer_evictions = 0;
+            int framebuffer_count = 0;
+            int render_pass_hits = 0;
+            int render_pass_misses = 0;
+            int render_pass_evictions = 0;
+            int render_pass_count = 0;
+            int sampler_hits = 0;
+            int sampler_misses = 0;
+            int sampler_evictions = 0;
+            int sampler_count = 0;
+            int pipeline_creation_count = 0;    // pipelines created since the Engine was created
+            float pipeline_creation_ms = 0;     // time spent creating them
+        } backend;
     } debug;
 };
 
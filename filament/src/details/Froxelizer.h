@@ -32,7 +32,6 @@
 #include <private/filament/UibGenerator.h>
 
 #include <utils/compiler.h>
-#include <utils/bitset.h>
 #include <utils/Slice.h>
 
 #include <math/mat4.h>
@@ -56,9 +55,9 @@ public:
 };
 
 //
-// Light UBO           Froxel Record Buffer     per-froxel light list texture
-// {4 x float4}         R_U8  {index into        RG_U16 {offset, point-count, spot-sount}
-// (spot/point            light texture}
+// Light texture       Froxel Record Buffer     per-froxel light list texture
+// {4 x float4}         R_U16 {index into        RG_U16 {offset, point-count, spot-sount}
+// (light_punctual)      light texture}
 //
 //  +----+                     +-+                     +----+
 // 0|....| <------------+     0| |         +-----------|0221| (e.g. offset=02, 2-point, 1-spot)
@@ -71,10 +70,10 @@ public:
 //  :    :                     | |                     |    |
 //  :    :                     +-+                     |    |
 //  :    :                  65536 max                  +----+
-//  |....|                                          h = num froxels
+//  |....|           (sized to the records used)    h = num froxels
 //  |....|
 //  +----+
-// 256 lights max
+// CONFIG_MAX_LIGHT_COUNT lights max (sized to the visible lights)
 //
 
 // Max number of froxels limited by:
@@ -89,6 +88,10 @@ static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
 
 class Froxelizer {
 public:
+    // number of texels per row of the light texture, each light uses 4 texels
+    static constexpr size_t LIGHT_BUFFER_WIDTH = 64;
+    static constexpr size_t LIGHTS_PER_ROW = LIGHT_BUFFER_WIDTH / 4;
+
     explicit Froxelizer(FEngine& engine);
     ~Froxelizer();
 
@@ -124,6 +127,8 @@ public:
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
+    // This does nothing if the camera, the viewport and the lights haven't changed since the
+    // last call.
     void froxelizeLights(FEngine& engine, CameraInfo const& camera,
             const FScene::LightSoa& lightData) noexcept;
 
@@ -135,8 +140,9 @@ public:
         u.setUniform(offsetof(PerViewUib, oneOverFroxelDimensionY), mOneOverDimension.y);
     }
 
-    // send froxel data to GPU
-    void commit(backend::DriverApi& driverApi);
+    // Send froxel data to GPU, unless the last froxelization was skipped. Returns true if the
+    // record buffer was reallocated, in which case its sampler must be set again.
+    bool commit(backend::DriverApi& driverApi);
 
 
     /*
@@ -158,22 +164,17 @@ public:
             };
         };
     };
-    // This depends on the maximum number of lights (currently 255),and can't be more than 16 bits.
+    // Light indices are stored on 16 bits.
     static_assert(CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint16_t>::max(), "can't have more than 65536 lights");
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
-    // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
-    // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
-    using LightGroupType = uint32_t;
+    // number of lights froxelized by a single job, when there are fewer light groups than
+    // threads, the z-slices are split between several jobs as well.
+    static constexpr size_t LIGHTS_PER_JOB = 16;
 
 private:
-    struct LightRecord {
-        using bitset = utils::bitset<uint64_t, (CONFIG_MAX_LIGHT_COUNT + 63) / 64>;
-        bitset lights;
-    };
-
     struct LightParams {
         math::float3 position;
         float cosSqr;
@@ -196,8 +197,22 @@ private:
         uint16_t reserved;
     };
 
-    // The first entry always encodes the type of light, i.e. point/spot
-    using FroxelThreadData = std::array<LightGroupType, FROXEL_BUFFER_ENTRY_COUNT_MAX + 1>;
+    // the froxels touched by a light in a range of z-slices, in the list of the job that
+    // froxelized it
+    struct LightFroxels {
+        uint32_t begin;
+        uint32_t end;
+        uint16_t job;
+        bool isSpot;
+    };
+
+    // the lights touching a froxel, in mRecordsScratch
+    struct FroxelLights {
+        uint32_t point;         // next point light, then end of the point lights
+        uint32_t spot;          // next spot light, then end of the spot lights
+        uint16_t pointCount;
+        uint16_t spotCount;
+    };
 
     void setViewport(Viewport const& viewport) noexcept;
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
@@ -206,10 +221,17 @@ private:
     void froxelizeLoop(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
-    void froxelizeAssignRecordsCompress() noexcept;
+    void froxelizeAssignRecordsCompress(size_t lightCount) noexcept;
 
-    void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
-            math::mat4f const& projection, const LightParams& light) const noexcept;
+    // hash of everything the froxelization depends on
+    uint64_t hashFroxelizationInputs(FEngine& engine,
+            const CameraInfo& camera, const FScene::LightSoa& lightData) const noexcept;
+
+    // appends the indices of the froxels touched by the light in the z-slices [zbegin, zend)
+    // to 'froxels'
+    void froxelizePointAndSpotLight(std::vector<uint16_t>& froxels,
+            math::mat4f const& projection, const LightParams& light,
+            size_t zbegin, size_t zend) const noexcept;
 
     static void computeLightTree(LightTreeNode* lightTree,
             utils::Slice<RecordBufferType> const& lightList,
@@ -235,12 +257,22 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
-    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
-    utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
-
-    // max 32 KiB  (actual: resolution dependant)
-    utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
-    utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
+    utils::Slice<FroxelLights> mFroxelLights;           //  96 KiB w/ 8192 froxels
+
+    // froxelization output, these grow with the number of lights and the froxels they touch
+    std::vector<std::vector<uint16_t>> mJobFroxels;     // froxels touched by the lights of a job
+    std::vector<LightFroxels> mLightFroxels;            // froxels touched by each light, per slab
+    std::vector<RecordBufferType> mRecordsScratch;      // lights of each froxel, not compacted
+    std::vector<RecordBufferType> mRecords;             // record buffer, max 128 KiB
+    utils::Slice<RecordBufferType> mRecordBufferUser;   // the part of mRecords in use
+    std::vector<FroxelEntry> mFroxels;                  // froxel buffer, 32 KiB
+    utils::Slice<FroxelEntry> mFroxelBufferUser;        // all of mFroxels
+
+    // the froxel and record buffers are kept from frame to frame, so we can skip the
+    // froxelization when its inputs don't change
+    uint64_t mFroxelizationHash = 0;
+    bool mHasFroxelization = false;
+    bool mFroxelizationSkipped = false;
 
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
@@ -31,6 +31,7 @@
 
 #include <utils/compiler.h>
 
+#include <vector>
 
 namespace filament {
 
@@ -68,6 +69,8 @@ public:
 
     bool hasParameter(const char* name) const noexcept;
 
+    ParameterHandle getParameterHandle(const char* name) const noexcept;
+
     FMaterialInstance const* getDefaultInstance() const noexcept { return &mDefaultInstance; }
     FMaterialInstance* getDefaultInstance() noexcept { return &mDefaultInstance; }
 
@@ -83,6 +86,8 @@ public:
         return UTILS_LIKELY(entry) ? entry : getProgramSlow(variantKey);
     }
 
+    void compile(VariantMask variants, CompileCallback callback, void* user) noexcept;
+
     bool isVariantLit() const noexcept { return mIsVariantLit; }
 
     const utils::CString& getName() const noexcept { return mName; }
@@ -116,9 +121,30 @@ public:
     uint32_t generateMaterialInstanceId() const noexcept { return mMaterialInstanceId++; }
 
 private:
+    // a compilePrograms() request, the driver passes it back once the programs are ready
+    struct CompileRequest {
+        FMaterial const* material;  // nullptr once the material is terminated
+        uint32_t variants;          // bit i set for variant i
+        CompileCallback callback;
+        void* user;
+    };
+
+    backend::Handle<backend::HwProgram> createProgram(uint8_t variantKey) const noexcept;
+
+    // returns the variant used while the program of variantKey compiles, or variantKey if none
+    uint8_t getFallbackVariant(uint8_t variantKey) const noexcept;
+
+    void compilePrograms(uint32_t variants, CompileCallback callback, void* user) const noexcept;
+    static void onProgramsCompiled(void* user);
+
     // try to order by frequency of use
+    // the program used for each variant, it's a fallback's while the variant's program compiles
     mutable std::array<backend::Handle<backend::HwProgram>, VARIANT_COUNT> mCachedPrograms;
 
+    // programs created but not known to be compiled yet
+    mutable std::array<backend::Handle<backend::HwProgram>, VARIANT_COUNT> mPendingPrograms;
+    mutable std::vector<CompileRequest*> mCompileRequests;
+
     backend::RasterState mRasterState;
     BlendingMode mRenderBlendingMode;
     TransparencyMode mTransparencyMode;
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include <utils/compiler.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * A software occlusion culler.
+ *
+ * The world-space AABBs of the occluders are rasterized into a low resolution depth buffer, from
+ * which a hierarchical-Z (each level storing the farthest depth of 2x2 texels of the level below)
+ * is built. The screen-space bounds of each occludee are then tested against a single 2x2 texels
+ * footprint of the hierarchical-Z.
+ *
+ * The rasterization is conservative: a texel only receives an occluder's depth if it's entirely
+ * covered by the occluder, and that depth is the farthest depth of the occluder within the texel.
+ * This means occluders' AABBs must be entirely opaque, i.e. the occluder must fill its bounds
+ * (e.g. walls, buildings), otherwise objects behind its empty parts would be culled.
+ *
+ * Depths are NDC z values, using the OpenGL convention (-1 at the near plane, 1 at the far plane).
+ */
+class OcclusionCuller {
+public:
+    // resolution of the depth buffer, independent of the viewport's
+    static constexpr size_t WIDTH = 256;
+    static constexpr size_t HEIGHT = 128;
+
+    // the depth buffer is rasterized in bands of BAND_HEIGHT lines, in parallel
+    static constexpr size_t BAND_HEIGHT = 16;
+
+    OcclusionCuller() noexcept;
+    ~OcclusionCuller() noexcept;
+
+    OcclusionCuller(OcclusionCuller const& rhs) = delete;
+    OcclusionCuller& operator=(OcclusionCuller const& rhs) = delete;
+
+    // Rasterizes the AABBs of the renderables listed in 'occluders' and builds the
+    // hierarchical-Z.
+    void rasterize(utils::JobSystem& js, math::mat4f const& clipFromWorld,
+            math::float3 const* center, math::float3 const* extent,
+            uint32_t const* occluders, size_t count) noexcept;
+
+    // Tests the AABBs of the renderables listed in 'occludees', and clears the bit 'bit' of
+    // results[i] for the ones that are hidden. Returns the number of renderables culled.
+    size_t cull(utils::JobSystem& js,
+            math::float3 const* center, math::float3 const* extent,
+            uint32_t const* occludees, size_t count,
+            uint8_t* results, size_t bit) const noexcept;
+
+    // number of occluders actually rasterized by the last call to rasterize()
+    size_t getRasterizedOccluderCount() const noexcept { return mOccluders.size(); }
+
+private:
+    // a plane, in screen-space, of the form a * x + b * y + c
+    struct Plane {
+        float a, b, c;
+    };
+
+    // The screen-space projection of an AABB, the shape is the convex hull of its projection
+    // and its depth is the farthest of its front faces.
+    struct Occluder {
+        Plane edges[6];     // inside is positive, offset so pixels must be fully covered
+        Plane depth[3];     // depth of the front faces, offset to the farthest pixel corner
+        uint8_t edgeCount;
+        uint8_t depthCount;
+        uint16_t ymin;      // lines covered by the occluder [ymin, ymax)
+        uint16_t ymax;
+    };
+
+    struct ScreenBounds {
+        math::float3 min;   // x and y in pixels, z is the closest depth
+        math::float3 max;
+    };
+
+    static bool project(math::mat4f const& clipFromWorld,
+            math::float3 const& center, math::float3 const& extent,
+            math::float3* corners) noexcept;
+
+    static bool setupOccluder(math::float3 const* corners, Occluder* occluder) noexcept;
+
+    void rasterizeBand(size_t band) noexcept;
+
+    void buildHierarchy() noexcept;
+
+    bool isOccluded(ScreenBounds const& bounds) const noexcept;
+
+    std::vector<Occluder> mOccluders;
+    std::vector<float> mLevels[8];   // hierarchical-Z, level 0 is the depth buffer
+    size_t mLevelCount = 0;
+    math::mat4f mClipFromWorld;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
@@ -20,6 +20,7 @@
 #include "components/RenderableManager.h"
 
 #include "details/MaterialInstance.h"
+#include "details/RenderPrimitiveCache.h"
 
 #include <backend/Handle.h>
 
@@ -37,7 +38,7 @@ class FRenderPrimitive {
 public:
     FRenderPrimitive() noexcept = default;
 
-    void init(backend::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
+    void init(FEngine& engine, const RenderableManager::Builder::Entry& entry) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
@@ -61,7 +62,11 @@ public:
     }
 
 private:
+    // replaces the geometry, mHandle is shared with all the primitives drawing the same geometry
+    void setGeometry(FEngine& engine, RenderPrimitiveCache::Geometry const& geometry) noexcept;
+
     FMaterialInstance const* mMaterialInstance = nullptr;
+    RenderPrimitiveCache::Geometry mGeometry;
     backend::Handle<backend::HwRenderPrimitive> mHandle;
     backend::PrimitiveType mPrimitiveType = backend::PrimitiveType::NONE;
     AttributeBitset mEnabledAttributes;
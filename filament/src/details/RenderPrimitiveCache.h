@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_RENDERPRIMITIVECACHE_H
+#define TNT_FILAMENT_DETAILS_RENDERPRIMITIVECACHE_H
+
+#include "private/backend/DriverApiForward.h"
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <utils/compiler.h>
+#include <utils/Hash.h>
+
+#include <tsl/robin_map.h>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Shares HwRenderPrimitive handles between the primitives that draw the same geometry, i.e. the
+ * same range of the same vertex and index buffers. This allows RenderPass to recognize
+ * consecutive draws of the same geometry and to merge them into a single instanced draw.
+ */
+class RenderPrimitiveCache {
+public:
+    struct Geometry {
+        backend::Handle<backend::HwVertexBuffer> vertices;
+        backend::Handle<backend::HwIndexBuffer> indices;
+        uint32_t enabledAttributes = 0;
+        uint32_t offset = 0;
+        uint32_t minIndex = 0;
+        uint32_t maxIndex = 0;
+        uint32_t count = 0;
+        uint32_t type = uint32_t(backend::PrimitiveType::NONE);
+
+        bool operator==(Geometry const& rhs) const noexcept {
+            return vertices.getId() == rhs.vertices.getId() &&
+                   indices.getId() == rhs.indices.getId() &&
+                   enabledAttributes == rhs.enabledAttributes && offset == rhs.offset &&
+                   minIndex == rhs.minIndex && maxIndex == rhs.maxIndex &&
+                   count == rhs.count && type == rhs.type;
+        }
+    };
+
+    RenderPrimitiveCache() noexcept;
+    ~RenderPrimitiveCache() noexcept;
+
+    RenderPrimitiveCache(RenderPrimitiveCache const& rhs) = delete;
+    RenderPrimitiveCache& operator=(RenderPrimitiveCache const& rhs) = delete;
+
+    // Returns the handle drawing 'geometry', creating it if needed. Each call must be balanced
+    // by a call to release().
+    backend::Handle<backend::HwRenderPrimitive> acquire(
+            backend::DriverApi& driver, Geometry const& geometry) noexcept;
+
+    // Releases a handle returned by acquire(), the handle is destroyed when it's not used anymore.
+    void release(backend::DriverApi& driver, Geometry const& geometry) noexcept;
+
+    // number of distinct geometries currently alive
+    size_t size() const noexcept { return mEntries.size(); }
+
+private:
+    static_assert(sizeof(Geometry) == 32, "Geometry must not have padding, it's hashed as is");
+
+    struct Entry {
+        backend::Handle<backend::HwRenderPrimitive> handle;
+        uint32_t refs;
+    };
+
+    using HashFn = utils::hash::MurmurHashFn<Geometry>;
+    tsl::robin_map<Geometry, Entry, HashFn> mEntries;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_RENDERPRIMITIVECACHE_H
@@ -26,6 +26,9 @@
 #include "details/FrameSkipper.h"
 #include "details/SwapChain.h"
 
+#include "fg/FrameGraphCache.h"
+#include "fg/ResourceAllocator.h"
+
 #include "private/backend/DriverApiForward.h"
 
 #include <filament/Renderer.h>
@@ -118,6 +121,8 @@ private:
     size_t mCommandsHighWatermark = 0;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    ResourceAllocator mResourceAllocator;
+    FrameGraphCache mFrameGraphCache;
     bool mIsRGB16FSupported : 1;
     bool mIsRGB8Supported : 1;
     Epoch mUserEpoch;
@@ -23,22 +23,32 @@
 #include "components/TransformManager.h"
 
 #include "details/Culler.h"
+#include "details/CullingHierarchy.h"
 
 #include "Allocators.h"
 
 #include <filament/Box.h>
 #include <filament/Scene.h>
 
+#include <private/filament/EngineEnums.h>
+
 #include <utils/compiler.h>
 #include <utils/Entity.h>
+#include <utils/EntityManager.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <atomic>
 #include <cstddef>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
 namespace filament {
+
+class GPUBuffer;
+
 namespace details {
 
 struct CameraInfo;
@@ -48,7 +58,7 @@ class FRenderer;
 class FSkybox;
 
 
-class FScene : public Scene {
+class FScene : public Scene, private utils::EntityManager::Listener {
 public:
 
     /*
@@ -69,6 +79,9 @@ public:
     size_t getLightCount() const noexcept;
     bool hasEntity(utils::Entity entity) const noexcept;
 
+    void setCullingHierarchyEnabled(bool enabled) noexcept;
+    bool isCullingHierarchyEnabled() const noexcept { return mCullingHierarchyEnabled; }
+
 public:
     /*
      * Filaments-scope Public API
@@ -78,16 +91,57 @@ public:
     // for that in a few places.
     static constexpr size_t DIRECTIONAL_LIGHTS_COUNT = 1;
 
+    // values of the 'VISIBLE_MASK' after culling (0: not visible)
+    static constexpr size_t VISIBLE_RENDERABLE_BIT = 0u;
+    static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
+    static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
+    static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
+    static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
+
+    // the shadow casters visible in each cascade of the directional light's shadow map, the
+    // VISIBLE_SHADOW_CASTER bit is set if any of these bits is set.
+    static constexpr size_t VISIBLE_CASCADE_BIT = 2u;
+    static constexpr uint8_t VISIBLE_CASCADES =
+            ((1u << CONFIG_MAX_SHADOW_CASCADES) - 1u) << VISIBLE_CASCADE_BIT;
+    static constexpr uint8_t visibleCascade(size_t cascade) noexcept {
+        return uint8_t(1u << (VISIBLE_CASCADE_BIT + cascade));
+    }
+    static_assert(VISIBLE_CASCADE_BIT + CONFIG_MAX_SHADOW_CASCADES <= 6,
+            "the cascades' visibility bits don't fit in the VISIBLE_MASK");
+
+    // the shadow casters visible in any of the spot lights' shadow maps, the VISIBLE_SHADOW_CASTER
+    // bit is set if this bit is set.
+    static constexpr size_t VISIBLE_SPOT_SHADOWS_BIT = 6u;
+    static constexpr uint8_t VISIBLE_SPOT_SHADOWS = 1u << VISIBLE_SPOT_SHADOWS_BIT;
+
+    // the shadow casters visible in the spot light's shadow map being rendered, this bit is
+    // only valid while the commands of that shadow map are generated.
+    static constexpr size_t VISIBLE_SPOT_SHADOW_BIT = 7u;
+    static constexpr uint8_t VISIBLE_SPOT_SHADOW = 1u << VISIBLE_SPOT_SHADOW_BIT;
+
+    // all the bits selecting the shadow casters of a shadow map
+    static constexpr uint8_t VISIBLE_SHADOW_MAPS =
+            VISIBLE_CASCADES | VISIBLE_SPOT_SHADOWS | VISIBLE_SPOT_SHADOW;
+
     explicit FScene(FEngine& engine);
     ~FScene() noexcept;
     void terminate(FEngine& engine);
 
     void prepare(const math::mat4f& worldOriginTransform);
-    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept;
+    // lightsBuffer must be large enough for the visible lights, up to CONFIG_MAX_LIGHT_COUNT
+    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, GPUBuffer& lightsBuffer) noexcept;
 
 
+    // per-renderable uniforms, the uniforms of a renderable are at its UBO_INDEX, unless it's
+    // instanced (see InstanceGroupSoa below).
     filament::backend::Handle<backend::HwUniformBuffer> getRenderableUBO() const noexcept {
-        return mRenderableViewUbh;
+        return mRenderableUbh;
+    }
+
+    // returns the culling hierarchy matching getRenderableData(), or null if it's not enabled.
+    // This is only valid until the RenderableSoa is reordered (i.e. until after culling).
+    CullingHierarchy* getCullingHierarchy() noexcept {
+        return mCullingHierarchyEnabled ? &mCullingHierarchy : nullptr;
     }
 
     /*
@@ -99,6 +153,8 @@ public:
         WORLD_TRANSFORM,        // 16 instance of the Transform component
         VISIBILITY_STATE,       //  1 visibility data of the component
         BONES_UBH,              //  4 bones uniform buffer handle
+        UBO_INDEX,              //  4 index of the renderable's uniforms in getRenderableUBO()
+        INSTANCE_COUNT,         //  2 number of instances, 0 unless the renderable is instanced
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
@@ -116,6 +172,8 @@ public:
             math::mat4f,
             FRenderableManager::Visibility,
             backend::Handle<backend::HwUniformBuffer>,
+            uint32_t,
+            uint16_t,
             math::float3,
             Culler::result_type,
             uint8_t,
@@ -139,6 +197,41 @@ public:
         return soa.elementAt<SUMMED_PRIMITIVE_COUNT>(last);
     }
 
+    /*
+     * Instanced renderables are drawn and culled in groups of CONFIG_MAX_INSTANCES consecutive
+     * instances. The UBO_INDEX of an instanced renderable is the index of its first group, the
+     * uniforms of a group's instances start at getInstanceGroupSlot().
+     */
+
+    enum {
+        GROUP_WORLD_AABB_CENTER,    // world-space bounding box center of the group
+        GROUP_WORLD_AABB_EXTENT,    // world-space bounding box half-extent of the group
+        GROUP_INSTANCE_COUNT,       // number of instances from this group to the last one
+        GROUP_CULLING_MASK,         // all the bits if the renderable's culling is disabled
+        GROUP_VISIBLE_MASK,         // each bit represents a visibility in a pass
+    };
+
+    using InstanceGroupSoa = utils::StructureOfArrays<
+            math::float3,
+            math::float3,
+            uint16_t,
+            Culler::result_type,
+            Culler::result_type
+    >;
+
+    // the size of this SoA is a multiple of Culler::MODULO, the extra groups are unused
+    InstanceGroupSoa const& getInstanceGroupData() const noexcept { return mInstanceGroupData; }
+    InstanceGroupSoa& getInstanceGroupData() noexcept { return mInstanceGroupData; }
+
+    // index of the uniforms of the first instance of a group in getRenderableUBO()
+    size_t getInstanceGroupSlot(size_t group) const noexcept {
+        return mFirstInstanceSlot + group * CONFIG_MAX_INSTANCES;
+    }
+
+    // maximum number of slots in getRenderableUBO(), UBO_INDEX is stored on 23 bits in the
+    // render commands
+    static constexpr size_t MAX_UNIFORM_SLOT_COUNT = 1u << 23;
+
     /*
      * Storage for per-frame light data
      */
@@ -148,7 +241,8 @@ public:
         DIRECTION,
         LIGHT_INSTANCE,
         VISIBILITY,
-        SCREEN_SPACE_Z_RANGE
+        SCREEN_SPACE_Z_RANGE,
+        SHADOW_INDEX            // index + 1 of the spot light's shadow map, 0 if none
     };
 
     using LightSoa = utils::StructureOfArrays<
@@ -156,13 +250,15 @@ public:
             math::float3,
             FLightManager::Instance,
             Culler::result_type,
-            math::float2
+            math::float2,
+            uint8_t
     >;
 
     LightSoa const& getLightData() const noexcept { return mLightData; }
     LightSoa& getLightData() noexcept { return mLightData; }
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept;
+    // uploads the uniforms of the renderables that changed since the last call
+    void updateUBOs() noexcept;
 
 private:
     static inline void computeLightRanges(math::float2* zrange,
@@ -171,6 +267,40 @@ private:
     static inline void computeLightCameraPlaneDistances(float* distances,
             const CameraInfo& camera, const math::float4* spheres, size_t count) noexcept;
 
+    // transforms the local AABBs stored in center/extent by the given rigid transforms
+    static inline void computeWorldAABBs(math::float3* center, math::float3* extent,
+            const math::mat4f* transforms, size_t count) noexcept;
+
+    void sortEntities() noexcept;
+
+    // gathers the data of all the entities in the scene into the caches below, in parallel
+    void gather(math::mat4f const& worldOriginTransform) noexcept;
+
+    // updates the cached rows of the instances that changed since the last call,
+    // returns true if any renderable was updated.
+    bool update(math::mat4f const& worldOriginTransform) noexcept;
+
+    // the world AABB must be computed with computeWorldAABBs() afterwards
+    void gatherRenderable(size_t index, math::mat4f const& worldOriginTransform) noexcept;
+
+    // assigns the UBO_INDEX of all the renderables, and allocates their instance groups
+    void assignUniformSlots() noexcept;
+
+    // computes the world-space bounds of the instance groups of an instanced renderable
+    void updateInstanceGroups(size_t index) noexcept;
+
+    // writes the uniforms of a renderable (or of one of its instances) at 'offset' in 'buffer'
+    static void setRenderableUniforms(void* buffer, size_t offset,
+            math::mat4f const& model) noexcept;
+
+    void updateLight(size_t index, math::mat4f const& worldOriginTransform) noexcept;
+    void updateDirectionalLight(math::mat4f const& worldOriginTransform) noexcept;
+    bool hasDeadEntities() const noexcept;
+
+    // EntityManager::Listener
+    void onEntitiesDestroyed(size_t n, utils::Entity const* entities) noexcept override;
+    void onAllEntitiesDestroyed() noexcept override;
+
     FEngine& mEngine;
     FSkybox const* mSkybox = nullptr;
     FIndirectLight const* mIndirectLight = nullptr;
@@ -182,6 +312,72 @@ private:
      */
     tsl::robin_set<utils::Entity> mEntities;
 
+    /*
+     * When the culling hierarchy is enabled, the entities are gathered in a spatially coherent
+     * order, stored here. Renderables come first, in the order expected by mCullingHierarchy.
+     */
+    std::vector<utils::Entity> mSortedEntities;
+    CullingHierarchy mCullingHierarchy;
+    bool mCullingHierarchyEnabled = false;
+    bool mSortedEntitiesDirty = true;
+
+    /*
+     * The gathered renderable and light data is kept across frames, so that prepare() only needs
+     * to update the rows of the instances that changed, which are tracked by the component
+     * managers. Everything is gathered again when the set of entities or the world origin
+     * changes, or when component instances are created, destroyed or moved.
+     */
+    struct LightSource {
+        utils::Entity entity;
+        FLightManager::Instance li;
+        FTransformManager::Instance ti;
+    };
+    RenderableSoa mRenderableCache;
+    LightSoa mLightCache;
+    std::vector<FTransformManager::Instance> mRenderableTransforms; // one per mRenderableCache row
+    std::vector<uint8_t> mChangedRows;              // rows not copied to mRenderableData yet
+    bool mRenderableCacheGathered = true;           // all rows must be copied to mRenderableData
+    std::vector<LightSource> mLightSources;         // one per mLightCache row
+    std::vector<LightSource> mDirectionalLights;    // all directional lights in the scene
+    math::mat4f mWorldOriginTransform;
+    uint32_t mTransformVersion = 0;
+    uint32_t mRenderableVersion = 0;
+    uint32_t mLightVersion = 0;
+    uint32_t mTransformLayoutVersion = 0;
+    uint32_t mRenderableLayoutVersion = 0;
+    uint32_t mLightLayoutVersion = 0;
+    bool mEntitiesDirty = true;
+    std::atomic<bool> mEntitiesDestroyed = { false };
+
+    // number of entities processed by each job in gather()
+    static constexpr size_t GATHER_CHUNK_SIZE = 256;
+    struct ChunkSize {
+        uint32_t renderables;
+        uint32_t lights;
+    };
+    std::vector<ChunkSize> mChunkSizes;     // temporary storage for gather()
+    std::vector<utils::Entity> mEntityList; // temporary storage for gather()
+
+    /*
+     * The per-renderable uniforms are kept in a persistent UBO, in the order of mRenderableCache.
+     * Only the uniforms of the renderables that changed are recomputed and uploaded.
+     *
+     * Instanced renderables use one slot per instance. They come after all the other
+     * renderables, and each of them starts on a multiple of CONFIG_MAX_INSTANCES slots, so that
+     * each group of instances is bound with a single range of the UBO.
+     */
+    backend::Handle<backend::HwUniformBuffer> mRenderableUbh;
+    size_t mRenderableUboCount = 0;             // number of slots mRenderableUbh can hold
+    size_t mUniformSlotCount = 0;               // number of slots used
+    size_t mFirstInstanceSlot = 0;              // slot of the first instance group
+    static constexpr size_t MAX_UNIFORM_SLOTS_PER_UPLOAD = 1024;
+    // a flush always leaves at least CONFIG_MIN_COMMAND_BUFFERS_SIZE free in the command stream,
+    // half of it is used for the uniforms, the rest for the commands recorded before them
+    static constexpr size_t MAX_UNIFORM_UPLOAD_SIZE_PER_FLUSH = CONFIG_MIN_COMMAND_BUFFERS_SIZE / 2;
+    InstanceGroupSoa mInstanceGroupData;
+    std::vector<uint8_t> mDirtyUniforms;        // one per mRenderableCache row
+    bool mHasDirtyUniforms = false;
+
 
     /*
      * The data below is valid only during a view pass. i.e. if a scene is used in multiple
@@ -191,7 +387,6 @@ private:
      */
     RenderableSoa mRenderableData;
     LightSoa mLightData;
-    backend::Handle<backend::HwUniformBuffer> mRenderableViewUbh; // This is actually owned by the view.
 };
 
 FILAMENT_UPCAST(Scene)
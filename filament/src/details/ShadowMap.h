@@ -22,8 +22,7 @@
 #include "details/Camera.h"
 #include "details/Scene.h"
 
-#include "private/backend/DriverApiForward.h"
-#include "private/backend/SamplerGroup.h"
+#include <backend/DriverEnums.h>
 
 #include <filament/Viewport.h>
 
@@ -33,44 +32,54 @@
 namespace filament {
 namespace details {
 
-class FView;
-class RenderPass;
-
+/*
+ * Computes the light's camera of one shadow map, e.g. one cascade of the directional light or
+ * a spot light. The shadow map is rendered in a tile of the shadow atlas owned by
+ * ShadowMapManager.
+ */
 class ShadowMap {
 public:
     explicit ShadowMap(FEngine& engine) noexcept;
     ~ShadowMap();
 
-    void terminate(backend::DriverApi& driverApi) noexcept;
+    // Sets where this shadow map is rendered in the shadow atlas: a 'dimension' x 'dimension'
+    // tile (including its 1-texel border) at (x, y), in an atlas of width x height texels.
+    // Must be called before update().
+    void setAtlasTile(uint32_t x, uint32_t y, uint32_t dimension,
+            uint32_t width, uint32_t height, backend::TextureFormat format) noexcept;
 
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera. The shadow map of a directional light covers the part
+    // of the camera's frustum between the distances zNear and zFar from the camera, the shadow
+    // map of a spot light covers the light's cone.
     void update(const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
-
-    void render(backend::DriverApi& driver, RenderPass& pass, FView& view) noexcept;
+            details::CameraInfo const& camera, uint8_t visibleLayers,
+            float zNear, float zFar) noexcept;
 
     // Do we have visible shadows. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
-    // Allocates shadow texture based on user parameters (e.g. dimensions)
-    void prepare(backend::DriverApi& driver, backend::SamplerGroup& buffer) noexcept;
-
-    // Returns the shadow map's viewport. Valid after prepare().
+    // Returns the shadow map's viewport in the atlas. Valid after setAtlasTile().
     Viewport const& getViewport() const noexcept { return mViewport; }
 
-    backend::Handle<backend::HwRenderTarget> getRenderTarget() const { return mShadowMapRenderTarget; }
+    // Returns the bounds of this shadow map's tile in the atlas, in texture coordinates and
+    // inset to the center of the border texels: { umin, vmin, umax, vmax }.
+    // Valid after setAtlasTile().
+    math::float4 const& getTextureCoordsBounds() const noexcept { return mTextureCoordsBounds; }
 
     // Computes the transform to use in the shader to access the shadow map.
     // Valid after calling update().
     math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
 
-    // return the size of a texel in world space (pre-warping)
+    // return the size of a texel in world space (pre-warping), for spot lights this is the size
+    // of a texel at 1 world unit from the light.
     float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
 
     // Returns the light's projection. Valid after calling update().
     FCamera const& getCamera() const noexcept { return *mCamera; }
 
+    backend::PolygonOffset const& getPolygonOffset() const noexcept { return mPolygonOffset; }
+
     // use only for debugging
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
 
@@ -107,6 +116,10 @@ private:
             CameraInfo const& camera, FLightManager::ShadowParams const& params,
             uint8_t visibleLayers) noexcept;
 
+    void computeShadowCameraSpot(math::float4 const& sphere, math::float3 const& direction,
+            CameraInfo const& camera, FLightManager::SpotParams const& spot,
+            FLightManager::ShadowParams const& params) noexcept;
+
     static math::mat4f applyLISPSM(math::mat4f& Wp,
             CameraInfo const& camera, FLightManager::ShadowParams const& params,
             const math::mat4f& LMpMv,
@@ -168,12 +181,11 @@ private:
     static math::mat4f directionalLightFrustum(float n, float f) noexcept;
 
     math::mat4f getTextureCoordsMapping() const noexcept;
+    math::mat4f getAtlasMapping() const noexcept;
 
     float texelSizeWorldSpace(const math::mat3f& worldToShadowTexture) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& W, const math::mat4f& MbMtF) const noexcept;
 
-    void fillWithDebugPattern(backend::DriverApi& driverApi) const noexcept;
-
     static constexpr const Segment sBoxSegments[12] = {
             { 0, 1 }, { 1, 3 }, { 3, 2 }, { 2, 0 },
             { 4, 5 }, { 5, 7 }, { 7, 6 }, { 6, 4 },
@@ -193,14 +205,15 @@ private:
     math::mat4f mLightSpace;
     float mTexelSizeWs = 0.0f;
 
-    // set-up in prepare()
+    // set-up in setAtlasTile()
     Viewport mViewport;
-    backend::Handle<backend::HwTexture> mShadowMapHandle;
-    backend::Handle<backend::HwRenderTarget> mShadowMapRenderTarget;
-
-    // set-up in update()
+    math::uint2 mAtlasTile = {};                // tile's origin in the atlas
+    math::uint2 mAtlasDimension = {};
+    math::float4 mTextureCoordsBounds = {};
     uint32_t mShadowMapDimension = 0;
     math::float3 mShadowMapResolution = {};     // 1 / effective resolution
+
+    // set-up in update()
     bool mHasVisibleShadows = false;
     backend::PolygonOffset mPolygonOffset{};
 
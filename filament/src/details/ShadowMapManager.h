@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
+#define TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
+
+#include "details/Camera.h"
+#include "details/Scene.h"
+#include "details/ShadowMap.h"
+
+#include "private/backend/DriverApiForward.h"
+#include "private/backend/SamplerGroup.h"
+
+#include <private/filament/EngineEnums.h>
+
+#include <filament/View.h>
+#include <filament/Viewport.h>
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <math/vec2.h>
+#include <math/vec4.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Range.h>
+
+#include <array>
+#include <memory>
+
+namespace filament {
+
+class FrameGraph;
+class UniformBuffer;
+
+namespace details {
+
+class FEngine;
+class FView;
+class RenderPass;
+
+/*
+ * Manages the shadow maps of a view: the cascaded shadow maps of the directional light and the
+ * shadow maps of the spot lights.
+ *
+ * The view frustum is split in up to CONFIG_MAX_SHADOW_CASCADES slices along the view
+ * direction, each covered by its own ShadowMap. Up to CONFIG_MAX_SHADOWED_SPOT_LIGHTS spot
+ * lights get a ShadowMap sized from their projected size on screen. All the shadow maps are
+ * rendered in the square power-of-two tiles of a single depth texture (the shadow atlas) by a
+ * single FrameGraph pass.
+ *
+ * The atlas is owned by the manager and outlives the FrameGraph, so when the light's shadow
+ * caching is enabled and none of the inputs of the shadow pass changed since the last frame,
+ * the shadow pass is skipped and the atlas is sampled as is.
+ */
+class ShadowMapManager {
+public:
+    explicit ShadowMapManager(FEngine& engine) noexcept;
+    ~ShadowMapManager();
+
+    ShadowMapManager(ShadowMapManager const& rhs) = delete;
+    ShadowMapManager& operator=(ShadowMapManager const& rhs) = delete;
+
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // Computes the cascades' light cameras of the directional light (always at index 0) and
+    // the light cameras of the shadow casting spot lights, and lays out the shadow atlas.
+    // This sets the SHADOW_INDEX of the spot lights, the visible lights must be known.
+    // Returns whether any shadow map has visible shadows.
+    bool update(FScene::LightSoa& lightData, FScene const* scene,
+            details::CameraInfo const& camera, uint8_t visibleLayers,
+            filament::Viewport const& viewport, View::ShadowAtlasOptions const& options) noexcept;
+
+    // Allocates the shadow atlas if needed and sets the shadow uniforms and sampler.
+    // Call after update() when there are visible shadows.
+    void prepare(backend::DriverApi& driver, UniformBuffer& u, backend::SamplerGroup& sb) noexcept;
+
+    // Generates the commands of all the cascades and adds the shadow pass to the FrameGraph.
+    void render(FrameGraph& fg, FEngine& engine, RenderPass& pass, FView& view) noexcept;
+
+    // Returns whether the atlas rendered by a previous frame has the content the shadow pass
+    // would render this frame, in which case the shadow pass can be skipped. Otherwise the inputs
+    // of this frame are remembered for the next one. Valid after calling update().
+    bool checkShadowCache(FEngine& engine, FScene::RenderableSoa const& renderableData,
+            utils::Range<uint32_t> const& visibleRenderables) noexcept;
+
+    // Do we have visible shadows. Valid after calling update().
+    bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
+
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    ShadowMap const& getCascade(size_t cascade) const noexcept {
+        assert(cascade < mCascadeCount);
+        return *mCascades[cascade];
+    }
+
+    size_t getSpotShadowCount() const noexcept { return mSpotShadowCount; }
+
+    ShadowMap const& getSpotShadow(size_t shadow) const noexcept {
+        assert(shadow < mSpotShadowCount);
+        return *mSpotShadows[shadow];
+    }
+
+    // Returns the size of the shadow atlas. Valid after calling update().
+    math::uint2 getAtlasSize() const noexcept { return { mAtlasWidth, mAtlasHeight }; }
+
+    // Packs square power-of-two tiles, sorted by decreasing size, in the smallest power-of-two
+    // square atlas that fits them, or in its bottom half. The position of each tile is written
+    // in positions, and the size of the atlas is returned.
+    static math::uint2 packAtlas(uint32_t const* dimensions, size_t count,
+            math::uint2* positions) noexcept;
+
+    // use only for debugging
+    FCamera const& getDebugCamera() const noexcept { return mCascades[0]->getDebugCamera(); }
+
+private:
+    static constexpr backend::TextureFormat SHADOW_MAP_FORMAT = backend::TextureFormat::DEPTH16;
+
+    static details::CameraInfo getCameraInfo(FCamera const& camera) noexcept;
+
+    // lays out the shadow maps in the atlas, returns false if there are none
+    bool layoutAtlas(View::ShadowAtlasOptions const& options) noexcept;
+
+    // sets the VISIBLE_SPOT_SHADOW bit of the shadow casters visible in a spot light's frustum
+    static void cullSpotShadowCasters(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> const& casters,
+            Frustum const& frustum) noexcept;
+
+    void fillWithDebugPattern(backend::DriverApi& driverApi) const noexcept;
+
+    // Hashes everything the content of the atlas depends on. Returns false if the atlas can't
+    // be cached, e.g. if a shadow caster is skinned.
+    bool hashShadowInputs(FEngine& engine, FScene::RenderableSoa const& renderableData,
+            utils::Range<uint32_t> const& visibleRenderables, uint64_t* hash) const noexcept;
+
+    FEngine& mEngine;
+
+    std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASCADES> mCascades;
+    std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOWED_SPOT_LIGHTS> mSpotShadows;
+
+    // the far plane of each cascade, i.e. the near plane of the next one (set by update())
+    math::float4 mCascadeSplits{};
+    size_t mCascadeCount = 0;
+    float mCascadeNormalBias = 0.0f;
+    bool mHasVisibleShadows = false;
+
+    // the spot lights' shadow maps, by decreasing size on screen (set by update())
+    struct SpotShadow {
+        uint32_t light;         // index of the light in the LightSoa
+        uint32_t dimension;     // size of the tile in the atlas
+        float normalBias;
+    };
+    std::array<SpotShadow, CONFIG_MAX_SHADOWED_SPOT_LIGHTS> mSpotShadowInfos{};
+    size_t mSpotShadowCount = 0;
+
+    // the size of the tiles of the cascades and the size of the shadow atlas needed by all
+    // the shadow maps (set by update())
+    uint32_t mCascadeDimension = 0;
+    uint32_t mAtlasWidth = 0;
+    uint32_t mAtlasHeight = 0;
+
+    // the shadow atlas and its size (allocated by prepare())
+    backend::Handle<backend::HwTexture> mShadowMapHandle;
+    backend::Handle<backend::HwRenderTarget> mShadowMapRenderTarget;
+    uint32_t mShadowMapWidth = 0;
+    uint32_t mShadowMapHeight = 0;
+
+    // shadow caching state, the hash identifies the content of the atlas
+    bool mShadowCaching = false;
+    bool mHasShadowCache = false;
+    uint64_t mShadowCacheHash = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
@@ -26,7 +26,8 @@
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
-#include "details/ShadowMap.h"
+#include "details/OcclusionCuller.h"
+#include "details/ShadowMapManager.h"
 #include "details/Scene.h"
 
 #include "private/backend/DriverApi.h"
@@ -100,6 +101,12 @@ public:
     void setFrustumCullingEnabled(bool culling) noexcept { mCulling = culling; }
     bool isFrustumCullingEnabled() const noexcept { return mCulling; }
 
+    void setOcclusionCullingEnabled(bool enabled) noexcept { mOcclusionCulling = enabled; }
+    bool isOcclusionCullingEnabled() const noexcept { return mOcclusionCulling; }
+
+    void setLodBias(float bias) noexcept { mLodBias = bias; }
+    float getLodBias() const noexcept { return mLodBias; }
+
     void setFrontFaceWindingInverted(bool inverted) noexcept { mFrontFaceWindingInverted = inverted; }
     bool isFrontFaceWindingInverted() const noexcept { return mFrontFaceWindingInverted; }
 
@@ -120,7 +127,8 @@ public:
 
     void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
     void prepareShadowing(FEngine& engine, backend::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+            filament::Viewport const& viewport) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
     void froxelize(FEngine& engine) const noexcept;
@@ -129,7 +137,7 @@ public:
 
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
-    bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasShadowing() const noexcept { return mHasShadowing & mShadowMapManager.hasVisibleShadows(); }
 
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
@@ -137,11 +145,17 @@ public:
 
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
-    ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
-    ShadowMap& getShadowMap() { return mDirectionalShadowMap; }
+    void setShadowAtlasOptions(ShadowAtlasOptions const& options) noexcept;
+
+    ShadowAtlasOptions getShadowAtlasOptions() const noexcept {
+        return mShadowAtlasOptions;
+    }
+
+    ShadowMapManager const& getShadowMapManager() const { return mShadowMapManager; }
+    ShadowMapManager& getShadowMapManager() { return mShadowMapManager; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
-        return &mDirectionalShadowMap.getDebugCamera();
+        return &mShadowMapManager.getDebugCamera();
     }
 
     void setRenderTarget(TargetBufferFlags discard) noexcept {
@@ -249,15 +263,33 @@ private:
     void prepareVisibleRenderables(utils::JobSystem& js,
             Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept;
 
+    void cullOccludedRenderables(FEngine& engine, utils::JobSystem& js,
+            math::mat4f const& clipFromWorld, FScene::RenderableSoa& renderableData) noexcept;
+
     static void prepareVisibleShadowCasters(utils::JobSystem& js,
-            Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept;
+            ShadowMapManager const& shadowMapManager, FScene::RenderableSoa& renderableData,
+            FScene::InstanceGroupSoa& instanceGroupData, CullingHierarchy* hierarchy) noexcept;
 
     static void prepareVisibleLights(
             FLightManager const& lcm, utils::JobSystem& js, Frustum const& frustum,
             FScene::LightSoa& lightData) noexcept;
 
     static void cullRenderables(utils::JobSystem& js,
-            FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept;
+            FScene::RenderableSoa& renderableData, CullingHierarchy* hierarchy,
+            Frustum const& frustum, size_t bit) noexcept;
+
+    // culls the renderables against several frusta at once, setting bits[i] for frusta[i]
+    static void cullRenderables(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData, CullingHierarchy* hierarchy,
+            Frustum const* frusta, uint8_t const* bits, size_t count) noexcept;
+
+    static void cullInstanceGroups(FScene::InstanceGroupSoa& instanceGroupData,
+            Frustum const& frustum, size_t bit) noexcept;
+
+    static void computeScreenCoverage(float* coverage,
+            math::float3 const* center, math::float3 const* extent,
+            math::float3 const& eye, math::float4 const& wFromWorld, float scale,
+            size_t count) noexcept;
 
     void computeVisibilityMasks(
             uint8_t visibleLayers, uint8_t const* layers,
@@ -266,7 +298,6 @@ private:
 
     void bindPerViewUniformsAndSamplers(FEngine::DriverApi& driver) const noexcept {
         driver.bindUniformBuffer(BindingPoints::PER_VIEW, mPerViewUbh);
-        driver.bindUniformBuffer(BindingPoints::LIGHTS, mLightUbh);
         driver.bindSamplers(BindingPoints::PER_VIEW, mPerViewSbh);
     }
 
@@ -278,12 +309,9 @@ private:
     // these are accessed in the render loop, keep together
     backend::Handle<backend::HwSamplerGroup> mPerViewSbh;
     backend::Handle<backend::HwUniformBuffer> mPerViewUbh;
-    backend::Handle<backend::HwUniformBuffer> mLightUbh;
-    backend::Handle<backend::HwUniformBuffer> mRenderableUbh;
 
     backend::Handle<backend::HwSamplerGroup> getUsh() const noexcept { return mPerViewSbh; }
     backend::Handle<backend::HwUniformBuffer> getUbh() const noexcept { return mPerViewUbh; }
-    backend::Handle<backend::HwUniformBuffer> getLightUbh() const noexcept { return mLightUbh; }
 
     FScene* mScene = nullptr;
     FCamera* mCullingCamera = nullptr;
@@ -293,10 +321,13 @@ private:
     Frustum mCullingFrustum;
 
     mutable Froxelizer mFroxelizer;
+    GPUBuffer mLightsBuffer;    // data of the point and spot lights, sized to the visible lights
 
     Viewport mViewport;
     LinearColorA mClearColor;
     bool mCulling = true;
+    bool mOcclusionCulling = false;
+    float mLodBias = 0.0f;
     bool mFrontFaceWindingInverted = false;
     bool mClearTargetColor = true;
     bool mClearTargetDepth = true;
@@ -321,6 +352,13 @@ private:
     bool mIsDynamicResolutionSupported = false;
 
     RenderQuality mRenderQuality;
+    ShadowAtlasOptions mShadowAtlasOptions;
+
+    OcclusionCuller mOcclusionCuller;
+    std::vector<uint32_t> mOccluders;   // scratch lists of indices in the RenderableSoa
+    std::vector<uint32_t> mOccludees;
+
+    std::vector<float> mScreenCoverage; // scratch screen coverage of the visible renderables
 
     mutable UniformBuffer mPerViewUb;
     mutable backend::SamplerGroup mPerViewSb;
@@ -330,11 +368,10 @@ private:
     // the following values are set by prepare()
     Range mVisibleRenderables;
     Range mVisibleShadowCasters;
-    uint32_t mRenderableUBOSize = 0;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
-    mutable ShadowMap mDirectionalShadowMap;
+    mutable ShadowMapManager mShadowMapManager;
 };
 
 FILAMENT_UPCAST(View)
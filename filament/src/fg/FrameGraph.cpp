@@ -16,14 +16,17 @@
 
 #include "FrameGraph.h"
 
+#include "FrameGraphCache.h"
 #include "FrameGraphPassResources.h"
 #include "FrameGraphResource.h"
+#include "ResourceAllocator.h"
 
 #include "private/backend/CommandStream.h"
 
 #include <backend/DriverEnums.h>
 #include <backend/Handle.h>
 
+#include <utils/Hash.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
@@ -71,6 +74,14 @@ struct Resource final : public VirtualResource { // 72
     void create(FrameGraph& fg, DriverApi& driver) noexcept override;
     void destroy(FrameGraph& fg, DriverApi& driver) noexcept override;
 
+    // the usage and sample count of the concrete texture
+    TextureUsage getEffectiveUsage() const noexcept {
+        return needsTexture ? usage | TextureUsage::SAMPLEABLE : usage;
+    }
+    uint8_t getEffectiveSamples() const noexcept {
+        return needsTexture ? uint8_t(1) : desc.samples; // sampleable textures can't be multi-sampled
+    }
+
     // constants
     const char* const name;
     const uint16_t id;            // for debugging and graphing
@@ -163,18 +174,17 @@ struct RenderTargetResource final : public VirtualResource {  // 104
                     }
                 }
 
-                // create the concrete rendertarget
-                targetInfo.target = driver.createRenderTarget(attachments,
-                        width, height, desc.samples,
-                        { textures[0] }, { textures[1] }, {});
+                // create the concrete rendertarget, or reuse the one from a previous frame
+                targetInfo.target = fg.getResourceAllocator().createRenderTarget(driver,
+                        attachments, width, height, desc.samples, textures[0], textures[1]);
             }
         }
     }
 
-    void destroy(FrameGraph&, DriverApi& driver) noexcept override {
+    void destroy(FrameGraph& fg, DriverApi&) noexcept override {
         if (!imported) {
             if (targetInfo.target) {
-                driver.destroyRenderTarget(targetInfo.target);
+                fg.getResourceAllocator().destroyRenderTarget(targetInfo.target);
                 targetInfo.target.clear();
             }
         }
@@ -425,28 +435,23 @@ Resource::~Resource() noexcept {
     }
 }
 
-void Resource::create(FrameGraph&, DriverApi& driver) noexcept {
+void Resource::create(FrameGraph& fg, DriverApi& driver) noexcept {
     // some sanity check
     if (!imported) {
         assert(usage);
-        // (it means it's only used as an attachment for a rendertarget)
-        uint8_t samples = desc.samples;
-        auto effectiveUsage = usage;
-        if (needsTexture) {
-            effectiveUsage |= TextureUsage::SAMPLEABLE;
-            samples = 1; // sampleable textures can't be multi-sampled
-        }
         // FIXME: set the proper sampler count
-        texture = driver.createTexture(desc.type, desc.levels, desc.format, samples,
-                desc.width, desc.height, desc.depth, effectiveUsage);
+        texture = fg.getResourceAllocator().createTexture(driver,
+                desc.type, desc.levels, desc.format, getEffectiveSamples(),
+                desc.width, desc.height, desc.depth, getEffectiveUsage());
     }
 }
 
-void Resource::destroy(FrameGraph&, DriverApi& driver) noexcept {
+void Resource::destroy(FrameGraph& fg, DriverApi&) noexcept {
     // we don't own the handles of imported resources
     if (!imported) {
         if (texture) {
-            driver.destroyTexture(texture);
+            // the texture goes back to the pool, where it can be used by the following passes
+            fg.getResourceAllocator().destroyTexture(texture);
             texture.clear(); // needed because of noop driver
         }
     }
@@ -648,8 +653,10 @@ FrameGraphResource::Descriptor const& FrameGraphPassResources::getDescriptor(
 
 // ------------------------------------------------------------------------------------------------
 
-FrameGraph::FrameGraph()
-        : mArena("FrameGraph Arena", 16384), // TODO: the Area will eventually come from outside
+FrameGraph::FrameGraph(ResourceAllocator& resourceAllocator, FrameGraphCache* cache)
+        : mResourceAllocator(resourceAllocator),
+          mCache(cache),
+          mArena("FrameGraph Arena", 16384), // TODO: the Area will eventually come from outside
           mPassNodes(mArena),
           mResourceNodes(mArena),
           mRenderTargets(mArena),
@@ -863,8 +870,6 @@ TargetBufferFlags FrameGraph::computeDiscardFlags(DiscardPhase phase,
 FrameGraph& FrameGraph::compile() noexcept {
     Vector<fg::PassNode>& passNodes = mPassNodes;
     Vector<fg::ResourceNode>& resourceNodes = mResourceNodes;
-    Vector<UniquePtr<fg::Resource>>& resourceRegistry = mResourceRegistry;
-    Vector<UniquePtr<RenderTargetResource>>& renderTargetCache = mRenderTargetCache;
 
     /*
      * remap aliased resources
@@ -931,6 +936,21 @@ FrameGraph& FrameGraph::compile() noexcept {
         }
     }
 
+    /*
+     * reuse the result of a previous identical graph
+     */
+
+    Vector<uint32_t> key(mArena);
+    uint64_t hash = 0;
+    if (mCache) {
+        hash = computeCacheKey(key);
+        FrameGraphCache::CompiledGraph const* graph = mCache->find(hash, key.data(), key.size());
+        if (graph) {
+            replayCompiledGraph(*graph);
+            return *this;
+        }
+    }
+
     /*
      * compute passes and resource reference counts
      */
@@ -1047,8 +1067,23 @@ FrameGraph& FrameGraph::compile() noexcept {
         }
     }
 
+    scheduleResources();
+
+    computeTransientMemorySize();
+
+    if (mCache) {
+        std::unique_ptr<FrameGraphCache::CompiledGraph> graph = recordCompiledGraph();
+        graph->key.assign(key.begin(), key.end());
+        graph->hash = hash;
+        mCache->insert(std::move(graph));
+    }
+
+    return *this;
+}
+
+void FrameGraph::scheduleResources() noexcept {
     // add resource to de-virtualize or destroy to the corresponding list for each active pass
-    for (UniquePtr<fg::Resource> const& resource : resourceRegistry) {
+    for (UniquePtr<fg::Resource> const& resource : mResourceRegistry) {
         if (resource->refs) {
             assert(!resource->first == !resource->last);
             if (resource->first && resource->last) {
@@ -1059,15 +1094,250 @@ FrameGraph& FrameGraph::compile() noexcept {
     }
 
     // *THEN* add the virtual rendertargets
-    for (UniquePtr<RenderTargetResource> const& entry : renderTargetCache) {
+    for (UniquePtr<RenderTargetResource> const& entry : mRenderTargetCache) {
         assert(!entry->first == !entry->last);
         if (entry->first && entry->last) {
             entry->first->devirtualize.push_back(entry.get());
             entry->last->destroy.push_back(entry.get());
         }
     }
+}
 
-    return *this;
+uint64_t FrameGraph::computeCacheKey(Vector<uint32_t>& key) const noexcept {
+    // The key is computed after the aliases are remapped, it describes the passes, resources
+    // and render targets as declared, before any of them is culled or resolved. The handles of
+    // imported resources aren't part of it, they're only used by execute().
+    auto add = [&key](std::initializer_list<uint32_t> values) {
+        key.insert(key.end(), values.begin(), values.end());
+    };
+    auto addViewport = [&add](filament::Viewport const& viewport) {
+        add({ uint32_t(viewport.left), uint32_t(viewport.bottom),
+              viewport.width, viewport.height });
+    };
+    auto addAttachments = [&add](FrameGraphRenderTarget::Descriptor const& desc) {
+        for (FrameGraphResource const& attachment : desc.attachments.textures) {
+            add({ attachment.index });
+        }
+        add({ desc.samples });
+    };
+
+    add({ uint32_t(mPassNodes.size()), uint32_t(mResourceNodes.size()),
+          uint32_t(mResourceRegistry.size()), uint32_t(mRenderTargets.size()),
+          uint32_t(mRenderTargetCache.size()) });
+
+    for (PassNode const& pass : mPassNodes) {
+        add({ pass.hasSideEffect, uint32_t(pass.reads.size()) });
+        for (FrameGraphResource resource : pass.reads) {
+            add({ resource.index });
+        }
+        add({ uint32_t(pass.writes.size()) });
+        for (FrameGraphResource resource : pass.writes) {
+            add({ resource.index });
+        }
+        add({ uint32_t(pass.renderTargets.size()) });
+        for (RenderTarget const* pRenderTarget : pass.renderTargets) {
+            add({ pRenderTarget->index });
+        }
+    }
+
+    for (ResourceNode const& node : mResourceNodes) {
+        add({ node.resource->id, node.version });
+    }
+
+    for (UniquePtr<fg::Resource> const& resource : mResourceRegistry) {
+        FrameGraphResource::Descriptor const& desc = resource->desc;
+        add({ resource->imported, resource->needsTexture, uint32_t(resource->usage),
+              desc.width, desc.height, desc.depth, desc.levels, desc.samples,
+              uint32_t(desc.type), uint32_t(desc.format), desc.relaxed });
+    }
+
+    for (RenderTarget const& renderTarget : mRenderTargets) {
+        addAttachments(renderTarget.desc);
+        addViewport(renderTarget.desc.viewport);
+        add({ uint32_t(renderTarget.userClearFlags) });
+    }
+
+    // at this point, the cache only has the imported render targets
+    for (UniquePtr<RenderTargetResource> const& entry : mRenderTargetCache) {
+        addAttachments(entry->desc);
+        addViewport(entry->desc.viewport);
+        add({ entry->width, entry->height, uint32_t(entry->attachments),
+              uint32_t(entry->discardStart), uint32_t(entry->discardEnd) });
+    }
+
+    return hash::murmur3x2(key.data(), key.size());
+}
+
+std::unique_ptr<FrameGraphCache::CompiledGraph> FrameGraph::recordCompiledGraph() const noexcept {
+    using CompiledGraph = FrameGraphCache::CompiledGraph;
+    std::unique_ptr<CompiledGraph> graph(new CompiledGraph);
+
+    PassNode const* const passes = mPassNodes.data();
+    auto passIndex = [passes](PassNode const* pass) {
+        return pass ? uint32_t(pass - passes) : FrameGraphCache::NONE;
+    };
+    auto cacheIndex = [this](RenderTargetResource const* entry) {
+        auto pos = std::find_if(mRenderTargetCache.begin(), mRenderTargetCache.end(),
+                [entry](auto const& cur) { return cur.get() == entry; });
+        return pos != mRenderTargetCache.end() ?
+                uint32_t(pos - mRenderTargetCache.begin()) : FrameGraphCache::NONE;
+    };
+
+    graph->passRefCounts.reserve(mPassNodes.size());
+    for (PassNode const& pass : mPassNodes) {
+        graph->passRefCounts.push_back(pass.refCount);
+    }
+
+    graph->resources.reserve(mResourceRegistry.size());
+    for (UniquePtr<fg::Resource> const& resource : mResourceRegistry) {
+        graph->resources.push_back({ resource->refs,
+                resource->desc.width, resource->desc.height,
+                passIndex(resource->first), passIndex(resource->last) });
+    }
+
+    graph->renderTargets.reserve(mRenderTargets.size());
+    for (RenderTarget const& renderTarget : mRenderTargets) {
+        graph->renderTargets.push_back({
+                renderTarget.cache ? cacheIndex(renderTarget.cache) : FrameGraphCache::NONE,
+                renderTarget.targetFlags });
+    }
+
+    // The entries following the imported ones were created by resolve(), in the order the
+    // render targets were resolved.
+    size_t created = 0;
+    const size_t importedCount = mRenderTargetCache.size() - std::count_if(
+            mRenderTargetCache.begin(), mRenderTargetCache.end(),
+            [](auto const& entry) { return !entry->imported; });
+    for (PassNode const& pass : mPassNodes) {
+        for (RenderTarget const* pRenderTarget : pass.renderTargets) {
+            const uint32_t index = graph->renderTargets[pRenderTarget->index].cacheIndex;
+            if (index != FrameGraphCache::NONE && index == importedCount + created) {
+                RenderTargetResource const& entry = *mRenderTargetCache[index];
+                graph->renderTargetCacheEntries.push_back({ pRenderTarget->index,
+                        entry.attachments, entry.width, entry.height, entry.format });
+                created++;
+            }
+        }
+    }
+    assert(importedCount + created == mRenderTargetCache.size());
+
+    for (UniquePtr<RenderTargetResource> const& entry : mRenderTargetCache) {
+        graph->renderTargetCacheFirst.push_back(passIndex(entry->first));
+        graph->renderTargetCacheLast.push_back(passIndex(entry->last));
+    }
+
+    graph->transientMemorySize = mTransientMemorySize;
+    graph->aliasedTransientMemorySize = mAliasedTransientMemorySize;
+    return graph;
+}
+
+void FrameGraph::replayCompiledGraph(FrameGraphCache::CompiledGraph const& graph) noexcept {
+    Vector<fg::PassNode>& passNodes = mPassNodes;
+    auto pass = [&passNodes](uint32_t index) {
+        return index != FrameGraphCache::NONE ? &passNodes[index] : nullptr;
+    };
+
+    for (size_t i = 0, c = passNodes.size(); i < c; i++) {
+        passNodes[i].refCount = graph.passRefCounts[i];
+    }
+
+    for (size_t i = 0, c = mResourceRegistry.size(); i < c; i++) {
+        auto const& record = graph.resources[i];
+        Resource& resource = *mResourceRegistry[i];
+        resource.refs = record.refs;
+        resource.desc.width = record.width;
+        resource.desc.height = record.height;
+        resource.first = pass(record.first);
+        resource.last = pass(record.last);
+    }
+
+    for (auto const& record : graph.renderTargetCacheEntries) {
+        RenderTargetResource* pRenderTargetResource = mArena.make<RenderTargetResource>(
+                mRenderTargets[record.renderTarget].desc, false,
+                record.attachments, record.width, record.height, record.format);
+        mRenderTargetCache.emplace_back(pRenderTargetResource, *this);
+    }
+
+    for (size_t i = 0, c = mRenderTargetCache.size(); i < c; i++) {
+        mRenderTargetCache[i]->first = pass(graph.renderTargetCacheFirst[i]);
+        mRenderTargetCache[i]->last = pass(graph.renderTargetCacheLast[i]);
+    }
+
+    for (size_t i = 0, c = mRenderTargets.size(); i < c; i++) {
+        auto const& record = graph.renderTargets[i];
+        RenderTarget& renderTarget = mRenderTargets[i];
+        if (record.cacheIndex != FrameGraphCache::NONE) {
+            renderTarget.cache = mRenderTargetCache[record.cacheIndex].get();
+            renderTarget.cache->targetInfo.params.flags.clear |= renderTarget.userClearFlags;
+        }
+        renderTarget.targetFlags = record.targetFlags;
+    }
+
+    scheduleResources();
+
+    mTransientMemorySize = graph.transientMemorySize;
+    mAliasedTransientMemorySize = graph.aliasedTransientMemorySize;
+}
+
+void FrameGraph::computeTransientMemorySize() noexcept {
+    // This replays the allocations execute() will make: textures are created before their first
+    // pass and returned to the pool after their last one, where they can be used by a
+    // later texture with the same parameters.
+    struct Slot {
+        Resource const* resource;   // texture parameters
+        size_t size;
+        bool free;
+    };
+    Vector<Slot> slots(mArena);
+
+    auto compatible = [](Resource const& lhs, Resource const& rhs) {
+        return lhs.desc.type == rhs.desc.type && lhs.desc.levels == rhs.desc.levels &&
+               lhs.desc.format == rhs.desc.format && lhs.desc.width == rhs.desc.width &&
+               lhs.desc.height == rhs.desc.height && lhs.desc.depth == rhs.desc.depth &&
+               lhs.getEffectiveSamples() == rhs.getEffectiveSamples() &&
+               lhs.getEffectiveUsage() == rhs.getEffectiveUsage();
+    };
+
+    size_t total = 0;
+    for (PassNode const& pass : mPassNodes) {
+        if (!pass.refCount) continue;
+        for (VirtualResource* virtualResource : pass.devirtualize) {
+            auto pos = std::find_if(mResourceRegistry.begin(), mResourceRegistry.end(),
+                    [virtualResource](auto const& r) { return r.get() == virtualResource; });
+            if (pos == mResourceRegistry.end() || (*pos)->imported) {
+                continue; // this is a render target or an imported texture
+            }
+            Resource const& resource = **pos;
+            const size_t size = ResourceAllocator::computeTextureSize(resource.desc.format,
+                    resource.desc.levels, resource.getEffectiveSamples(),
+                    resource.desc.width, resource.desc.height, resource.desc.depth);
+            total += size;
+            auto slot = std::find_if(slots.begin(), slots.end(), [&](Slot const& slot) {
+                return slot.free && compatible(*slot.resource, resource);
+            });
+            if (slot != slots.end()) {
+                slot->resource = &resource;
+                slot->free = false;
+            } else {
+                slots.push_back({ &resource, size, false });
+            }
+        }
+        for (VirtualResource* virtualResource : pass.destroy) {
+            auto slot = std::find_if(slots.begin(), slots.end(), [virtualResource](Slot const& slot) {
+                return !slot.free && slot.resource == virtualResource;
+            });
+            if (slot != slots.end()) {
+                slot->free = true;
+            }
+        }
+    }
+
+    size_t aliased = 0;
+    for (Slot const& slot : slots) {
+        aliased += slot.size;
+    }
+    mTransientMemorySize = total;
+    mAliasedTransientMemorySize = aliased;
 }
 
 void FrameGraph::execute(DriverApi& driver) noexcept {
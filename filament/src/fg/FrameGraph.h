@@ -18,6 +18,7 @@
 #define TNT_FILAMENT_FRAMEGRAPH_H
 
 
+#include "FrameGraphCache.h"
 #include "FrameGraphPass.h"
 #include "FrameGraphPassResources.h"
 #include "FrameGraphResource.h"
@@ -53,6 +54,7 @@ struct Alias;
 } // namespace fg
 
 class FrameGraphPassResources;
+class ResourceAllocator;
 
 class FrameGraph {
 public:
@@ -118,7 +120,12 @@ public:
         fg::PassNode& mPass;
     };
 
-    FrameGraph();
+    // The concrete textures are allocated by 'resourceAllocator', which must outlive the
+    // FrameGraph. Transient textures with disjoint lifetimes and the same parameters share the
+    // same texture.
+    // When 'cache' is set, compile() reuses the result of a previous identical graph, the
+    // cache must outlive the FrameGraph.
+    explicit FrameGraph(ResourceAllocator& resourceAllocator, FrameGraphCache* cache = nullptr);
     FrameGraph(FrameGraph const&) = delete;
     FrameGraph& operator = (FrameGraph const&) = delete;
     ~FrameGraph();
@@ -186,12 +193,19 @@ public:
     // execute all referenced passes
     void execute(backend::DriverApi& driver) noexcept;
 
+    // Size in bytes of the transient textures of the compiled graph if each had its own
+    // allocation, and their actual size once the textures with disjoint lifetimes are shared.
+    // Valid after compile().
+    size_t getTransientMemorySize() const noexcept { return mTransientMemorySize; }
+    size_t getAliasedTransientMemorySize() const noexcept { return mAliasedTransientMemorySize; }
+
     // for debugging
     void export_graphviz(utils::io::ostream& out);
 
 private:
     friend class FrameGraphPassResources;
     friend struct fg::PassNode;
+    friend struct fg::Resource;
     friend struct fg::RenderTarget;
     friend struct fg::RenderTargetResource;
 
@@ -208,6 +222,8 @@ private:
 
     auto& getArena() noexcept { return mArena; }
 
+    ResourceAllocator& getResourceAllocator() noexcept { return mResourceAllocator; }
+
     fg::PassNode& createPass(const char* name, FrameGraphPassExecutor* base) noexcept;
 
     fg::Resource* createResource(const char* name,
@@ -228,6 +244,18 @@ private:
     bool equals(FrameGraphRenderTarget::Descriptor const& lhs,
             FrameGraphRenderTarget::Descriptor const& rhs) const noexcept;
 
+    void computeTransientMemorySize() noexcept;
+
+    // adds the resources to the devirtualize and destroy lists of their first and last pass
+    void scheduleResources() noexcept;
+
+    // describes the declared graph, everything compile() depends on
+    uint64_t computeCacheKey(Vector<uint32_t>& key) const noexcept;
+    std::unique_ptr<FrameGraphCache::CompiledGraph> recordCompiledGraph() const noexcept;
+    void replayCompiledGraph(FrameGraphCache::CompiledGraph const& graph) noexcept;
+
+    ResourceAllocator& mResourceAllocator;
+    FrameGraphCache* const mCache;
     details::LinearAllocatorArena mArena;
     Vector<fg::PassNode> mPassNodes;                    // list of frame graph passes
     Vector<fg::ResourceNode> mResourceNodes;            // list of resource nodes
@@ -237,6 +265,8 @@ private:
     Vector<UniquePtr<fg::RenderTargetResource>> mRenderTargetCache; // list of actual rendertargets
 
     uint16_t mId = 0;
+    size_t mTransientMemorySize = 0;
+    size_t mAliasedTransientMemorySize = 0;
 };
 
 } // namespace filament
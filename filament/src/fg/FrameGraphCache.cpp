@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameGraphCache.h"
+
+#include <algorithm>
+
+namespace filament {
+
+FrameGraphCache::FrameGraphCache() noexcept = default;
+
+FrameGraphCache::~FrameGraphCache() noexcept = default;
+
+FrameGraphCache::CompiledGraph const* FrameGraphCache::find(
+        uint64_t hash, uint32_t const* key, size_t size) noexcept {
+    auto pos = std::find_if(mGraphs.rbegin(), mGraphs.rend(),
+            [hash, key, size](std::unique_ptr<CompiledGraph> const& graph) {
+                // the hash is only used to reject quickly, the keys must match
+                return graph->hash == hash && graph->key.size() == size &&
+                       std::equal(graph->key.begin(), graph->key.end(), key);
+            });
+    if (pos == mGraphs.rend()) {
+        mMissCount++;
+        return nullptr;
+    }
+    mHitCount++;
+    // move the graph to the back, it's now the most recently used
+    std::rotate(std::next(pos).base(), std::next(pos).base() + 1, mGraphs.end());
+    return mGraphs.back().get();
+}
+
+void FrameGraphCache::insert(std::unique_ptr<CompiledGraph> graph) noexcept {
+    if (mGraphs.size() >= CAPACITY) {
+        mGraphs.erase(mGraphs.begin());
+    }
+    mGraphs.push_back(std::move(graph));
+}
+
+} // namespace filament
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FG_FRAMEGRAPHCACHE_H
+#define TNT_FILAMENT_FG_FRAMEGRAPHCACHE_H
+
+#include <backend/DriverEnums.h>
+
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Remembers the result of FrameGraph::compile() across frames.
+ *
+ * The graph declared by the passes is usually the same every frame, the FrameGraph computes a
+ * key describing its passes, resources and render targets before compiling, and when a
+ * previous graph had the same key, its culling, render target resolution, resource lifetimes
+ * and discard flags are replayed instead of being computed again.
+ *
+ * A few graphs are kept, since several views can be rendered each frame.
+ */
+class FrameGraphCache {
+public:
+    // number of compiled graphs kept
+    static constexpr size_t CAPACITY = 8;
+
+    // index of "no pass" or "no render target"
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    struct CompiledGraph {
+        // the key of the declared graph and its hash
+        std::vector<uint32_t> key;
+        uint64_t hash = 0;
+
+        // reference count of each pass after culling
+        std::vector<uint32_t> passRefCounts;
+
+        struct Resource {
+            uint32_t refs;
+            uint32_t width;         // dimensions after the render targets are resolved
+            uint32_t height;
+            uint32_t first;         // index of the first pass using the resource, or NONE
+            uint32_t last;          // index of the last pass using the resource, or NONE
+        };
+        std::vector<Resource> resources;
+
+        struct RenderTarget {
+            uint32_t cacheIndex;    // index of the render target cache entry, or NONE
+            backend::RenderPassFlags targetFlags;
+        };
+        std::vector<RenderTarget> renderTargets;
+
+        // the render target cache entries created when the render targets are resolved,
+        // following the imported ones
+        struct RenderTargetCacheEntry {
+            uint32_t renderTarget;  // index of the render target creating the entry
+            backend::TargetBufferFlags attachments;
+            uint32_t width;
+            uint32_t height;
+            backend::TextureFormat format;
+        };
+        std::vector<RenderTargetCacheEntry> renderTargetCacheEntries;
+
+        // first and last pass of all the render target cache entries, or NONE
+        std::vector<uint32_t> renderTargetCacheFirst;
+        std::vector<uint32_t> renderTargetCacheLast;
+
+        size_t transientMemorySize = 0;
+        size_t aliasedTransientMemorySize = 0;
+    };
+
+    FrameGraphCache() noexcept;
+    ~FrameGraphCache() noexcept;
+
+    FrameGraphCache(FrameGraphCache const& rhs) = delete;
+    FrameGraphCache& operator=(FrameGraphCache const& rhs) = delete;
+
+    // Returns the compiled graph with this key, or nullptr.
+    CompiledGraph const* find(uint64_t hash, uint32_t const* key, size_t size) noexcept;
+
+    // Adds a compiled graph, evicting the least recently used one if the cache is full.
+    void insert(std::unique_ptr<CompiledGraph> graph) noexcept;
+
+    void clear() noexcept { mGraphs.clear(); }
+
+    size_t getHitCount() const noexcept { return mHitCount; }
+    size_t getMissCount() const noexcept { return mMissCount; }
+
+private:
+    // the most recently used graph is last
+    std::vector<std::unique_ptr<CompiledGraph>> mGraphs;
+    size_t mHitCount = 0;
+    size_t mMissCount = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FG_FRAMEGRAPHCACHE_H
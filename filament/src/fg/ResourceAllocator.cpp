@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ResourceAllocator.h"
+
+#include "details/Texture.h"
+
+#include "private/backend/CommandStream.h"
+
+#include <algorithm>
+
+namespace filament {
+
+using namespace backend;
+
+ResourceAllocator::ResourceAllocator() noexcept = default;
+
+ResourceAllocator::~ResourceAllocator() noexcept {
+    // all the textures must have been returned to the pool
+    assert(mInUse.empty());
+    assert(mRenderTargetsInUse.empty());
+}
+
+void ResourceAllocator::terminate(DriverApi& driver) noexcept {
+    assert(mInUse.empty());
+    assert(mRenderTargetsInUse.empty());
+    for (RenderTargetEntry const& entry : mRenderTargetCache) {
+        driver.destroyRenderTarget(entry.handle);
+    }
+    mRenderTargetCache.clear();
+    for (Entry const& entry : mCache) {
+        driver.destroyTexture(entry.handle);
+    }
+    mCache.clear();
+    mCacheSize = 0;
+}
+
+Handle<HwTexture> ResourceAllocator::createTexture(DriverApi& driver,
+        SamplerType target, uint8_t levels, TextureFormat format, uint8_t samples,
+        uint32_t width, uint32_t height, uint32_t depth, TextureUsage usage) noexcept {
+    const TextureKey key{ target, levels, format, samples, width, height, depth, usage };
+
+    // reuse the most recently returned texture, it's the most likely to still be resident
+    auto pos = std::find_if(mCache.rbegin(), mCache.rend(),
+            [&key](Entry const& entry) { return entry.key == key; });
+    if (pos != mCache.rend()) {
+        Entry entry = *pos;
+        mCache.erase(std::next(pos).base());
+        mCacheSize -= entry.size;
+        mInUse.push_back(entry);
+        return entry.handle;
+    }
+
+    Handle<HwTexture> handle = driver.createTexture(
+            target, levels, format, samples, width, height, depth, usage);
+    mInUse.push_back({ key, handle,
+            computeTextureSize(format, levels, samples, width, height, depth), 0 });
+    mCreatedTextureCount++;
+    return handle;
+}
+
+void ResourceAllocator::destroyTexture(Handle<HwTexture> handle) noexcept {
+    // textures in use are few, so a linear search is fine
+    auto pos = std::find_if(mInUse.begin(), mInUse.end(),
+            [handle](Entry const& entry) { return entry.handle.getId() == handle.getId(); });
+    assert(pos != mInUse.end());
+    if (pos != mInUse.end()) {
+        Entry entry = *pos;
+        mInUse.erase(pos);
+        entry.age = 0;
+        mCacheSize += entry.size;
+        mCache.push_back(entry);
+    }
+}
+
+Handle<HwRenderTarget> ResourceAllocator::createRenderTarget(DriverApi& driver,
+        TargetBufferFlags targetBufferFlags, uint32_t width, uint32_t height, uint8_t samples,
+        Handle<HwTexture> color, Handle<HwTexture> depth) noexcept {
+    const RenderTargetKey key{ targetBufferFlags, width, height, samples,
+            color.getId(), depth.getId() };
+
+    auto pos = std::find_if(mRenderTargetCache.rbegin(), mRenderTargetCache.rend(),
+            [&key](RenderTargetEntry const& entry) { return entry.key == key; });
+    if (pos != mRenderTargetCache.rend()) {
+        RenderTargetEntry entry = *pos;
+        mRenderTargetCache.erase(std::next(pos).base());
+        mRenderTargetsInUse.push_back(entry);
+        return entry.handle;
+    }
+
+    Handle<HwRenderTarget> handle = driver.createRenderTarget(
+            targetBufferFlags, width, height, samples, { color }, { depth }, {});
+    mRenderTargetsInUse.push_back({ key, handle, 0 });
+    mCreatedRenderTargetCount++;
+    return handle;
+}
+
+void ResourceAllocator::destroyRenderTarget(Handle<HwRenderTarget> handle) noexcept {
+    auto pos = std::find_if(mRenderTargetsInUse.begin(), mRenderTargetsInUse.end(),
+            [handle](RenderTargetEntry const& entry) {
+                return entry.handle.getId() == handle.getId();
+            });
+    assert(pos != mRenderTargetsInUse.end());
+    if (pos != mRenderTargetsInUse.end()) {
+        RenderTargetEntry entry = *pos;
+        mRenderTargetsInUse.erase(pos);
+        entry.age = 0;
+        mRenderTargetCache.push_back(entry);
+    }
+}
+
+void ResourceAllocator::destroyRenderTargets(DriverApi& driver,
+        Handle<HwTexture> texture) noexcept {
+    // a render target can't outlive its attachments, their handles could be reused
+    const HandleBase::HandleId id = texture.getId();
+    auto last = std::remove_if(mRenderTargetCache.begin(), mRenderTargetCache.end(),
+            [&driver, id](RenderTargetEntry const& entry) {
+                if (entry.key.color == id || entry.key.depth == id) {
+                    driver.destroyRenderTarget(entry.handle);
+                    return true;
+                }
+                return false;
+            });
+    mRenderTargetCache.erase(last, mRenderTargetCache.end());
+}
+
+void ResourceAllocator::gc(DriverApi& driver) noexcept {
+    auto last = std::remove_if(mRenderTargetCache.begin(), mRenderTargetCache.end(),
+            [&driver](RenderTargetEntry& entry) {
+                if (++entry.age > CACHE_MAX_AGE) {
+                    driver.destroyRenderTarget(entry.handle);
+                    return true;
+                }
+                return false;
+            });
+    mRenderTargetCache.erase(last, mRenderTargetCache.end());
+
+    std::vector<Handle<HwTexture>> destroyed;
+    auto lastTexture = std::remove_if(mCache.begin(), mCache.end(),
+            [this, &destroyed](Entry& entry) {
+                if (++entry.age > CACHE_MAX_AGE) {
+                    destroyed.push_back(entry.handle);
+                    mCacheSize -= entry.size;
+                    return true;
+                }
+                return false;
+            });
+    mCache.erase(lastTexture, mCache.end());
+
+    for (Handle<HwTexture> handle : destroyed) {
+        destroyRenderTargets(driver, handle);
+        driver.destroyTexture(handle);
+    }
+}
+
+size_t ResourceAllocator::computeTextureSize(TextureFormat format, uint8_t levels,
+        uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept {
+    const size_t texelSize = details::FTexture::getFormatSize(format) * std::max(samples, uint8_t(1));
+    size_t size = 0;
+    for (size_t level = 0; level < std::max(levels, uint8_t(1)); level++) {
+        size += texelSize *
+                std::max(1u, width >> level) * std::max(1u, height >> level) * std::max(1u, depth);
+    }
+    return size;
+}
+
+} // namespace filament
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FG_RESOURCEALLOCATOR_H
+#define TNT_FILAMENT_FG_RESOURCEALLOCATOR_H
+
+#include "private/backend/DriverApiForward.h"
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Allocates the concrete textures and render targets of the FrameGraph's transient resources.
+ *
+ * Destroyed textures are kept in a pool and handed back by createTexture() when a texture with
+ * the same parameters is requested, either later in the same frame -- in which case resources
+ * with disjoint lifetimes share the same memory -- or in a following frame. Textures that
+ * haven't been used for CACHE_MAX_AGE frames are destroyed by gc().
+ *
+ * Render targets are pooled the same way, since the pooled textures are handed back in the
+ * same order every frame, a render target is found with the same attachments.
+ */
+class ResourceAllocator {
+public:
+    // number of frames a texture can stay unused in the pool
+    static constexpr uint32_t CACHE_MAX_AGE = 30;
+
+    ResourceAllocator() noexcept;
+    ~ResourceAllocator() noexcept;
+
+    ResourceAllocator(ResourceAllocator const& rhs) = delete;
+    ResourceAllocator& operator=(ResourceAllocator const& rhs) = delete;
+
+    // destroys all the textures, none must be in use
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    backend::Handle<backend::HwTexture> createTexture(backend::DriverApi& driver,
+            backend::SamplerType target, uint8_t levels, backend::TextureFormat format,
+            uint8_t samples, uint32_t width, uint32_t height, uint32_t depth,
+            backend::TextureUsage usage) noexcept;
+
+    // returns a texture created by createTexture() to the pool
+    void destroyTexture(backend::Handle<backend::HwTexture> handle) noexcept;
+
+    backend::Handle<backend::HwRenderTarget> createRenderTarget(backend::DriverApi& driver,
+            backend::TargetBufferFlags targetBufferFlags, uint32_t width, uint32_t height,
+            uint8_t samples, backend::Handle<backend::HwTexture> color,
+            backend::Handle<backend::HwTexture> depth) noexcept;
+
+    // returns a render target created by createRenderTarget() to the pool
+    void destroyRenderTarget(backend::Handle<backend::HwRenderTarget> handle) noexcept;
+
+    // Call once per frame, destroys the textures that have been in the pool for too long.
+    void gc(backend::DriverApi& driver) noexcept;
+
+    // estimated size in bytes of a texture created with these parameters
+    static size_t computeTextureSize(backend::TextureFormat format, uint8_t levels,
+            uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept;
+
+    // number of textures created with the driver since the allocator was created
+    size_t getCreatedTextureCount() const noexcept { return mCreatedTextureCount; }
+
+    // number of render targets created with the driver since the allocator was created
+    size_t getCreatedRenderTargetCount() const noexcept { return mCreatedRenderTargetCount; }
+
+    // size in bytes of the textures in the pool, not used by the FrameGraph
+    size_t getCacheSize() const noexcept { return mCacheSize; }
+
+private:
+    struct TextureKey {
+        backend::SamplerType target;
+        uint8_t levels;
+        backend::TextureFormat format;
+        uint8_t samples;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        backend::TextureUsage usage;
+
+        bool operator==(TextureKey const& rhs) const noexcept {
+            return target == rhs.target && levels == rhs.levels && format == rhs.format &&
+                   samples == rhs.samples && width == rhs.width && height == rhs.height &&
+                   depth == rhs.depth && usage == rhs.usage;
+        }
+    };
+
+    struct Entry {
+        TextureKey key;
+        backend::Handle<backend::HwTexture> handle;
+        size_t size;
+        uint32_t age;           // frames since the texture was returned to the pool
+    };
+
+    struct RenderTargetKey {
+        backend::TargetBufferFlags targetBufferFlags;
+        uint32_t width;
+        uint32_t height;
+        uint8_t samples;
+        backend::HandleBase::HandleId color;
+        backend::HandleBase::HandleId depth;
+
+        bool operator==(RenderTargetKey const& rhs) const noexcept {
+            return targetBufferFlags == rhs.targetBufferFlags && width == rhs.width &&
+                   height == rhs.height && samples == rhs.samples &&
+                   color == rhs.color && depth == rhs.depth;
+        }
+    };
+
+    struct RenderTargetEntry {
+        RenderTargetKey key;
+        backend::Handle<backend::HwRenderTarget> handle;
+        uint32_t age;
+    };
+
+    // destroys the pooled render targets using this texture
+    void destroyRenderTargets(backend::DriverApi& driver,
+            backend::Handle<backend::HwTexture> texture) noexcept;
+
+    std::vector<Entry> mCache;      // textures available for reuse
+    std::vector<Entry> mInUse;      // textures currently used by a FrameGraph
+    std::vector<RenderTargetEntry> mRenderTargetCache;
+    std::vector<RenderTargetEntry> mRenderTargetsInUse;
+    size_t mCacheSize = 0;
+    size_t mCreatedTextureCount = 0;
+    size_t mCreatedRenderTargetCount = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FG_RESOURCEALLOCATOR_H
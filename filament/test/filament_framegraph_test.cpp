@@ -17,7 +17,9 @@
 #include <gtest/gtest.h>
 
 #include "fg/FrameGraph.h"
+#include "fg/FrameGraphCache.h"
 #include "fg/FrameGraphPassResources.h"
+#include "fg/ResourceAllocator.h"
 
 #include <backend/Platform.h>
 
@@ -30,10 +32,11 @@ static CircularBuffer buffer(8192);
 static Backend gBackend = Backend::NOOP;
 static DefaultPlatform* platform = DefaultPlatform::create(&gBackend);
 static CommandStream driverApi(*platform->createDriver(nullptr), buffer);
+static ResourceAllocator resourceAllocator;
 
 TEST(FrameGraphTest, SimpleRenderPass) {
 
-    FrameGraph fg;
+    FrameGraph fg(resourceAllocator);
 
     bool renderPassExecuted = false;
 
@@ -71,7 +74,7 @@ TEST(FrameGraphTest, SimpleRenderPass) {
 
 TEST(FrameGraphTest, SimpleRenderPass2) {
 
-    FrameGraph fg;
+    FrameGraph fg(resourceAllocator);
 
     bool renderPassExecuted = false;
 
@@ -119,7 +122,7 @@ TEST(FrameGraphTest, SimpleRenderPass2) {
 
 TEST(FrameGraphTest, ScenarioDepthPrePass) {
 
-    FrameGraph fg;
+    FrameGraph fg(resourceAllocator);
 
     bool depthPrepassExecuted = false;
     bool colorPassExecuted = false;
@@ -197,7 +200,7 @@ TEST(FrameGraphTest, ScenarioDepthPrePass) {
 
 TEST(FrameGraphTest, SimplePassCulling) {
 
-    FrameGraph fg;
+    FrameGraph fg(resourceAllocator);
 
     bool renderPassExecuted = false;
     bool postProcessPassExecuted = false;
@@ -284,7 +287,7 @@ TEST(FrameGraphTest, SimplePassCulling) {
 
 TEST(FrameGraphTest, RenderTargetLifetime) {
 
-    FrameGraph fg;
+    FrameGraph fg(resourceAllocator);
 
     bool renderPassExecuted1 = false;
     bool renderPassExecuted2 = false;
@@ -341,3 +344,174 @@ TEST(FrameGraphTest, RenderTargetLifetime) {
     EXPECT_TRUE(renderPassExecuted1);
     EXPECT_TRUE(renderPassExecuted2);
 }
+
+TEST(FrameGraphTest, TransientTextureAliasing) {
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    // a chain of 4 passes, each reads the texture written by the previous one
+    auto buildChain = [](FrameGraph& fg) {
+        FrameGraphResource input;
+        for (const char* name : { "Pass1", "Pass2", "Pass3", "Pass4" }) {
+            auto& pass = fg.addPass<PassData>(name,
+                    [&](FrameGraph::Builder& builder, PassData& data) {
+                        FrameGraphResource::Descriptor desc{ .width = 16, .height = 16 };
+                        if (input.isValid()) {
+                            data.input = builder.read(input);
+                        }
+                        data.output = builder.createTexture("color buffer", desc);
+                        data.output = builder.useRenderTarget(data.output).textures[0];
+                    },
+                    [=](FrameGraphPassResources const& resources, PassData const& data,
+                            DriverApi& driver) {
+                        EXPECT_TRUE(resources.getRenderTarget(data.output).target);
+                    });
+            input = pass.getData().output;
+        }
+        fg.present(input);
+    };
+
+    const size_t size = ResourceAllocator::computeTextureSize(
+            TextureFormat::RGBA8, 1, 1, 16, 16, 1);
+    const size_t createdTextureCount = resourceAllocator.getCreatedTextureCount();
+
+    FrameGraph fg(resourceAllocator);
+    buildChain(fg);
+    fg.compile();
+
+    // the 3rd texture reuses the 1st one, the last one isn't sampled so it can't reuse the 2nd
+    EXPECT_EQ(4 * size, fg.getTransientMemorySize());
+    EXPECT_EQ(3 * size, fg.getAliasedTransientMemorySize());
+
+    fg.execute(driverApi);
+    EXPECT_EQ(createdTextureCount + 3, resourceAllocator.getCreatedTextureCount());
+
+    // the next frame uses the pooled textures
+    FrameGraph fg2(resourceAllocator);
+    buildChain(fg2);
+    fg2.compile();
+    fg2.execute(driverApi);
+    EXPECT_EQ(createdTextureCount + 3, resourceAllocator.getCreatedTextureCount());
+
+    for (uint32_t i = 0; i <= ResourceAllocator::CACHE_MAX_AGE; i++) {
+        resourceAllocator.gc(driverApi);
+    }
+    EXPECT_EQ(0, resourceAllocator.getCacheSize());
+}
+
+TEST(FrameGraphTest, CompileCache) {
+
+    struct DepthPrepassData {
+        FrameGraphResource outDepth;
+    };
+
+    struct ColorPassData {
+        FrameGraphResource outColor;
+        FrameGraphResource outDepth;
+    };
+
+    struct Executed {
+        bool depthPrepass = false;
+        bool colorPass = false;
+        bool culledPass = false;
+    };
+
+    // a depth pre-pass, a color pass using the same depth buffer and a pass that gets culled
+    auto buildGraph = [](FrameGraph& fg, uint32_t width, Executed& executed) {
+        auto& depthPrepass = fg.addPass<DepthPrepassData>("depth prepass",
+                [&](FrameGraph::Builder& builder, DepthPrepassData& data) {
+                    FrameGraphResource::Descriptor desc{ .width = width };
+                    desc.format = TextureFormat::DEPTH24;
+                    data.outDepth = builder.createTexture("depth buffer", desc);
+                    FrameGraphRenderTarget::Descriptor outputDesc{
+                            .attachments.depth = data.outDepth
+                    };
+                    data.outDepth = builder.useRenderTarget("rt depth", outputDesc).textures[1];
+                },
+                [&executed](FrameGraphPassResources const& resources,
+                        DepthPrepassData const& data, DriverApi& driver) {
+                    executed.depthPrepass = true;
+                    auto const& rt = resources.getRenderTarget(data.outDepth);
+                    EXPECT_TRUE(rt.target);
+                    EXPECT_EQ(TargetBufferFlags::ALL, rt.params.flags.discardStart);
+                    EXPECT_EQ(TargetBufferFlags::COLOR_AND_STENCIL, rt.params.flags.discardEnd);
+                });
+
+        auto& colorPass = fg.addPass<ColorPassData>("color pass",
+                [&](FrameGraph::Builder& builder, ColorPassData& data) {
+                    FrameGraphResource::Descriptor desc{ .width = width };
+                    desc.format = TextureFormat::RGBA16F;
+                    data.outColor = builder.createTexture("color buffer", desc);
+                    FrameGraphRenderTarget::Descriptor outputDesc{
+                            .attachments.color = data.outColor,
+                            .attachments.depth = depthPrepass.getData().outDepth
+                    };
+                    auto rt = builder.useRenderTarget("rt color+depth", outputDesc);
+                    data.outColor = rt.textures[0];
+                    data.outDepth = rt.textures[1];
+                },
+                [&executed](FrameGraphPassResources const& resources,
+                        ColorPassData const& data, DriverApi& driver) {
+                    executed.colorPass = true;
+                    auto const& rt = resources.getRenderTarget(data.outColor);
+                    EXPECT_TRUE(rt.target);
+                    EXPECT_EQ(TargetBufferFlags::COLOR_AND_STENCIL, rt.params.flags.discardStart);
+                    EXPECT_EQ(TargetBufferFlags::DEPTH_AND_STENCIL, rt.params.flags.discardEnd);
+                });
+
+        fg.addPass<DepthPrepassData>("culled pass",
+                [&](FrameGraph::Builder& builder, DepthPrepassData& data) {
+                    data.outDepth = builder.createTexture("unused", {});
+                    data.outDepth = builder.useRenderTarget(data.outDepth).textures[0];
+                },
+                [&executed](FrameGraphPassResources const& resources,
+                        DepthPrepassData const& data, DriverApi& driver) {
+                    executed.culledPass = true;
+                });
+
+        fg.present(colorPass.getData().outColor);
+    };
+
+    FrameGraphCache cache;
+
+    // the first frame compiles the graph
+    Executed executed;
+    FrameGraph fg(resourceAllocator, &cache);
+    buildGraph(fg, 1, executed);
+    fg.compile();
+    const size_t transientMemorySize = fg.getTransientMemorySize();
+    fg.execute(driverApi);
+    EXPECT_EQ(0, cache.getHitCount());
+    EXPECT_EQ(1, cache.getMissCount());
+    EXPECT_TRUE(executed.depthPrepass);
+    EXPECT_TRUE(executed.colorPass);
+    EXPECT_FALSE(executed.culledPass);
+
+    // the second frame replays it and creates no new render targets
+    const size_t createdRenderTargetCount = resourceAllocator.getCreatedRenderTargetCount();
+    Executed executed2;
+    FrameGraph fg2(resourceAllocator, &cache);
+    buildGraph(fg2, 1, executed2);
+    fg2.compile();
+    EXPECT_EQ(transientMemorySize, fg2.getTransientMemorySize());
+    fg2.execute(driverApi);
+    EXPECT_EQ(1, cache.getHitCount());
+    EXPECT_EQ(1, cache.getMissCount());
+    EXPECT_TRUE(executed2.depthPrepass);
+    EXPECT_TRUE(executed2.colorPass);
+    EXPECT_FALSE(executed2.culledPass);
+    EXPECT_EQ(createdRenderTargetCount, resourceAllocator.getCreatedRenderTargetCount());
+
+    // a different graph isn't matched
+    Executed executed3;
+    FrameGraph fg3(resourceAllocator, &cache);
+    buildGraph(fg3, 2, executed3);
+    fg3.compile();
+    fg3.execute(driverApi);
+    EXPECT_EQ(1, cache.getHitCount());
+    EXPECT_EQ(2, cache.getMissCount());
+    EXPECT_TRUE(executed3.colorPass);
+}
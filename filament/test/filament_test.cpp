@@ -14,11 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <initializer_list>
+#include <iterator>
 #include <random>
+#include <vector>
+
+#include <string.h>
 
 #include <gtest/gtest.h>
 
+#include <utils/JobSystem.h>
+
 #include <math/vec3.h>
 #include <math/vec4.h>
 #include <math/mat4.h>
@@ -26,17 +35,26 @@
 #include <filament/Camera.h>
 #include <filament/Color.h>
 #include <filament/Frustum.h>
+#include <filament/LightManager.h>
 #include <filament/Material.h>
+#include <filament/RenderableManager.h>
 #include <filament/Engine.h>
+#include <filament/View.h>
 
+#include <private/filament/EngineEnums.h>
 #include <private/filament/UniformInterfaceBlock.h>
+#include <private/filament/Variant.h>
 #include <private/filament/UibGenerator.h>
 
 #include "details/Allocators.h"
 #include "details/Material.h"
 #include "details/Camera.h"
+#include "details/Culler.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
 #include "details/Engine.h"
+#include "details/Scene.h"
+#include "details/ShadowMapManager.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 #include "UniformBuffer.h"
@@ -144,6 +162,53 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(newParent), mat4f{ float4{ 8 }});
     EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
+
+    // only the subtrees of the changed transforms are updated
+    const uint32_t parentVersion = tcm.getVersion(parent);
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(newParent, mat4f{ float4{ 16 }});
+    tcm.commitLocalTransformTransaction();
+    parent = tcm.getInstance(entities[0]);
+    child = tcm.getInstance(entities[1]);
+    EXPECT_EQ(parentVersion, tcm.getVersion(parent));
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 16 }});
+    EXPECT_EQ(tcm.getVersion(), tcm.getVersion(child));
+}
+
+TEST(FilamentTest, TransformManagerBulkUpdate) {
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    // a root with a child, and a grand-child
+    tcm.create(entities[0]);
+    tcm.create(entities[1], tcm.getInstance(entities[0]), mat4f{});
+    tcm.create(entities[2], tcm.getInstance(entities[1]), mat4f{});
+
+    // the world transforms are updated when setTransforms() returns
+    std::array<TransformManager::Instance, 2> instances = {
+            tcm.getInstance(entities[0]), tcm.getInstance(entities[1]) };
+    std::array<mat4f, 2> transforms = { mat4f{ float4{ 2 }}, mat4f{ float4{ 3 }} };
+    tcm.setTransforms(instances.data(), transforms.data(), instances.size());
+    EXPECT_EQ(tcm.getTransform(tcm.getInstance(entities[1])), mat4f{ float4{ 3 }});
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[1])), mat4f{ float4{ 6 }});
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[2])), mat4f{ float4{ 6 }});
+
+    // in a transaction, they're updated when it's committed
+    TransformManager::Instance grandChild = tcm.getInstance(entities[2]);
+    const float3 translation{ 1, 2, 3 };
+    const quatf rotation{ 1, 0, 0, 0 };
+    const float3 scale{ 2, 2, 2 };
+    tcm.openLocalTransformTransaction();
+    tcm.setTransforms(&grandChild, &translation, &rotation, &scale, 1);
+    EXPECT_EQ(tcm.getWorldTransform(grandChild), mat4f{ float4{ 6 }});
+    tcm.commitLocalTransformTransaction();
+    grandChild = tcm.getInstance(entities[2]);
+    EXPECT_EQ(tcm.getTransform(grandChild),
+            mat4f::translation(translation) * mat4f::scaling(scale));
+    EXPECT_EQ(tcm.getWorldTransform(grandChild),
+            mat4f{ float4{ 6 }} * mat4f::translation(translation) * mat4f::scaling(scale));
 }
 
 TEST(FilamentTest, UniformInterfaceBlock) {
@@ -410,6 +475,99 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, CullingKernels) {
+    using namespace filament::details;
+
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    std::default_random_engine gen; // NOLINT
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 25.0f);
+
+    constexpr size_t COUNT = 256;
+    std::vector<float3> center(COUNT);
+    std::vector<float3> extent(COUNT);
+    std::vector<float4> spheres(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        center[i] = { position(gen), position(gen), -std::abs(position(gen)) };
+        extent[i] = { size(gen), size(gen), size(gen) };
+        spheres[i] = { center[i], size(gen) };
+    }
+
+    std::vector<Culler::result_type> expectedBoxes(COUNT);
+    std::vector<Culler::result_type> expectedSpheres(COUNT);
+    Culler::Test::intersects(expectedBoxes.data(), frustum,
+            center.data(), extent.data(), COUNT, Culler::Isa::GENERIC);
+    Culler::Test::intersects(expectedSpheres.data(), frustum,
+            spheres.data(), COUNT, Culler::Isa::GENERIC);
+
+    // all kernels must produce the same results
+    for (Culler::Isa isa : { Culler::Isa::SSE2, Culler::Isa::AVX2, Culler::Isa::NEON }) {
+        if (!Culler::Test::isSupported(isa)) {
+            continue;
+        }
+        std::vector<Culler::result_type> boxes(COUNT);
+        std::vector<Culler::result_type> results(COUNT);
+        Culler::Test::intersects(boxes.data(), frustum,
+                center.data(), extent.data(), COUNT, isa);
+        Culler::Test::intersects(results.data(), frustum, spheres.data(), COUNT, isa);
+        EXPECT_EQ(expectedBoxes, boxes);
+        EXPECT_EQ(expectedSpheres, results);
+    }
+
+    // the results must be 0 or 1, and the box test must only set its own bit
+    std::vector<Culler::result_type> results(COUNT, 0x1);
+    Culler::intersects(results.data(), frustum, center.data(), extent.data(), COUNT, 2);
+    for (size_t i = 0; i < COUNT; i++) {
+        EXPECT_LE(expectedBoxes[i], 1);
+        EXPECT_LE(expectedSpheres[i], 1);
+        EXPECT_EQ(0x1 | (expectedBoxes[i] << 2), results[i]);
+    }
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    using namespace filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    const mat4f clipFromWorld = mat4f::perspective(60.0f, 2.0f, 0.1f, 1000.0f);
+
+    // a wall at z=-10, covering x and y in [-5, 5]
+    std::vector<float3> center = {
+            { 0, 0, -10 },      // the wall
+            { 0, 0, -20 },      // behind the wall
+            { 0, 0, -5 },       // in front of the wall
+            { 30, 0, -20 },     // next to the wall
+            { 12, 0, -20 },     // partially hidden
+    };
+    std::vector<float3> extent = {
+            { 5, 5, 0.5f },
+            { 1, 1, 1 },
+            { 1, 1, 1 },
+            { 1, 1, 1 },
+            { 1, 1, 1 },
+    };
+
+    OcclusionCuller occlusionCuller;
+    const uint32_t occluders[] = { 0 };
+    occlusionCuller.rasterize(js, clipFromWorld, center.data(), extent.data(), occluders, 1);
+    EXPECT_EQ(1, occlusionCuller.getRasterizedOccluderCount());
+
+    const uint32_t occludees[] = { 0, 1, 2, 3, 4 };
+    uint8_t results[] = { 3, 3, 3, 3, 3 };
+    size_t culled = occlusionCuller.cull(js, center.data(), extent.data(),
+            occludees, 5, results, 0);
+    EXPECT_EQ(1, culled);
+    EXPECT_EQ(3, results[0]);   // an occluder doesn't hide itself
+    EXPECT_EQ(2, results[1]);   // only the requested bit is cleared
+    EXPECT_EQ(3, results[2]);
+    EXPECT_EQ(3, results[3]);
+    EXPECT_EQ(3, results[4]);
+
+    js.emancipate();
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -518,8 +676,8 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
     FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {});
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, {});
 
     {
         froxelData.froxelizeLights(*engine, {}, lights);
@@ -554,11 +712,591 @@ TEST(FilamentTest, FroxelData) {
         EXPECT_GT(pointCount, 0);
     }
 
+    {
+        // light indices don't fit in 8 bits
+        FScene::LightSoa manyLights;
+        manyLights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+        for (size_t i = 0; i < 300; i++) {
+            // these lights are beyond "light far" and don't touch any froxel
+            manyLights.push_back(float4{ 0, 0, -1000, 1 }, {}, instance, 1, {}, {});
+        }
+        manyLights.push_back(float4{ 0, 0, -3, 1 }, {}, instance, 1, {}, {});
+
+        froxelData.froxelizeLights(*engine, {}, manyLights);
+        auto const& froxelBuffer = froxelData.getFroxelBufferUser();
+        auto const& recordBuffer = froxelData.getRecordBufferUser();
+        size_t pointCount = 0;
+        for (size_t i = 0, c = froxelData.getFroxelCount(); i < c; i++) {
+            auto const& entry = froxelBuffer[i];
+            EXPECT_LE(entry.pointLightCount, 1);
+            EXPECT_EQ(entry.spotLightCount, 0);
+            if (entry.pointLightCount) {
+                EXPECT_EQ(300, recordBuffer[entry.offset]);
+            }
+            pointCount += entry.pointLightCount;
+        }
+        EXPECT_GT(pointCount, 0);
+
+        // nothing changed, the froxelization is skipped and its results kept
+        const int skipped = engine->debug.froxelizer.skipped;
+        froxelData.froxelizeLights(*engine, {}, manyLights);
+        EXPECT_EQ(skipped + 1, engine->debug.froxelizer.skipped);
+        for (size_t i = 0, c = froxelData.getFroxelCount(); i < c; i++) {
+            auto const& entry = froxelBuffer[i];
+            if (entry.pointLightCount) {
+                EXPECT_EQ(300, recordBuffer[entry.offset]);
+            }
+        }
+
+        // moving a light makes it run again
+        manyLights.elementAt<FScene::POSITION_RADIUS>(301) = float4{ 0, 0, -4, 1 };
+        froxelData.froxelizeLights(*engine, {}, manyLights);
+        EXPECT_EQ(skipped + 1, engine->debug.froxelizer.skipped);
+    }
+
     froxelData.terminate(engine->getDriverApi());
     engine->shutdown();
     delete engine;
 }
 
+TEST(FilamentTest, ShadowCaching) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    EntityManager& em = engine->getEntityManager();
+    FTransformManager& tcm = engine->getTransformManager();
+    FLightManager& lcm = engine->getLightManager();
+    FScene* scene = engine->createScene();
+
+    // a box in front of the camera that casts and receives shadows
+    Entity caster = em.create();
+    tcm.create(caster);
+    RenderableManager::Builder(1)
+            .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+            .castShadows(true)
+            .receiveShadows(true)
+            .build(*engine, caster);
+    scene->addEntity(caster);
+
+    LightManager::ShadowOptions shadowOptions;
+    shadowOptions.shadowCaching = true;
+    Entity sun = em.create();
+    LightManager::Builder(LightManager::Type::DIRECTIONAL)
+            .direction(normalize(float3{ 0, -1, -1 }))
+            .castShadows(true)
+            .shadowOptions(shadowOptions)
+            .build(*engine, sun);
+    scene->addEntity(sun);
+
+    Entity cameraEntity = em.create();
+    FCamera* camera = engine->createCamera(cameraEntity);
+    camera->setProjection(45, 1, 0.1, 100);
+    camera->lookAt({ 0, 2, 10 }, { 0, 0, 0 });
+
+    ShadowMapManager shadowMapManager(*engine);
+    const Viewport viewport(0, 0, 512, 512);
+
+    // runs the part of a frame the shadow pass depends on, returns whether the shadow map
+    // rendered by the previous frame is reused
+    auto isShadowMapReused = [&]() {
+        scene->prepare(mat4f{});
+        const CameraInfo cameraInfo{
+                .projection         = mat4f{ camera->getProjectionMatrix() },
+                .cullingProjection  = mat4f{ camera->getCullingProjectionMatrix() },
+                .model              = camera->getModelMatrix(),
+                .view               = camera->getViewMatrix(),
+                .zn                 = camera->getNear(),
+                .zf                 = camera->getCullingFar(),
+        };
+        EXPECT_TRUE(shadowMapManager.update(scene->getLightData(), scene, cameraInfo, 0xFF,
+                viewport, View::ShadowAtlasOptions{}));
+        FScene::RenderableSoa const& renderableData = scene->getRenderableData();
+        return shadowMapManager.checkShadowCache(*engine, renderableData,
+                { 0, uint32_t(renderableData.size()) });
+    };
+
+    // the first frame renders the shadow map
+    const int misses = engine->debug.shadowmap.cache_misses;
+    EXPECT_FALSE(isShadowMapReused());
+    EXPECT_EQ(misses + 1, engine->debug.shadowmap.cache_misses);
+
+    // nothing changed, the shadow map is reused
+    const int hits = engine->debug.shadowmap.cache_hits;
+    EXPECT_TRUE(isShadowMapReused());
+    EXPECT_TRUE(isShadowMapReused());
+    EXPECT_EQ(hits + 2, engine->debug.shadowmap.cache_hits);
+
+    // moving a shadow caster invalidates it
+    tcm.setTransform(tcm.getInstance(caster), mat4f::translation(float3{ 0, 0.5f, 0 }));
+    EXPECT_FALSE(isShadowMapReused());
+    EXPECT_TRUE(isShadowMapReused());
+
+    // so does moving the light
+    lcm.setDirection(lcm.getInstance(sun), normalize(float3{ 1, -1, -1 }));
+    EXPECT_FALSE(isShadowMapReused());
+    EXPECT_TRUE(isShadowMapReused());
+
+    // and moving the camera
+    camera->lookAt({ 5, 2, 10 }, { 0, 0, 0 });
+    EXPECT_FALSE(isShadowMapReused());
+    EXPECT_TRUE(isShadowMapReused());
+
+    // the shadow map is never reused when the light's shadow caching is disabled
+    shadowOptions.shadowCaching = false;
+    lcm.setShadowOptions(lcm.getInstance(sun), shadowOptions);
+    EXPECT_FALSE(isShadowMapReused());
+    EXPECT_FALSE(isShadowMapReused());
+
+    shadowMapManager.terminate(engine->getDriverApi());
+    engine->destroyCameraComponent(cameraEntity);
+    engine->destroy(scene);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, SceneUniformUpload) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    EntityManager& em = engine->getEntityManager();
+    FTransformManager& tcm = engine->getTransformManager();
+    FScene* scene = engine->createScene();
+
+    // more uniforms than the command stream can hold at once
+    const size_t count = 2 * CONFIG_COMMAND_BUFFERS_SIZE / sizeof(PerRenderableUib);
+    std::vector<Entity> entities(count);
+    em.create(count, entities.data());
+    for (size_t i = 0; i < count; i++) {
+        tcm.create(entities[i], {}, mat4f::translation(float3{ float(i), 0, 0 }));
+        RenderableManager::Builder(1)
+                .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                .build(*engine, entities[i]);
+        scene->addEntity(entities[i]);
+    }
+
+    // all the uniforms are uploaded after a regather, the command stream is flushed between
+    // the batches so it doesn't overflow
+    scene->prepare(mat4f{});
+    scene->updateUBOs();
+    engine->flush();
+
+    engine->destroy(scene);
+    for (Entity e : entities) {
+        engine->destroy(e);
+    }
+    em.destroy(count, entities.data());
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, MaterialParameterHandle) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+
+    // the skybox material has a bool parameter and a sampler parameter
+    FMaterial const* material = engine->getSkyboxMaterial(false);
+
+    MaterialInstance::ParameterHandle showSun = material->getParameterHandle("showSun");
+    EXPECT_TRUE(showSun.isValid());
+    EXPECT_FALSE(showSun.isSampler());
+    EXPECT_EQ(1u, showSun.getCount());
+    EXPECT_EQ(backend::UniformType::BOOL, showSun.getType());
+
+    MaterialInstance::ParameterHandle skybox = material->getParameterHandle("skybox");
+    EXPECT_TRUE(skybox.isValid());
+    EXPECT_TRUE(skybox.isSampler());
+
+    EXPECT_FALSE(material->getParameterHandle("doesNotExist").isValid());
+
+    // a handle sets the uniform at the offset its name resolves to
+    const ssize_t offset = material->getUniformInterfaceBlock().getUniformOffset("showSun", 0);
+    ASSERT_GE(offset, 0);
+    FMaterialInstance* byName = material->createInstance();
+    FMaterialInstance* byHandle = material->createInstance();
+    byName->setParameter("showSun", true);
+    byHandle->setParameter(showSun, true);
+    UniformBuffer const& expected = byName->getUniformBuffer();
+    UniformBuffer const& actual = byHandle->getUniformBuffer();
+    ASSERT_EQ(expected.getSize(), actual.getSize());
+    EXPECT_EQ(0, memcmp(expected.getBuffer(), actual.getBuffer(), expected.getSize()));
+    EXPECT_EQ(expected.getUniform<uint32_t>(size_t(offset)),
+            actual.getUniform<uint32_t>(size_t(offset)));
+
+    // invalid handles, including the sampler handle for a uniform, are no-ops
+    byHandle->setParameter(MaterialInstance::ParameterHandle{}, false);
+    byHandle->setParameter(material->getParameterHandle("doesNotExist"), false);
+    byHandle->setParameter(skybox, false);
+    EXPECT_EQ(0, memcmp(expected.getBuffer(), actual.getBuffer(), expected.getSize()));
+
+    engine->destroy(byName);
+    engine->destroy(byHandle);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, CompileProgramsCallback) {
+    using namespace filament::details;
+
+    // the noop backend has nothing to compile, but still calls back, and the callbacks pending
+    // when the Engine shuts down are called too
+    FEngine* engine = FEngine::create(backend::Backend::NOOP);
+    int called = 0;
+    engine->getDriverApi().compilePrograms(
+            [](void* user) { ++*static_cast<int*>(user); }, &called);
+    engine->shutdown();
+    EXPECT_EQ(called, 1);
+    delete engine;
+}
+
+TEST(FilamentTest, FallbackVariant) {
+    constexpr uint8_t DIR = Variant::DIRECTIONAL_LIGHTING;
+    constexpr uint8_t DYN = Variant::DYNAMIC_LIGHTING;
+    constexpr uint8_t SRE = Variant::SHADOW_RECEIVER;
+    constexpr uint8_t SKN = Variant::SKINNING;
+    auto ready = [](std::initializer_list<uint8_t> keys) {
+        uint32_t variants = 0;
+        for (uint8_t key : keys) {
+            variants |= 1u << key;
+        }
+        return variants;
+    };
+
+    // without a ready variant there is no fallback
+    EXPECT_EQ(DIR | DYN | SRE, Variant::getFallbackVariant(DIR | DYN | SRE, 0));
+
+    // the ready variant with the most features is picked
+    EXPECT_EQ(DIR | DYN,
+            Variant::getFallbackVariant(DIR | DYN | SRE, ready({ 0, DIR, DIR | DYN })));
+    EXPECT_EQ(DIR,
+            Variant::getFallbackVariant(DIR | DYN | SRE, ready({ 0, DIR })));
+
+    // variants with features the requested variant doesn't have are never picked
+    EXPECT_EQ(DIR, Variant::getFallbackVariant(DIR | SRE, ready({ DIR, DYN, DIR | DYN })));
+
+    // skinning is kept, the vertex inputs must be the same
+    EXPECT_EQ(SKN, Variant::getFallbackVariant(SKN | DIR, ready({ DIR, SKN })));
+    EXPECT_EQ(SKN | DIR, Variant::getFallbackVariant(SKN | DIR, ready({ 0, DIR })));
+
+    // SHADOW_RECEIVER alone is the depth variant, it's never a fallback
+    EXPECT_EQ(DIR | SRE, Variant::getFallbackVariant(DIR | SRE, ready({ SRE })));
+    EXPECT_EQ(0, Variant::getFallbackVariant(DIR | SRE, ready({ 0, SRE })));
+    EXPECT_EQ(DYN, Variant::getFallbackVariant(DYN | SRE, ready({ SRE, DYN })));
+    EXPECT_EQ(SKN | DIR | SRE, Variant::getFallbackVariant(SKN | DIR | SRE, ready({ SKN | SRE })));
+
+    // and the depth variants have no fallback
+    EXPECT_EQ(SRE, Variant::getFallbackVariant(SRE, ready({ 0 })));
+    EXPECT_EQ(SKN | SRE, Variant::getFallbackVariant(SKN | SRE, ready({ SKN })));
+}
+
+TEST(FilamentTest, ShadowAtlasPacking) {
+    using namespace filament::details;
+
+    // the tiles are within the atlas, don't overlap, and start on a multiple of their size
+    auto checkTiles = [](uint32_t const* dimensions, uint2 const* positions, size_t count,
+            uint2 atlasSize) {
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(0u, positions[i].x % dimensions[i]);
+            EXPECT_EQ(0u, positions[i].y % dimensions[i]);
+            EXPECT_LE(positions[i].x + dimensions[i], atlasSize.x);
+            EXPECT_LE(positions[i].y + dimensions[i], atlasSize.y);
+            for (size_t j = 0; j < i; j++) {
+                const bool disjoint =
+                        positions[i].x >= positions[j].x + dimensions[j] ||
+                        positions[j].x >= positions[i].x + dimensions[i] ||
+                        positions[i].y >= positions[j].y + dimensions[j] ||
+                        positions[j].y >= positions[i].y + dimensions[i];
+                EXPECT_TRUE(disjoint);
+            }
+        }
+    };
+
+    uint2 positions[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+
+    {
+        // a single tile is the whole atlas
+        const uint32_t dimensions[] = { 1024 };
+        const uint2 atlasSize = ShadowMapManager::packAtlas(dimensions, 1, positions);
+        EXPECT_EQ(uint2(1024, 1024), atlasSize);
+        EXPECT_EQ(uint2(0, 0), positions[0]);
+    }
+
+    {
+        // two tiles fit in the bottom half of the atlas
+        const uint32_t dimensions[] = { 1024, 1024 };
+        const uint2 atlasSize = ShadowMapManager::packAtlas(dimensions, 2, positions);
+        EXPECT_EQ(uint2(2048, 1024), atlasSize);
+        EXPECT_EQ(uint2(0, 0), positions[0]);
+        EXPECT_EQ(uint2(1024, 0), positions[1]);
+    }
+
+    {
+        // four tiles fill the atlas in Z-order
+        const uint32_t dimensions[] = { 1024, 1024, 1024, 1024 };
+        const uint2 atlasSize = ShadowMapManager::packAtlas(dimensions, 4, positions);
+        EXPECT_EQ(uint2(2048, 2048), atlasSize);
+        EXPECT_EQ(uint2(   0,    0), positions[0]);
+        EXPECT_EQ(uint2(1024,    0), positions[1]);
+        EXPECT_EQ(uint2(   0, 1024), positions[2]);
+        EXPECT_EQ(uint2(1024, 1024), positions[3]);
+    }
+
+    {
+        // smaller tiles fill the squares of the Z-order curve left by the larger ones
+        const uint32_t dimensions[] = { 1024, 512, 512, 256, 256, 256, 256 };
+        const uint2 atlasSize = ShadowMapManager::packAtlas(dimensions, 7, positions);
+        EXPECT_EQ(uint2(2048, 1024), atlasSize);
+        EXPECT_EQ(uint2(   0,   0), positions[0]);
+        EXPECT_EQ(uint2(1024,   0), positions[1]);
+        EXPECT_EQ(uint2(1536,   0), positions[2]);
+        EXPECT_EQ(uint2(1024, 512), positions[3]);
+        EXPECT_EQ(uint2(1280, 512), positions[4]);
+        EXPECT_EQ(uint2(1024, 768), positions[5]);
+        EXPECT_EQ(uint2(1280, 768), positions[6]);
+        checkTiles(dimensions, positions, 7, atlasSize);
+    }
+
+    {
+        // the largest number of tiles, of all sizes
+        uint32_t dimensions[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+        const size_t count = sizeof(dimensions) / sizeof(dimensions[0]);
+        for (size_t i = 0; i < count; i++) {
+            dimensions[i] = 2048u >> (i / 3u);
+        }
+        const uint2 atlasSize = ShadowMapManager::packAtlas(dimensions, count, positions);
+        EXPECT_EQ(uint2(4096, 4096), atlasSize);
+        checkTiles(dimensions, positions, count, atlasSize);
+    }
+}
+
+TEST(FilamentTest, ShadowAtlasLayout) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    EntityManager& em = engine->getEntityManager();
+    FScene* scene = engine->createScene();
+
+    // a directional light with 2 cascades of 512 texels
+    LightManager::ShadowOptions sunShadowOptions;
+    sunShadowOptions.mapSize = 512;
+    sunShadowOptions.shadowCascades = 2;
+    Entity sun = em.create();
+    LightManager::Builder(LightManager::Type::DIRECTIONAL)
+            .direction(normalize(float3{ 0, -1, -1 }))
+            .castShadows(true)
+            .shadowOptions(sunShadowOptions)
+            .build(*engine, sun);
+    scene->addEntity(sun);
+
+    // 4 spot lights large enough on screen to get shadow maps of 1024 texels
+    LightManager::ShadowOptions spotShadowOptions;
+    spotShadowOptions.mapSize = 1024;
+    Entity spots[4];
+    for (size_t i = 0; i < 4; i++) {
+        spots[i] = em.create();
+        LightManager::Builder(LightManager::Type::SPOT)
+                .position({ float(i) * 2.0f - 3.0f, 3, 0 })
+                .direction({ 0, -1, 0 })
+                .falloff(10)
+                .spotLightCone(0.5f, 0.8f)
+                .castShadows(true)
+                .shadowOptions(spotShadowOptions)
+                .build(*engine, spots[i]);
+        scene->addEntity(spots[i]);
+    }
+
+    Entity cameraEntity = em.create();
+    FCamera* camera = engine->createCamera(cameraEntity);
+    camera->setProjection(45, 1, 0.1, 100);
+    camera->lookAt({ 0, 2, 10 }, { 0, 0, 0 });
+    const CameraInfo cameraInfo{
+            .projection         = mat4f{ camera->getProjectionMatrix() },
+            .cullingProjection  = mat4f{ camera->getCullingProjectionMatrix() },
+            .model              = camera->getModelMatrix(),
+            .view               = camera->getViewMatrix(),
+            .zn                 = camera->getNear(),
+            .zf                 = camera->getCullingFar(),
+    };
+
+    ShadowMapManager shadowMapManager(*engine);
+    const Viewport viewport(0, 0, 512, 512);
+
+    // lays out the atlas, returns the size of the tile of each shadow map, the cascades first
+    auto layout = [&](uint32_t maxSize, uint32_t minShadowMapSize) {
+        View::ShadowAtlasOptions options;
+        options.maxSize = maxSize;
+        options.minShadowMapSize = minShadowMapSize;
+        scene->prepare(mat4f{});
+        shadowMapManager.update(scene->getLightData(), scene, cameraInfo, 0xFF, viewport, options);
+
+        // the tiles, including their 1-texel border, are within the atlas and don't overlap
+        const uint2 atlasSize = shadowMapManager.getAtlasSize();
+        std::vector<Viewport> tiles;
+        for (size_t i = 0; i < shadowMapManager.getCascadeCount(); i++) {
+            tiles.push_back(shadowMapManager.getCascade(i).getViewport());
+        }
+        for (size_t k = 0; k < shadowMapManager.getSpotShadowCount(); k++) {
+            tiles.push_back(shadowMapManager.getSpotShadow(k).getViewport());
+        }
+        std::vector<uint32_t> dimensions;
+        uint64_t area = 0;
+        for (size_t i = 0; i < tiles.size(); i++) {
+            Viewport const& a = tiles[i];
+            EXPECT_GE(a.left - 1, 0);
+            EXPECT_GE(a.bottom - 1, 0);
+            EXPECT_LE(a.left + a.width + 1, atlasSize.x);
+            EXPECT_LE(a.bottom + a.height + 1, atlasSize.y);
+            for (size_t j = 0; j < i; j++) {
+                Viewport const& b = tiles[j];
+                const bool disjoint =
+                        a.left + int32_t(a.width) + 1 <= b.left - 1 ||
+                        b.left + int32_t(b.width) + 1 <= a.left - 1 ||
+                        a.bottom + int32_t(a.height) + 1 <= b.bottom - 1 ||
+                        b.bottom + int32_t(b.height) + 1 <= a.bottom - 1;
+                EXPECT_TRUE(disjoint);
+            }
+            dimensions.push_back(a.width + 2);
+            area += uint64_t(a.width + 2) * (a.width + 2);
+        }
+        if (area <= uint64_t(maxSize) * maxSize) {
+            EXPECT_LE(atlasSize.x, maxSize);
+            EXPECT_LE(atlasSize.y, maxSize);
+        }
+        return dimensions;
+    };
+
+    {
+        // everything fits
+        auto dimensions = layout(4096, 128);
+        ASSERT_EQ(6, dimensions.size());
+        EXPECT_EQ(512, dimensions[0]);
+        EXPECT_EQ(512, dimensions[1]);
+        for (size_t k = 2; k < 6; k++) {
+            EXPECT_EQ(1024, dimensions[k]);
+        }
+        EXPECT_EQ(uint2(4096, 2048), shadowMapManager.getAtlasSize());
+    }
+
+    {
+        // the largest shadow map of the least important spot light is made smaller first
+        auto dimensions = layout(2048, 128);
+        ASSERT_EQ(6, dimensions.size());
+        EXPECT_EQ(512, dimensions[0]);
+        EXPECT_EQ(512, dimensions[1]);
+        EXPECT_EQ(1024, dimensions[2]);
+        EXPECT_EQ(1024, dimensions[3]);
+        EXPECT_EQ(1024, dimensions[4]);
+        EXPECT_EQ(512, dimensions[5]);
+        EXPECT_EQ(uint2(2048, 2048), shadowMapManager.getAtlasSize());
+    }
+
+    {
+        // the spot lights' shadow maps are made smaller until they fit, the cascades never are
+        auto dimensions = layout(1024, 128);
+        ASSERT_EQ(6, dimensions.size());
+        EXPECT_EQ(512, dimensions[0]);
+        EXPECT_EQ(512, dimensions[1]);
+        EXPECT_EQ(512, dimensions[2]);
+        EXPECT_EQ(256, dimensions[3]);
+        EXPECT_EQ(256, dimensions[4]);
+        EXPECT_EQ(256, dimensions[5]);
+        EXPECT_EQ(uint2(1024, 1024), shadowMapManager.getAtlasSize());
+    }
+
+    {
+        // when the spot lights' shadow maps don't fit at their minimum size, the least
+        // important spot lights lose their shadows
+        auto dimensions = layout(1024, 512);
+        ASSERT_EQ(4, dimensions.size());
+        for (uint32_t dimension : dimensions) {
+            EXPECT_EQ(512, dimension);
+        }
+        EXPECT_EQ(uint2(1024, 1024), shadowMapManager.getAtlasSize());
+    }
+
+    shadowMapManager.terminate(engine->getDriverApi());
+    engine->destroyCameraComponent(cameraEntity);
+    engine->destroy(scene);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, ShadowCascadeSplits) {
+    using ShadowCascades = LightManager::ShadowCascades;
+    constexpr size_t MAX_SPLITS = CONFIG_MAX_SHADOW_CASCADES - 1;
+
+    // the splits are increasing and within (0, 1)
+    auto checkSplits = [](float const* splits, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_TRUE(std::isfinite(splits[i]));
+            EXPECT_GT(splits[i], 0.0f);
+            EXPECT_LT(splits[i], 1.0f);
+            if (i > 0) {
+                EXPECT_GT(splits[i], splits[i - 1]);
+            }
+        }
+    };
+
+    float uniform[MAX_SPLITS];
+    ShadowCascades::computeUniformSplits(uniform, 4);
+    checkSplits(uniform, 3);
+    EXPECT_FLOAT_EQ(0.25f, uniform[0]);
+    EXPECT_FLOAT_EQ(0.50f, uniform[1]);
+    EXPECT_FLOAT_EQ(0.75f, uniform[2]);
+
+    float log[MAX_SPLITS];
+    ShadowCascades::computeLogSplits(log, 4, 0.1f, 100.0f);
+    checkSplits(log, 3);
+    // the logarithmic splits are closer to the camera
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_LT(log[i], uniform[i]);
+    }
+
+    // lambda interpolates from the uniform splits to the logarithmic splits
+    float practical[MAX_SPLITS];
+    ShadowCascades::computePracticalSplits(practical, 4, 0.1f, 100.0f, 0.0f);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_FLOAT_EQ(uniform[i], practical[i]);
+    }
+    ShadowCascades::computePracticalSplits(practical, 4, 0.1f, 100.0f, 1.0f);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_FLOAT_EQ(log[i], practical[i]);
+    }
+    ShadowCascades::computePracticalSplits(practical, 4, 0.1f, 100.0f, 0.5f);
+    checkSplits(practical, 3);
+
+    // a near plane at 0 doesn't produce NaNs or infinities
+    ShadowCascades::computeLogSplits(log, 4, 0.0f, 100.0f);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_TRUE(std::isfinite(log[i]));
+        EXPECT_GE(log[i], 0.0f);
+        EXPECT_LT(log[i], 1.0f);
+    }
+    ShadowCascades::computePracticalSplits(practical, 4, 0.0f, 100.0f, 0.5f);
+    checkSplits(practical, 3);
+
+    // the number of cascades is clamped to [1, CONFIG_MAX_SHADOW_CASCADES]
+    float splits[8];
+    std::fill(std::begin(splits), std::end(splits), -1.0f);
+    ShadowCascades::computeUniformSplits(splits, 8);
+    checkSplits(splits, MAX_SPLITS);
+    EXPECT_FLOAT_EQ(-1.0f, splits[MAX_SPLITS]);
+
+    std::fill(std::begin(splits), std::end(splits), -1.0f);
+    ShadowCascades::computeLogSplits(splits, 8, 0.1f, 100.0f);
+    checkSplits(splits, MAX_SPLITS);
+    EXPECT_FLOAT_EQ(-1.0f, splits[MAX_SPLITS]);
+
+    std::fill(std::begin(splits), std::end(splits), -1.0f);
+    ShadowCascades::computePracticalSplits(splits, 8, 0.1f, 100.0f, 0.5f);
+    checkSplits(splits, MAX_SPLITS);
+    EXPECT_FLOAT_EQ(-1.0f, splits[MAX_SPLITS]);
+
+    std::fill(std::begin(splits), std::end(splits), -1.0f);
+    ShadowCascades::computePracticalSplits(splits, 0, 0.1f, 100.0f, 0.5f);
+    EXPECT_FLOAT_EQ(-1.0f, splits[0]);
+}
+
 TEST(FilamentTest, Bones) {
     using namespace ::filament::details;
 
@@ -36,7 +36,7 @@ namespace BindingPoints {
     constexpr uint8_t PER_VIEW                = 0;    // uniforms/samplers updated per view
     constexpr uint8_t PER_RENDERABLE          = 1;    // uniforms/samplers updated per renderable
     constexpr uint8_t PER_RENDERABLE_BONES    = 2;    // bones data, per renderable
-    constexpr uint8_t LIGHTS                  = 3;    // lights data array
+    constexpr uint8_t LIGHTS                  = 3;    // unused, lights are in a per-view sampler
     constexpr uint8_t POST_PROCESS            = 4;    // samplers for the post process pass
     constexpr uint8_t PER_MATERIAL_INSTANCE   = 5;    // uniforms/samplers updates per material
     constexpr uint8_t COUNT                   = 6;
@@ -46,15 +46,26 @@ namespace BindingPoints {
 static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
         "Dynamically sized sampler buffer must be the last binding point.");
 
-// This value is limited by UBO size, ES3.0 only guarantees 16 KiB.
-// Values <= 256, use less CPU and GPU resources.
-constexpr size_t CONFIG_MAX_LIGHT_COUNT = 256;
+// The lights data is stored in a texture sized to the number of visible lights, and the light
+// indices in the froxel records are 16 bits.
+constexpr size_t CONFIG_MAX_LIGHT_COUNT = 4096;
 constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 
 // This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
 // We store 64 bytes per bone.
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
+// Each instance of an instanced draw uses one 256 bytes PerRenderableUib.
+constexpr size_t CONFIG_MAX_INSTANCES = 64;
+
+// The directional light's cascades are rendered in tiles of a 2x2 shadow map atlas.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// The shadow maps of the spot lights are rendered in the same atlas as the cascades. Each one
+// uses 84 bytes of the per-view UBO, must be a multiple of 4.
+constexpr size_t CONFIG_MAX_SHADOWED_SPOT_LIGHTS = 16;
+
 // TODO This should be injected by the engine as a define of the shader.
 static constexpr bool   CONFIG_IBL_RGBM  = true;
 static constexpr size_t CONFIG_IBL_SIZE  = 256;
@@ -41,8 +41,9 @@ struct PerViewSib {
     static constexpr size_t FROXELS        = 2;
     static constexpr size_t IBL_DFG_LUT    = 3;
     static constexpr size_t IBL_SPECULAR   = 4;
+    static constexpr size_t PUNCTUAL_LIGHTS = 5;
 
-    static constexpr size_t SAMPLER_COUNT = 5;
+    static constexpr size_t SAMPLER_COUNT = 6;
 };
 
 struct PostProcessSib {
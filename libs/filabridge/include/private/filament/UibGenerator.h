@@ -18,6 +18,8 @@
 #define TNT_FILABRIDGE_UIBGENERATOR_H
 
 
+#include <private/filament/EngineEnums.h>
+
 #include <math/mat4.h>
 #include <math/vec4.h>
 
@@ -29,7 +31,6 @@ class UibGenerator {
 public:
     static UniformInterfaceBlock const& getPerViewUib() noexcept;
     static UniformInterfaceBlock const& getPerRenderableUib() noexcept;
-    static UniformInterfaceBlock const& getLightsUib() noexcept;
     static UniformInterfaceBlock const& getPostProcessingUib() noexcept;
     static UniformInterfaceBlock const& getPerRenderableBonesUib() noexcept;
 };
@@ -50,7 +51,7 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     filament::math::mat4f viewFromClipMatrix;
     filament::math::mat4f clipFromWorldMatrix;
     filament::math::mat4f worldFromClipMatrix;
-    filament::math::mat4f lightFromWorldMatrix;
+    filament::math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES]; // one per cascade
 
     filament::math::float4 resolution; // viewport width, height, 1/width, 1/height
 
@@ -80,23 +81,35 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     alignas(16) filament::math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
 
     filament::math::float4 userTime;  // time(s), (double)time - (float)time, 0, 0
+
+    // shadow cascades
+    filament::math::float4 cascadeSplits;       // negated view-space far plane of each cascade
+    filament::math::float4 cascadeNormalBias;   // normal bias of each cascade
+    filament::math::float4 cascadeTiles[CONFIG_MAX_SHADOW_CASCADES]; // umin, vmin, umax, vmax
+    uint32_t cascades;                          // number of cascades, 0 without shadows
+
+    // spot light shadows, indexed by the shadow index stored in the lights data
+    alignas(16) filament::math::mat4f spotLightFromWorldMatrix[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    filament::math::float4 spotShadowTiles[CONFIG_MAX_SHADOWED_SPOT_LIGHTS]; // umin, vmin, umax, vmax
+    filament::math::float4 spotShadowNormalBias[CONFIG_MAX_SHADOWED_SPOT_LIGHTS / 4]; // at 1m
 };
 
 
 // PerRenderableUib must have an alignment of 256 to be compatible with all versions of GLES.
+// The shaders see an array of CONFIG_MAX_INSTANCES of these, indexed by the instance index,
+// non-instanced draws only use the first one.
 struct alignas(256) PerRenderableUib {
     filament::math::mat4f worldFromModelMatrix;
     filament::math::mat3f worldFromModelNormalMatrix;
 };
 
-struct LightsUib {
-    static const UniformInterfaceBlock& getUib() noexcept {
-        return UibGenerator::getLightsUib();
-    }
+// The data of each point or spot light, stored in 4 consecutive texels of the per-view
+// "punctual" sampler (see PerViewSib::PUNCTUAL_LIGHTS).
+struct LightsData {
     filament::math::float4 positionFalloff;   // { float3(pos), 1/falloff^2 }
     filament::math::float4 colorIntensity;    // { float3(col), intensity }
     filament::math::float4 directionIES;      // { float3(dir), IES index }
-    filament::math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
+    filament::math::float4 spotScaleOffset;   // { scale, offset, shadow index + 1, unused }
 };
 
 struct PostProcessingUib {
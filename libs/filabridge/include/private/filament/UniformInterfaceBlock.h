@@ -111,6 +111,9 @@ public:
     // negative value if name doesn't exist or Panic if exceptions are enabled
     ssize_t getUniformOffset(const char* name, size_t index) const;
 
+    // information record for uniform of the given name, nullptr if it doesn't exist
+    UniformInfo const* getUniformInfo(const char* name) const noexcept;
+
     bool hasUniform(const char* name) const noexcept {
         return mInfoMap.find(name) != mInfoMap.end();
     }
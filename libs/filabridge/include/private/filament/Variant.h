@@ -17,6 +17,8 @@
 #ifndef TNT_FILAMENT_VARIANT_H
 #define TNT_FILAMENT_VARIANT_H
 
+#include <utils/algorithm.h>
+
 #include <stdint.h>
 #include <cstddef>
 
@@ -37,13 +39,15 @@ namespace filament {
         //                    ...-----+-----+-----+-----+-----+
         // Variant                 0  | SKN | SRE | DYN | DIR |
         //                    ...-----+-----+-----+-----+-----+
-        // Reserved variants:
+        // Special variants:
         //       Depth shader            X     1     0     0
-        //           Reserved            X     1     1     0
         //
         // Standard variants:
-        //      Vertex shader            X     X     0     X
+        //      Vertex shader            X     X     0     X     (SRE only with DIR)
         //    Fragment shader            0     X     X     X
+        //
+        // Only the directional light's shadows need the vertex shader, the SRE|DYN variant
+        // (spot light shadows only) uses the vertex shader of the DYN variant.
 
         uint8_t key = 0;
 
@@ -90,14 +94,13 @@ namespace filament {
             return (key & DEPTH_MASK) == DEPTH_VARIANT;
         }
 
-        static constexpr bool isReserved(uint8_t variantKey) noexcept {
-            // reserved variants that should just be skipped.
-            return (variantKey & DEPTH_MASK) == (SHADOW_RECEIVER | DYNAMIC_LIGHTING);
-        }
-
         static constexpr uint8_t filterVariantVertex(uint8_t variantKey) noexcept {
             // filter out vertex variants that are not needed. For e.g. dynamic lighting
             // doesn't affect the vertex shader.
+            if ((variantKey & DEPTH_MASK) == (SHADOW_RECEIVER | DYNAMIC_LIGHTING)) {
+                // the spot lights' shadows don't need the vertex shader
+                variantKey &= ~SHADOW_RECEIVER;
+            }
             return variantKey & VERTEX_MASK;
         }
 
@@ -116,6 +119,32 @@ namespace filament {
             return isLit ? variantKey : (variantKey & UNLIT_MASK);
         }
 
+        // Returns the variant to use in place of variantKey while its program isn't ready: the
+        // variant of readyVariants (one bit per variant key) that has the most of variantKey's
+        // lighting and shadowing features and none it doesn't have. Skinning is kept so that
+        // the vertex inputs are the same, and the depth variant is never picked. Returns
+        // variantKey when there is no such variant.
+        static uint8_t getFallbackVariant(uint8_t variantKey, uint32_t readyVariants) noexcept {
+            if ((variantKey & DEPTH_MASK) == DEPTH_VARIANT) {
+                return variantKey;
+            }
+            const uint8_t features = variantKey & FRAGMENT_MASK;
+            uint8_t fallbackKey = variantKey;
+            int fallbackFeatureCount = -1;
+            for (uint8_t subset = uint8_t((features - 1u) & features); subset != features;
+                    subset = uint8_t((subset - 1u) & features)) {
+                const uint8_t key = uint8_t((variantKey & ~features) | subset);
+                if ((key & DEPTH_MASK) != DEPTH_VARIANT && (readyVariants & (1u << key))) {
+                    const int featureCount = int(utils::popcount(unsigned(subset)));
+                    if (featureCount > fallbackFeatureCount) {
+                        fallbackKey = key;
+                        fallbackFeatureCount = featureCount;
+                    }
+                }
+            }
+            return fallbackKey;
+        }
+
     private:
         inline void set(bool v, uint8_t mask) noexcept {
             key = (key & ~mask) | (v ? mask : uint8_t(0));
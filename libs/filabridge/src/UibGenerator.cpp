@@ -31,6 +31,15 @@ static_assert(sizeof(PerRenderableUib) % 256 == 0,
 static_assert(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone) <= 16384,
         "Bones exceed max UBO size");
 
+static_assert(CONFIG_MAX_INSTANCES * sizeof(PerRenderableUib) <= 16384,
+        "Instances exceed max UBO size");
+
+static_assert(sizeof(PerViewUib) <= 16384,
+        "PerViewUib exceeds max UBO size");
+
+static_assert(CONFIG_MAX_SHADOWED_SPOT_LIGHTS % 4 == 0,
+        "the spot lights' normal biases are packed in float4");
+
 
 UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
     // IMPORTANT NOTE: Respect std140 layout, don't update without updating Engine::PerViewUib
@@ -43,7 +52,7 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromClipMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -73,6 +82,15 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
             // user time
             .add("userTime",                1, UniformInterfaceBlock::Type::FLOAT4)
+            // shadow cascades
+            .add("cascadeSplits",           1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("cascadeNormalBias",       1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("cascadeTiles",            CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("cascades",                1, UniformInterfaceBlock::Type::UINT)
+            // spot light shadows
+            .add("spotLightFromWorldMatrix", CONFIG_MAX_SHADOWED_SPOT_LIGHTS, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("spotShadowTiles",         CONFIG_MAX_SHADOWED_SPOT_LIGHTS, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("spotShadowNormalBias",    CONFIG_MAX_SHADOWED_SPOT_LIGHTS / 4, UniformInterfaceBlock::Type::FLOAT4)
             .build();
     return uib;
 }
@@ -82,14 +100,8 @@ UniformInterfaceBlock const& UibGenerator::getPerRenderableUib() noexcept {
             .name("ObjectUniforms")
             .add("worldFromModelMatrix",       1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromModelNormalMatrix", 1, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
-            .build();
-    return uib;
-}
-
-UniformInterfaceBlock const& UibGenerator::getLightsUib() noexcept {
-    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
-            .name("LightsUniforms")
-            .add("lights", CONFIG_MAX_LIGHT_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            // pads the structure to 256 bytes, the stride of the per-instance array in the shaders
+            .add("reserved",                   9, UniformInterfaceBlock::Type::FLOAT4)
             .build();
     return uib;
 }
@@ -123,6 +123,15 @@ ssize_t UniformInterfaceBlock::getUniformOffset(const char* name, size_t index)
     return mUniformsInfoList[pos->second].getBufferOffset(index);
 }
 
+UniformInterfaceBlock::UniformInfo const* UniformInterfaceBlock::getUniformInfo(
+        const char* name) const noexcept {
+    auto const& pos = mInfoMap.find(name);
+    if (pos == mInfoMap.end()) {
+        return nullptr;
+    }
+    return &mUniformsInfoList[pos->second];
+}
+
 
 uint8_t UTILS_NOINLINE UniformInterfaceBlock::baseAlignmentForType(UniformInterfaceBlock::Type type) noexcept {
     switch (type) {
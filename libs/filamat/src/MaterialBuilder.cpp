@@ -540,11 +540,6 @@ Package MaterialBuilder::build() noexcept {
         uint8_t variantMask = ~mVariantFilter;
 
         for (uint8_t k = 0; k < filament::VARIANT_COUNT; k++) {
-
-            if (filament::Variant::isReserved(k)) {
-                continue;
-            }
-
             glslEntry.variant = k;
             spirvEntry.variant = k;
             metalEntry.variant = k;
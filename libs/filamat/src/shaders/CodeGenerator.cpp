@@ -247,8 +247,34 @@ std::ostream& CodeGenerator::generateUniforms(std::ostream& out, ShaderType shad
     std::string instanceName(uib.getName().c_str());
     instanceName.front() = char(std::tolower((unsigned char)instanceName.front()));
 
-    Precision uniformPrecision = getDefaultUniformPrecision();
-    Precision defaultPrecision = getDefaultPrecision(shaderType);
+    out << "\nlayout(";
+    if (mTargetLanguage == TargetLanguage::SPIRV) {
+        uint32_t bindingIndex = (uint32_t) binding; // avoid char output
+        out << "binding = " << bindingIndex << ", ";
+    }
+    out << "std140) uniform " << blockName.c_str() << " {\n";
+    generateUniformMembers(out, shaderType, uib);
+    out << "} " << instanceName << ";\n";
+
+    return out;
+}
+
+std::ostream& CodeGenerator::generateUniformsArray(std::ostream& out, ShaderType shaderType,
+        uint8_t binding, const UniformInterfaceBlock& uib, size_t size) const {
+    auto const& infos = uib.getUniformInfoList();
+    if (infos.empty()) {
+        return out;
+    }
+
+    // e.g.: struct ObjectUniformsData { ... };
+    //       uniform ObjectUniforms { ObjectUniformsData data[64]; } objectUniforms;
+    const CString& blockName = uib.getName();
+    std::string instanceName(uib.getName().c_str());
+    instanceName.front() = char(std::tolower((unsigned char)instanceName.front()));
+
+    out << "\nstruct " << blockName.c_str() << "Data {\n";
+    generateUniformMembers(out, shaderType, uib);
+    out << "};\n";
 
     out << "\nlayout(";
     if (mTargetLanguage == TargetLanguage::SPIRV) {
@@ -256,7 +282,18 @@ std::ostream& CodeGenerator::generateUniforms(std::ostream& out, ShaderType shad
         out << "binding = " << bindingIndex << ", ";
     }
     out << "std140) uniform " << blockName.c_str() << " {\n";
-    for (auto const& info : infos) {
+    out << "    " << blockName.c_str() << "Data data[" << size << "];\n";
+    out << "} " << instanceName << ";\n";
+
+    return out;
+}
+
+std::ostream& CodeGenerator::generateUniformMembers(std::ostream& out, ShaderType shaderType,
+        const UniformInterfaceBlock& uib) const {
+    Precision uniformPrecision = getDefaultUniformPrecision();
+    Precision defaultPrecision = getDefaultPrecision(shaderType);
+
+    for (auto const& info : uib.getUniformInfoList()) {
         char const* const type = getUniformTypeName(info.type);
         char const* const precision = getUniformPrecisionQualifier(info.type, info.precision,
                 uniformPrecision, defaultPrecision);
@@ -268,8 +305,6 @@ std::ostream& CodeGenerator::generateUniforms(std::ostream& out, ShaderType shad
         }
         out << ";\n";
     }
-    out << "} " << instanceName << ";\n";
-
     return out;
 }
 
@@ -91,6 +91,11 @@ public:
     std::ostream& generateUniforms(std::ostream& out, ShaderType type, uint8_t binding,
             const filament::UniformInterfaceBlock& uib) const;
 
+    // generate a uniform block holding an array of 'size' structures, each laid out as described
+    // by the given UniformInterfaceBlock, which must be padded to a multiple of 16 bytes.
+    std::ostream& generateUniformsArray(std::ostream& out, ShaderType type, uint8_t binding,
+            const filament::UniformInterfaceBlock& uib, size_t size) const;
+
     // generate samplers
     std::ostream& generateSamplers(
         std::ostream& out, uint8_t firstBinding, const filament::SamplerInterfaceBlock& sib) const;
@@ -114,6 +119,10 @@ public:
             std::string& shader, filament::SamplerInterfaceBlock const& sib) noexcept;
 
 private:
+    // generate the declarations of the uniforms of a block, one per line
+    std::ostream& generateUniformMembers(std::ostream& out, ShaderType type,
+            const filament::UniformInterfaceBlock& uib) const;
+
     filament::backend::Precision getDefaultPrecision(ShaderType type) const;
     filament::backend::Precision getDefaultUniformPrecision() const;
 
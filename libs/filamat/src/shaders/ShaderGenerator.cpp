@@ -170,8 +170,9 @@ const std::string ShaderGenerator::createVertexProgram(filament::backend::Shader
     // uniforms
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
-    cg.generateUniforms(vs, ShaderType::VERTEX,
-            BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib());
+    cg.generateUniformsArray(vs, ShaderType::VERTEX,
+            BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib(),
+            CONFIG_MAX_INSTANCES);
     if (variant.hasSkinning()) {
         cg.generateUniforms(vs, ShaderType::VERTEX,
                 BindingPoints::PER_RENDERABLE_BONES,
@@ -294,8 +295,6 @@ const std::string ShaderGenerator::createFragmentProgram(filament::backend::Shad
     // uniforms and samplers
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
-    cg.generateUniforms(fs, ShaderType::FRAGMENT,
-            BindingPoints::LIGHTS, UibGenerator::getLightsUib());
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
     cg.generateSeparator(fs);
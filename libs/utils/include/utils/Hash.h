@@ -17,6 +17,7 @@
 #ifndef TNT_UTILS_HASH_H
 #define TNT_UTILS_HASH_H
 
+#include <assert.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -44,6 +45,31 @@ inline uint32_t murmur3(const uint32_t* key, size_t wordCount, uint32_t seed) {
     return h;
 }
 
+// A 64-bit hash made of two 32-bit murmur3 hashes with different seeds. It's computed
+// incrementally: each add() chains the hashes, so the result depends on the order of the calls.
+class Murmur3x2 {
+public:
+    // size is in bytes, and must be a non-zero multiple of 4
+    void add(const void* data, size_t size) noexcept {
+        assert(size && (size & 3) == 0);
+        mHash[0] = murmur3(static_cast<const uint32_t*>(data), size / 4, mHash[0]);
+        mHash[1] = murmur3(static_cast<const uint32_t*>(data), size / 4, mHash[1]);
+    }
+
+    uint64_t get() const noexcept {
+        return (uint64_t(mHash[1]) << 32u) | mHash[0];
+    }
+
+private:
+    uint32_t mHash[2] = { 0, 0x9e3779b9u };
+};
+
+inline uint64_t murmur3x2(const uint32_t* key, size_t wordCount) noexcept {
+    Murmur3x2 hash;
+    hash.add(key, wordCount * sizeof(uint32_t));
+    return hash.get();
+}
+
 template<typename T>
 struct MurmurHashFn {
     uint32_t operator()(const T& key) const {
@@ -3,17 +3,27 @@
 //------------------------------------------------------------------------------
 
 mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+    // the vertex shader computes the light space position of the first cascade only
+    return frameUniforms.lightFromWorldMatrix[0];
+}
+
+// index of the instance in the current draw, which selects its per-renderable uniforms
+int getInstanceIndex() {
+#if defined(TARGET_LANGUAGE_SPIRV)
+    return gl_InstanceIndex;
+#else
+    return gl_InstanceID;
+#endif
 }
 
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
-    return objectUniforms.worldFromModelMatrix;
+    return objectUniforms.data[getInstanceIndex()].worldFromModelMatrix;
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
-    return objectUniforms.worldFromModelNormalMatrix;
+    return objectUniforms.data[getInstanceIndex()].worldFromModelNormalMatrix;
 }
 
 //------------------------------------------------------------------------------
@@ -11,6 +11,11 @@
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
+// each light uses 4 consecutive texels of the light_punctual texture
+#define LIGHT_BUFFER_WIDTH_SHIFT    6u
+#define LIGHT_BUFFER_WIDTH          (1u << LIGHT_BUFFER_WIDTH_SHIFT)
+#define LIGHT_BUFFER_WIDTH_MASK     (LIGHT_BUFFER_WIDTH - 1u)
+
 struct FroxelParams {
     uint recordOffset; // offset at which the list of lights for this froxel starts
     uint pointCount;   // number of point lights in this froxel
@@ -72,12 +77,22 @@ FroxelParams getFroxelParams(uint froxelIndex) {
 /**
  * Returns the coordinates of the light record in the light_records texture
  * given the specified index. A light record is a single uint index into the
- * lights data buffer (lightsUniforms UBO).
+ * lights data texture (light_punctual).
  */
 ivec2 getRecordTexCoord(uint index) {
     return ivec2(index & RECORD_BUFFER_WIDTH_MASK, index >> RECORD_BUFFER_WIDTH_SHIFT);
 }
 
+/**
+ * Returns the i-th vec4 of the data of the specified light, fetched from the
+ * light_punctual texture.
+ */
+HIGHP vec4 getLightData(uint lightIndex, uint i) {
+    uint texel = lightIndex * 4u + i;
+    ivec2 texCoord = ivec2(texel & LIGHT_BUFFER_WIDTH_MASK, texel >> LIGHT_BUFFER_WIDTH_SHIFT);
+    return texelFetch(light_punctual, texCoord, 0);
+}
+
 float getSquareFalloffAttenuation(float distanceSquare, float falloff) {
     float factor = distanceSquare * falloff;
     float smoothFactor = saturate(1.0 - factor * factor);
@@ -116,27 +131,29 @@ void setupPunctualLight(inout Light light, const HIGHP vec4 positionFalloff) {
 /**
  * Returns a Light structure (see common_lighting.fs) describing a spot light.
  * The colorIntensity field will store the *pre-exposed* intensity of the light
- * in the w component.
+ * in the w component. shadowIndex is set to the index + 1 of the light's shadow
+ * map, or 0 if the light has no shadows.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * light_punctual texture.
  */
-Light getSpotLight(uint index) {
+Light getSpotLight(uint index, out uint shadowIndex) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
 
-    HIGHP vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
-          vec4 directionIES    = lightsUniforms.lights[lightIndex][2];
-          vec2 scaleOffset     = lightsUniforms.lights[lightIndex][3].xy;
+    HIGHP vec4 positionFalloff = getLightData(lightIndex, 0u);
+    HIGHP vec4 colorIntensity  = getLightData(lightIndex, 1u);
+          vec4 directionIES    = getLightData(lightIndex, 2u);
+          vec4 scaleOffset     = getLightData(lightIndex, 3u);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
 
     setupPunctualLight(light, positionFalloff);
 
-    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
+    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset.xy);
+    shadowIndex = uint(scaleOffset.z);
 
     return light;
 }
@@ -147,15 +164,15 @@ Light getSpotLight(uint index) {
  * in the w component.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * light_punctual texture.
  */
 Light getPointLight(uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
 
-    HIGHP vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
+    HIGHP vec4 positionFalloff = getLightData(lightIndex, 0u);
+    HIGHP vec4 colorIntensity  = getLightData(lightIndex, 1u);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
@@ -179,7 +196,7 @@ void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
     // the current fragment. A froxel also contains a record offset that
     // tells us where the indices of those lights are in the records
     // texture. The records texture contains the indices of the actual
-    // light data in the lightsUniforms uniform buffer
+    // light data in the light_punctual texture
 
     uint index = froxel.recordOffset;
     uint end = index + froxel.pointCount;
@@ -200,13 +217,21 @@ void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
 
     // Iterate spotlights
     for ( ; index < end; index++) {
-        Light light = getSpotLight(index);
+        uint shadowIndex;
+        Light light = getSpotLight(index, shadowIndex);
+        float visibility = 1.0;
+#if defined(HAS_SHADOWING)
+        if (shadowIndex > 0u && light.NoL > 0.0) {
+            visibility = shadow(light_shadowMap,
+                    getSpotLightSpacePosition(shadowIndex - 1u, light.l));
+        }
+#endif
 #if defined(MATERIAL_CAN_SKIP_LIGHTING)
         if (light.NoL > 0.0) {
-            color.rgb += surfaceShading(pixel, light, 1.0);
+            color.rgb += surfaceShading(pixel, light, visibility);
         }
 #else
-        color.rgb += surfaceShading(pixel, light, 1.0);
+        color.rgb += surfaceShading(pixel, light, visibility);
 #endif
     }
 }
@@ -252,3 +252,86 @@ float shadow(const lowp sampler2DShadow shadowMap, const vec3 shadowPosition) {
     return ShadowSample_PCF_High(shadowMap, size, shadowPosition);
 #endif
 }
+
+//------------------------------------------------------------------------------
+// Shadow cascades
+//------------------------------------------------------------------------------
+
+#if defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Returns the index of the directional light's shadow cascade covering the current fragment.
+ */
+uint getShadowCascade() {
+    HIGHP float z = (getViewFromWorldMatrix() * vec4(getWorldPosition(), 1.0)).z;
+    // the view-space z is negative in front of the camera, and so are the cascades' far planes
+    uint cascade = uint(dot(vec4(lessThan(vec4(z), frameUniforms.cascadeSplits)), vec4(1.0)));
+    return min(cascade, frameUniforms.cascades - 1u);
+}
+
+/**
+ * Returns the position of the current fragment in the specified cascade's shadow map. The
+ * position is clamped to the cascade's tile so that the neighboring tiles of the shadow map
+ * atlas are never sampled.
+ */
+HIGHP vec3 getCascadeLightSpacePosition(const uint cascade) {
+    HIGHP vec3 position;
+    if (cascade == 0u) {
+        // interpolated from the vertex shader
+        position = getLightSpacePosition();
+    } else {
+        HIGHP vec3 p = getWorldPosition();
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+        vec3 n = normalize(vertex_worldNormal);
+        float NoL = saturate(dot(n, frameUniforms.lightDirection));
+        float sinTheta = sqrt(1.0 - NoL * NoL);
+        p += n * (sinTheta * frameUniforms.cascadeNormalBias[cascade]);
+#endif
+        HIGHP vec4 lightSpacePosition = frameUniforms.lightFromWorldMatrix[cascade] * vec4(p, 1.0);
+        position = lightSpacePosition.xyz * (1.0 / lightSpacePosition.w);
+    }
+    vec4 tile = frameUniforms.cascadeTiles[cascade];
+    position.xy = clamp(position.xy, tile.xy, tile.zw);
+    return position;
+}
+
+/**
+ * Returns the visibility of the directional light at the current fragment, 1.0 when the
+ * directional light doesn't cast shadows.
+ */
+float shadowDirectional() {
+    if (frameUniforms.cascades == 0u) {
+        return 1.0;
+    }
+    return shadow(light_shadowMap, getCascadeLightSpacePosition(getShadowCascade()));
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Spot light shadows
+//------------------------------------------------------------------------------
+
+#if defined(HAS_DYNAMIC_LIGHTING)
+/**
+ * Returns the position of the current fragment in the specified spot light's shadow map. l is
+ * the normalized direction from the fragment to the light. The position is clamped to the
+ * shadow map's tile in the shadow map atlas.
+ */
+HIGHP vec3 getSpotLightSpacePosition(const uint shadowIndex, const vec3 l) {
+    HIGHP mat4 lightFromWorld = frameUniforms.spotLightFromWorldMatrix[shadowIndex];
+    HIGHP vec3 p = getWorldPosition();
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+    // the size of a texel grows with the distance to the light, w is that distance
+    HIGHP float w = (lightFromWorld * vec4(p, 1.0)).w;
+    vec3 n = normalize(vertex_worldNormal);
+    float NoL = saturate(dot(n, l));
+    float sinTheta = sqrt(1.0 - NoL * NoL);
+    float normalBias = frameUniforms.spotShadowNormalBias[shadowIndex / 4u][shadowIndex % 4u];
+    p += n * (sinTheta * normalBias * w);
+#endif
+    HIGHP vec4 lightSpacePosition = lightFromWorld * vec4(p, 1.0);
+    HIGHP vec3 position = lightSpacePosition.xyz * (1.0 / lightSpacePosition.w);
+    vec4 tile = frameUniforms.spotShadowTiles[shadowIndex];
+    position.xy = clamp(position.xy, tile.xy, tile.zw);
+    return position;
+}
+#endif